@@ -0,0 +1,228 @@
+#include "Emulator.h"
+#include "BlindModel.h"
+#include "config.h"
+#include <EEPROM.h>
+#include <esp_ota_ops.h>
+#include <malloc.h>
+#include <mutex>
+#include <poll.h>
+#include <random>
+#include <unistd.h>
+
+#define EMU_BLIND_MAGIC 0x424C4E33 // "BLN3", changed with the BlindModel layout
+#define EMU_EEPROM_CAPACITY 4096
+#define EMU_HEAP_BYTES (320 * 1024) // Internal heap left to the application on the board
+
+HardwareSerial Serial;
+EspClass ESP;
+EEPROMClass EEPROM;
+
+// The mechanism outlives the process: it is mapped from the state directory
+struct BlindState
+{
+  uint32_t magic;
+  BlindModel blind;
+};
+
+static BlindState *blindState = NULL;
+static std::mutex blindLock;
+static void (*retractedHandler)() = NULL;
+static void (*deployedHandler)() = NULL;
+static uint8_t *eepromStore = NULL;
+static bool stdinClosed = false;
+
+bool Emulator::beginBoard()
+{
+  blindState = (BlindState *)mapStateFile("blind.bin", sizeof(BlindState), 0);
+  eepromStore = (uint8_t *)mapStateFile("eeprom.bin", EMU_EEPROM_CAPACITY, 0xFF);
+  if (blindState == NULL || eepromStore == NULL)
+    return false;
+
+  if (blindState->magic != EMU_BLIND_MAGIC)
+  {
+    blindState->blind.reset(travelSteps, EMU_OVERTRAVEL_STEPS, startSteps, esp_random() | 1);
+    blindState->magic = EMU_BLIND_MAGIC;
+    fprintf(stderr, "[emu] New blind: %lld steps of travel, carriage at %lld\n", (long long)travelSteps, (long long)startSteps);
+  }
+
+  // Outputs are undriven until the firmware configures them
+  blindState->blind.powerOff();
+  Serial.enabled = true;
+  return true;
+}
+
+// ========================================
+// GPIO
+// ========================================
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+// Attached once at boot, before any task steps the motor
+void attachInterrupt(uint8_t pin, void (*handler)(), int)
+{
+  if (pin == LIMIT_RETRACTED)
+    retractedHandler = handler;
+  else if (pin == LIMIT_DEPLOYED)
+    deployedHandler = handler;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  bool retractedChanged, deployedChanged;
+  {
+    std::lock_guard<std::mutex> guard(blindLock);
+    int retracted = blindState->blind.read(LIMIT_RETRACTED);
+    int deployed = blindState->blind.read(LIMIT_DEPLOYED);
+    blindState->blind.write(pin, value);
+    retractedChanged = blindState->blind.read(LIMIT_RETRACTED) != retracted;
+    deployedChanged = blindState->blind.read(LIMIT_DEPLOYED) != deployed;
+  }
+
+  // Handlers read the pin themselves, so they run outside the lock
+  if (retractedChanged && retractedHandler != NULL)
+    retractedHandler();
+  if (deployedChanged && deployedHandler != NULL)
+    deployedHandler();
+}
+
+int digitalRead(uint8_t pin)
+{
+  std::lock_guard<std::mutex> guard(blindLock);
+  return blindState->blind.read(pin);
+}
+
+// Drive current (VREF) makes no difference to the model blind
+void analogWrite(uint8_t, int)
+{
+}
+
+// ========================================
+// Serial console on the terminal
+// ========================================
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (!enabled)
+    return size;
+  size_t written = 0;
+  while (written < size)
+  {
+    ssize_t n = ::write(STDOUT_FILENO, buffer + written, size - written);
+    if (n <= 0)
+      break;
+    written += n;
+  }
+  return written;
+}
+
+int HardwareSerial::available()
+{
+  if (stdinClosed)
+    return 0;
+  struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+  return poll(&input, 1, 0) > 0 ? 1 : 0;
+}
+
+int HardwareSerial::read()
+{
+  if (stdinClosed)
+    return -1;
+  uint8_t c;
+  if (::read(STDIN_FILENO, &c, 1) == 1)
+    return c;
+  stdinClosed = true;
+  return -1;
+}
+
+// ========================================
+// EEPROM (the ESP32 core keeps it in one flash page)
+// ========================================
+
+bool EEPROMClass::begin(size_t bytes)
+{
+  size = bytes < sizeof(data) ? bytes : sizeof(data);
+  memcpy(data, eepromStore, size);
+  return true;
+}
+
+bool EEPROMClass::commit()
+{
+  memcpy(eepromStore, data, size);
+  return true;
+}
+
+// ========================================
+// System
+// ========================================
+
+void EspClass::restart()
+{
+  Emulator::restart(ESP_RST_SW);
+}
+
+// The host process's live allocations stand in for heap use. They include
+// what the emulator itself holds, so only changes under load mean much.
+static uint32_t minFreeHeap = EMU_HEAP_BYTES;
+
+uint32_t EspClass::getHeapSize()
+{
+  return EMU_HEAP_BYTES;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+  size_t used = mallinfo2().uordblks;
+  uint32_t free = used < EMU_HEAP_BYTES ? EMU_HEAP_BYTES - used : 0;
+  if (free < minFreeHeap)
+    minFreeHeap = free;
+  return free;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+  getFreeHeap();
+  return minFreeHeap;
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+  return Emulator::resetReason();
+}
+
+uint32_t esp_random()
+{
+  static std::random_device source;
+  static std::mutex lock;
+  std::lock_guard<std::mutex> guard(lock);
+  return source();
+}
+
+const char *esp_err_to_name(esp_err_t err)
+{
+  switch (err)
+  {
+  case ESP_OK:
+    return "ESP_OK";
+  case ESP_FAIL:
+    return "ESP_FAIL";
+  case ESP_ERR_NO_MEM:
+    return "ESP_ERR_NO_MEM";
+  case ESP_ERR_INVALID_ARG:
+    return "ESP_ERR_INVALID_ARG";
+  case ESP_ERR_INVALID_STATE:
+    return "ESP_ERR_INVALID_STATE";
+  case ESP_ERR_INVALID_SIZE:
+    return "ESP_ERR_INVALID_SIZE";
+  case ESP_ERR_NOT_FOUND:
+    return "ESP_ERR_NOT_FOUND";
+  case ESP_ERR_NOT_SUPPORTED:
+    return "ESP_ERR_NOT_SUPPORTED";
+  case ESP_ERR_OTA_PARTITION_CONFLICT:
+    return "ESP_ERR_OTA_PARTITION_CONFLICT";
+  case ESP_ERR_OTA_VALIDATE_FAILED:
+    return "ESP_ERR_OTA_VALIDATE_FAILED";
+  }
+  return "UNKNOWN ERROR";
+}
@@ -0,0 +1,153 @@
+#include "Emulator.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Static member initialization
+uint16_t Emulator::httpPort = EMU_DEFAULT_HTTP_PORT;
+const char *Emulator::stateDir = EMU_DEFAULT_STATE_DIR;
+const char *Emulator::partitionTable = EMU_DEFAULT_PARTITIONS;
+int64_t Emulator::travelSteps = EMU_DEFAULT_TRAVEL_STEPS;
+int64_t Emulator::startSteps = EMU_DEFAULT_TRAVEL_STEPS / 4;
+char **Emulator::args = NULL;
+esp_reset_reason_t Emulator::reason = ESP_RST_POWERON;
+
+static void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --port N          HTTP port the web server listens on (default %d)\n"
+          "  --state DIR       Flash, EEPROM and mechanism state (default %s)\n"
+          "  --partitions CSV  Partition table (default %s)\n"
+          "  --travel N        Steps between the limit switches of a new blind (default %d)\n"
+          "  --start N         Carriage position of a new blind (default travel / 4)\n"
+          "Delete the state directory for a factory-fresh board.\n",
+          program, EMU_DEFAULT_HTTP_PORT, EMU_DEFAULT_STATE_DIR, EMU_DEFAULT_PARTITIONS, EMU_DEFAULT_TRAVEL_STEPS);
+}
+
+bool Emulator::begin(int argc, char **argv)
+{
+  args = argv;
+  bool startGiven = false;
+  for (int i = 1; i < argc; i++)
+  {
+    const char *option = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(option, "--help") == 0 || value == NULL)
+    {
+      usage(argv[0]);
+      return false;
+    }
+    i++;
+
+    if (strcmp(option, "--port") == 0)
+      httpPort = (uint16_t)atoi(value);
+    else if (strcmp(option, "--state") == 0)
+      stateDir = value;
+    else if (strcmp(option, "--partitions") == 0)
+      partitionTable = value;
+    else if (strcmp(option, "--travel") == 0)
+      travelSteps = atoll(value);
+    else if (strcmp(option, "--start") == 0)
+    {
+      startSteps = atoll(value);
+      startGiven = true;
+    }
+    else
+    {
+      usage(argv[0]);
+      return false;
+    }
+  }
+  if (!startGiven)
+    startSteps = travelSteps / 4;
+
+  // A warm boot inherits the reason the previous image restarted for
+  const char *inherited = getenv(EMU_RESET_ENV);
+  if (inherited != NULL)
+  {
+    reason = (esp_reset_reason_t)atoi(inherited);
+    unsetenv(EMU_RESET_ENV);
+  }
+
+  if (mkdir(stateDir, 0755) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "[emu] cannot create state directory %s: %s\n", stateDir, strerror(errno));
+    return false;
+  }
+
+  beginTasks();
+  if (!beginBoard() || !beginFlash())
+    return false;
+
+  fprintf(stderr, "[emu] Serving http://localhost:%u/, state in %s/\n", httpPort, stateDir);
+  return true;
+}
+
+void *Emulator::mapStateFile(const char *name, size_t size, uint8_t fill)
+{
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", stateDir, name);
+
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0)
+  {
+    fprintf(stderr, "[emu] cannot open %s: %s\n", path, strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return NULL;
+  }
+
+  // New (or grown) files start out erased
+  if ((size_t)info.st_size < size)
+  {
+    size_t missing = size - info.st_size;
+    uint8_t *blank = (uint8_t *)malloc(missing);
+    memset(blank, fill, missing);
+    bool written = pwrite(fd, blank, missing, info.st_size) == (ssize_t)missing;
+    free(blank);
+    if (!written)
+    {
+      fprintf(stderr, "[emu] cannot initialize %s: %s\n", path, strerror(errno));
+      close(fd);
+      return NULL;
+    }
+  }
+
+  // Shared mappings reach the file even if the process is killed
+  void *data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+  {
+    fprintf(stderr, "[emu] cannot map %s: %s\n", path, strerror(errno));
+    return NULL;
+  }
+  return data;
+}
+
+void Emulator::restart(esp_reset_reason_t resetReason)
+{
+  fflush(stdout);
+  fflush(stderr);
+
+  char value[8];
+  snprintf(value, sizeof(value), "%d", (int)resetReason);
+  setenv(EMU_RESET_ENV, value, 1);
+
+  // Sockets the firmware opened would otherwise outlive the boot
+  for (int fd = 3; fd < 1024; fd++)
+    close(fd);
+
+  fprintf(stderr, "[emu] Restarting\n");
+  execv("/proc/self/exe", args);
+  fprintf(stderr, "[emu] restart failed: %s\n", strerror(errno));
+  _exit(1);
+}
+
+esp_reset_reason_t Emulator::resetReason()
+{
+  return reason;
+}
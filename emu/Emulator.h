@@ -0,0 +1,47 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include <Arduino.h>
+
+#define EMU_DEFAULT_HTTP_PORT 8080
+#define EMU_DEFAULT_STATE_DIR "emu-state"
+#define EMU_DEFAULT_PARTITIONS "partitions.csv"
+#define EMU_DEFAULT_TRAVEL_STEPS 12000
+#define EMU_OVERTRAVEL_STEPS 50
+#define EMU_RESET_ENV "BIRDBLINDS_EMU_RESET" // Reset reason handed to the next boot
+
+// Runs the whole firmware as a Linux process. Tasks are threads, the web
+// server listens on localhost, and GPIO drives a simulated blind. Flash,
+// EEPROM and the mechanism live in files under the state directory, so
+// they survive restarts (ESP.restart() re-executes the process) and
+// being killed, like the real board survives a power cut.
+class Emulator
+{
+public:
+  // Parse the command line and open the state directory; false to exit
+  static bool begin(int argc, char **argv);
+
+  // Map a state file, creating it filled with `fill` on first use
+  static void *mapStateFile(const char *name, size_t size, uint8_t fill);
+
+  // Re-execute the process: a warm boot with the given reset reason
+  static void restart(esp_reset_reason_t reason);
+  static esp_reset_reason_t resetReason();
+
+  // Board bring-up, one per emu/ unit
+  static void beginTasks();
+  static bool beginBoard();
+  static bool beginFlash();
+
+  static uint16_t httpPort;
+  static const char *stateDir;
+  static const char *partitionTable;
+  static int64_t travelSteps;
+  static int64_t startSteps;
+
+private:
+  static char **args;
+  static esp_reset_reason_t reason;
+};
+
+#endif // EMULATOR_H
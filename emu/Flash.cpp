@@ -0,0 +1,420 @@
+#include "Emulator.h"
+#include <esp_ota_ops.h>
+#include <esp32s3/rom/miniz.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// SPI flash laid out by the partition table, kept in one state file.
+// Writes can only clear bits and erases work on whole sectors, as on the
+// real chip, so code that forgets to erase misbehaves here too.
+
+#define EMU_FLASH_SECTOR 4096
+#define EMU_OTADATA_MAGIC 0x4F544144 // "OTAD"
+
+// The emulator's own record in the otadata partition (not the IDF layout)
+struct OtaData
+{
+  uint32_t magic;
+  uint32_t bootSlot;
+  uint32_t state[2]; // esp_ota_img_states_t per app slot
+};
+
+static uint8_t *flash = NULL;
+static std::vector<esp_partition_t> partitions;
+static std::mutex flashLock;
+
+static const esp_partition_t *appSlots[2] = {NULL, NULL};
+static const esp_partition_t *otadataPartition = NULL;
+static OtaData ota = {EMU_OTADATA_MAGIC, 0, {ESP_OTA_IMG_UNDEFINED, ESP_OTA_IMG_UNDEFINED}};
+static uint32_t runningSlot = 0;
+
+struct OtaSession
+{
+  const esp_partition_t *partition;
+  size_t written;
+};
+
+static OtaSession session = {NULL, 0};
+
+static std::string trim(const std::string &text)
+{
+  size_t begin = text.find_first_not_of(" \t\r\n");
+  size_t end = text.find_last_not_of(" \t\r\n");
+  return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+}
+
+static uint32_t parseSize(const std::string &text)
+{
+  char *end = NULL;
+  uint32_t value = strtoul(text.c_str(), &end, 0);
+  if (*end == 'K' || *end == 'k')
+    value *= 1024;
+  else if (*end == 'M' || *end == 'm')
+    value *= 1024 * 1024;
+  return value;
+}
+
+static int parseSubtype(bool app, const std::string &text)
+{
+  static const struct
+  {
+    bool app;
+    const char *name;
+    int subtype;
+  } names[] = {
+      {true, "factory", 0x00}, {true, "ota_0", ESP_PARTITION_SUBTYPE_APP_OTA_0}, {true, "ota_1", ESP_PARTITION_SUBTYPE_APP_OTA_1},
+      {false, "ota", ESP_PARTITION_SUBTYPE_DATA_OTA}, {false, "phy", 0x01}, {false, "nvs", ESP_PARTITION_SUBTYPE_DATA_NVS},
+      {false, "coredump", ESP_PARTITION_SUBTYPE_DATA_COREDUMP}, {false, "spiffs", 0x82}, {false, "fat", 0x81}};
+
+  for (const auto &name : names)
+  {
+    if (name.app == app && text == name.name)
+      return name.subtype;
+  }
+  return (int)strtol(text.c_str(), NULL, 0);
+}
+
+static bool loadPartitionTable(const char *path)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    fprintf(stderr, "[emu] cannot read partition table %s (run from the project root or pass --partitions)\n", path);
+    return false;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    std::string text = trim(line);
+    if (text.empty() || text[0] == '#')
+      continue;
+
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true)
+    {
+      size_t comma = text.find(',', start);
+      fields.push_back(trim(text.substr(start, comma == std::string::npos ? std::string::npos : comma - start)));
+      if (comma == std::string::npos)
+        break;
+      start = comma + 1;
+    }
+    if (fields.size() < 5)
+      continue;
+
+    esp_partition_t partition = {};
+    bool app = fields[1] == "app";
+    partition.type = app ? ESP_PARTITION_TYPE_APP : ESP_PARTITION_TYPE_DATA;
+    partition.subtype = parseSubtype(app, fields[2]);
+    partition.address = parseSize(fields[3]);
+    partition.size = parseSize(fields[4]);
+    strncpy(partition.label, fields[0].c_str(), sizeof(partition.label) - 1);
+    partitions.push_back(partition);
+  }
+  fclose(file);
+  return !partitions.empty();
+}
+
+static void saveOtaData()
+{
+  if (otadataPartition != NULL)
+    memcpy(flash + otadataPartition->address, &ota, sizeof(ota));
+}
+
+bool Emulator::beginFlash()
+{
+  if (!loadPartitionTable(partitionTable))
+    return false;
+
+  size_t flashSize = 0;
+  for (const esp_partition_t &partition : partitions)
+  {
+    if (partition.address + partition.size > flashSize)
+      flashSize = partition.address + partition.size;
+
+    if (partition.type == ESP_PARTITION_TYPE_APP && partition.subtype >= ESP_PARTITION_SUBTYPE_APP_OTA_0 &&
+        partition.subtype <= ESP_PARTITION_SUBTYPE_APP_OTA_1)
+      appSlots[partition.subtype - ESP_PARTITION_SUBTYPE_APP_OTA_0] = &partition;
+    else if (partition.type == ESP_PARTITION_TYPE_DATA && partition.subtype == ESP_PARTITION_SUBTYPE_DATA_OTA)
+      otadataPartition = &partition;
+  }
+
+  flash = (uint8_t *)mapStateFile("flash.bin", flashSize, 0xFF);
+  if (flash == NULL)
+    return false;
+
+  if (otadataPartition != NULL)
+  {
+    OtaData stored;
+    memcpy(&stored, flash + otadataPartition->address, sizeof(stored));
+    if (stored.magic == EMU_OTADATA_MAGIC && stored.bootSlot < 2 && appSlots[stored.bootSlot] != NULL)
+      ota = stored;
+  }
+
+  // The bootloader's part of rollback: a new image gets one trial boot,
+  // and an image still unconfirmed at the next boot is abandoned
+  runningSlot = ota.bootSlot;
+  if (ota.state[runningSlot] == ESP_OTA_IMG_NEW)
+  {
+    ota.state[runningSlot] = ESP_OTA_IMG_PENDING_VERIFY;
+  }
+  else if (ota.state[runningSlot] == ESP_OTA_IMG_PENDING_VERIFY && appSlots[1 - runningSlot] != NULL)
+  {
+    fprintf(stderr, "[emu] bootloader: image in slot %u was never confirmed, rolling back\n", runningSlot);
+    ota.state[runningSlot] = ESP_OTA_IMG_ABORTED;
+    runningSlot = ota.bootSlot = 1 - runningSlot;
+  }
+  saveOtaData();
+  return true;
+}
+
+// ========================================
+// Partition API
+// ========================================
+
+struct PartitionIterator
+{
+  size_t index;
+  esp_partition_type_t type;
+  esp_partition_subtype_t subtype;
+  std::string label;
+};
+
+static bool matches(const esp_partition_t &partition, const PartitionIterator &query)
+{
+  return partition.type == query.type &&
+         (query.subtype == ESP_PARTITION_SUBTYPE_ANY || partition.subtype == query.subtype) &&
+         (query.label.empty() || query.label == partition.label);
+}
+
+// Advance to the next match at or after it->index; frees the iterator at the end
+static esp_partition_iterator_t seek(PartitionIterator *it)
+{
+  while (it->index < partitions.size() && !matches(partitions[it->index], *it))
+    it->index++;
+  if (it->index < partitions.size())
+    return it;
+  delete it;
+  return NULL;
+}
+
+esp_partition_iterator_t esp_partition_find(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+  PartitionIterator *it = new PartitionIterator();
+  it->index = 0;
+  it->type = type;
+  it->subtype = subtype;
+  it->label = label != NULL ? label : "";
+  return seek(it);
+}
+
+const esp_partition_t *esp_partition_get(esp_partition_iterator_t iterator)
+{
+  return &partitions[((PartitionIterator *)iterator)->index];
+}
+
+esp_partition_iterator_t esp_partition_next(esp_partition_iterator_t iterator)
+{
+  PartitionIterator *it = (PartitionIterator *)iterator;
+  it->index++;
+  return seek(it);
+}
+
+void esp_partition_iterator_release(esp_partition_iterator_t iterator)
+{
+  delete (PartitionIterator *)iterator;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+  esp_partition_iterator_t it = esp_partition_find(type, subtype, label);
+  if (it == NULL)
+    return NULL;
+  const esp_partition_t *partition = esp_partition_get(it);
+  esp_partition_iterator_release(it);
+  return partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset, void *dst, size_t size)
+{
+  if (offset + size > partition->size)
+    return ESP_ERR_INVALID_SIZE;
+  std::lock_guard<std::mutex> guard(flashLock);
+  memcpy(dst, flash + partition->address + offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset, const void *src, size_t size)
+{
+  if (offset + size > partition->size)
+    return ESP_ERR_INVALID_SIZE;
+  std::lock_guard<std::mutex> guard(flashLock);
+  uint8_t *target = flash + partition->address + offset;
+  const uint8_t *bytes = (const uint8_t *)src;
+  for (size_t i = 0; i < size; i++)
+    target[i] &= bytes[i];
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size)
+{
+  if (offset % EMU_FLASH_SECTOR != 0 || size % EMU_FLASH_SECTOR != 0)
+    return ESP_ERR_INVALID_ARG;
+  if (offset + size > partition->size)
+    return ESP_ERR_INVALID_SIZE;
+  std::lock_guard<std::mutex> guard(flashLock);
+  memset(flash + partition->address + offset, 0xFF, size);
+  return ESP_OK;
+}
+
+// ========================================
+// OTA
+// ========================================
+
+static int slotOf(const esp_partition_t *partition)
+{
+  for (int slot = 0; slot < 2; slot++)
+  {
+    if (partition != NULL && appSlots[slot] == partition)
+      return slot;
+  }
+  return -1;
+}
+
+const esp_partition_t *esp_ota_get_running_partition()
+{
+  return appSlots[runningSlot];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start)
+{
+  int from = slotOf(start != NULL ? start : appSlots[runningSlot]);
+  return from < 0 ? NULL : appSlots[1 - from];
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t, esp_ota_handle_t *handle)
+{
+  int slot = slotOf(partition);
+  if (slot < 0)
+    return ESP_ERR_NOT_FOUND;
+  if (slot == (int)runningSlot)
+    return ESP_ERR_OTA_PARTITION_CONFLICT;
+
+  esp_err_t err = esp_partition_erase_range(partition, 0, partition->size);
+  if (err != ESP_OK)
+    return err;
+  session.partition = partition;
+  session.written = 0;
+  *handle = 1;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+  if (handle != 1 || session.partition == NULL)
+    return ESP_ERR_INVALID_ARG;
+  esp_err_t err = esp_partition_write(session.partition, session.written, data, size);
+  if (err == ESP_OK)
+    session.written += size;
+  return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+  if (handle != 1 || session.partition == NULL)
+    return ESP_ERR_NOT_FOUND;
+
+  // Only the image header magic is checked; the image is never executed
+  uint8_t magic = 0;
+  esp_partition_read(session.partition, 0, &magic, 1);
+  session.partition = NULL;
+  return session.written > 0 && magic == 0xE9 ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t)
+{
+  session.partition = NULL;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+  int slot = slotOf(partition);
+  if (slot < 0)
+    return ESP_ERR_NOT_FOUND;
+  ota.bootSlot = slot;
+  if (slot != (int)runningSlot)
+    ota.state[slot] = ESP_OTA_IMG_NEW;
+  saveOtaData();
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *state)
+{
+  int slot = slotOf(partition);
+  if (slot < 0 || ota.state[slot] == ESP_OTA_IMG_UNDEFINED)
+    return ESP_ERR_NOT_FOUND;
+  *state = (esp_ota_img_states_t)ota.state[slot];
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback()
+{
+  ota.state[runningSlot] = ESP_OTA_IMG_VALID;
+  saveOtaData();
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot()
+{
+  uint32_t other = 1 - runningSlot;
+  if (appSlots[other] == NULL || ota.state[other] == ESP_OTA_IMG_INVALID || ota.state[other] == ESP_OTA_IMG_ABORTED)
+    return ESP_FAIL;
+
+  ota.state[runningSlot] = ESP_OTA_IMG_INVALID;
+  ota.bootSlot = other;
+  saveOtaData();
+  Emulator::restart(ESP_RST_SW);
+  return ESP_OK;
+}
+
+// ========================================
+// ROM inflater over zlib
+// ========================================
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *inSize, uint8_t *, uint8_t *outNext,
+                              size_t *outSize, const uint32_t flags)
+{
+  z_stream *stream = (z_stream *)r->stream;
+  if (stream == NULL)
+  {
+    stream = new z_stream();
+    if (inflateInit2(stream, (flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? MAX_WBITS : -MAX_WBITS) != Z_OK)
+    {
+      delete stream;
+      *inSize = *outSize = 0;
+      return TINFL_STATUS_FAILED;
+    }
+    r->stream = stream;
+  }
+
+  stream->next_in = (Bytef *)in;
+  stream->avail_in = *inSize;
+  stream->next_out = outNext;
+  stream->avail_out = *outSize;
+  int result = inflate(stream, Z_NO_FLUSH);
+  *inSize -= stream->avail_in;
+  *outSize -= stream->avail_out;
+
+  if (result == Z_OK || result == Z_BUF_ERROR)
+    return stream->avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+
+  // Finished or failed: the stream is not used again
+  inflateEnd(stream);
+  delete stream;
+  r->stream = NULL;
+  return result == Z_STREAM_END ? TINFL_STATUS_DONE : TINFL_STATUS_FAILED;
+}
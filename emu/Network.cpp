@@ -0,0 +1,196 @@
+#include "Emulator.h"
+#include "config.h"
+#include <WiFi.h>
+#include <ESPmDNS.h>
+#include <mdns.h>
+#include <esp_now.h>
+#include <esp_sntp.h>
+#include <sys/time.h>
+
+// The host is always "associated": WiFi reports a connection on loopback,
+// the clock is the host's (already synchronized) clock, and the radio
+// features with no host equivalent report that they are unavailable, so
+// group commands travel over the UDP transport instead of ESP-NOW.
+
+WiFiClass WiFi;
+MDNSResponder MDNS;
+
+static wl_status_t wifiStatus = WL_DISCONNECTED;
+static const uint8_t EMU_MAC[6] = {0x02, 0x00, 0x00, 0xB1, 0xD0, 0x01}; // Locally administered
+
+bool WiFiClass::begin(const char *, const char *)
+{
+  wifiStatus = WL_CONNECTED;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool)
+{
+  wifiStatus = WL_DISCONNECTED;
+  return true;
+}
+
+bool WiFiClass::reconnect()
+{
+  wifiStatus = WL_CONNECTED;
+  return true;
+}
+
+void WiFiClass::persistent(bool)
+{
+}
+
+bool WiFiClass::mode(wifi_mode_t)
+{
+  return true;
+}
+
+bool WiFiClass::setAutoReconnect(bool)
+{
+  return true;
+}
+
+bool WiFiClass::setSleep(bool)
+{
+  return true;
+}
+
+bool WiFiClass::setTxPower(wifi_power_t)
+{
+  return true;
+}
+
+wl_status_t WiFiClass::status()
+{
+  return wifiStatus;
+}
+
+String WiFiClass::macAddress()
+{
+  char text[18];
+  snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", EMU_MAC[0], EMU_MAC[1], EMU_MAC[2], EMU_MAC[3], EMU_MAC[4], EMU_MAC[5]);
+  return String(text);
+}
+
+uint8_t *WiFiClass::macAddress(uint8_t *mac)
+{
+  memcpy(mac, EMU_MAC, sizeof(EMU_MAC));
+  return mac;
+}
+
+IPAddress WiFiClass::localIP()
+{
+  return wifiStatus == WL_CONNECTED ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::gatewayIP()
+{
+  return localIP();
+}
+
+IPAddress WiFiClass::subnetMask()
+{
+  return IPAddress(255, 0, 0, 0);
+}
+
+IPAddress WiFiClass::dnsIP()
+{
+  return localIP();
+}
+
+int8_t WiFiClass::RSSI()
+{
+  return wifiStatus == WL_CONNECTED ? -40 : 0;
+}
+
+int32_t WiFiClass::channel()
+{
+  return REMOTE_ESPNOW_CHANNEL;
+}
+
+// ========================================
+// mDNS: accepted, not multicast
+// ========================================
+
+bool MDNSResponder::begin(const char *)
+{
+  return true;
+}
+
+void MDNSResponder::end()
+{
+}
+
+bool MDNSResponder::addService(const char *, const char *, uint16_t)
+{
+  return true;
+}
+
+esp_err_t mdns_service_txt_set(const char *, const char *, mdns_txt_item_t[], uint8_t)
+{
+  return ESP_OK;
+}
+
+// ========================================
+// Radio
+// ========================================
+
+esp_err_t esp_now_init()
+{
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_now_deinit()
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *)
+{
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t)
+{
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_now_send(const uint8_t *, const uint8_t *, size_t)
+{
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t *, wifi_second_chan_t *)
+{
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t, wifi_second_chan_t)
+{
+  return ESP_ERR_NOT_SUPPORTED;
+}
+
+// ========================================
+// Time
+// ========================================
+
+static sntp_sync_time_cb_t timeSyncCallback = NULL;
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t callback)
+{
+  timeSyncCallback = callback;
+}
+
+void configTzTime(const char *tz, const char *, const char *, const char *)
+{
+  setenv("TZ", tz, 1);
+  tzset();
+
+  // The host clock is already in sync
+  if (timeSyncCallback != NULL)
+  {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    timeSyncCallback(&now);
+  }
+}
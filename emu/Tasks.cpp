@@ -0,0 +1,383 @@
+#include "Emulator.h"
+#include <esp_task_wdt.h>
+#include <esp_timer.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// FreeRTOS on host threads. Every task is a detached thread; priorities
+// and core affinity are recorded for TaskConfig to report but not
+// enforced, since Linux schedules the threads itself.
+
+typedef std::chrono::steady_clock Clock;
+
+static Clock::time_point bootTime;
+
+struct EmuTask
+{
+  std::string name;
+  TaskFunction_t function;
+  void *parameter;
+  uint32_t stackDepth;
+  UBaseType_t priority;
+  BaseType_t core;
+
+  std::mutex notifyLock;
+  std::condition_variable notified;
+  uint32_t notifications = 0;
+
+  // Task watchdog
+  bool supervised = false;
+  Clock::time_point fedAt;
+};
+
+static std::mutex registryLock;
+static std::vector<EmuTask *> tasks;
+static thread_local EmuTask *currentTask = NULL;
+
+static std::recursive_mutex criticalLock;
+
+static std::mutex watchdogLock;
+static uint32_t watchdogTimeoutMs = 0;
+static bool watchdogPanics = false;
+
+static void watchdogMonitor();
+
+// Wait for a condition with a FreeRTOS tick timeout
+template <typename Predicate>
+static bool waitTicks(std::condition_variable &condition, std::unique_lock<std::mutex> &lock, TickType_t wait, Predicate ready)
+{
+  if (wait == portMAX_DELAY)
+  {
+    condition.wait(lock, ready);
+    return true;
+  }
+  return condition.wait_for(lock, std::chrono::milliseconds(wait * portTICK_PERIOD_MS), ready);
+}
+
+static EmuTask *registerTask(const char *name, uint32_t stackDepth, UBaseType_t priority, BaseType_t core)
+{
+  EmuTask *task = new EmuTask();
+  task->name = name;
+  task->function = NULL;
+  task->parameter = NULL;
+  task->stackDepth = stackDepth;
+  task->priority = priority;
+  task->core = core;
+
+  std::lock_guard<std::mutex> guard(registryLock);
+  tasks.push_back(task);
+  return task;
+}
+
+void Emulator::beginTasks()
+{
+  bootTime = Clock::now();
+
+  // setup() and loop() run on the main thread, as in the Arduino loopTask
+  currentTask = registerTask("loopTask", CONFIG_ARDUINO_LOOP_STACK_SIZE, 1, ARDUINO_RUNNING_CORE);
+
+  std::thread(watchdogMonitor).detach();
+}
+
+// ========================================
+// Time
+// ========================================
+
+unsigned long millis()
+{
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - bootTime).count();
+}
+
+unsigned long micros()
+{
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - bootTime).count();
+}
+
+int64_t esp_timer_get_time()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - bootTime).count();
+}
+
+void delay(uint32_t ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  // Spin like the ESP32 does; sleeping would stretch every step pulse
+  Clock::time_point until = Clock::now() + std::chrono::microseconds(us);
+  while (Clock::now() < until)
+  {
+  }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+// ========================================
+// Tasks
+// ========================================
+
+static void runTask(EmuTask *task)
+{
+  currentTask = task;
+  task->function(task->parameter);
+
+  // Returning from a FreeRTOS task function is a fatal error
+  fprintf(stderr, "[emu] task %s returned\n", task->name.c_str());
+  abort();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameter,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  EmuTask *task = registerTask(name, stackDepth, priority, core);
+  task->function = function;
+  task->parameter = parameter;
+  if (handle != NULL)
+    *handle = task;
+
+  std::thread(runTask, task).detach();
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return currentTask;
+}
+
+TaskHandle_t xTaskGetHandle(const char *name)
+{
+  std::lock_guard<std::mutex> guard(registryLock);
+  for (EmuTask *task : tasks)
+  {
+    if (task->name == name)
+      return task;
+  }
+  return NULL;
+}
+
+static EmuTask *resolve(TaskHandle_t handle)
+{
+  return handle != NULL ? (EmuTask *)handle : currentTask;
+}
+
+char *pcTaskGetName(TaskHandle_t handle)
+{
+  return (char *)resolve(handle)->name.c_str();
+}
+
+void vTaskPrioritySet(TaskHandle_t handle, UBaseType_t priority)
+{
+  resolve(handle)->priority = priority;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t handle)
+{
+  return resolve(handle)->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t handle)
+{
+  // Host stacks are megabytes and not measured; report the whole budget
+  return resolve(handle)->stackDepth;
+}
+
+BaseType_t xPortGetCoreID()
+{
+  EmuTask *task = currentTask;
+  return task != NULL && task->core != tskNO_AFFINITY ? task->core : 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t wait)
+{
+  EmuTask *task = currentTask;
+  std::unique_lock<std::mutex> lock(task->notifyLock);
+  waitTicks(task->notified, lock, wait, [task]
+            { return task->notifications > 0; });
+
+  uint32_t value = task->notifications;
+  if (value > 0)
+    task->notifications = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+  EmuTask *task = (EmuTask *)handle;
+  {
+    std::lock_guard<std::mutex> guard(task->notifyLock);
+    task->notifications++;
+  }
+  task->notified.notify_one();
+  return pdPASS;
+}
+
+// ========================================
+// Critical sections, mutexes and queues
+// ========================================
+
+// One lock for every portMUX: coarser than the ESP32's spinlocks, but
+// critical sections only ever guard a few instructions
+void vPortEnterCritical(portMUX_TYPE *)
+{
+  criticalLock.lock();
+}
+
+void vPortExitCritical(portMUX_TYPE *)
+{
+  criticalLock.unlock();
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return new std::timed_mutex();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait)
+{
+  std::timed_mutex *mutex = (std::timed_mutex *)semaphore;
+  if (wait == portMAX_DELAY)
+  {
+    mutex->lock();
+    return pdTRUE;
+  }
+  return mutex->try_lock_for(std::chrono::milliseconds(wait * portTICK_PERIOD_MS)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  ((std::timed_mutex *)semaphore)->unlock();
+  return pdTRUE;
+}
+
+struct EmuQueue
+{
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  std::mutex lock;
+  std::condition_variable changed;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+  EmuQueue *queue = new EmuQueue();
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void *item, TickType_t wait)
+{
+  EmuQueue *queue = (EmuQueue *)handle;
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitTicks(queue->changed, lock, wait, [queue]
+                 { return queue->items.size() < queue->length; }))
+    return pdFALSE;
+
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void *item, TickType_t wait)
+{
+  EmuQueue *queue = (EmuQueue *)handle;
+  std::unique_lock<std::mutex> lock(queue->lock);
+  if (!waitTicks(queue->changed, lock, wait, [queue]
+                 { return !queue->items.empty(); }))
+    return pdFALSE;
+
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  lock.unlock();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+// ========================================
+// Task watchdog
+// ========================================
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config)
+{
+  std::lock_guard<std::mutex> guard(watchdogLock);
+  watchdogTimeoutMs = config->timeout_ms;
+  watchdogPanics = config->trigger_panic;
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *config)
+{
+  // The ESP32 core starts the watchdog before setup(); the emulator does not
+  std::lock_guard<std::mutex> guard(watchdogLock);
+  if (watchdogTimeoutMs == 0)
+    return ESP_ERR_INVALID_STATE;
+  watchdogTimeoutMs = config->timeout_ms;
+  watchdogPanics = config->trigger_panic;
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t handle)
+{
+  EmuTask *task = resolve(handle);
+  std::lock_guard<std::mutex> guard(watchdogLock);
+  if (watchdogTimeoutMs == 0)
+    return ESP_ERR_INVALID_STATE;
+  task->supervised = true;
+  task->fedAt = Clock::now();
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset()
+{
+  EmuTask *task = currentTask;
+  std::lock_guard<std::mutex> guard(watchdogLock);
+  if (task == NULL || !task->supervised)
+    return ESP_ERR_NOT_FOUND;
+  task->fedAt = Clock::now();
+  return ESP_OK;
+}
+
+static void watchdogMonitor()
+{
+  while (true)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::string starved;
+    bool panic;
+    {
+      std::lock_guard<std::mutex> watchdog(watchdogLock);
+      std::lock_guard<std::mutex> registry(registryLock);
+      Clock::time_point now = Clock::now();
+      for (EmuTask *task : tasks)
+      {
+        if (task->supervised && now - task->fedAt > std::chrono::milliseconds(watchdogTimeoutMs))
+        {
+          starved = task->name;
+          task->fedAt = now;
+        }
+      }
+      panic = watchdogPanics;
+    }
+
+    if (starved.empty())
+      continue;
+    fprintf(stderr, "E (%lu) task_wdt: Task watchdog got triggered. %s did not reset the watchdog in time\n",
+            millis(), starved.c_str());
+    if (panic)
+      Emulator::restart(ESP_RST_TASK_WDT);
+  }
+}
@@ -0,0 +1,577 @@
+#include "Emulator.h"
+#include <ESPAsyncWebServer.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string>
+
+// ESPAsyncWebServer over host sockets. One task multiplexes every
+// connection with poll(), like AsyncTCP's single event task: a request is
+// read in full, dispatched to its handler, and the response is then
+// written out as the socket accepts it (pulling from chunked fillers on
+// the way). Connections close after one response.
+
+#ifndef CONFIG_ASYNC_TCP_STACK_SIZE
+#define CONFIG_ASYNC_TCP_STACK_SIZE 16384
+#endif
+#ifndef CONFIG_ASYNC_TCP_PRIORITY
+#define CONFIG_ASYNC_TCP_PRIORITY 10
+#endif
+#ifndef CONFIG_ASYNC_TCP_RUNNING_CORE
+#define CONFIG_ASYNC_TCP_RUNNING_CORE 0
+#endif
+
+#define EMU_HTTP_MAX_HEADER 16384
+#define EMU_HTTP_MAX_BODY (8 * 1024 * 1024)
+#define EMU_HTTP_BODY_CHUNK 1436 // One TCP segment, as handlers see it on the board
+#define EMU_HTTP_FILL_CHUNK 4096
+
+struct AsyncWebServer::Connection
+{
+  int fd;
+  std::string input;
+  size_t bodyStart = 0; // 0 until the header is complete
+  size_t contentLength = 0;
+  AsyncWebServerRequest *request = NULL;
+
+  std::string output;
+  size_t sent = 0;
+  size_t filled = 0; // Body bytes produced so far
+  bool started = false;
+  bool finished = false;
+};
+
+static const char *reasonPhrase(int code)
+{
+  switch (code)
+  {
+  case 200:
+    return "OK";
+  case 204:
+    return "No Content";
+  case 304:
+    return "Not Modified";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 413:
+    return "Payload Too Large";
+  case 431:
+    return "Request Header Fields Too Large";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  }
+  return "";
+}
+
+static std::string urlDecode(const std::string &text)
+{
+  std::string decoded;
+  for (size_t i = 0; i < text.size(); i++)
+  {
+    if (text[i] == '+')
+      decoded += ' ';
+    else if (text[i] == '%' && i + 2 < text.size() && isxdigit((unsigned char)text[i + 1]) && isxdigit((unsigned char)text[i + 2]))
+    {
+      decoded += (char)strtol(text.substr(i + 1, 2).c_str(), NULL, 16);
+      i += 2;
+    }
+    else
+      decoded += text[i];
+  }
+  return decoded;
+}
+
+static void parseQuery(const std::string &query, std::vector<AsyncWebParameter> &params, bool form)
+{
+  size_t start = 0;
+  while (start < query.size())
+  {
+    size_t end = query.find('&', start);
+    if (end == std::string::npos)
+      end = query.size();
+    std::string pair = query.substr(start, end - start);
+    size_t equals = pair.find('=');
+    if (!pair.empty())
+    {
+      std::string name = urlDecode(pair.substr(0, equals));
+      std::string value = equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1));
+      params.push_back(AsyncWebParameter(String(name), String(value), form));
+    }
+    start = end + 1;
+  }
+}
+
+// Value of `key="..."` (or key=...) in a header such as Content-Disposition
+static std::string headerAttribute(const std::string &header, const char *key)
+{
+  std::string marker = std::string(key) + "=";
+  size_t at = header.find(marker);
+  if (at == std::string::npos)
+    return "";
+  at += marker.size();
+  if (at < header.size() && header[at] == '"')
+  {
+    size_t end = header.find('"', at + 1);
+    return header.substr(at + 1, end == std::string::npos ? std::string::npos : end - at - 1);
+  }
+  size_t end = header.find(';', at);
+  return header.substr(at, end == std::string::npos ? std::string::npos : end - at);
+}
+
+// ========================================
+// Request
+// ========================================
+
+AsyncWebServerRequest::~AsyncWebServerRequest()
+{
+  delete _response;
+  free(_tempObject);
+}
+
+const AsyncWebParameter *AsyncWebServerRequest::getParam(size_t index) const
+{
+  return index < _params.size() ? &_params[index] : NULL;
+}
+
+const AsyncWebParameter *AsyncWebServerRequest::getParam(const String &name, bool post, bool file) const
+{
+  for (const AsyncWebParameter &param : _params)
+  {
+    if (param.name() == name && param.isPost() == post && param.isFile() == file)
+      return &param;
+  }
+  return NULL;
+}
+
+bool AsyncWebServerRequest::hasParam(const String &name, bool post, bool file) const
+{
+  return getParam(name, post, file) != NULL;
+}
+
+const AsyncWebHeader *AsyncWebServerRequest::getHeader(const String &name) const
+{
+  for (const AsyncWebHeader &header : _headers)
+  {
+    if (header.name().equalsIgnoreCase(name))
+      return &header;
+  }
+  return NULL;
+}
+
+bool AsyncWebServerRequest::hasHeader(const String &name) const
+{
+  return getHeader(name) != NULL;
+}
+
+String AsyncWebServerRequest::header(const char *name) const
+{
+  const AsyncWebHeader *found = getHeader(name);
+  return found != NULL ? found->value() : String();
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse *response)
+{
+  delete _response;
+  _response = response;
+}
+
+void AsyncWebServerRequest::send(int code, const String &contentType, const String &content)
+{
+  send(beginResponse(code, contentType, content));
+}
+
+void AsyncWebServerRequest::send(int code, const char *contentType, const uint8_t *content, size_t len)
+{
+  send(beginResponse(code, contentType, content, len));
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const String &contentType, const String &content)
+{
+  std::string body(content.c_str(), content.length());
+  return new AsyncWebServerResponse(code, contentType, body.size(), false, [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                    {
+    size_t take = body.size() - index < maxLen ? body.size() - index : maxLen;
+    memcpy(buffer, body.data() + index, take);
+    return take; });
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginResponse(int code, const char *contentType, const uint8_t *content, size_t len)
+{
+  // Sent straight from the caller's buffer, which must outlive the request
+  return new AsyncWebServerResponse(code, contentType, len, false, [content, len](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                    {
+    size_t take = len - index < maxLen ? len - index : maxLen;
+    memcpy(buffer, content + index, take);
+    return take; });
+}
+
+AsyncWebServerResponse *AsyncWebServerRequest::beginChunkedResponse(const String &contentType, AwsResponseFiller filler)
+{
+  return new AsyncWebServerResponse(200, contentType, 0, true, filler);
+}
+
+// ========================================
+// Server
+// ========================================
+
+AsyncWebServer::~AsyncWebServer()
+{
+  if (_listener >= 0)
+    close(_listener);
+}
+
+AsyncCallbackWebHandler &AsyncWebServer::on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                                            ArUploadHandlerFunction onUpload, ArBodyHandlerFunction onBody)
+{
+  AsyncCallbackWebHandler *handler = new AsyncCallbackWebHandler();
+  handler->uri = uri;
+  handler->method = method;
+  handler->onRequest = onRequest;
+  handler->onUpload = onUpload;
+  handler->onBody = onBody;
+  _handlers.push_back(handler);
+  return *handler;
+}
+
+void AsyncWebServer::begin()
+{
+  _listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int enable = 1;
+  setsockopt(_listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+
+  // The board's port is privileged on the host; every server gets --port
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(Emulator::httpPort);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(_listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(_listener, 16) != 0)
+  {
+    fprintf(stderr, "[emu] cannot listen on port %u: %s\n", Emulator::httpPort, strerror(errno));
+    close(_listener);
+    _listener = -1;
+    return;
+  }
+
+  xTaskCreatePinnedToCore(task, "async_tcp", CONFIG_ASYNC_TCP_STACK_SIZE, this, CONFIG_ASYNC_TCP_PRIORITY, NULL,
+                          CONFIG_ASYNC_TCP_RUNNING_CORE);
+}
+
+void AsyncWebServer::task(void *server)
+{
+  ((AsyncWebServer *)server)->serve();
+}
+
+void AsyncWebServer::serve()
+{
+  std::vector<Connection *> connections;
+  std::vector<struct pollfd> fds;
+
+  while (true)
+  {
+    fds.clear();
+    fds.push_back({_listener, POLLIN, 0});
+    bool waitingOnFiller = false;
+    for (Connection *connection : connections)
+    {
+      short events = connection->request != NULL && connection->request->_response != NULL ? POLLOUT : POLLIN;
+      fds.push_back({connection->fd, events, 0});
+      waitingOnFiller |= connection->started && connection->output.size() == connection->sent && !connection->finished;
+    }
+
+    poll(fds.data(), fds.size(), waitingOnFiller ? 10 : 1000);
+
+    if (fds[0].revents & POLLIN)
+    {
+      int fd = accept4(_listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd >= 0)
+      {
+        Connection *connection = new Connection();
+        connection->fd = fd;
+        connections.push_back(connection);
+      }
+    }
+
+    for (size_t i = 0; i < connections.size();)
+    {
+      Connection *connection = connections[i];
+      short revents = i + 1 < fds.size() && fds[i + 1].fd == connection->fd ? fds[i + 1].revents : 0;
+      bool open = true;
+      if (revents & (POLLERR | POLLHUP | POLLNVAL))
+        open = false;
+      else if (connection->request == NULL || connection->request->_response == NULL)
+        open = !(revents & POLLIN) || receive(*connection);
+      else
+        open = transmit(*connection);
+
+      if (open)
+      {
+        i++;
+        continue;
+      }
+
+      close(connection->fd);
+      if (connection->request != NULL)
+      {
+        for (ArDisconnectHandler &handler : connection->request->_disconnectHandlers)
+          handler();
+        delete connection->request;
+      }
+      delete connection;
+      connections.erase(connections.begin() + i);
+      if (i + 1 < fds.size())
+        fds.erase(fds.begin() + i + 1);
+    }
+  }
+}
+
+// Read what has arrived; dispatches once the whole request is in
+bool AsyncWebServer::receive(Connection &connection)
+{
+  char buffer[16384];
+  ssize_t length = recv(connection.fd, buffer, sizeof(buffer), 0);
+  if (length <= 0)
+    return length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+  connection.input.append(buffer, length);
+
+  if (connection.bodyStart == 0)
+  {
+    size_t end = connection.input.find("\r\n\r\n");
+    if (end == std::string::npos)
+    {
+      if (connection.input.size() <= EMU_HTTP_MAX_HEADER)
+        return true;
+      connection.request = new AsyncWebServerRequest();
+      connection.request->send(431, "text/plain", "Header too large");
+      return true;
+    }
+    connection.bodyStart = end + 4;
+
+    AsyncWebServerRequest *request = new AsyncWebServerRequest();
+    connection.request = request;
+
+    size_t lineEnd = connection.input.find("\r\n");
+    std::string line = connection.input.substr(0, lineEnd);
+    size_t space = line.find(' ');
+    size_t secondSpace = line.find(' ', space + 1);
+    std::string method = line.substr(0, space);
+    std::string target = line.substr(space + 1, secondSpace - space - 1);
+
+    static const struct
+    {
+      const char *name;
+      WebRequestMethod method;
+    } methods[] = {{"GET", HTTP_GET}, {"POST", HTTP_POST}, {"DELETE", HTTP_DELETE}, {"PUT", HTTP_PUT}, {"PATCH", HTTP_PATCH}, {"HEAD", HTTP_HEAD}, {"OPTIONS", HTTP_OPTIONS}};
+    for (const auto &entry : methods)
+    {
+      if (method == entry.name)
+        request->_method = entry.method;
+    }
+
+    size_t question = target.find('?');
+    request->_url = String(urlDecode(target.substr(0, question)));
+    if (question != std::string::npos)
+      parseQuery(target.substr(question + 1), request->_params, false);
+
+    size_t at = lineEnd + 2;
+    while (at < end)
+    {
+      size_t next = connection.input.find("\r\n", at);
+      std::string header = connection.input.substr(at, next - at);
+      size_t colon = header.find(':');
+      if (colon != std::string::npos)
+      {
+        size_t valueStart = header.find_first_not_of(' ', colon + 1);
+        std::string value = valueStart == std::string::npos ? "" : header.substr(valueStart);
+        request->_headers.push_back(AsyncWebHeader(String(header.substr(0, colon)), String(value)));
+      }
+      at = next + 2;
+    }
+
+    connection.contentLength = strtoul(request->header("Content-Length").c_str(), NULL, 10);
+    if (request->_method == 0)
+    {
+      request->send(400, "text/plain", "Unsupported method");
+      return true;
+    }
+    if (connection.contentLength > EMU_HTTP_MAX_BODY)
+    {
+      request->send(413, "text/plain", "Body too large");
+      return true;
+    }
+    if (connection.contentLength > 0 && request->header("Expect").equalsIgnoreCase("100-continue"))
+    {
+      static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+      ::send(connection.fd, CONTINUE, sizeof(CONTINUE) - 1, MSG_NOSIGNAL);
+    }
+  }
+
+  if (connection.input.size() - connection.bodyStart >= connection.contentLength)
+    dispatch(connection);
+  return true;
+}
+
+void AsyncWebServer::dispatch(Connection &connection)
+{
+  AsyncWebServerRequest *request = connection.request;
+  std::string url = request->_url.c_str();
+
+  AsyncCallbackWebHandler *handler = NULL;
+  for (AsyncCallbackWebHandler *candidate : _handlers)
+  {
+    std::string uri = candidate->uri.c_str();
+    if ((candidate->method & request->_method) && (url == uri || url.compare(0, uri.size() + 1, uri + "/") == 0))
+    {
+      handler = candidate;
+      break;
+    }
+  }
+
+  if (handler == NULL)
+  {
+    if (_notFound)
+      _notFound(request);
+    else
+      request->send(404, "text/plain", "Not found");
+  }
+  else
+  {
+    uint8_t *body = (uint8_t *)&connection.input[connection.bodyStart];
+    size_t length = connection.contentLength;
+    std::string type = request->header("Content-Type").c_str();
+
+    if (type.compare(0, 19, "multipart/form-data") == 0)
+    {
+      // Fields become form parameters, files go to the upload handler
+      std::string delimiter = "--" + headerAttribute(type, "boundary");
+      std::string data((const char *)body, length);
+      size_t at = data.find(delimiter);
+      while (at != std::string::npos)
+      {
+        size_t partStart = at + delimiter.size();
+        if (data.compare(partStart, 2, "--") == 0)
+          break;
+        size_t headerEnd = data.find("\r\n\r\n", partStart);
+        size_t next = data.find("\r\n" + delimiter, headerEnd);
+        if (headerEnd == std::string::npos || next == std::string::npos)
+          break;
+
+        std::string headers = data.substr(partStart, headerEnd - partStart);
+        std::string name = headerAttribute(headers, "name");
+        std::string filename = headerAttribute(headers, "filename");
+        size_t contentStart = headerEnd + 4;
+        size_t contentLength = next - contentStart;
+
+        if (headers.find("filename=") != std::string::npos)
+        {
+          request->_params.push_back(AsyncWebParameter(String(name), String(filename), true, true, contentLength));
+          if (handler->onUpload)
+          {
+            size_t index = 0;
+            do
+            {
+              size_t take = contentLength - index < EMU_HTTP_BODY_CHUNK ? contentLength - index : EMU_HTTP_BODY_CHUNK;
+              handler->onUpload(request, String(filename), index, body + contentStart + index, take, index + take == contentLength);
+              index += take;
+            } while (index < contentLength);
+          }
+        }
+        else
+        {
+          request->_params.push_back(AsyncWebParameter(String(name), String(data.substr(contentStart, contentLength)), true));
+        }
+        at = next + 2;
+      }
+    }
+    else if (type.compare(0, 33, "application/x-www-form-urlencoded") == 0)
+    {
+      parseQuery(std::string((const char *)body, length), request->_params, true);
+    }
+    else if (length > 0 && handler->onBody)
+    {
+      for (size_t index = 0; index < length; index += EMU_HTTP_BODY_CHUNK)
+      {
+        size_t take = length - index < EMU_HTTP_BODY_CHUNK ? length - index : EMU_HTTP_BODY_CHUNK;
+        handler->onBody(request, body + index, take, index, length);
+      }
+    }
+
+    handler->onRequest(request);
+  }
+
+  // Every firmware handler answers before returning
+  if (request->_response == NULL)
+    request->send(500, "text/plain", "Handler sent no response");
+  connection.input.clear();
+}
+
+// Write the pending response; false once it is out and the connection can close
+bool AsyncWebServer::transmit(Connection &connection)
+{
+  AsyncWebServerResponse *response = connection.request->_response;
+
+  if (!connection.started)
+  {
+    connection.started = true;
+    String head = "HTTP/1.1 " + String(response->_code) + " " + reasonPhrase(response->_code) + "\r\n";
+    if (response->_contentType.length() > 0)
+      head += "Content-Type: " + response->_contentType + "\r\n";
+    if (response->_chunked)
+      head += "Transfer-Encoding: chunked\r\n";
+    else
+      head += "Content-Length: " + String((unsigned long)response->_contentLength) + "\r\n";
+    for (const AsyncWebHeader &header : response->_headers)
+      head += header.name() + ": " + header.value() + "\r\n";
+    head += "Connection: close\r\n\r\n";
+    connection.output.assign(head.c_str(), head.length());
+  }
+
+  // Pull more of the body once the previous piece is out
+  if (connection.sent == connection.output.size() && !connection.finished)
+  {
+    connection.output.clear();
+    connection.sent = 0;
+
+    uint8_t buffer[EMU_HTTP_FILL_CHUNK];
+    size_t room = response->_chunked ? sizeof(buffer) : response->_contentLength - connection.filled;
+    if (room > sizeof(buffer))
+      room = sizeof(buffer);
+    size_t produced = room > 0 ? response->_filler(buffer, room, connection.filled) : 0;
+
+    if (produced == RESPONSE_TRY_AGAIN)
+      return true;
+    if (produced > room)
+      produced = room;
+    connection.filled += produced;
+
+    if (response->_chunked)
+    {
+      char size[16];
+      snprintf(size, sizeof(size), "%zx\r\n", produced);
+      connection.output = size;
+      connection.output.append((const char *)buffer, produced);
+      connection.output += "\r\n";
+      connection.finished = produced == 0;
+    }
+    else
+    {
+      connection.output.assign((const char *)buffer, produced);
+      connection.finished = connection.filled >= response->_contentLength || produced == 0;
+    }
+  }
+
+  while (connection.sent < connection.output.size())
+  {
+    ssize_t n = ::send(connection.fd, connection.output.data() + connection.sent, connection.output.size() - connection.sent, MSG_NOSIGNAL);
+    if (n < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    connection.sent += n;
+  }
+  return !(connection.finished && connection.sent == connection.output.size());
+}
@@ -0,0 +1,15 @@
+#include "Emulator.h"
+
+// Arduino entry points, as the ESP32 core's loopTask runs them
+void setup();
+void loop();
+
+int main(int argc, char **argv)
+{
+  if (!Emulator::begin(argc, argv))
+    return 2;
+
+  setup();
+  while (true)
+    loop();
+}
@@ -0,0 +1,8 @@
+#ifndef WIFI_CONFIG_H
+#define WIFI_CONFIG_H
+
+// The emulator is always on the host's network; these are only logged
+#define WIFI_SSID "emulator"
+#define WIFI_PASSWORD ""
+
+#endif // WIFI_CONFIG_H
@@ -0,0 +1,145 @@
+#include "BlindModel.h"
+#include <Arduino.h>
+#include "config.h"
+
+void BlindModel::reset(int64_t travelSteps, int64_t overtravelSteps, int64_t start, uint32_t seed)
+{
+  *this = BlindModel();
+  travel = travelSteps;
+  overtravel = overtravelSteps;
+  carriage = start;
+  travel2 = travelSteps;
+  carriage2 = start;
+  rng = seed;
+  updateSwitches();
+  updateSecondSwitches();
+}
+
+void BlindModel::setSecondTravel(int64_t steps)
+{
+  carriage2 = travel > 0 ? carriage * steps / travel : carriage;
+  travel2 = steps;
+  updateSecondSwitches();
+}
+
+int64_t BlindModel::skew() const
+{
+  return carriage2 - (travel > 0 ? carriage * travel2 / travel : carriage);
+}
+
+uint32_t BlindModel::nextRandom()
+{
+  // xorshift32: cheap and identical on every host
+  uint32_t x = rng;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  rng = x;
+  return x;
+}
+
+// A switch closes at its end of travel and, with bounce enabled, chatters
+// on the approach: the lever touches intermittently a few steps early.
+// Contacts are settled once per step pulse, so every change is an edge
+// at a known time.
+bool BlindModel::switchClosed(int64_t distance)
+{
+  if (distance <= 0)
+    return true;
+  if (distance <= bounceSteps)
+    return nextRandom() % 4 == 0;
+  return false;
+}
+
+void BlindModel::updateSwitches()
+{
+  retractedClosed = switchClosed(carriage);
+  deployedClosed = switchClosed(travel - carriage);
+}
+
+void BlindModel::updateSecondSwitches()
+{
+  retracted2Closed = switchClosed(carriage2);
+  deployed2Closed = switchClosed(travel2 - carriage2);
+}
+
+void BlindModel::step()
+{
+  if (loseStepEvery > 0 && ++stepCounter % loseStepEvery == 0)
+    stepsLost++;
+  else
+  {
+    int64_t next = carriage + (forward ? 1 : -1);
+    if (next < -overtravel || next > travel + overtravel)
+      stepsJammed++;
+    else
+      carriage = next;
+  }
+  updateSwitches();
+}
+
+void BlindModel::stepSecond()
+{
+  int64_t next = carriage2 + (forward2 ? 1 : -1);
+  if (next < -overtravel || next > travel2 + overtravel)
+    stepsJammed++;
+  else
+    carriage2 = next;
+  updateSecondSwitches();
+}
+
+bool BlindModel::write(uint8_t pin, uint8_t value)
+{
+  switch (pin)
+  {
+  case EN_PIN:
+    driverEnabled = value == LOW;
+    break;
+  case DIR_PIN:
+    forward = value == HIGH;
+    break;
+  case STEP_PIN:
+  {
+    bool edge = value == HIGH && !stepLevel && driverEnabled;
+    stepLevel = value == HIGH;
+    if (edge)
+      step();
+    return edge;
+  }
+  case DIR2_PIN:
+    forward2 = (value == HIGH) != (bool)DIR2_INVERTED;
+    break;
+  case STEP2_PIN:
+  {
+    bool edge = value == HIGH && !stepLevel2 && driverEnabled;
+    stepLevel2 = value == HIGH;
+    if (edge)
+      stepSecond();
+    return edge;
+  }
+  }
+  return false;
+}
+
+int BlindModel::read(uint8_t pin)
+{
+  switch (pin)
+  {
+  case LIMIT_RETRACTED:
+    return retractedClosed ? LOW : HIGH;
+  case LIMIT_DEPLOYED:
+    return deployedClosed ? LOW : HIGH;
+  case LIMIT_RETRACTED2:
+    return retracted2Closed ? LOW : HIGH;
+  case LIMIT_DEPLOYED2:
+    return deployed2Closed ? LOW : HIGH;
+  }
+  return HIGH;
+}
+
+void BlindModel::powerOff()
+{
+  stepLevel = false;
+  stepLevel2 = false;
+  driverEnabled = false;
+}
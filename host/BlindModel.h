@@ -0,0 +1,63 @@
+#ifndef BLIND_MODEL_H
+#define BLIND_MODEL_H
+
+#include <stdint.h>
+
+// Simulated blind mechanism shared by the host builds: a carriage driven
+// through the stepper driver's EN/DIR/STEP pins between the two limit
+// switches. In dual-motor builds a second carriage at the other end of
+// the blind runs on STEP2/DIR2 between its own switches. Plain data, so
+// the simulator can keep it in memory shared across firmware boots.
+struct BlindModel
+{
+  int64_t carriage;   // Steps from the retracted switch
+  int64_t travel;     // Steps between the retracted and deployed switches
+  int64_t overtravel; // Steps past a switch before the carriage jams
+  bool driverEnabled;
+  bool forward;
+  bool stepLevel;
+  uint32_t loseStepEvery; // Drop every Nth step pulse (0 = none)
+  uint32_t stepCounter;
+  int32_t bounceSteps; // Steps before each switch where it chatters (0 = clean)
+  bool retractedClosed; // Switch contacts, which only change as the carriage moves
+  bool deployedClosed;
+  uint32_t rng;
+  uint32_t stepsLost;
+  uint32_t stepsJammed;
+
+  // Second side, on the shared enable line
+  int64_t carriage2;
+  int64_t travel2; // May differ from travel: the skew the firmware learns
+  bool forward2;
+  bool stepLevel2;
+  bool retracted2Closed;
+  bool deployed2Closed;
+
+  void reset(int64_t travelSteps, int64_t overtravelSteps, int64_t start, uint32_t seed);
+
+  // Give the second side its own travel; its carriage keeps its place
+  // relative to the first
+  void setSecondTravel(int64_t steps);
+
+  // How far the second side is from where the first side's position puts
+  // it, with the difference in travel spread along the way
+  int64_t skew() const;
+
+  // Output pin change; true when it was a step pulse the enabled driver saw
+  // (the switches may have changed)
+  bool write(uint8_t pin, uint8_t value);
+  int read(uint8_t pin);
+
+  // Power cut: the driver drops out wherever the carriage is
+  void powerOff();
+
+private:
+  uint32_t nextRandom();
+  bool switchClosed(int64_t distance);
+  void updateSwitches();
+  void updateSecondSwitches();
+  void step();
+  void stepSecond();
+};
+
+#endif // BLIND_MODEL_H
@@ -0,0 +1,271 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino core the firmware uses. The
+// shim headers only declare; each host build supplies the bodies. The
+// scenario simulator (sim/) runs on a virtual clock that delay() and
+// delayMicroseconds() advance, the emulator (emu/) on the wall clock.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <string>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define CHANGE 3
+#define DEC 10
+#define HEX 16
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR // Host "RTC memory" does not outlive the process: every boot is a power-on
+
+#define ARDUINO_RUNNING_CORE 1
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+// Pin-change handlers run on the task whose step pulse moved a switch
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t pin, void (*handler)(), int mode);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+unsigned long millis();
+unsigned long micros();
+
+// No PSRAM on the host
+inline bool psramFound() { return false; }
+inline void *ps_malloc(size_t size) { return malloc(size); }
+
+uint32_t esp_random();
+void configTzTime(const char *tz, const char *server1, const char *server2 = NULL, const char *server3 = NULL);
+
+class String
+{
+public:
+  String(const char *s = "") : text(s ? s : "") {}
+  String(const std::string &s) : text(s) {}
+  String(char c) : text(1, c) {}
+  String(unsigned char value, unsigned char base = DEC) : text(format((unsigned long long)value, base)) {}
+  String(int value, unsigned char base = DEC) : text(format((long long)value, base)) {}
+  String(unsigned int value, unsigned char base = DEC) : text(format((unsigned long long)value, base)) {}
+  String(long value, unsigned char base = DEC) : text(format((long long)value, base)) {}
+  String(unsigned long value, unsigned char base = DEC) : text(format((unsigned long long)value, base)) {}
+  String(long long value, unsigned char base = DEC) : text(format(value, base)) {}
+  String(unsigned long long value, unsigned char base = DEC) : text(format(value, base)) {}
+  String(float value, unsigned int decimals = 2) : String((double)value, decimals) {}
+  String(double value, unsigned int decimals = 2)
+  {
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+    text = buf;
+  }
+
+  const char *c_str() const { return text.c_str(); }
+  size_t length() const { return text.size(); }
+  bool isEmpty() const { return text.empty(); }
+  bool reserve(size_t size)
+  {
+    text.reserve(size);
+    return true;
+  }
+  long toInt() const { return strtol(text.c_str(), NULL, 10); }
+  float toFloat() const { return (float)toDouble(); }
+  double toDouble() const { return strtod(text.c_str(), NULL); }
+  char operator[](size_t i) const { return i < text.size() ? text[i] : 0; }
+  bool operator==(const String &other) const { return text == other.text; }
+  bool operator!=(const String &other) const { return text != other.text; }
+  bool equalsIgnoreCase(const String &other) const { return strcasecmp(text.c_str(), other.text.c_str()) == 0; }
+  bool startsWith(const String &prefix) const { return text.compare(0, prefix.text.size(), prefix.text) == 0; }
+  bool endsWith(const String &suffix) const
+  {
+    return text.size() >= suffix.text.size() && text.compare(text.size() - suffix.text.size(), suffix.text.size(), suffix.text) == 0;
+  }
+
+  int indexOf(char c, unsigned int from = 0) const { return find(text.find(c, from)); }
+  int indexOf(const String &s, unsigned int from = 0) const { return find(text.find(s.text, from)); }
+  int lastIndexOf(char c) const { return find(text.rfind(c)); }
+  String substring(unsigned int from) const { return from < text.size() ? String(text.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const
+  {
+    if (from > to)
+      std::swap(from, to);
+    return from < text.size() ? String(text.substr(from, to - from)) : String();
+  }
+
+  void trim()
+  {
+    size_t begin = 0;
+    size_t end = text.size();
+    while (begin < end && isspace((unsigned char)text[begin]))
+      begin++;
+    while (end > begin && isspace((unsigned char)text[end - 1]))
+      end--;
+    text = text.substr(begin, end - begin);
+  }
+  void toLowerCase()
+  {
+    for (char &c : text)
+      c = (char)tolower((unsigned char)c);
+  }
+  void toUpperCase()
+  {
+    for (char &c : text)
+      c = (char)toupper((unsigned char)c);
+  }
+
+  bool concat(const char *s, unsigned int len)
+  {
+    text.append(s, len);
+    return true;
+  }
+  String &operator+=(const String &other)
+  {
+    text += other.text;
+    return *this;
+  }
+  String &operator+=(const char *s)
+  {
+    text += s;
+    return *this;
+  }
+  String &operator+=(char c)
+  {
+    text += c;
+    return *this;
+  }
+  friend String operator+(const String &a, const String &b) { return String(a.text + b.text); }
+  friend String operator+(const String &a, const char *b) { return String(a.text + b); }
+  friend String operator+(const char *a, const String &b) { return String(a + b.text); }
+
+private:
+  static int find(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+  static std::string format(long long value, unsigned char base)
+  {
+    if (value < 0)
+      return "-" + format((unsigned long long)-value, base);
+    return format((unsigned long long)value, base);
+  }
+  static std::string format(unsigned long long value, unsigned char base)
+  {
+    char buf[32];
+    snprintf(buf, sizeof(buf), base == HEX ? "%llX" : "%llu", value);
+    return buf;
+  }
+
+  std::string text;
+};
+
+class Print;
+
+class Printable
+{
+public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print &out) const = 0;
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size)
+  {
+    size_t written = 0;
+    while (size--)
+      written += write(*buffer++);
+    return written;
+  }
+  size_t write(const char *s, size_t len) { return write((const uint8_t *)s, len); }
+  virtual void flush() {}
+
+  size_t print(const char *s) { return write(s, strlen(s)); }
+  size_t print(const String &s) { return write(s.c_str(), s.length()); }
+  size_t print(const Printable &p) { return p.printTo(*this); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(long long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned long long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, (unsigned int)decimals)); }
+
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(const T &value)
+  {
+    return print(value) + println();
+  }
+  template <typename T>
+  size_t println(const T &value, int format)
+  {
+    return print(value, format) + println();
+  }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)))
+  {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0)
+      return 0;
+    return write(buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+  }
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+};
+
+// Firmware console. The simulator keeps it quiet unless asked; the
+// emulator maps it to the terminal.
+class HardwareSerial : public Stream
+{
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+
+  bool enabled = false;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+public:
+  void restart();
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+};
+
+extern EspClass ESP;
+
+#endif // HOST_ARDUINO_H
@@ -0,0 +1,67 @@
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <Arduino.h>
+
+// Like the ESP32 core, writes land in a RAM copy and only reach the
+// (simulated, power-loss safe) backing store on commit()
+class EEPROMClass
+{
+public:
+  bool begin(size_t size);
+  bool commit();
+
+  uint8_t read(int address) { return data[address]; }
+  void write(int address, uint8_t value) { data[address] = value; }
+
+  template <typename T>
+  T &get(int address, T &value)
+  {
+    memcpy(&value, data + address, sizeof(T));
+    return value;
+  }
+  template <typename T>
+  const T &put(int address, const T &value)
+  {
+    memcpy(data + address, &value, sizeof(T));
+    return value;
+  }
+
+  uint16_t readUShort(int address) { return readValue<uint16_t>(address); }
+  int32_t readLong(int address) { return readValue<int32_t>(address); }
+  int64_t readLong64(int address) { return readValue<int64_t>(address); }
+  size_t writeUShort(int address, uint16_t value) { return writeValue(address, value); }
+  size_t writeLong(int address, int32_t value) { return writeValue(address, value); }
+  size_t writeLong64(int address, int64_t value) { return writeValue(address, value); }
+  size_t readBytes(int address, void *value, size_t length)
+  {
+    memcpy(value, data + address, length);
+    return length;
+  }
+  size_t writeBytes(int address, const void *value, size_t length)
+  {
+    memcpy(data + address, value, length);
+    return length;
+  }
+
+private:
+  template <typename T>
+  T readValue(int address)
+  {
+    T value;
+    return get(address, value);
+  }
+  template <typename T>
+  size_t writeValue(int address, T value)
+  {
+    put(address, value);
+    return sizeof(T);
+  }
+
+  uint8_t data[4096] = {};
+  size_t size = 0;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // HOST_EEPROM_H
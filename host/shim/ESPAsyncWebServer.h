@@ -0,0 +1,164 @@
+#ifndef HOST_ESPASYNCWEBSERVER_H
+#define HOST_ESPASYNCWEBSERVER_H
+
+// The subset of ESPAsyncWebServer 3.x the firmware uses. The emulator
+// serves it over host sockets from one "async_tcp" task, so handlers run
+// one at a time on that task, as they do on the board.
+
+#include <Arduino.h>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#define RESPONSE_TRY_AGAIN 0xFFFFFFFF // Filler has nothing yet; call again later
+
+typedef enum
+{
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebParameter
+{
+public:
+  AsyncWebParameter(const String &name, const String &value, bool form = false, bool file = false, size_t size = 0)
+      : _name(name), _value(value), _size(size), _isForm(form), _isFile(file) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+  size_t size() const { return _size; }
+  bool isPost() const { return _isForm; }
+  bool isFile() const { return _isFile; }
+
+private:
+  String _name;
+  String _value;
+  size_t _size;
+  bool _isForm;
+  bool _isFile;
+};
+
+class AsyncWebHeader
+{
+public:
+  AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+
+private:
+  String _name;
+  String _value;
+};
+
+typedef std::function<size_t(uint8_t *buffer, size_t maxLen, size_t index)> AwsResponseFiller;
+typedef std::function<void()> ArDisconnectHandler;
+
+class AsyncWebServerResponse
+{
+public:
+  AsyncWebServerResponse(int code, const String &contentType, size_t contentLength, bool chunked, AwsResponseFiller filler)
+      : _code(code), _contentType(contentType), _contentLength(contentLength), _chunked(chunked), _filler(filler) {}
+  void setCode(int code) { _code = code; }
+  void setContentType(const String &type) { _contentType = type; }
+  void addHeader(const String &name, const String &value) { _headers.push_back(AsyncWebHeader(name, value)); }
+
+private:
+  friend class AsyncWebServer;
+
+  int _code;
+  String _contentType;
+  size_t _contentLength;
+  bool _chunked;
+  AwsResponseFiller _filler;
+  std::vector<AsyncWebHeader> _headers;
+};
+
+class AsyncWebServerRequest
+{
+public:
+  ~AsyncWebServerRequest();
+
+  WebRequestMethodComposite method() const { return _method; }
+  const String &url() const { return _url; }
+
+  size_t params() const { return _params.size(); }
+  const AsyncWebParameter *getParam(size_t index) const;
+  bool hasParam(const String &name, bool post = false, bool file = false) const;
+  const AsyncWebParameter *getParam(const String &name, bool post = false, bool file = false) const;
+
+  size_t headers() const { return _headers.size(); }
+  bool hasHeader(const String &name) const;
+  const AsyncWebHeader *getHeader(const String &name) const;
+  String header(const char *name) const;
+
+  void send(AsyncWebServerResponse *response);
+  void send(int code, const String &contentType = String(), const String &content = String());
+  void send(int code, const char *contentType, const uint8_t *content, size_t len);
+
+  AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String());
+  AsyncWebServerResponse *beginResponse(int code, const char *contentType, const uint8_t *content, size_t len);
+  AsyncWebServerResponse *beginChunkedResponse(const String &contentType, AwsResponseFiller filler);
+
+  void onDisconnect(ArDisconnectHandler handler) { _disconnectHandlers.push_back(handler); }
+
+  void *_tempObject = NULL; // Handler scratch, free()d with the request
+
+private:
+  friend class AsyncWebServer;
+
+  WebRequestMethodComposite _method = 0;
+  String _url;
+  std::vector<AsyncWebParameter> _params;
+  std::vector<AsyncWebHeader> _headers;
+  AsyncWebServerResponse *_response = NULL;
+  std::vector<ArDisconnectHandler> _disconnectHandlers;
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)> ArBodyHandlerFunction;
+
+class AsyncCallbackWebHandler
+{
+public:
+  String uri;
+  WebRequestMethodComposite method;
+  ArRequestHandlerFunction onRequest;
+  ArUploadHandlerFunction onUpload;
+  ArBodyHandlerFunction onBody;
+};
+
+class AsyncWebServer
+{
+public:
+  AsyncWebServer(uint16_t port) : _port(port) {}
+  ~AsyncWebServer();
+
+  void begin();
+  AsyncCallbackWebHandler &on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                              ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr);
+  void onNotFound(ArRequestHandlerFunction handler) { _notFound = handler; }
+
+private:
+  struct Connection;
+
+  static void task(void *server);
+  void serve();
+  bool receive(Connection &connection);
+  void dispatch(Connection &connection);
+  bool transmit(Connection &connection);
+
+  uint16_t _port;
+  int _listener = -1;
+  std::vector<AsyncCallbackWebHandler *> _handlers;
+  ArRequestHandlerFunction _notFound;
+};
+
+#endif // HOST_ESPASYNCWEBSERVER_H
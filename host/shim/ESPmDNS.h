@@ -0,0 +1,16 @@
+#ifndef HOST_ESPMDNS_H
+#define HOST_ESPMDNS_H
+
+#include <Arduino.h>
+
+class MDNSResponder
+{
+public:
+  bool begin(const char *hostName);
+  void end();
+  bool addService(const char *service, const char *proto, uint16_t port);
+};
+
+extern MDNSResponder MDNS;
+
+#endif // HOST_ESPMDNS_H
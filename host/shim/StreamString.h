@@ -0,0 +1,26 @@
+#ifndef HOST_STREAMSTRING_H
+#define HOST_STREAMSTRING_H
+
+#include <Arduino.h>
+
+class StreamString : public Stream, public String
+{
+public:
+  size_t write(uint8_t c) override
+  {
+    concat((const char *)&c, 1);
+    return 1;
+  }
+  size_t write(const uint8_t *buffer, size_t size) override
+  {
+    concat((const char *)buffer, size);
+    return size;
+  }
+  int available() override { return length() - readIndex; }
+  int read() override { return readIndex < length() ? (*this)[readIndex++] : -1; }
+
+private:
+  size_t readIndex = 0;
+};
+
+#endif // HOST_STREAMSTRING_H
@@ -0,0 +1,74 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include <Arduino.h>
+
+class IPAddress : public Printable
+{
+public:
+  IPAddress() : address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address((uint32_t)a | (uint32_t)b << 8 | (uint32_t)c << 16 | (uint32_t)d << 24) {}
+  operator uint32_t() const { return address; }
+  uint8_t operator[](int index) const { return (uint8_t)(address >> (8 * index)); }
+
+  String toString() const
+  {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+    return String(buf);
+  }
+  size_t printTo(Print &out) const override { return out.print(toString()); }
+
+private:
+  uint32_t address; // Network byte order, as on the ESP32
+};
+
+typedef enum
+{
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum
+{
+  WIFI_POWER_8_5dBm = 34
+} wifi_power_t;
+
+class WiFiClass
+{
+public:
+  bool begin(const char *ssid, const char *password);
+  bool disconnect(bool wifiOff = false);
+  bool reconnect();
+  void persistent(bool persistent);
+  bool mode(wifi_mode_t mode);
+  bool setAutoReconnect(bool autoReconnect);
+  bool setSleep(bool enabled);
+  bool setTxPower(wifi_power_t power);
+  wl_status_t status();
+  String macAddress();
+  uint8_t *macAddress(uint8_t *mac);
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP();
+  int8_t RSSI();
+  int32_t channel();
+};
+
+extern WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
@@ -0,0 +1,36 @@
+#ifndef HOST_MINIZ_H
+#define HOST_MINIZ_H
+
+// The ROM inflater's interface; the host builds implement it over zlib
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TINFL_LZ_DICT_SIZE 32768
+
+enum
+{
+  TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+  TINFL_FLAG_HAS_MORE_INPUT = 2,
+  TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4
+};
+
+typedef enum
+{
+  TINFL_STATUS_FAILED = -1,
+  TINFL_STATUS_DONE = 0,
+  TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+  TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+typedef struct
+{
+  void *stream; // Created on the first call
+} tinfl_decompressor;
+
+#define tinfl_init(r) ((r)->stream = NULL)
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const uint8_t *in, size_t *inSize, uint8_t *outStart,
+                              uint8_t *outNext, size_t *outSize, const uint32_t flags);
+
+#endif // HOST_MINIZ_H
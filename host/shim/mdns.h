@@ -0,0 +1,15 @@
+#ifndef HOST_MDNS_H
+#define HOST_MDNS_H
+
+#include <stdint.h>
+#include "esp_system.h"
+
+typedef struct
+{
+  const char *key;
+  const char *value;
+} mdns_txt_item_t;
+
+esp_err_t mdns_service_txt_set(const char *service, const char *proto, mdns_txt_item_t txt[], uint8_t count);
+
+#endif // HOST_MDNS_H
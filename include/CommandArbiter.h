@@ -0,0 +1,70 @@
+#ifndef COMMAND_ARBITER_H
+#define COMMAND_ARBITER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "MotorControl.h"
+
+// Priority between command sources, in front of the single pending
+// command slot. A manual command (a person at the web page) always goes
+// through and opens a hold window; until it closes, automation (API
+// scripts, the schedule, group commands) is deferred or dropped, as
+// configured. A deferred command waits in one slot, newest wins, and runs
+// when the window closes. A manual command also preempts a deploy or
+// retract that automation started; calibration always runs to the end.
+class CommandArbiter
+{
+public:
+  static void begin();
+
+  // Any task, from MotorControl::queueCommand()
+  static CommandDecision admit(MotorCommand cmd, CommandSource source);
+  static void preemptFor(CommandSource source);
+
+  // Motor task: bracket each command it runs
+  static void beginCommand(MotorCommand cmd, CommandSource source);
+  static void endCommand();
+
+  // Motor task: the deferred command, once the hold has expired
+  static MotorCommand takeDeferred(CommandSource &source);
+  static MotorCommand peekDeferred();
+
+  static bool isManual(CommandSource source);
+  static uint32_t getHoldRemainingMs();
+
+  // Settings (persisted immediately)
+  static uint32_t getHoldMs();
+  static bool getDeferDuringHold();
+  static void setHold(uint32_t holdMs, bool deferDuringHold);
+
+  static CommandSource parseSource(const String &name);
+  static const char *sourceName(CommandSource source);
+
+  static void writeJSON(Print &out);
+  static void writeMetrics(Print &out);
+
+private:
+  struct SourceStats
+  {
+    uint32_t received;
+    uint32_t accepted;
+    uint32_t deferred;
+    uint32_t dropped;
+    uint32_t preempted; // Moves cut short by a manual command
+  };
+
+  static uint32_t holdRemaining(unsigned long now);
+
+  static SourceStats stats[SOURCE_COUNT];
+  static uint32_t holdMs;
+  static bool deferDuringHold;
+  static bool manualSeen;
+  static unsigned long lastManualMs;
+  static MotorCommand deferredCommand;
+  static CommandSource deferredSource;
+  static MotorCommand runningCommand;
+  static CommandSource runningSource;
+  static portMUX_TYPE lock;
+};
+
+#endif // COMMAND_ARBITER_H
@@ -0,0 +1,65 @@
+#ifndef COMMAND_BUS_H
+#define COMMAND_BUS_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "CommandTransport.h"
+#include "MotorControl.h"
+
+// Group commands between nodes, in front of MotorControl::queueCommand().
+//
+// Any node can act as a remote: broadcast() sends a command to a group
+// bitmask over every registered transport and queues it locally if this
+// node is a member. Receivers drop packets from other installations,
+// repeats (by sender and sequence) and commands for groups they are not in.
+class CommandBus
+{
+public:
+  // Call after WiFi has been started (ESP-NOW needs the radio)
+  static void begin();
+  static void addTransport(CommandTransport *transport);
+
+  // Web task: poll transports
+  static void service();
+
+  static bool broadcast(MotorCommand command, uint8_t groups);
+
+  // Called by transports for every frame they receive
+  static void receive(const uint8_t *data, size_t length, CommandTransport *source);
+
+  static uint8_t getGroups();
+  static void setGroups(uint8_t groups);
+  static uint8_t parseGroups(const String &list);
+
+  static void writeJSON(Print &out);
+
+private:
+  static bool isRepeat(uint32_t nodeId, uint32_t sequence);
+
+  struct PeerState
+  {
+    uint32_t nodeId;
+    uint32_t sequence;
+    uint32_t lastSeenMs;
+  };
+
+  struct TransportStats
+  {
+    uint32_t sent;
+    uint32_t received;
+  };
+
+  static CommandTransport *transports[REMOTE_MAX_TRANSPORTS];
+  static TransportStats stats[REMOTE_MAX_TRANSPORTS];
+  static size_t transportCount;
+  static PeerState peers[REMOTE_DEDUP_SLOTS];
+  static uint32_t nodeId;
+  static uint32_t sequence;
+  static uint8_t groups;
+  static uint32_t accepted;
+  static uint32_t repeats;
+  static uint32_t rejected;
+  static portMUX_TYPE lock;
+};
+
+#endif // COMMAND_BUS_H
@@ -0,0 +1,36 @@
+#ifndef COMMAND_TRANSPORT_H
+#define COMMAND_TRANSPORT_H
+
+#include <Arduino.h>
+
+// Wire format shared by every transport (little-endian, 20 bytes)
+struct CommandPacket
+{
+  uint32_t magic;     // COMMAND_PACKET_MAGIC
+  uint32_t networkId; // REMOTE_NETWORK_ID of the sender's installation
+  uint32_t nodeId;    // Random per boot, identifies the sender
+  uint32_t sequence;  // Per-sender, increasing; repeats are dropped
+  uint8_t command;    // MotorCommand
+  uint8_t groups;     // Target group bitmask
+  uint8_t reserved[2];
+};
+
+#define COMMAND_PACKET_MAGIC 0x31434242 // "BBC1"
+
+// A link that carries CommandPackets between nodes. Transports deliver
+// incoming frames to CommandBus::receive() from whatever task or callback
+// they receive on.
+class CommandTransport
+{
+public:
+  virtual ~CommandTransport() {}
+
+  virtual const char *name() const = 0;
+  virtual bool begin() = 0;
+  virtual bool send(const CommandPacket &packet) = 0;
+
+  // Called periodically from the web task (for transports that poll)
+  virtual void poll() {}
+};
+
+#endif // COMMAND_TRANSPORT_H
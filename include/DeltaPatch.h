@@ -0,0 +1,104 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming applier for delta firmware images built by tools/ota_delta.py.
+//
+// Patch format (all integers little-endian):
+//   header  "BBDP" | version u8 | flags u8 | reserved u16
+//           | sourceSize u32 | sourceCrc u32 | targetSize u32 | targetCrc u32
+//   ops     0x01 COPY   varint offset, varint length   (bytes from the source image)
+//           0x02 INSERT varint length, <length bytes>  (literal bytes)
+//           0x00 END
+//
+// The patch is fed in arbitrary chunks as it arrives; output is produced
+// immediately through the writer callback, so neither the patch nor the
+// target image is ever held in memory. Plain C++ with no Arduino
+// dependencies so it also builds on the host.
+class DeltaPatch
+{
+public:
+  typedef bool (*SourceReader)(uint32_t offset, uint8_t *buffer, size_t length, void *context);
+  typedef bool (*TargetWriter)(const uint8_t *data, size_t length, void *context);
+
+  enum Status
+  {
+    PATCH_OK,
+    PATCH_DONE,
+    PATCH_BAD_HEADER,
+    PATCH_BAD_OPCODE,
+    PATCH_SOURCE_MISMATCH,
+    PATCH_SOURCE_RANGE,
+    PATCH_READ_FAILED,
+    PATCH_WRITE_FAILED,
+    PATCH_SIZE_MISMATCH,
+    PATCH_CRC_MISMATCH,
+    PATCH_TRAILING_DATA,
+    PATCH_INCOMPLETE
+  };
+
+  static const uint8_t MAGIC[4];
+  static const uint8_t VERSION = 1;
+  static const size_t HEADER_SIZE = 24;
+
+  void begin(SourceReader reader, TargetWriter writer, void *context);
+
+  // Consume the next chunk of patch data
+  Status feed(const uint8_t *data, size_t length);
+
+  // Call after the last chunk; verifies the patch was complete
+  Status finish();
+
+  uint32_t getTargetSize() const { return targetSize; }
+  uint32_t getBytesWritten() const { return written; }
+
+  static const char *statusName(Status status);
+  static uint32_t crc32(uint32_t crc, const uint8_t *data, size_t length);
+
+private:
+  enum State
+  {
+    ST_HEADER,
+    ST_OPCODE,
+    ST_ARG1,
+    ST_ARG2,
+    ST_INSERT,
+    ST_DONE,
+    ST_FAILED
+  };
+
+  Status parseHeader();
+  Status verifySource();
+  Status copyFromSource(uint32_t offset, uint32_t length);
+  Status emit(const uint8_t *data, size_t length);
+  bool readVarint(uint8_t byte, uint32_t &value);
+  bool varintOverflows(uint8_t byte) const;
+  Status fail(Status status);
+
+  SourceReader reader;
+  TargetWriter writer;
+  void *context;
+
+  State state;
+  Status failure;
+  uint8_t header[HEADER_SIZE];
+  size_t headerLength;
+
+  uint8_t opcode;
+  uint32_t arg1;
+  uint32_t arg2;
+  uint32_t varintValue;
+  uint8_t varintShift;
+  uint32_t insertRemaining;
+
+  uint32_t sourceSize;
+  uint32_t sourceCrc;
+  uint32_t targetSize;
+  uint32_t targetCrc;
+  uint32_t written;
+  uint32_t runningCrc;
+};
+
+#endif // DELTA_PATCH_H
@@ -0,0 +1,30 @@
+#ifndef DISCOVERY_H
+#define DISCOVERY_H
+
+#include <Arduino.h>
+
+// Advertises the controller as _birdblinds._tcp over mDNS. TXT records
+// carry the firmware version, calibration state, position and motion
+// state, so one DNS-SD browse gives a dashboard the whole fleet.
+// Records are republished when they change, at most once per
+// DISCOVERY_MIN_UPDATE_MS, to keep multicast traffic low during moves.
+class Discovery
+{
+public:
+  // Web task: starts mDNS once WiFi is up, then keeps TXT records current
+  static void service();
+
+  static String getHostname();
+
+private:
+  static bool start();
+  static void publish(bool force);
+
+  static bool started;
+  static unsigned long lastUpdateMs;
+  static bool lastCalibrated;
+  static int lastPercent;
+  static const char *lastState;
+};
+
+#endif // DISCOVERY_H
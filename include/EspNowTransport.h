@@ -0,0 +1,17 @@
+#ifndef ESPNOW_TRANSPORT_H
+#define ESPNOW_TRANSPORT_H
+
+#include "CommandTransport.h"
+
+// Connectionless broadcast between nodes on the same WiFi channel; works
+// without an access point and typically delivers in a few milliseconds.
+class EspNowTransport : public CommandTransport
+{
+public:
+  const char *name() const override { return "espnow"; }
+  bool begin() override;
+  bool send(const CommandPacket &packet) override;
+  void poll() override;
+};
+
+#endif // ESPNOW_TRANSPORT_H
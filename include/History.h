@@ -0,0 +1,114 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include "config.h"
+
+// Event codes stored with each record (3 bits)
+enum HistoryEvent
+{
+  HIST_SAMPLE,
+  HIST_MOVE_START,
+  HIST_MOVE_END,
+  HIST_LIMIT_RETRACTED,
+  HIST_LIMIT_DEPLOYED,
+  HIST_CALIBRATED,
+  HIST_ABORT,
+  HIST_BOOT
+};
+
+// Compact motion history in a ring of flash sectors ("history" partition).
+//
+// Each 4 KB sector is one block: a header with the block's base time and
+// position, then records of (time delta << 3 | event) and zigzag position
+// delta, both varint-packed; a typical sample is 3-4 bytes. Records are
+// staged in RAM and appended to the open block in length-prefixed chunks,
+// so every flash byte is programmed once and each sector erased once per
+// trip around the ring; when the ring is full the oldest block is
+// reclaimed. Appends are held back while the motor moves, as flash
+// writes stall both cores. Records taken before NTP sets the clock are
+// kept in RAM by uptime and given epoch times once it is set.
+class History
+{
+public:
+  static void begin();
+
+  // Queue a record from any task (never blocks)
+  static void record(HistoryEvent event, int64_t position);
+
+  // Persistence task: sample while moving, encode queued records, flush
+  static void service();
+
+  static bool isAvailable();
+  static uint32_t getDroppedRecords();
+
+  // Streaming range query, producing JSON in arbitrary-sized pieces
+  class Cursor
+  {
+  public:
+    Cursor(int64_t fromMs, int64_t toMs);
+    ~Cursor();
+
+    // Fill up to maxLength bytes; returns 0 when the query is complete
+    size_t read(uint8_t *buffer, size_t maxLength);
+
+  private:
+    bool nextRecord();
+    bool loadBlock();
+
+    int64_t fromMs;
+    int64_t toMs;
+    uint8_t *block;
+    uint32_t blocksVisited;
+    size_t chunkEnd;
+    size_t offset;
+    int64_t timeMs;
+    int64_t position;
+    uint8_t event;
+    bool started;
+    bool finished;
+    uint32_t emitted;
+    char pending[64];
+    size_t pendingLength;
+    size_t pendingOffset;
+  };
+
+private:
+  struct Entry
+  {
+    int64_t timeMs; // Epoch ms, or millis() while the clock is unset
+    int64_t position;
+    uint8_t event;
+    bool clockSet;
+  };
+
+  static void hold(const Entry &entry);
+  static void releaseHeld();
+  static void append(const Entry &entry);
+  static bool flush();
+  static bool openBlock(const Entry &first);
+  static void scan();
+
+  static QueueHandle_t queue;
+  static bool available;
+  static uint32_t blockCount;
+  static uint32_t headIndex;
+  static uint32_t headSequence;
+  static size_t writeOffset;
+  static int64_t lastTimeMs;
+  static int64_t lastPosition;
+  static uint8_t staging[HISTORY_STAGING_BYTES];
+  static size_t stagingLength;
+  static unsigned long stagingSince;
+  static unsigned long lastSampleMs;
+  static bool moveEnded;
+  static volatile uint32_t dropped;
+  static Entry held[HISTORY_HELD_RECORDS];
+  static uint8_t heldCount;
+
+  friend class Cursor;
+};
+
+#endif // HISTORY_H
@@ -0,0 +1,109 @@
+#ifndef LIMIT_SWITCHES_H
+#define LIMIT_SWITCHES_H
+
+#include <Arduino.h>
+#include "config.h"
+
+enum LimitSwitch
+{
+  SWITCH_RETRACTED,
+  SWITCH_DEPLOYED,
+  SWITCH_COUNT
+};
+
+#define SWITCH_BOUNCE_BUCKETS 6   // Bounces per burst: 0, 1, 2-3, 4-7, 8-15, 16+
+#define SWITCH_DURATION_BUCKETS 8 // Burst length up to 0.1, 0.5, 1, 2, 5, 10, 20 ms, longer
+
+// A level change on one of the limit switches
+struct SwitchEdge
+{
+  uint32_t us; // micros()
+  uint8_t sw;  // LimitSwitch
+  uint8_t closed;
+};
+
+// Debounced limit switches (the first motor's pair) and an edge analyzer
+// that tunes the debounce to each unit. A switch only changes state once
+// its contacts have held the new level for the debounce time, so chatter
+// on the approach cannot stop a move early.
+//
+// With capture on, a pin-change interrupt timestamps every edge into a
+// ring. update() groups the edges into bursts (edges closer together
+// than SWITCH_QUIET_US) and keeps, per switch, bounce count and duration
+// histograms and the longest gap between two edges of one burst: the
+// longest the contacts ever sat still before bouncing again. Once
+// SWITCH_TUNE_MIN_BURSTS have been seen, the debounce becomes that gap
+// plus SWITCH_DEBOUNCE_MARGIN_PERCENT, so a clean switch stops the motor
+// sooner and a worn one is still filtered. Tuned values are persisted.
+class LimitSwitches
+{
+public:
+  static void begin();
+
+  // Any task: debounced state
+  static bool isClosed(LimitSwitch sw);
+
+  // How long the contacts have held their current level: once isClosed()
+  // turns true, how long the switch was closed before it counted
+  static uint32_t getSettledUs(LimitSwitch sw);
+
+  // Debounced to closed (or open), and the contacts at that level without
+  // a break for at least minUs. Searches use it to tell the end of travel
+  // from chatter on the approach, which can outlast the debounce at low
+  // speed.
+  static bool isHeld(LimitSwitch sw, bool closed, uint32_t minUs);
+
+  // Fold captured edges into the statistics and retune
+  static void update();
+
+  static void setCapture(bool enabled);
+  static bool isCapturing();
+  static void resetStats(); // Keeps the tuned debounce until new bursts retune it
+  static uint32_t getDebounceUs(LimitSwitch sw);
+
+  static void writeJSON(Print &out);
+  static void writeMetrics(Print &out);
+
+private:
+  struct Contact
+  {
+    bool closed;         // Debounced
+    bool raw;            // Last level seen
+    uint32_t lastEdgeUs; // When raw last changed
+  };
+
+  struct BounceStats
+  {
+    uint32_t edges;
+    uint32_t bursts;
+    uint32_t bounces;
+    uint32_t maxGapUs;
+    uint32_t maxDurationUs;
+    uint32_t bounceHistogram[SWITCH_BOUNCE_BUCKETS];
+    uint32_t durationHistogram[SWITCH_DURATION_BUCKETS];
+
+    // Burst in progress
+    bool open;
+    uint32_t burstEdges;
+    uint32_t burstStartUs;
+    uint32_t lastEdgeUs;
+  };
+
+  static void onEdge(LimitSwitch sw, bool closed, uint32_t now);
+  static void closeBurst(BounceStats &s);
+  static void retractedEdge();
+  static void deployedEdge();
+  static uint8_t pinOf(LimitSwitch sw);
+
+  static Contact contacts[SWITCH_COUNT];
+  static BounceStats stats[SWITCH_COUNT];
+  static uint32_t debounceUs[SWITCH_COUNT];
+  static SwitchEdge edges[SWITCH_EDGE_BUFFER];
+  static uint32_t head; // Edges written; the slot is head % SWITCH_EDGE_BUFFER
+  static uint32_t tail; // Edges analyzed
+  static uint32_t dropped;
+  static bool capturing;
+  static portMUX_TYPE lock;
+};
+
+#endif // LIMIT_SWITCHES_H
@@ -0,0 +1,101 @@
+#ifndef LOG_SHIPPER_H
+#define LOG_SHIPPER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Syslog severities (RFC 5424) given to log lines by their prefix
+enum LogSeverity
+{
+  LOG_SEVERITY_ERROR = 3,   // "ERROR" or "Error"
+  LOG_SEVERITY_WARNING = 4, // "WARNING" or "Warning"
+  LOG_SEVERITY_INFO = 6     // Everything else
+};
+
+// Where log lines go besides the serial port
+struct LogShippingSettings
+{
+  char host[16];       // IPv4 address of the collector; empty ships nothing
+  uint16_t port;       // 514 for syslog
+  uint8_t maxSeverity; // Ship lines at this severity or more urgent
+  uint8_t reserved;
+};
+
+// Ships log output to a syslog or any other UDP collector. Console hands
+// over each line as it is printed, on whichever task prints it, and the
+// line is copied into a fixed pool of LOG_SHIP_SLOTS; nothing waits on
+// the network there. The web task's service() sends the pool as RFC 5424
+// messages, one per line, packed into as few datagrams of up to
+// LOG_SHIP_DATAGRAM_BYTES as they fit in.
+//
+// When the collector cannot keep up or the network is down, lines stay
+// pooled. Once the pool is full, a new line replaces the oldest of the
+// least urgent lines held, or is dropped when every line held is more
+// urgent, so errors outlast chatter.
+class LogShipper
+{
+public:
+  static void begin(); // After Storage::begin(); lines are pooled from here on
+  static void setHostname(const String &hostname);
+
+  // Web task: send what has been pooled
+  static void service();
+
+  // Any task (Console)
+  static void append(const uint8_t *data, size_t size);
+
+  static LogShippingSettings getSettings();
+  static void setSettings(const LogShippingSettings &settings);
+
+  // For settings from the web API
+  static bool isValidHost(const String &host); // Dotted IPv4 address
+  static int parseSeverity(const String &name); // "error", "warning", "info", "debug" or 0-7; -1 if neither
+
+  static void writeJSON(Print &out);
+  static void writeMetrics(Print &out);
+
+private:
+  struct Slot
+  {
+    uint32_t seq; // 0 while free; later lines get higher numbers
+    uint32_t ms;
+    uint8_t severity;
+    uint8_t length;
+    char text[LOG_SHIP_LINE_BYTES];
+  };
+
+  static void commitLine();
+  static bool takeNext(uint32_t after, Slot &out);
+  static void release(uint32_t upTo);
+  static size_t format(const Slot &slot, char *out, size_t capacity);
+  static bool openSocket();
+
+  static LogShippingSettings settings;
+  static bool active;
+  static char hostname[32];
+  static Slot slots[LOG_SHIP_SLOTS];
+  static uint32_t nextSeq;
+  static char partial[LOG_SHIP_LINE_BYTES]; // Line being printed
+  static size_t partialLength;
+  static uint32_t sentLines;
+  static uint32_t datagrams;
+  static uint32_t sendFailures;
+  static uint32_t dropped[8]; // By severity
+  static int sock;
+  static portMUX_TYPE lock;
+};
+
+// Print target for log output: writes to the serial port and hands the
+// text to LogShipper. Use it wherever a message is meant for whoever is
+// diagnosing the unit; Serial stays for the console's input.
+class ConsoleOutput : public Print
+{
+public:
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+};
+
+extern ConsoleOutput Console;
+
+#endif // LOG_SHIPPER_H
@@ -0,0 +1,69 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+// Lifetime totals, as checkpointed to EEPROM
+struct LifetimeCounters
+{
+  uint64_t steps;
+  uint32_t moves;
+  uint32_t retractedLimitHits;
+  uint32_t deployedLimitHits;
+  uint32_t runtimeSeconds;
+  uint32_t boots;
+  uint32_t checkpoints; // EEPROM writes of this block
+};
+
+// Health counters that survive reboots. Counters are updated in RAM by
+// any task and written to EEPROM by the persistence task via flush(),
+// so the motor task never waits on a flash commit.
+//
+// Lifetime totals (steps, moves, limit hits, runtime, boots) change far
+// too often to commit each time. They live in RTC memory, which keeps
+// them through software, panic and watchdog resets, and are checkpointed
+// to EEPROM every LIFETIME_CHECKPOINT_INTERVAL_S or after
+// LIFETIME_CHECKPOINT_MOVES moves, with the motor idle, and before a
+// planned restart. Losing power costs at most the moves since the last
+// checkpoint.
+class Metrics
+{
+public:
+  static void begin();
+
+  static void recordWatchdogReset();
+  static void recordMotionAbort();
+
+  // Any task
+  static void recordMove(int64_t steps);
+  static void recordLimitHit(bool deployed);
+
+  static uint32_t getWatchdogResets();
+  static uint32_t getMotionAborts();
+  static LifetimeCounters getLifetime();
+
+  // Commit counters to EEPROM if they changed since the last flush, and
+  // the lifetime totals when a checkpoint is due
+  static void flush();
+
+  // Commit everything now, e.g. before a restart
+  static void checkpoint();
+
+  // Prometheus samples for the lifetime totals
+  static void writeMetrics(Print &out);
+
+private:
+  static void accumulateRuntime(unsigned long now);
+  static uint32_t checksum(const LifetimeCounters &totals);
+  static void seal();
+
+  static portMUX_TYPE lock;
+  static uint32_t watchdogResets;
+  static uint32_t motionAborts;
+  static bool dirty;
+  static uint32_t unsavedMoves;
+  static unsigned long lastCheckpointMs;
+  static unsigned long runtimeMarkMs;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,44 @@
+#ifndef MOTION_PLANNER_H
+#define MOTION_PLANNER_H
+
+#include <Arduino.h>
+
+// Speeds the stepper runs at. Searches (calibration, homing) are always
+// conservative; ThermalModel decides whether a move may burst.
+enum SpeedProfile
+{
+  PROFILE_CONSERVATIVE, // SPEED_DELAY at the run current
+  PROFILE_BURST         // BURST_SPEED_DELAY at the burst current
+};
+
+// How a move will run, worked out without moving
+struct MotionPlan
+{
+  int64_t from;
+  int64_t to;
+  int64_t steps;        // Step periods, the longer side in dual-motor mode
+  uint32_t segments;    // Constant-speed segments in the profile
+  uint32_t peakSpeed;   // Steps/s
+  uint64_t durationUs;  // Direction setup plus every step period
+  SpeedProfile profile;
+};
+
+// Timing model shared by everything that needs to know how long stepping
+// takes: MotorControl plans moves with it, MotionSupervisor sets time
+// budgets and ETAs from it. Each move runs at one speed, so a profile is
+// a single constant-speed segment.
+class MotionPlanner
+{
+public:
+  static MotionPlan plan(int64_t from, int64_t to, int64_t steps, SpeedProfile profile = PROFILE_CONSERVATIVE);
+
+  // Time for this many step periods, without direction setup
+  static uint64_t stepsDurationUs(int64_t steps, SpeedProfile profile = PROFILE_CONSERVATIVE);
+  static uint32_t stepPeriodUs(SpeedProfile profile = PROFILE_CONSERVATIVE);
+  static uint32_t stepRate(SpeedProfile profile = PROFILE_CONSERVATIVE);
+  static uint32_t halfPeriodUs(SpeedProfile profile);
+
+  static const char *profileName(SpeedProfile profile);
+};
+
+#endif // MOTION_PLANNER_H
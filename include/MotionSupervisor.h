@@ -0,0 +1,68 @@
+#ifndef MOTION_SUPERVISOR_H
+#define MOTION_SUPERVISOR_H
+
+#include <Arduino.h>
+#include "MotionPlanner.h"
+
+// Watches a single move at a time. Each move gets a time budget derived
+// from its nominal duration; the stepping loop reports progress and stops
+// when checkProgress() returns false. The supervisor also feeds the task
+// watchdog, so a move only keeps the motor task alive while it is healthy.
+// At the end of each move it files a MoveReport with timing and speed,
+// and it tells ThermalModel when the motor starts and stops stepping.
+class MotionSupervisor
+{
+public:
+  static void beginMove(const char *label, int64_t expectedSteps, SpeedProfile profile = PROFILE_CONSERVATIVE);
+  static bool checkProgress(int64_t stepsDone);
+  static void endMove(int64_t stepsTaken);
+
+  // Mark the current move with MoveFlags
+  static void flagMove(uint8_t flags);
+
+  // A command was queued for the motor task; the next move measures its
+  // start latency from here
+  static void noteCommand();
+
+  // Any task: stop the current move at the next step, without counting
+  // it as a fault (a manual command outranks an automated move)
+  static void preempt();
+
+  static bool wasAborted();
+  static bool wasPreempted();
+  static bool isMoveActive();
+
+  // Live view of the current move for status reports. Searches
+  // (calibration, homing) plan for their longest possible travel, so
+  // their ETA is an upper bound.
+  static float getProgress();
+  static uint32_t getEtaMs();
+
+private:
+  static void abortMove(const char *reason, int64_t stepsDone);
+
+  static const char *moveLabel;
+  static SpeedProfile moveProfile;
+  static int64_t expectedSteps;
+  static unsigned long moveStartUs;
+  static unsigned long moveStartMs;
+  static unsigned long originUs;
+  static unsigned long firstStepUs;
+  static unsigned long lastStepUs;
+  static unsigned long minStepUs;
+  static int64_t startPosition;
+  static uint8_t moveFlags;
+  static volatile unsigned long commandUs;
+  static volatile bool commandPending;
+  static int64_t plannedSteps; // Live view, under progressLock
+  static int64_t stepsSoFar;
+  static portMUX_TYPE progressLock;
+  static unsigned long lastFeedUs;
+  static uint64_t budgetUs;
+  static bool aborted;
+  static volatile bool preemptRequested;
+  static bool preempted;
+  static volatile bool active;
+};
+
+#endif // MOTION_SUPERVISOR_H
@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
+#include "MotionPlanner.h"
+#include "LimitSwitches.h"
 
 // Command queue for thread-safe motor control
 enum MotorCommand
@@ -14,6 +16,34 @@ enum MotorCommand
   CMD_CALIBRATE
 };
 
+// Where a command came from, for arbitration (see CommandArbiter)
+enum CommandSource
+{
+  SOURCE_MANUAL,   // A person: the web page, or an API call with source=manual
+  SOURCE_API,      // Scripts and other HTTP clients
+  SOURCE_SCHEDULE, // Scheduler rules
+  SOURCE_REMOTE,   // Group commands (CommandBus)
+  SOURCE_COUNT
+};
+
+// What became of a command offered to queueCommand()
+enum CommandDecision
+{
+  COMMAND_ACCEPTED, // Queued for the motor task
+  COMMAND_DEFERRED, // Held until the manual override expires
+  COMMAND_DROPPED,  // Discarded: manual override active
+  COMMAND_REFUSED   // Discarded: a firmware update is being written
+};
+
+// Calibration runs since boot
+struct CalibrationStats
+{
+  uint32_t runs;           // Completed runs
+  uint32_t traverseTenths; // Steps moved, in tenths of the measured travel
+  uint64_t durationUs;
+  int64_t savedUs; // Estimated time saved compared with a retracted-first run that then moves to the same end
+};
+
 class MotorControl
 {
 public:
@@ -21,46 +51,111 @@ public:
   static void initializePins();
   static void createMutexes();
 
-  // Calibration and movement
+  // Calibration and movement. Calibration starts at the nearer switch,
+  // measures the travel in both directions and averages them, then moves
+  // where a queued deploy or retract wants the blind, else where the last
+  // one left it.
   static void calibrate();
   static void deploy();
   static void retract();
   static void homeToRetractedPosition();
 
+  // Boot: home with the stored calibration, or run a full calibration
+  static void startup();
+
   // Position management (thread-safe)
-  static long getPosition();
-  static void setPosition(long pos);
+  static int64_t getPosition();
+  static void setPosition(int64_t pos);
 
   // Status queries
   static bool isCalibrated();
-  static long getDeployedPosition();
+  static bool isCalibrationSuspect(); // A deployed trip too far out to trust; recalibration requested
+  static int64_t getDeployedPosition();
+  static int64_t getSafeDeployedPosition();
+  static int64_t getSafetyBuffer();
   static bool isRetractedLimitHit();
   static bool isDeployedLimitHit();
 
-  // Command queue
-  static void queueCommand(MotorCommand cmd);
+  // Second side in dual-motor mode
+  static int64_t getSecondPosition();
+  static int64_t getSkew();
+  static bool isSecondRetractedLimitHit();
+  static bool isSecondDeployedLimitHit();
+
+  // Steps a limit search may take before giving up
+  static int64_t getSearchLimit();
+
+  static CalibrationStats getCalibrationStats();
+
+  // Bumped by the motor task whenever a position, the calibration or the
+  // skew changes, so readers can tell cheaply that nothing has
+  static uint32_t getStateGeneration();
+
+  // Command queue; the command is only queued if it is COMMAND_ACCEPTED
+  static CommandDecision queueCommand(MotorCommand cmd, CommandSource source);
   static MotorCommand getQueuedCommand();
   static void clearQueuedCommand();
 
+  // Motor task: run the pending command, if any (returns false when idle)
+  static bool processQueuedCommand();
+
+  // Set by OtaUpdater for an open upload session: commands are refused,
+  // and one already queued waits, so no move runs during flash writes
+  static void setFirmwareUpdating(bool updating);
+
   // Low-level control
-  static void moveSteps(int steps, bool checkLimits = true);
-  static void moveToPosition(long targetPosition);
+  static void moveSteps(int64_t steps, bool checkLimits = true);
+  static void moveToPosition(int64_t targetPosition);
+
+  // How moveToPosition(targetPosition) would run, starting where the
+  // current move (if any) ends
+  static MotionPlan planMove(int64_t targetPosition);
 
   // Load/save calibration
   static bool loadStoredCalibration();
   static void saveCurrentCalibration();
 
 private:
+  static void setDirection(bool forward, bool secondForward);
+  static void stepPulse(bool first, bool second);
+  static void setProfile(SpeedProfile profile);
+  static void finishMove(int64_t stepsTaken);
+  static void setSafetyBuffer(int64_t buffer);
+  static void setSecondPosition(int64_t pos);
+  static void setMoveTarget(int64_t pos);
+  static int64_t secondTargetFor(int64_t position);
+  static int64_t moveTicks(int64_t from, int64_t steps, int64_t secondFrom);
+  static bool switchHeld(LimitSwitch sw, bool closed = true);
+  static int64_t stepsPastSwitch(LimitSwitch sw);
+  static bool seekEnd(bool forward, const char *label, int64_t maxSteps, SpeedProfile profile,
+                      int64_t &firstSteps, int64_t &secondSteps, int64_t &past);
+  static bool calibrationStartsDeployed();
+  static bool calibrationFinishesDeployed(bool startDeployed);
+  static void calibrationFailed(const char *reason, bool positionKnown);
+  static void requestRecalibration();
+  static MotorCommand takeQueuedCommand(CommandSource &source);
+  static void touchState();
+
   static SemaphoreHandle_t positionMutex;
   static SemaphoreHandle_t commandMutex;
 
-  static long currentPosition;
-  static long retractedPosition;
-  static long deployedPosition;
-  static long safeDeployedPosition;
-  static long safetyBuffer;
+  static int64_t currentPosition;
+  static int64_t retractedPosition;
+  static int64_t deployedPosition;
+  static int64_t safeDeployedPosition;
+  static int64_t safetyBuffer;
+  static int64_t secondPosition;
+  static int64_t skewSteps;
+  static int64_t moveTarget;
   static bool calibrated;
+  static bool calibrationSuspect;
+  static MotorCommand lastEndCommand; // Last deploy or retract run, CMD_NONE until then
+  static CalibrationStats calibrationStats;
   static volatile MotorCommand pendingCommand;
+  static volatile CommandSource pendingSource;
+  static volatile bool firmwareUpdating;
+  static uint32_t halfPeriodUs; // Of the current move's speed profile
+  static volatile uint32_t stateGeneration;
 };
 
 #endif // MOTOR_CONTROL_H
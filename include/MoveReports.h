@@ -0,0 +1,57 @@
+#ifndef MOVE_REPORTS_H
+#define MOVE_REPORTS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Anomaly flags carried by a move report
+enum MoveFlags
+{
+  MOVE_ABORTED = 0x01,               // Stopped by the motion supervisor
+  MOVE_EARLY_DEPLOYED_LIMIT = 0x02,  // Deployed switch hit before the target
+  MOVE_EARLY_RETRACTED_LIMIT = 0x04, // Retracted switch hit away from position 0
+  MOVE_SLOW = 0x08,                  // Average speed below MOVE_SLOW_PERCENT of nominal
+  MOVE_PREEMPTED = 0x10,             // Cut short by a manual command (see CommandArbiter)
+  MOVE_BURST = 0x20                  // Ran at the burst speed (see ThermalModel)
+};
+
+// Summary of one supervised move
+struct MoveReport
+{
+  uint32_t id;
+  const char *label;
+  uint32_t startMs; // millis() when the move began
+  uint32_t durationMs;
+  int64_t startPosition;
+  int64_t endPosition;
+  int64_t stepsRequested;
+  int64_t stepsTaken;
+  uint32_t peakSpeed;       // Steps/s over the shortest step period
+  uint32_t averageSpeed;    // Steps/s from first step to the end of the move
+  uint32_t startLatencyUs;  // Command (or move start) to the first step
+  uint32_t finishLatencyUs; // Last step to the end of the move
+  uint8_t flags;
+};
+
+// Fixed ring of the most recent move reports, filled by MotionSupervisor at
+// the end of every move. Trends across reports (slower moves, more early
+// limit hits) show mechanical wear without tracing individual steps.
+class MoveReports
+{
+public:
+  // Motor task: store a finished move (assigns its id)
+  static void add(MoveReport &report);
+
+  // Reports with an id greater than since, oldest first
+  static void writeJSON(Print &out, uint32_t since);
+  static void print(size_t count);
+
+private:
+  static size_t collect(uint32_t since, MoveReport *out, size_t maxCount);
+
+  static MoveReport ring[MOVE_REPORT_SLOTS];
+  static uint32_t nextId;
+  static portMUX_TYPE lock;
+};
+
+#endif // MOVE_REPORTS_H
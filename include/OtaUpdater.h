@@ -0,0 +1,88 @@
+#ifndef OTA_UPDATER_H
+#define OTA_UPDATER_H
+
+#include <Arduino.h>
+#include "DeltaPatch.h"
+
+// HTTP-push firmware updates into the inactive A/B app partition.
+//
+// Uploads are streamed straight to flash as they arrive. The image format
+// is detected from its first bytes: a plain ESP app image, a zlib stream
+// (decompressed on the fly with the ROM inflater) or a delta patch
+// against the running image, optionally zlib-compressed.
+//
+// A new image boots on trial. It is confirmed once it has run healthy for
+// OTA_HEALTH_MIN_UPTIME_MS; if it fails the health check, or keeps
+// rebooting before it gets there, the previous image is restored.
+//
+// Motor commands are refused from the start of an upload until it fails
+// or the device restarts into the new image.
+class OtaUpdater
+{
+public:
+  // Boot-time trial accounting; call early in setup()
+  static void begin();
+
+  // Post-boot health check of a trial image; call periodically
+  static void checkHealth();
+
+  // Upload pipeline (called from the web server)
+  static bool start(size_t expectedSize, String &error);
+  static bool write(const uint8_t *data, size_t length);
+  static bool finish(String &error);
+  static bool isUploading();
+  static void checkStall(); // Call periodically
+
+  // Restart (into the new image, or to load new settings) once the HTTP
+  // response is out
+  static void scheduleRestart(const char *reason);
+  static void pollRestart();
+
+  static void writeStatusJSON(Print &out);
+
+private:
+  enum Format
+  {
+    FORMAT_UNKNOWN,
+    FORMAT_IMAGE,
+    FORMAT_DELTA
+  };
+
+  static bool route(const uint8_t *data, size_t length);
+  static bool deliver(const uint8_t *data, size_t length);
+  static bool inflate(const uint8_t *data, size_t length);
+  static bool fail(const String &error);
+  static void abandon();
+  static void release();
+  static bool isHealthy();
+  static void rollback(const char *reason);
+
+  static bool readSource(uint32_t offset, uint8_t *buffer, size_t length, void *context);
+  static bool writeTarget(const uint8_t *data, size_t length, void *context);
+
+  static bool uploading;
+  static bool failed;
+  static bool compressed;
+  static Format format;
+  static String lastError;
+  static uint32_t received;
+  static uint32_t flashed;
+  static unsigned long lastChunkMs;
+  static unsigned long restartAt;
+  static const char *restartReason;
+
+  static uint8_t zlibHeader[2];
+  static size_t zlibHeaderLength;
+  static uint8_t probe[4];
+  static size_t probeLength;
+
+  static DeltaPatch patch;
+  static void *inflator;
+  static uint8_t *dictionary;
+  static size_t dictionaryOffset;
+  static bool inflateDone;
+
+  static bool trialPending;
+};
+
+#endif // OTA_UPDATER_H
@@ -0,0 +1,55 @@
+#ifndef REQUEST_ARENA_H
+#define REQUEST_ARENA_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Bump arena a web handler builds its response body in. A fixed pool of
+// arenas is carved from one PSRAM block at boot, so building responses
+// no longer competes with WiFi and lwIP for internal DRAM. Writes only
+// ever append; releasing an arena resets its length, whatever was built.
+// When every arena is busy the caller falls back to a heap String.
+class RequestArena : public Print
+{
+public:
+  RequestArena() = default;
+  // Over a caller's buffer, outside the pool: never acquired or released
+  RequestArena(uint8_t *buffer, size_t size);
+
+  static void begin();
+
+  // AsyncTCP task: take a free arena (NULL when the pool is exhausted)
+  static RequestArena *acquire();
+  static void release(RequestArena *arena);
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+
+  const uint8_t *data() const;
+  size_t length() const;
+  bool overflowed() const;
+
+  // Pool statistics
+  static size_t getHighWaterBytes();
+  static uint32_t getHighWaterInUse();
+  static uint32_t getFallbacks();
+  static uint32_t getOverflows();
+  static bool isInPsram();
+
+private:
+  uint8_t *base = NULL;
+  size_t capacity = REQUEST_ARENA_BYTES;
+  size_t used = 0;
+  bool full = false;
+
+  static RequestArena pool[REQUEST_ARENA_COUNT];
+  static uint32_t busyMask;
+  static size_t highWaterBytes;
+  static uint32_t highWaterInUse;
+  static uint32_t fallbacks;
+  static uint32_t overflows;
+  static bool psram;
+  static portMUX_TYPE lock;
+};
+
+#endif // REQUEST_ARENA_H
@@ -0,0 +1,46 @@
+#ifndef SAFETY_BUFFER_H
+#define SAFETY_BUFFER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Recent deployed-switch trips, as stored in EEPROM
+struct TripSamples
+{
+  uint8_t count; // Valid entries, up to SAFETY_BUFFER_SAMPLES
+  uint8_t next;  // Slot for the next sample
+  uint16_t total;
+  int16_t shortfalls[SAFETY_BUFFER_SAMPLES]; // Steps short of the calibrated endpoint
+};
+
+// Learns how far before the calibrated deployed endpoint moves must stop.
+// Every time the deployed switch trips during a move, the shortfall (the
+// calibrated endpoint minus the position the switch tripped at) becomes
+// a sample. The buffer grows to the mean plus SAFETY_BUFFER_SIGMA_K
+// standard deviations of the recent samples, plus a margin; with only a
+// few samples it covers the largest one. Trips are only seen when the
+// buffer was too small, so a run of clean deploys narrows the buffer a
+// little at a time, never below what the samples call for. MotorControl
+// applies and persists the buffer with the calibration.
+class SafetyBuffer
+{
+public:
+  static void begin();
+
+  // Motor task: return the buffer to use from now on
+  static int64_t recordTrip(int64_t shortfall, int64_t currentBuffer);
+  static int64_t recordCleanDeploy(int64_t currentBuffer);
+
+  static void writeJSON(Print &out);
+  static void writeMetrics(Print &out);
+
+private:
+  static int64_t required();
+  static void statistics(float &mean, float &stddev);
+
+  static TripSamples samples;
+  static uint32_t cleanStreak;
+  static portMUX_TYPE lock;
+};
+
+#endif // SAFETY_BUFFER_H
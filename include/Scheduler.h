@@ -0,0 +1,88 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <time.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "config.h"
+#include "MotorControl.h"
+
+enum ScheduleKind
+{
+  RULE_TIME,    // Fixed local time of day
+  RULE_SUNRISE, // Relative to sunrise
+  RULE_SUNSET   // Relative to sunset
+};
+
+// One schedule rule. Days use the cron day-of-week numbering
+// (bit 0 = Sunday ... bit 6 = Saturday).
+struct ScheduleRule
+{
+  uint8_t enabled;
+  uint8_t kind;     // ScheduleKind
+  uint8_t action;   // MotorCommand
+  uint8_t weekdays; // Day-of-week mask
+  int16_t minutes;  // RULE_TIME: minutes after midnight, sun rules: offset
+  int16_t reserved;
+};
+
+struct ScheduleSettings
+{
+  int32_t latitudeE6; // Millionths of a degree, north positive
+  int32_t longitudeE6; // Millionths of a degree, east positive
+  char timezone[48]; // POSIX TZ string, e.g. "CET-1CEST,M3.5.0,M10.5.0/3"
+  uint8_t ruleCount;
+  ScheduleRule rules[SCHEDULE_MAX_RULES];
+};
+
+// On-device deploy/retract schedule. Sun-relative times are computed
+// locally (SolarCalculator), so the schedule keeps running without WiFi
+// once the clock has been set. Upcoming events sit in a min-heap keyed by
+// fire time and the scheduler task sleeps until the earliest one; it is
+// only woken early when the rules or the clock change.
+class Scheduler
+{
+public:
+  static void begin();
+  static void startTimeSync();
+  static void run(); // Scheduler task body, never returns
+
+  static bool isTimeValid();
+
+  // Rule management (persisted immediately)
+  static bool addRule(const ScheduleRule &rule, String &error);
+  static bool removeRule(int index);
+  static void setLocation(int32_t latitudeE6, int32_t longitudeE6, const String &timezone);
+  static uint8_t parseWeekdays(const String &field);
+
+  static void writeJSON(Print &out);
+  static void print();
+
+private:
+  struct HeapEntry
+  {
+    time_t when;
+    uint8_t rule;
+  };
+
+  static time_t nextFireTime(const ScheduleRule &rule, time_t after);
+  static time_t eventTime(const ScheduleRule &rule, const struct tm &localDay);
+  static void rebuildHeap(time_t now);
+  static void heapPush(const HeapEntry &entry);
+  static HeapEntry heapPop();
+  static void fire(uint8_t ruleIndex);
+  static void wake();
+  static void onTimeSync(struct timeval *tv);
+  static void printLocal(Print &out, time_t when);
+
+  static SemaphoreHandle_t mutex;
+  static TaskHandle_t taskHandle;
+  static ScheduleSettings settings;
+  static HeapEntry heap[SCHEDULE_MAX_RULES];
+  static uint8_t heapSize;
+  static volatile bool rebuildPending;
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,59 @@
+#ifndef SOLAR_CALCULATOR_H
+#define SOLAR_CALCULATOR_H
+
+#include <stdint.h>
+
+// Sun events for one day, in seconds after 00:00 UTC of that date
+// (may fall outside 0..86399 far from the Greenwich meridian)
+struct SolarTimes
+{
+  enum State
+  {
+    SOLAR_NORMAL,
+    SOLAR_POLAR_DAY,  // Sun never sets
+    SOLAR_POLAR_NIGHT // Sun never rises
+  };
+
+  State state;
+  int32_t sunriseUtc;
+  int32_t noonUtc;
+  int32_t sunsetUtc;
+};
+
+// Sunrise/sunset from the low-precision solar position formulas of the
+// Astronomical Almanac. Each event uses the sun's position at that event,
+// which keeps it within a minute of a full solution between 1950 and 2050
+// up to about 78 degrees latitude (test/test_solar_calculator).
+// Everything is integer fixed-point (angles in 1/65536 degree, trig values
+// Q30, CORDIC for the trig functions) so it runs without floating point
+// and gives identical results on the device and the host.
+class SolarCalculator
+{
+public:
+  static const int32_t DEGREE = 65536; // One degree in Q16 angle units
+  static const int32_t ONE = 1 << 30;  // 1.0 in Q30
+
+  // Latitude/longitude in millionths of a degree (east positive)
+  static SolarTimes compute(int year, int month, int day, int32_t latitudeE6, int32_t longitudeE6);
+
+  // Days since 1970-01-01 for a proleptic Gregorian date
+  static int32_t daysFromCivil(int year, int month, int day);
+
+  // Fixed-point trigonometry (angles in Q16 degrees, values in Q30)
+  static int32_t sinQ30(int32_t angle);
+  static int32_t cosQ30(int32_t angle);
+  static int32_t atan2Deg(int64_t y, int64_t x);
+  static int32_t asinDeg(int32_t value);
+  static int32_t acosDeg(int32_t value);
+
+private:
+  static int32_t sunPosition(int64_t n, int64_t longitude, int32_t &declination);
+  static SolarTimes::State hourAngleSeconds(int64_t latitude, int32_t declination, int32_t &seconds);
+  static int32_t refineEvent(int64_t n, int64_t longitude, int64_t latitude, int32_t hourAngle);
+  static void cordicRotate(int32_t angle, int64_t &cosOut, int64_t &sinOut);
+  static int32_t normalize(int64_t angle);
+  static int64_t mulQ30(int64_t a, int64_t b);
+  static int64_t isqrt(uint64_t value);
+};
+
+#endif // SOLAR_CALCULATOR_H
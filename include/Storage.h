@@ -2,13 +2,80 @@
 #define STORAGE_H
 
 #include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "TaskConfig.h"
+#include "Scheduler.h"
+#include "SafetyBuffer.h"
+#include "LimitSwitches.h"
+#include "Metrics.h"
+#include "LogShipper.h"
 
 class Storage
 {
 public:
   static void begin();
-  static bool loadCalibration(long &deployedPosition, long &safetyBuffer);
-  static void saveCalibration(long deployedPosition, long safetyBuffer);
+  static bool loadCalibration(int64_t &deployedPosition, int64_t &safetyBuffer);
+  static void saveCalibration(int64_t deployedPosition, int64_t safetyBuffer);
+
+  // Dual-motor mode: second side's deployed limit relative to the first
+  static bool loadSkew(int64_t &skew);
+  static void saveSkew(int64_t skew);
+
+  // Persistent health counters (see Metrics)
+  static bool loadMetrics(uint32_t &watchdogResets, uint32_t &motionAborts);
+  static void saveMetrics(uint32_t watchdogResets, uint32_t motionAborts);
+  static bool loadLifetime(LifetimeCounters &totals);
+  static void saveLifetime(const LifetimeCounters &totals);
+
+  // Runtime task placement overrides (see TaskConfig)
+  static bool loadTaskOverrides(TaskOverride *overrides, size_t count);
+  static void saveTaskOverrides(const TaskOverride *overrides, size_t count);
+
+  // Trial boot record for a freshly installed OTA image (see OtaUpdater)
+  static bool loadOtaTrial(uint32_t &previousAddress, uint32_t &trialAddress, uint8_t &attempts);
+  static void saveOtaTrial(uint32_t previousAddress, uint32_t trialAddress, uint8_t attempts);
+  static void clearOtaTrial();
+
+  // Schedule rules and location (see Scheduler)
+  static bool loadSchedule(ScheduleSettings &settings);
+  static void saveSchedule(const ScheduleSettings &settings);
+
+  // Group membership for peer-to-peer commands (see CommandBus)
+  static bool loadRemoteGroups(uint8_t &groups);
+  static void saveRemoteGroups(uint8_t groups);
+
+  // Manual override hold window (see CommandArbiter)
+  static bool loadArbitration(uint32_t &holdMs, bool &deferDuringHold);
+  static void saveArbitration(uint32_t holdMs, bool deferDuringHold);
+
+  // Deployed limit trip samples (see SafetyBuffer)
+  static bool loadLimitTrips(TripSamples &samples);
+  static void saveLimitTrips(const TripSamples &samples);
+
+  // Tuned debounce per limit switch (see LimitSwitches)
+  static bool loadDebounce(uint32_t *debounceUs, size_t count);
+  static void saveDebounce(const uint32_t *debounceUs, size_t count);
+
+  // Remote log collector (see LogShipper)
+  static bool loadLogShipping(LogShippingSettings &settings);
+  static void saveLogShipping(const LogShippingSettings &settings);
+
+  // Settings snapshot for provisioning (/api/config/snapshot). All
+  // integers little-endian:
+  //   header  "BBCS" | version u8 | flags u8 | blockCount u16 | length u32 | crc u32
+  //   blocks  tag u8 | reserved u8 | size u16 | <size bytes: the block as stored>
+  // The CRC (zlib.crc32) covers everything after the header. Flag 0x01
+  // means the unit-specific blocks (calibration, skew, debounce, limit
+  // trips) are included. Returns 0 if the buffer is too small.
+  static size_t exportSnapshot(uint8_t *buffer, size_t capacity, bool withCalibration);
+  static bool importSnapshot(const uint8_t *data, size_t length, String &error);
+
+private:
+  static void commit();
+
+  // EEPROM is shared by the motor and persistence tasks
+  static SemaphoreHandle_t mutex;
 };
 
 #endif // STORAGE_H
@@ -0,0 +1,71 @@
+#ifndef TASK_CONFIG_H
+#define TASK_CONFIG_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Every task the firmware creates or configures
+enum TaskId
+{
+  TASK_MOTOR,
+  TASK_WEB,
+  TASK_PERSISTENCE,
+  TASK_SCHEDULER,
+  TASK_LOOP,
+  TASK_ASYNC_TCP,
+  TASK_COUNT
+};
+
+struct TaskSettings
+{
+  const char *name;   // FreeRTOS task name
+  const char *key;    // Short name used by the API
+  uint32_t stackSize; // Bytes
+  UBaseType_t priority;
+  int core; // -1 = no affinity
+  bool coreConfigurable;
+};
+
+// Persisted runtime override for one task (core -1 stays "no affinity")
+struct TaskOverride
+{
+  uint8_t active;
+  int8_t core;
+  uint8_t priority;
+};
+
+// Single table of task placement and priorities. Defaults come from
+// config.h and the AsyncTCP build flags; runtime overrides are stored in
+// EEPROM. Priority changes apply immediately, core changes on next boot.
+class TaskConfig
+{
+public:
+  static void begin();
+
+  static const TaskSettings &get(TaskId id);
+  static int findByKey(const String &key);
+
+  // Create one of our own tasks using its table entry
+  static bool create(TaskId id, TaskFunction_t function, TaskHandle_t *handle);
+
+  // Apply priorities to tasks we don't create (loopTask, AsyncTCP)
+  static void applyExternal();
+
+  // Every task we create is still there
+  static bool ownTasksRunning();
+
+  static bool setOverride(TaskId id, int core, int priority, String &error);
+  static void clearOverrides();
+
+  static void writeJSON(Print &out);
+  static void print();
+
+private:
+  static TaskHandle_t findHandle(TaskId id);
+
+  static TaskSettings table[TASK_COUNT];
+  static TaskOverride overrides[TASK_COUNT];
+};
+
+#endif // TASK_CONFIG_H
@@ -0,0 +1,63 @@
+#ifndef THERMAL_MODEL_H
+#define THERMAL_MODEL_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "MotionPlanner.h"
+
+// Estimated motor temperature, so moves can burst while there is thermal
+// headroom. A first-order model: the motor is one heat capacity behind
+// one thermal resistance to the hide's air. Heat comes from the winding
+// current (I²R in both phases: run or burst current while stepping, hold
+// current at standstill) plus a loss that grows with step rate. Under a
+// constant load the temperature settles exponentially towards
+// ambient + power * resistance, so the model advances exactly from one
+// load change to the next.
+//
+// The conservative profile settles below THERMAL_LIMIT_C even when run
+// continuously; a burst is only allowed if its predicted end temperature
+// stays THERMAL_BURST_MARGIN_C below the limit. There is no sensor and
+// a reboot forgets the heat: the estimate restarts at the idle
+// equilibrium.
+class ThermalModel
+{
+public:
+  static void begin();
+
+  // Motor task: the load changes at the start and end of every move
+  static void startMoving(SpeedProfile profile);
+  static void stopMoving();
+
+  // Burst when a move of this many steps can end below the limit less
+  // the margin, else conservative. chooseProfile() is for the move about
+  // to start and counts fallbacks; predictProfile() is for planning.
+  static SpeedProfile chooseProfile(int64_t steps);
+  static SpeedProfile predictProfile(int64_t steps);
+
+  // RMS per phase while stepping with this profile
+  static uint32_t runCurrentMa(SpeedProfile profile);
+
+  static float getTemperatureC();
+  static float getPeakTemperatureC();
+  static SpeedProfile getLastProfile();
+
+  static void writeMetrics(Print &out);
+
+private:
+  static SpeedProfile predictProfile(int64_t steps, float &endC);
+  static float powerW(uint32_t currentMa, uint32_t stepRate);
+  static float settle(float fromC, float watts, float seconds);
+  static void advance(unsigned long now);
+
+  static float temperatureC;
+  static float peakC;
+  static float loadW;
+  static unsigned long lastUpdateMs;
+  static SpeedProfile lastProfile;
+  static uint32_t burstMoves;
+  static uint32_t conservativeMoves;
+  static uint32_t fallbacks;
+  static portMUX_TYPE lock;
+};
+
+#endif // THERMAL_MODEL_H
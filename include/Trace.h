@@ -0,0 +1,100 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include "config.h"
+
+// Timeline tracing for diagnosing slow or jittery moves. Each core writes
+// fixed-size events (a timestamp, a name, the running task) into its own
+// ring, so tracing never allocates and rarely contends; the oldest events
+// are overwritten. /api/trace.json exports the rings in Chrome trace-event
+// format, which loads straight into Perfetto (ui.perfetto.dev) or
+// chrome://tracing with one process per core and one thread per task.
+//
+// Names must be string literals (or otherwise live forever): only the
+// pointer is stored. With TRACE_ENABLED 0 the macros compile to nothing.
+#if TRACE_ENABLED
+#define TRACE_BEGIN(name) Trace::record('B', name, 0)
+#define TRACE_END(name) Trace::record('E', name, 0)
+#define TRACE_INSTANT(name, value) Trace::record('i', name, value)
+#define TRACE_COUNTER(name, value) Trace::record('C', name, value)
+#else
+#define TRACE_BEGIN(name) \
+  do                      \
+  {                       \
+  } while (0)
+#define TRACE_END(name) \
+  do                    \
+  {                     \
+  } while (0)
+#define TRACE_INSTANT(name, value) \
+  do                               \
+  {                                \
+  } while (0)
+#define TRACE_COUNTER(name, value) \
+  do                               \
+  {                                \
+  } while (0)
+#endif
+
+struct TraceEvent
+{
+  int64_t us; // esp_timer_get_time()
+  const char *name;
+  TaskHandle_t task;
+  int32_t value; // Instants and counters
+  char phase;    // 'B'egin, 'E'nd, 'i'nstant or 'C'ounter
+};
+
+class Trace
+{
+public:
+  // Any task (not an ISR): append an event to the running core's ring
+  static void record(char phase, const char *name, int32_t value);
+
+  // Streaming export of a snapshot of every ring, in arbitrary-sized pieces
+  class Cursor
+  {
+  public:
+    Cursor();
+    ~Cursor();
+
+    // Fill up to maxLength bytes; returns 0 when the export is complete
+    size_t read(uint8_t *buffer, size_t maxLength);
+
+  private:
+    bool nextPiece();
+    int threadId(TaskHandle_t task);
+    int coreOf(size_t event);
+
+    TraceEvent *events;
+    size_t eventCounts[portNUM_PROCESSORS];
+    TaskHandle_t tasks[TRACE_MAX_THREADS];
+    uint8_t taskCores[TRACE_MAX_THREADS]; // Bitmask of cores each task ran on
+    size_t taskCount;
+    uint32_t overwritten;
+    uint32_t stage;
+    size_t index;
+    char pending[160];
+    size_t pendingLength;
+    size_t pendingOffset;
+  };
+
+private:
+  struct Ring
+  {
+    Ring();
+
+    TraceEvent events[TRACE_RING_EVENTS];
+    uint32_t next; // Total events written; the slot is next % TRACE_RING_EVENTS
+    portMUX_TYPE lock;
+  };
+
+  static Ring rings[portNUM_PROCESSORS];
+
+  friend class Cursor;
+};
+
+#endif // TRACE_H
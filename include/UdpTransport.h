@@ -0,0 +1,25 @@
+#ifndef UDP_TRANSPORT_H
+#define UDP_TRANSPORT_H
+
+#include "CommandTransport.h"
+
+// UDP broadcast over BSD sockets (lwIP on the device, the host stack on
+// Linux). Reaches nodes on the AP's subnet, or other processes on the same
+// host when REMOTE_UDP_ADDRESS is a loopback broadcast address.
+class UdpTransport : public CommandTransport
+{
+public:
+  UdpTransport(const char *address, uint16_t port) : address(address), port(port), sock(-1) {}
+
+  const char *name() const override { return "udp"; }
+  bool begin() override;
+  bool send(const CommandPacket &packet) override;
+  void poll() override;
+
+private:
+  const char *address;
+  uint16_t port;
+  int sock;
+};
+
+#endif // UDP_TRANSPORT_H
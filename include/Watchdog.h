@@ -0,0 +1,22 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <Arduino.h>
+
+// Task watchdog (TWDT) supervision for the firmware's long-running tasks.
+// A subscribed task that stops calling feed() for TASK_WDT_TIMEOUT_S
+// triggers a panic reset, which Metrics counts on the next boot.
+class Watchdog
+{
+public:
+  static void begin();
+
+  // Subscribe the calling task; it must call feed() from then on
+  static bool subscribe(const char *taskName);
+  static void feed();
+
+  // True if the last reset was caused by a watchdog
+  static bool wasWatchdogReset();
+};
+
+#endif // WATCHDOG_H
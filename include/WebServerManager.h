@@ -7,7 +7,8 @@ class WebServerManager
 {
 public:
   static void begin();
-  static String getStatusJSON();
+  static void writeStatusJSON(Print &out);
+  static void writeMetricsText(Print &out);
 
 private:
   static void setupRoutes();
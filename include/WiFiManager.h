@@ -13,10 +13,12 @@ public:
   static void updateLastAction(const String &action);
   static String getLastAction();
   static unsigned long getLastActionTime();
+  static uint32_t getLastActionGeneration(); // Bumped by every updateLastAction()
 
 private:
   static String lastAction;
   static unsigned long lastActionTime;
+  static volatile uint32_t lastActionGeneration;
 };
 
 #endif // WIFI_MANAGER_H
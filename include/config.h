@@ -1,6 +1,9 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// Firmware Version (reported by /api/status and /api/ota)
+#define FIRMWARE_VERSION "1.1.0"
+
 // Pin Definitions
 #define EN_PIN 4   // LOW: Driver enabled, HIGH: Driver disabled
 #define STEP_PIN 5 // Step on the rising edge
@@ -10,17 +13,223 @@
 #define LIMIT_RETRACTED 15 // Limit switch for fully retracted position
 #define LIMIT_DEPLOYED 16  // Limit switch for fully deployed position
 
+// Dual-Motor Mode: a second driver and limit switches at the other end of the blind
+#ifndef DUAL_MOTOR_ENABLED
+#define DUAL_MOTOR_ENABLED 0
+#endif
+#define STEP2_PIN 7
+#define DIR2_PIN 8
+#define DIR2_INVERTED 1 // Mirrored mounting turns the second motor the other way
+#define LIMIT_RETRACTED2 17
+#define LIMIT_DEPLOYED2 18
+
 // Motor Configuration
-#define SPEED_DELAY 500 // Delay in microseconds between steps (controls speed)
+#define SPEED_DELAY 500      // Delay in microseconds between steps (controls speed)
+#define BURST_SPEED_DELAY 300 // Same for the burst profile, used while the motor has thermal headroom
+#define DIRECTION_SETUP_US 10 // Settle time after changing DIR before the first step
+
+// Motor Current (TMC2209 standalone: set by VREF, see ThermalModel)
+#ifndef VREF_PWM_PIN
+#define VREF_PWM_PIN -1 // PWM into an RC filter on VREF; -1 when the on-board pot sets VREF
+#endif
+#define VREF_MV_PER_AMP 1410             // VREF for 1 A RMS on the driver module
+#define MOTOR_RUN_CURRENT_MA 800         // RMS per phase while stepping (the pot setting without VREF_PWM_PIN)
+#define MOTOR_BURST_CURRENT_MA 1100      // While bursting; needs VREF_PWM_PIN
+#define MOTOR_HOLD_CURRENT_MA 400        // At standstill, after the driver's automatic reduction
+#define MOTOR_PHASE_RESISTANCE_MOHM 1650 // Winding resistance per phase
+
+// Thermal Model (see ThermalModel)
+#define THERMAL_AMBIENT_C 35                // Air inside a closed hide on a sunny day
+#define THERMAL_LIMIT_C 60                  // Printed motor mounts soften above this
+#define THERMAL_BURST_MARGIN_C 5            // A burst must end at least this far below the limit
+#define THERMAL_RESISTANCE_C_PER_W 10       // Motor case to ambient, as mounted
+#define THERMAL_TIME_CONSTANT_S 600         // Thermal resistance times heat capacity
+#define THERMAL_SPEED_LOSS_MW_PER_KSPS 200  // Iron and driver losses per 1000 steps/s
+
+// Travel Configuration
+#define FULL_STEPS_PER_REV 200
+#define MICROSTEPS 8                          // Driver microstep setting (MS1/MS2)
+#define MAX_TRAVEL_REVOLUTIONS 31             // Longest travel the mechanism allows, in motor revolutions
+#define CALIBRATION_SEARCH_MARGIN_PERCENT 110 // Limit searches give up this far past the longest travel
+
+// Calibrations outside this range are rejected, measured or stored. Limit
+// searches give up at the maximum, so whatever one measures loads back.
+#ifndef CALIBRATION_MIN_STEPS
+#define CALIBRATION_MIN_STEPS 1
+#endif
+#ifndef CALIBRATION_MAX_STEPS
+#define CALIBRATION_MAX_STEPS \
+  ((int64_t)FULL_STEPS_PER_REV * MICROSTEPS * MAX_TRAVEL_REVOLUTIONS * CALIBRATION_SEARCH_MARGIN_PERCENT / 100)
+#endif
 
 // Safety Configuration
 #define DEFAULT_SAFETY_BUFFER 200 // Steps to stop before deployed limit switch
 
+// Adaptive Safety Buffer (see SafetyBuffer)
+#define SAFETY_BUFFER_SAMPLES 16      // Most recent deployed limit trips kept
+#define SAFETY_BUFFER_MIN_SAMPLES 4   // With fewer, the largest shortfall sets the buffer
+#define SAFETY_BUFFER_SIGMA_K 3       // Buffer covers mean + k standard deviations of the shortfalls
+#define SAFETY_BUFFER_MARGIN_STEPS 20 // Added on top of that
+#define SAFETY_BUFFER_MIN_STEPS 40
+#define SAFETY_BUFFER_MAX_STEPS 1000
+#define SAFETY_BUFFER_SHRINK_AFTER 20 // Clean deploys in a row before the buffer narrows
+#define SAFETY_BUFFER_SHRINK_STEPS 10 // ...by this much
+#define SAFETY_TRIP_MAX_SHORTFALL SAFETY_BUFFER_MAX_STEPS // Trips earlier than this mean the endpoint moved: recalibrate
+
+// Lifetime Counters (see Metrics): kept in RTC memory, checkpointed to EEPROM
+#define LIFETIME_CHECKPOINT_INTERVAL_S 21600 // A scheduled write every 6 h at most...
+#define LIFETIME_CHECKPOINT_MOVES 50         // ...or sooner after this many moves
+
+// Limit Switch Debounce (see LimitSwitches; capture can be toggled via /api/switches)
+#define SWITCH_DEBOUNCE_DEFAULT_US 2000 // Until enough bounce has been seen to tune it
+#define SWITCH_DEBOUNCE_MIN_US 200
+#define SWITCH_DEBOUNCE_MAX_US 20000
+#define SWITCH_DEBOUNCE_MARGIN_PERCENT 150 // Debounce is the longest bounce gap seen, times this
+#define SWITCH_QUIET_US 50000              // A burst of edges ends after this long without one
+#define SWITCH_TUNE_MIN_BURSTS 4           // Bursts seen on a switch before its debounce is tuned
+#define SWITCH_EDGE_BUFFER 256             // Captured edges awaiting analysis
+#define SWITCH_CAPTURE_DEFAULT 0
+#define SWITCH_SETTLE_STEPS 8              // A switch stops a search or move once held closed this many steps
+
+// Watchdog Configuration
+#define TASK_WDT_TIMEOUT_S 10 // Reset if a subscribed task stops feeding for this long
+
+// Motion Supervisor Configuration
+#define MOTION_BUDGET_PERCENT 150       // Allowed move time as a percentage of the nominal duration
+#define MOTION_BUDGET_MARGIN_MS 2000    // Fixed allowance added to every move budget
+#define MOTION_STALL_GRACE_MS 500       // Time into a move before progress is checked
+#define MOTION_MIN_PROGRESS_PERCENT 50  // Abort if fewer steps than this share of expected were made
+#define MOTION_WDT_FEED_INTERVAL_MS 100 // How often a supervised move feeds the task watchdog
+
+// Command Arbitration (see CommandArbiter; both can be changed via /api/commands)
+#define COMMAND_MANUAL_HOLD_MS 900000 // Automation waits this long after a manual command
+#define COMMAND_DEFER_DURING_HOLD 1   // 1: run the latest held command afterwards, 0: drop it
+
+// Move Reports
+#define MOVE_REPORT_SLOTS 32 // Most recent moves kept for /api/moves
+#define MOVE_SLOW_PERCENT 80 // Flag moves averaging below this share of the nominal speed
+#define MOVE_SLOW_MIN_STEPS 200 // Shorter moves are too noisy to flag as slow
+
+// OTA Update Configuration
+#define OTA_HEALTH_MIN_UPTIME_MS 30000 // A new image must run healthy this long to be confirmed
+#define OTA_HEALTH_DEADLINE_MS 180000  // Roll back if the new image is still unhealthy after this long
+#define OTA_MAX_TRIAL_BOOTS 3          // Roll back after this many unconfirmed boots of a new image
+#define OTA_RESTART_DELAY_MS 1000      // Delay between a successful upload and the restart
+#define OTA_STALL_TIMEOUT_MS 30000     // Abandon an upload that has received nothing for this long
+
+// Scheduler Configuration
+#define SCHEDULE_MAX_RULES 8
+#define SCHEDULE_DEFAULT_TZ "UTC0"           // POSIX TZ string, set via /api/location
+#define SCHEDULE_NTP_SERVER "pool.ntp.org"
+#define SCHEDULE_MAX_SLEEP_MS 21600000       // Re-check the clock at least every 6 hours
+#define SCHEDULE_LATE_TOLERANCE_S 300        // Still run an event this many seconds late
+
+// History Configuration (motion time series in the "history" flash partition)
+#define HISTORY_PARTITION_LABEL "history"
+#define HISTORY_SAMPLE_INTERVAL_MS 500   // Position sampling period while moving
+#define HISTORY_STAGING_BYTES 1024       // RAM buffer for records not yet written to flash
+#define HISTORY_FLUSH_BYTES 256          // Write once this much is buffered (motor idle)
+#define HISTORY_FLUSH_INTERVAL_MS 60000  // ...or once the oldest buffered record is this old
+#define HISTORY_QUEUE_LENGTH 64          // Records in flight from other tasks
+#define HISTORY_HELD_RECORDS 64          // Records kept in RAM until NTP sets the clock
+#define HISTORY_CLOCK_WAIT_MS 300000     // ...for at most this long after boot
+
+// Peer-to-peer Command Transport (see CommandBus)
+#define REMOTE_NETWORK_ID 0x42424C44 // Shared by every blind in one installation
+#define REMOTE_DEFAULT_GROUPS 0x01   // Group bitmask this node answers to (bit 0 = group 1)
+#define REMOTE_MAX_TRANSPORTS 4
+#define REMOTE_DEDUP_SLOTS 8          // Recently seen senders
+#define REMOTE_ESPNOW_CHANNEL 1       // Held while the AP is unreachable; set the AP to match
+#define REMOTE_ESPNOW_REPEATS 3       // ESP-NOW broadcasts are not acknowledged
+#define REMOTE_UDP_ENABLED 1
+#define REMOTE_UDP_PORT 4210
+#ifndef REMOTE_UDP_ADDRESS
+#define REMOTE_UDP_ADDRESS "255.255.255.255" // 127.255.255.255 for loopback on Linux
+#endif
+
+// mDNS / DNS-SD Discovery (see Discovery)
+#define DISCOVERY_HOSTNAME_PREFIX "birdblinds" // Followed by the last three MAC bytes
+#define DISCOVERY_SERVICE "birdblinds"        // Advertised as _birdblinds._tcp
+#define DISCOVERY_MIN_UPDATE_MS 2000          // At most one TXT record update per interval
+
+// Web Response Arenas (see RequestArena)
+#define REQUEST_ARENA_COUNT 4     // Responses that can be in flight at once
+#define REQUEST_ARENA_BYTES 16384 // Largest response body built in an arena
+#define STATUS_CACHE_BYTES 512    // Largest /api/status body kept for repeat polls
+
+// Remote Log Shipping (see LogShipper); off until a collector is set
+#define LOG_SHIP_SLOTS 32            // Lines held while the collector is behind
+#define LOG_SHIP_LINE_BYTES 120      // Longer lines are cut short
+#define LOG_SHIP_DATAGRAM_BYTES 1200 // Fits one WiFi frame with the IP and UDP headers
+#define LOG_SHIP_BATCH_MS 1000       // Lines wait up to this long to share a datagram
+#define LOG_SHIP_FACILITY 16         // Syslog facility local0
+#define LOG_SHIP_DEFAULT_PORT 514
+#define LOG_SHIP_DEFAULT_SEVERITY 6 // Info and more urgent
+
+// Timeline Tracing (see Trace); off by default, the emulator build turns it on
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 0
+#endif
+#define TRACE_RING_EVENTS 512 // Events kept per core
+#define TRACE_MAX_THREADS 16  // Distinct tasks named in one export
+
+// Task Configuration (defaults; core/priority can be overridden at runtime via /api/tasks)
+// Core -1 means "no affinity"
+#define MOTOR_TASK_CORE 1
+#define MOTOR_TASK_PRIORITY 2
+#define MOTOR_TASK_STACK 8192
+#define WEB_TASK_CORE 0
+#define WEB_TASK_PRIORITY 1
+#define WEB_TASK_STACK 8192
+#define PERSISTENCE_TASK_CORE 0
+#define PERSISTENCE_TASK_PRIORITY 1
+#define PERSISTENCE_TASK_STACK 4096
+#define SCHEDULER_TASK_CORE 0
+#define SCHEDULER_TASK_PRIORITY 1
+#define SCHEDULER_TASK_STACK 4096
+#define LOOP_TASK_PRIORITY 1 // Arduino loopTask (runs setup(); core fixed by the framework)
+
+// AsyncTCP service task, configured through its own build flags (see platformio.ini)
+#ifndef CONFIG_ASYNC_TCP_RUNNING_CORE
+#define CONFIG_ASYNC_TCP_RUNNING_CORE -1
+#endif
+#ifndef CONFIG_ASYNC_TCP_PRIORITY
+#define CONFIG_ASYNC_TCP_PRIORITY 10
+#endif
+#ifndef CONFIG_ASYNC_TCP_STACK_SIZE
+#define CONFIG_ASYNC_TCP_STACK_SIZE 16384
+#endif
+
 // EEPROM Configuration
 #define EEPROM_SIZE 512
-#define EEPROM_MAGIC_NUMBER 0xBD01 // Bird Blinds v1
+#define EEPROM_MAGIC_NUMBER 0xBD02    // Bird Blinds v2 (64-bit deployed position)
+#define EEPROM_MAGIC_NUMBER_V1 0xBD01 // v1: 32-bit positions, migrated on load
 #define EEPROM_ADDR_MAGIC 0
-#define EEPROM_ADDR_DEPLOYED_POS 4
-#define EEPROM_ADDR_SAFETY_BUFFER 8
+#define EEPROM_ADDR_DEPLOYED_POS 4     // 8 bytes
+#define EEPROM_ADDR_SAFETY_BUFFER 12   // 4 bytes
+#define EEPROM_ADDR_SAFETY_BUFFER_V1 8 // 4 bytes
+#define EEPROM_METRICS_MAGIC 0xBD10 // Persistent metrics v1
+#define EEPROM_ADDR_METRICS 16
+#define EEPROM_TASKS_MAGIC 0xBD20 // Task overrides v1
+#define EEPROM_ADDR_TASKS 32 // Up to 32 bytes: room for 9 tasks
+#define EEPROM_OTA_MAGIC 0xBD30 // OTA trial boot record v1
+#define EEPROM_ADDR_OTA 64 // 12 bytes
+#define EEPROM_SCHEDULE_MAGIC 0xBD40 // Schedule and location v1
+#define EEPROM_ADDR_SCHEDULE 80 // 128 bytes
+#define EEPROM_REMOTE_MAGIC 0xBD50 // Remote group membership v1
+#define EEPROM_ADDR_REMOTE 208
+#define EEPROM_SKEW_MAGIC 0xBD60 // Dual-motor skew v1
+#define EEPROM_ADDR_SKEW 216 // 16 bytes
+#define EEPROM_ARBITRATION_MAGIC 0xBD70 // Manual override hold v1
+#define EEPROM_ADDR_ARBITRATION 232
+#define EEPROM_LIMIT_TRIPS_MAGIC 0xBD80 // Deployed limit trip samples v1
+#define EEPROM_ADDR_LIMIT_TRIPS 240     // 40 bytes
+#define EEPROM_DEBOUNCE_MAGIC 0xBD90 // Tuned limit switch debounce v1
+#define EEPROM_ADDR_DEBOUNCE 280     // 12 bytes
+#define EEPROM_LIFETIME_MAGIC 0xBDA0 // Lifetime counters v1
+#define EEPROM_ADDR_LIFETIME 296     // 40 bytes
+#define EEPROM_LOG_MAGIC 0xBDB0 // Log shipping collector v1
+#define EEPROM_ADDR_LOG 336     // 24 bytes
+#define CONFIG_SNAPSHOT_MAX_BYTES 1024 // Every settings block plus headers
 
 #endif // CONFIG_H
@@ -0,0 +1,385 @@
+#include "SimWorld.h"
+#include "Storage.h"
+#include "Watchdog.h"
+#include "Metrics.h"
+#include "History.h"
+#include "CommandArbiter.h"
+#include "MotionSupervisor.h"
+#include "ThermalModel.h"
+#include "SafetyBuffer.h"
+#include "LimitSwitches.h"
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Host scenario runner. Each scenario drives the real motion code
+// (MotorControl, MotionSupervisor, Storage) against the simulated blind
+// and reports how long the blind spent moving, how long commands waited
+// for the motor, where it ended up, how hot the thermal model thinks the
+// motor got and how much travel calibration took. Results go to stdout as JSON;
+// tools/sim_compare.py checks them against sim/golden.json. Built with
+// DUAL_MOTOR_ENABLED (env:sim_dual), it runs the dual-motor scenarios
+// instead, checked against sim/golden_dual.json.
+
+#define SIM_TRAVEL_STEPS 12000 // 12 s end to end at SPEED_DELAY 500
+#define SIM_OVERTRAVEL_STEPS 50
+#define SIM_RNG_SEED 2463534242U
+
+#define SEC(s) ((uint64_t)(s) * 1000000ULL)
+#define MSEC(ms) ((uint64_t)(ms) * 1000ULL)
+
+enum Expect
+{
+  EXPECT_RETRACTED,
+  EXPECT_DEPLOYED,
+  EXPECT_PRESET
+};
+
+struct Scenario
+{
+  const char *name;
+  int64_t startCarriage;
+  bool storedCalibration;
+  std::vector<SimEvent> events;
+  Expect expect;
+  int32_t expectPercent; // EXPECT_PRESET only
+};
+
+#if DUAL_MOTOR_ENABLED
+static const Scenario scenarios[] = {
+    {"dual_motor_long_run", 3000, false,
+     {{0, SIM_SECOND_TRAVEL, 150},
+      {MSEC(40003), SIM_CYCLE, 20},
+      {SEC(190), SIM_PRESET, 25},
+      {SEC(200), SIM_PRESET, 75},
+      {SEC(212), SIM_PRESET, 50},
+      {SEC(222), SIM_COMMAND, CMD_CALIBRATE},
+      {SEC(260), SIM_PRESET, 90},
+      {SEC(275), SIM_PRESET, 10}},
+     EXPECT_PRESET, 10},
+};
+#else
+static const Scenario scenarios[] = {
+    {"cold_boot_uncalibrated", 3000, false, {}, EXPECT_RETRACTED, 0},
+    {"cold_boot_calibrated", 3000, true, {}, EXPECT_RETRACTED, 0},
+    {"deploy_retract_cycles", 0, true,
+     {{MSEC(1003), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(15007), SIM_COMMAND, CMD_RETRACT},
+      {MSEC(30001), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(45009), SIM_COMMAND, CMD_RETRACT}},
+     EXPECT_RETRACTED, 0},
+    {"partial_presets", 0, true,
+     {{MSEC(1003), SIM_PRESET, 25},
+      {MSEC(10005), SIM_PRESET, 75},
+      {MSEC(20007), SIM_PRESET, 50},
+      {MSEC(28002), SIM_PRESET, 10}},
+     EXPECT_PRESET, 10},
+    {"conflicting_commands", 0, true,
+     {{MSEC(1003), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(1201), SIM_COMMAND, CMD_RETRACT},
+      {MSEC(1402), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(2005), SIM_COMMAND, CMD_RETRACT},
+      {MSEC(20004), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(20051), SIM_COMMAND, CMD_RETRACT}},
+     EXPECT_RETRACTED, 0},
+    {"switch_bounce", 3000, false,
+     {{0, SIM_SWITCH_BOUNCE, 40},
+      {MSEC(35004), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(50006), SIM_COMMAND, CMD_RETRACT}},
+     EXPECT_RETRACTED, 0},
+    {"lost_steps", 0, true,
+     {{0, SIM_LOSE_STEPS, 100},
+      {MSEC(1003), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(15007), SIM_COMMAND, CMD_RETRACT},
+      {MSEC(30001), SIM_COMMAND, CMD_DEPLOY}},
+     EXPECT_DEPLOYED, 0},
+    {"power_loss_recovery", 0, true,
+     {{MSEC(1003), SIM_COMMAND, CMD_DEPLOY},
+      {SEC(7), SIM_POWER_LOSS, 3000},
+      {MSEC(25005), SIM_COMMAND, CMD_DEPLOY}},
+     EXPECT_DEPLOYED, 0},
+    {"manual_override", 0, true,
+     {{0, SIM_MANUAL_HOLD, 20},
+      {MSEC(1003), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(5002), SIM_MANUAL_COMMAND, CMD_RETRACT},
+      {MSEC(8005), SIM_COMMAND, CMD_DEPLOY}},
+     EXPECT_DEPLOYED, 0},
+    {"thermal_cycling", 0, true,
+     {{MSEC(1003), SIM_CYCLE, 60}},
+     EXPECT_RETRACTED, 0},
+    {"deployed_switch_shift", 0, true,
+     {{0, SIM_SWITCH_SHIFT, -260},
+      {MSEC(1003), SIM_CYCLE, 50}},
+     EXPECT_RETRACTED, 0},
+    {"deployed_switch_moved", 0, true,
+     {{0, SIM_SWITCH_SHIFT, -2500},
+      {MSEC(1003), SIM_CYCLE, 10}},
+     EXPECT_RETRACTED, 0},
+    {"switch_debounce_tuning", 3000, false,
+     {{0, SIM_SWITCH_BOUNCE, 40},
+      {0, SIM_SWITCH_CAPTURE, 1},
+      {MSEC(35004), SIM_CYCLE, 4},
+      {SEC(70), SIM_COMMAND, CMD_CALIBRATE}},
+     EXPECT_RETRACTED, 0},
+    {"recalibrate_deployed", 0, true,
+     {{MSEC(1003), SIM_COMMAND, CMD_DEPLOY},
+      {MSEC(15007), SIM_COMMAND, CMD_CALIBRATE}},
+     EXPECT_DEPLOYED, 0},
+};
+#endif
+
+static bool verbose = false;
+
+// Same order as setup() in main.cpp, minus networking and tasks
+static void boot()
+{
+  Storage::begin();
+  Watchdog::begin();
+  Metrics::begin();
+  MotorControl::begin();
+  ThermalModel::begin();
+  SafetyBuffer::begin();
+  LimitSwitches::begin();
+  History::begin();
+  CommandArbiter::begin();
+  MotorControl::startup();
+}
+
+// Compare a move's duration with what MotorControl::planMove() said
+static void checkPlan(const MotionPlan &plan, uint64_t startUs)
+{
+  uint64_t actual = world->nowUs - startUs;
+  uint64_t error = actual > plan.durationUs ? actual - plan.durationUs : plan.durationUs - actual;
+  if (error > world->planErrorMaxUs)
+    world->planErrorMaxUs = error;
+}
+
+static void notePeakTemperature()
+{
+  float peakC = ThermalModel::getPeakTemperatureC();
+  if (peakC > world->peakMotorTempC)
+    world->peakMotorTempC = peakC;
+}
+
+// The motor task loop from main.cpp, plus preset moves (which have no
+// queued command of their own yet) and cycling, which queues the next
+// deploy or retract as soon as the motor is free
+static void motorTask()
+{
+  while (!simIdle())
+  {
+    if (world->cyclesLeft > 0 && MotorControl::getQueuedCommand() == CMD_NONE)
+    {
+      world->cyclesLeft--;
+      world->commandsQueued++;
+      world->commandUs = world->nowUs;
+      MotorControl::queueCommand(MotorControl::getPosition() > 0 ? CMD_RETRACT : CMD_DEPLOY, SOURCE_API);
+    }
+
+    MotorCommand cmd = MotorControl::getQueuedCommand();
+    if (cmd == CMD_NONE && CommandArbiter::getHoldRemainingMs() == 0)
+    {
+      // A deferred command waits from the end of the hold
+      cmd = CommandArbiter::peekDeferred();
+      if (cmd != CMD_NONE)
+        world->commandUs = world->nowUs;
+    }
+    if (cmd != CMD_NONE)
+    {
+      bool planned = MotorControl::isCalibrated() && cmd != CMD_CALIBRATE;
+      MotionPlan plan = MotorControl::planMove(cmd == CMD_DEPLOY ? MotorControl::getSafeDeployedPosition() : 0);
+      uint64_t startUs = world->nowUs;
+      world->servingCommand = true;
+      world->measuringSkew = cmd == CMD_DEPLOY || cmd == CMD_RETRACT;
+      MotorControl::processQueuedCommand();
+      world->servingCommand = false;
+      world->measuringSkew = false;
+      if (planned && !MotionSupervisor::wasPreempted())
+        checkPlan(plan, startUs);
+      if (planned && plan.profile == PROFILE_BURST)
+        world->burstMoves++;
+      notePeakTemperature();
+    }
+    else if (world->pendingPreset >= 0)
+    {
+      int64_t target = MotorControl::getSafeDeployedPosition() * world->pendingPreset / 100;
+      world->pendingPreset = -1;
+      MotionPlan plan = MotorControl::planMove(target);
+      uint64_t startUs = world->nowUs;
+      world->servingCommand = true;
+      world->measuringSkew = true;
+      MotorControl::moveToPosition(target);
+      world->servingCommand = false;
+      world->measuringSkew = false;
+      checkPlan(plan, startUs);
+      if (plan.profile == PROFILE_BURST)
+        world->burstMoves++;
+      notePeakTemperature();
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+// Run body in a fresh process: a cold RAM image every time, with the
+// world (clock, mechanism, EEPROM) shared across boots
+static int runChild(void (*body)())
+{
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    Serial.enabled = verbose;
+    body();
+    world->firmwarePosition = MotorControl::getPosition();
+    world->firmwareSafetyBuffer = MotorControl::getSafetyBuffer();
+    uint32_t retracted = LimitSwitches::getDebounceUs(SWITCH_RETRACTED);
+    uint32_t deployed = LimitSwitches::getDebounceUs(SWITCH_DEPLOYED);
+    world->firmwareDebounceUs = retracted > deployed ? retracted : deployed;
+    world->firmwareSkew = MotorControl::getSkew();
+    CalibrationStats calibration = MotorControl::getCalibrationStats();
+    world->calibrationTraverseTenths += calibration.traverseTenths;
+    world->calibrationSavedUs += calibration.savedUs;
+    fflush(stdout);
+    fflush(stderr);
+    _exit(0);
+  }
+
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) != pid)
+    return -1;
+  return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void provision()
+{
+  Storage::begin();
+  Storage::saveCalibration(SIM_TRAVEL_STEPS, DEFAULT_SAFETY_BUFFER);
+}
+
+static void firmware()
+{
+  boot();
+  motorTask();
+  notePeakTemperature();
+}
+
+static bool runScenario(const Scenario &scenario, bool first)
+{
+  *world = SimWorld();
+  memset(world->eeprom, 0xFF, sizeof(world->eeprom));
+  world->blind.reset(SIM_TRAVEL_STEPS, SIM_OVERTRAVEL_STEPS, scenario.startCarriage, SIM_RNG_SEED);
+  world->pendingPreset = -1;
+  world->eventCount = scenario.events.size() < SIM_MAX_EVENTS ? scenario.events.size() : SIM_MAX_EVENTS;
+  for (int i = 0; i < world->eventCount; i++)
+    world->events[i] = scenario.events[i];
+
+  if (scenario.storedCalibration && runChild(provision) != 0)
+  {
+    fprintf(stderr, "%s: provisioning failed\n", scenario.name);
+    return false;
+  }
+
+  int status;
+  do
+  {
+    world->boots++;
+    status = runChild(firmware);
+  } while (status == SIM_EXIT_POWER_LOSS);
+
+  if (status != 0)
+  {
+    fprintf(stderr, "%s: firmware %s\n", scenario.name, status == SIM_EXIT_TIMEOUT ? "ran out of simulated time" : "crashed");
+    return false;
+  }
+
+  int64_t safeDeployed = SIM_TRAVEL_STEPS - DEFAULT_SAFETY_BUFFER;
+  int64_t expected = 0;
+  if (scenario.expect == EXPECT_DEPLOYED)
+    expected = safeDeployed;
+  else if (scenario.expect == EXPECT_PRESET)
+    expected = safeDeployed * scenario.expectPercent / 100;
+
+  uint64_t latencyMean = world->commandsServed > 0 ? world->latencyTotalUs / world->commandsServed : 0;
+  int64_t positionError = llabs(world->firmwarePosition - world->blind.carriage);
+  int64_t targetError = llabs(world->blind.carriage - expected);
+
+  // The model is only useful if bursting never takes it past the limit
+  bool tooHot = world->peakMotorTempC > THERMAL_LIMIT_C;
+  if (tooHot)
+    fprintf(stderr, "%s: estimated motor temperature reached %.1f C\n", scenario.name, world->peakMotorTempC);
+
+  printf("%s\n    \"%s\": {", first ? "" : ",", scenario.name);
+  printf("\"totalTimeMs\": %llu, ", (unsigned long long)(world->nowUs / 1000));
+  printf("\"motionTimeMs\": %llu, ", (unsigned long long)(world->motionUs / 1000));
+  printf("\"commandLatencyMeanUs\": %llu, ", (unsigned long long)latencyMean);
+  printf("\"commandLatencyMaxUs\": %llu, ", (unsigned long long)world->latencyMaxUs);
+  printf("\"planErrorMaxUs\": %llu, ", (unsigned long long)world->planErrorMaxUs);
+  printf("\"positionErrorSteps\": %lld, ", (long long)positionError);
+  printf("\"targetErrorSteps\": %lld, ", (long long)targetError);
+  printf("\"commandsQueued\": %u, ", world->commandsQueued);
+  printf("\"commandsSuperseded\": %u, ", world->commandsSuperseded);
+  printf("\"commandsDeferred\": %u, ", world->commandsDeferred);
+  printf("\"commandsServed\": %u, ", world->commandsServed);
+  printf("\"burstMoves\": %u, ", world->burstMoves);
+  printf("\"peakMotorTempDeciC\": %d, ", (int)(world->peakMotorTempC * 10 + 0.5f));
+  printf("\"safetyBufferSteps\": %lld, ", (long long)world->firmwareSafetyBuffer);
+  printf("\"debounceUs\": %u, ", world->firmwareDebounceUs);
+  printf("\"calibrationTraverses\": %.1f, ", world->calibrationTraverseTenths / 10.0);
+  printf("\"calibrationSavedMs\": %lld, ", (long long)(world->calibrationSavedUs / 1000));
+  if (DUAL_MOTOR_ENABLED)
+  {
+    // Skew between the sides: the worst during moves, at the end, and the
+    // error in the skew the firmware learned
+    printf("\"skewMaxSteps\": %lld, ", (long long)world->skewMaxSteps);
+    printf("\"skewEndSteps\": %lld, ", (long long)llabs(world->blind.skew()));
+    printf("\"skewLearnedErrorSteps\": %lld, ",
+           (long long)llabs(world->firmwareSkew - (world->blind.travel2 - world->blind.travel)));
+  }
+  printf("\"stepsLost\": %u, ", world->blind.stepsLost);
+  printf("\"stepsJammed\": %u, ", world->blind.stepsJammed);
+  printf("\"boots\": %u}", world->boots);
+
+  fprintf(stderr, "%-24s %8.1f s total %8.1f s moving  latency %7.1f/%7.1f ms  error %lld/%lld steps\n",
+          scenario.name, world->nowUs / 1e6, world->motionUs / 1e6, latencyMean / 1e3, world->latencyMaxUs / 1e3,
+          (long long)positionError, (long long)targetError);
+  return !tooHot;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<const char *> selected;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--verbose") == 0)
+      verbose = true;
+    else
+      selected.push_back(argv[i]);
+  }
+
+  world = (SimWorld *)mmap(NULL, sizeof(SimWorld), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (world == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+
+  bool ok = true;
+  bool first = true;
+  printf("{\n  \"travelSteps\": %d,\n  \"speedDelayUs\": %d,\n  \"burstSpeedDelayUs\": %d,\n  \"scenarios\": {",
+         SIM_TRAVEL_STEPS, SPEED_DELAY, BURST_SPEED_DELAY);
+  for (const Scenario &scenario : scenarios)
+  {
+    bool wanted = selected.empty();
+    for (const char *name : selected)
+      wanted = wanted || strcmp(name, scenario.name) == 0;
+    if (!wanted)
+      continue;
+
+    ok = runScenario(scenario, first) && ok;
+    first = false;
+  }
+  printf("\n  }\n}\n");
+  return ok ? 0 : 1;
+}
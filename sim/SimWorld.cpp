@@ -0,0 +1,343 @@
+#include "SimWorld.h"
+#include "MotionSupervisor.h"
+#include "CommandArbiter.h"
+#include "LimitSwitches.h"
+#include <EEPROM.h>
+#include <esp_partition.h>
+#include <esp_task_wdt.h>
+#include <unistd.h>
+
+SimWorld *world = NULL;
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+
+// ========================================
+// Blind model
+// ========================================
+
+// The first pulse of a move ends the wait for the command it serves
+static void stepStarted()
+{
+  if (!world->servingCommand)
+    return;
+  uint64_t latency = world->nowUs - world->commandUs;
+  world->latencyTotalUs += latency;
+  if (latency > world->latencyMaxUs)
+    world->latencyMaxUs = latency;
+  world->commandsServed++;
+  world->servingCommand = false;
+}
+
+// Pin-change handlers, attached afresh by each boot
+static void (*retractedHandler)() = NULL;
+static void (*deployedHandler)() = NULL;
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(), int)
+{
+  if (pin == LIMIT_RETRACTED)
+    retractedHandler = handler;
+  else if (pin == LIMIT_DEPLOYED)
+    deployedHandler = handler;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  int retracted = world->blind.read(LIMIT_RETRACTED);
+  int deployed = world->blind.read(LIMIT_DEPLOYED);
+  if (world->blind.write(pin, value))
+    stepStarted();
+  if (world->measuringSkew && llabs(world->blind.skew()) > world->skewMaxSteps)
+    world->skewMaxSteps = llabs(world->blind.skew());
+
+  // The switches only move under a step pulse, so this is where they interrupt
+  if (retractedHandler != NULL && world->blind.read(LIMIT_RETRACTED) != retracted)
+    retractedHandler();
+  if (deployedHandler != NULL && world->blind.read(LIMIT_DEPLOYED) != deployed)
+    deployedHandler();
+}
+
+int digitalRead(uint8_t pin)
+{
+  return world->blind.read(pin);
+}
+
+// Drive current (VREF) makes no difference to the model blind
+void analogWrite(uint8_t, int)
+{
+}
+
+// ========================================
+// Virtual time and scenario events
+// ========================================
+
+static void fireEvent(SimEvent &event)
+{
+  event.fired = true;
+  switch (event.kind)
+  {
+  case SIM_COMMAND:
+  case SIM_MANUAL_COMMAND:
+  {
+    // The queue holds one command; a newer one replaces it
+    MotorCommand replaced = MotorControl::getQueuedCommand();
+    CommandSource source = event.kind == SIM_MANUAL_COMMAND ? SOURCE_MANUAL : SOURCE_API;
+    world->commandsQueued++;
+    if (MotorControl::queueCommand((MotorCommand)event.value, source) != COMMAND_ACCEPTED)
+    {
+      world->commandsDeferred++;
+      break;
+    }
+    if (replaced != CMD_NONE)
+      world->commandsSuperseded++;
+    world->commandUs = world->nowUs;
+    break;
+  }
+
+  case SIM_MANUAL_HOLD:
+    CommandArbiter::setHold((uint32_t)event.value * 1000, true);
+    break;
+
+  case SIM_PRESET:
+    if (world->pendingPreset >= 0)
+      world->commandsSuperseded++;
+    world->commandsQueued++;
+    world->commandUs = world->nowUs;
+    world->pendingPreset = event.value;
+    break;
+
+  case SIM_CYCLE:
+    world->cyclesLeft = event.value;
+    break;
+
+  case SIM_POWER_LOSS:
+    // RAM is gone; only the world (and committed EEPROM) survives
+    world->nowUs += (uint64_t)event.value * 1000;
+    world->servingCommand = false;
+    world->blind.powerOff();
+    fflush(stdout);
+    fflush(stderr);
+    _exit(SIM_EXIT_POWER_LOSS);
+
+  case SIM_LOSE_STEPS:
+    world->blind.loseStepEvery = event.value;
+    world->blind.stepCounter = 0;
+    break;
+
+  case SIM_SWITCH_BOUNCE:
+    world->blind.bounceSteps = event.value;
+    break;
+
+  case SIM_SWITCH_SHIFT:
+    world->blind.travel += event.value;
+    break;
+
+  case SIM_SWITCH_CAPTURE:
+    LimitSwitches::setCapture(event.value != 0);
+    break;
+
+  case SIM_SECOND_TRAVEL:
+    world->blind.setSecondTravel(world->blind.travel + event.value);
+    break;
+  }
+}
+
+void simAdvance(uint64_t us)
+{
+  uint64_t end = world->nowUs + us;
+  while (true)
+  {
+    // Earliest unfired event due by the end of this interval
+    SimEvent *due = NULL;
+    for (int i = 0; i < world->eventCount; i++)
+    {
+      SimEvent &event = world->events[i];
+      if (!event.fired && event.atUs <= end && (due == NULL || event.atUs < due->atUs))
+        due = &event;
+    }
+
+    uint64_t until = end;
+    if (due != NULL)
+      until = due->atUs > world->nowUs ? due->atUs : world->nowUs;
+    if (MotionSupervisor::isMoveActive())
+      world->motionUs += until - world->nowUs;
+    world->nowUs = until;
+
+    if (world->nowUs >= SIM_TIME_LIMIT_US)
+    {
+      fflush(stdout);
+      _exit(SIM_EXIT_TIMEOUT);
+    }
+    if (due == NULL)
+      return;
+    fireEvent(*due);
+  }
+}
+
+bool simIdle()
+{
+  for (int i = 0; i < world->eventCount; i++)
+  {
+    if (!world->events[i].fired)
+      return false;
+  }
+  return world->pendingPreset < 0 && world->cyclesLeft == 0 && MotorControl::getQueuedCommand() == CMD_NONE &&
+         CommandArbiter::peekDeferred() == CMD_NONE;
+}
+
+void delay(uint32_t ms)
+{
+  simAdvance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+  simAdvance(us);
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(world->nowUs / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)world->nowUs;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (!enabled)
+    return size;
+  return fwrite(buffer, 1, size, stderr);
+}
+
+int HardwareSerial::available()
+{
+  return 0;
+}
+
+int HardwareSerial::read()
+{
+  return -1;
+}
+
+// ========================================
+// EEPROM
+// ========================================
+
+bool EEPROMClass::begin(size_t bytes)
+{
+  size = bytes < sizeof(world->eeprom) ? bytes : sizeof(world->eeprom);
+  memcpy(data, world->eeprom, size);
+  return true;
+}
+
+bool EEPROMClass::commit()
+{
+  memcpy(world->eeprom, data, size);
+  return true;
+}
+
+// ========================================
+// FreeRTOS and ESP-IDF
+// ========================================
+
+void vPortEnterCritical(portMUX_TYPE *)
+{
+}
+
+void vPortExitCritical(portMUX_TYPE *)
+{
+}
+
+static int mutexToken;
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  return &mutexToken;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t)
+{
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t)
+{
+  return pdTRUE;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t)
+{
+  return NULL;
+}
+
+BaseType_t xQueueSend(QueueHandle_t, const void *, TickType_t)
+{
+  return pdFALSE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t, void *, TickType_t)
+{
+  return pdFALSE;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  simAdvance((uint64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+  return ESP_RST_POWERON;
+}
+
+const char *esp_err_to_name(esp_err_t err)
+{
+  return err == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t)
+{
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset()
+{
+  return ESP_OK;
+}
+
+// No flash: History finds no partition and stays off
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t, esp_partition_subtype_t, const char *)
+{
+  return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *, size_t, void *, size_t)
+{
+  return ESP_FAIL;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *, size_t, const void *, size_t)
+{
+  return ESP_FAIL;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *, size_t, size_t)
+{
+  return ESP_FAIL;
+}
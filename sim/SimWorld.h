@@ -0,0 +1,89 @@
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "MotorControl.h"
+#include "BlindModel.h"
+
+// Exit status of a firmware boot that ended in a simulated power cut
+#define SIM_EXIT_POWER_LOSS 42
+#define SIM_EXIT_TIMEOUT 43
+
+#define SIM_MAX_EVENTS 16
+#define SIM_TIME_LIMIT_US (1200ULL * 1000000) // Give up on a scenario after 20 simulated minutes
+
+enum SimEventKind
+{
+  SIM_COMMAND,     // value: MotorCommand, queued as an API script would
+  SIM_MANUAL_COMMAND, // value: MotorCommand, queued from the web page
+  SIM_MANUAL_HOLD, // value: seconds automation waits after a manual command
+  SIM_PRESET,      // value: percent of the safe deployed position
+  SIM_CYCLE,       // value: deploys and retracts to run back to back
+  SIM_POWER_LOSS,  // value: ms until power returns
+  SIM_LOSE_STEPS,  // value: drop every Nth step pulse (0 = stop losing steps)
+  SIM_SWITCH_BOUNCE, // value: steps before each switch where it chatters (0 = clean)
+  SIM_SWITCH_SHIFT, // value: steps the deployed switch moves (negative: towards retracted)
+  SIM_SWITCH_CAPTURE, // value: 1 to capture switch edges and tune the debounce, 0 to stop
+  SIM_SECOND_TRAVEL // value: steps more travel on the second side than the first (dual-motor builds)
+};
+
+struct SimEvent
+{
+  uint64_t atUs;
+  SimEventKind kind;
+  int32_t value;
+  bool fired = false;
+};
+
+// Everything that outlives a firmware boot: the clock, the mechanism, the
+// committed EEPROM contents and the measurements. It lives in memory
+// shared with the runner, so a boot can be cut off at any point (the
+// child process exits) and the next boot starts from a clean RAM image
+// against the same physical state.
+struct SimWorld
+{
+  uint64_t nowUs;
+
+  BlindModel blind;
+
+  uint8_t eeprom[EEPROM_SIZE];
+
+  SimEvent events[SIM_MAX_EVENTS];
+  int eventCount;
+  int32_t pendingPreset; // -1 when none
+  int32_t cyclesLeft;
+
+  // Measurements
+  uint64_t motionUs;
+  uint64_t commandUs;
+  bool servingCommand;
+  uint32_t commandsQueued;
+  uint32_t commandsSuperseded;
+  uint32_t commandsDeferred;
+  uint32_t commandsServed;
+  uint64_t latencyTotalUs;
+  uint64_t latencyMaxUs;
+  uint64_t planErrorMaxUs; // Planned vs. actual duration of commanded moves
+  uint32_t burstMoves;     // Commanded moves planned at the burst speed
+  float peakMotorTempC;    // Highest ThermalModel estimate across boots
+  uint32_t boots;
+  int64_t firmwarePosition;
+  int64_t firmwareSafetyBuffer;
+  uint32_t firmwareDebounceUs; // The longer of the two switches'
+  uint32_t calibrationTraverseTenths; // Calibration travel across boots, in tenths of the travel
+  int64_t calibrationSavedUs;         // Versus retracted-first calibration (MotorControl's estimate)
+  bool measuringSkew;                 // Set during commanded moves (not searches)
+  int64_t skewMaxSteps;               // Largest BlindModel::skew() seen while measuring
+  int64_t firmwareSkew;               // MotorControl::getSkew() at the end
+};
+
+extern SimWorld *world;
+
+// Advance virtual time, firing due scenario events on the way
+void simAdvance(uint64_t us);
+
+// True once every event has fired and nothing is waiting for the motor
+bool simIdle();
+
+#endif // SIM_WORLD_H
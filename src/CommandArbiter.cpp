@@ -0,0 +1,286 @@
+#include "CommandArbiter.h"
+#include "MotionSupervisor.h"
+#include "Storage.h"
+#include "Trace.h"
+#include "LogShipper.h"
+
+static const char *SOURCE_NAMES[] = {"manual", "api", "schedule", "remote"};
+static const char *COMMAND_NAMES[] = {"none", "deploy", "retract", "calibrate"};
+
+// Static member initialization
+CommandArbiter::SourceStats CommandArbiter::stats[SOURCE_COUNT] = {};
+uint32_t CommandArbiter::holdMs = COMMAND_MANUAL_HOLD_MS;
+bool CommandArbiter::deferDuringHold = COMMAND_DEFER_DURING_HOLD;
+bool CommandArbiter::manualSeen = false;
+unsigned long CommandArbiter::lastManualMs = 0;
+MotorCommand CommandArbiter::deferredCommand = CMD_NONE;
+CommandSource CommandArbiter::deferredSource = SOURCE_API;
+MotorCommand CommandArbiter::runningCommand = CMD_NONE;
+CommandSource CommandArbiter::runningSource = SOURCE_API;
+portMUX_TYPE CommandArbiter::lock = portMUX_INITIALIZER_UNLOCKED;
+
+void CommandArbiter::begin()
+{
+  uint32_t storedHoldMs;
+  bool storedDefer;
+  if (Storage::loadArbitration(storedHoldMs, storedDefer))
+  {
+    holdMs = storedHoldMs;
+    deferDuringHold = storedDefer;
+  }
+
+  Console.print("Manual override hold: ");
+  Console.print(holdMs / 1000);
+  Console.print(" s, automation ");
+  Console.println(deferDuringHold ? "deferred" : "dropped");
+}
+
+bool CommandArbiter::isManual(CommandSource source)
+{
+  return source == SOURCE_MANUAL;
+}
+
+// Callers hold the lock
+uint32_t CommandArbiter::holdRemaining(unsigned long now)
+{
+  if (!manualSeen || now - lastManualMs >= holdMs)
+    return 0;
+  return holdMs - (now - lastManualMs);
+}
+
+CommandDecision CommandArbiter::admit(MotorCommand cmd, CommandSource source)
+{
+  unsigned long now = millis();
+  CommandDecision decision = COMMAND_ACCEPTED;
+
+  portENTER_CRITICAL(&lock);
+  SourceStats &s = stats[source];
+  s.received++;
+  if (isManual(source))
+  {
+    // A newer manual command outranks what automation wanted earlier
+    if (deferredCommand != CMD_NONE)
+      stats[deferredSource].dropped++;
+    deferredCommand = CMD_NONE;
+    manualSeen = true;
+    lastManualMs = now;
+  }
+  else if (holdRemaining(now) > 0)
+  {
+    if (deferDuringHold)
+    {
+      if (deferredCommand != CMD_NONE)
+        stats[deferredSource].dropped++;
+      deferredCommand = cmd;
+      deferredSource = source;
+      s.deferred++;
+      decision = COMMAND_DEFERRED;
+    }
+    else
+    {
+      s.dropped++;
+      decision = COMMAND_DROPPED;
+    }
+  }
+  if (decision == COMMAND_ACCEPTED)
+    s.accepted++;
+  portEXIT_CRITICAL(&lock);
+
+  if (decision != COMMAND_ACCEPTED)
+  {
+    Console.print("[Commands] Manual override active: ");
+    Console.print(sourceName(source));
+    Console.println(decision == COMMAND_DEFERRED ? " command deferred" : " command dropped");
+  }
+  return decision;
+}
+
+// Called once a manual command is queued: stop an automated deploy or
+// retract so the motor task gets to it now rather than after the move
+void CommandArbiter::preemptFor(CommandSource source)
+{
+  if (!isManual(source))
+    return;
+
+  bool preempt = false;
+  portENTER_CRITICAL(&lock);
+  if (!isManual(runningSource) && (runningCommand == CMD_DEPLOY || runningCommand == CMD_RETRACT))
+  {
+    stats[runningSource].preempted++;
+    runningCommand = CMD_NONE; // Once per move
+    preempt = true;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (preempt)
+  {
+    TRACE_INSTANT("preempt", source);
+    MotionSupervisor::preempt();
+  }
+}
+
+void CommandArbiter::beginCommand(MotorCommand cmd, CommandSource source)
+{
+  portENTER_CRITICAL(&lock);
+  runningCommand = cmd;
+  runningSource = source;
+  portEXIT_CRITICAL(&lock);
+}
+
+void CommandArbiter::endCommand()
+{
+  portENTER_CRITICAL(&lock);
+  runningCommand = CMD_NONE;
+  portEXIT_CRITICAL(&lock);
+}
+
+MotorCommand CommandArbiter::takeDeferred(CommandSource &source)
+{
+  MotorCommand cmd = CMD_NONE;
+  portENTER_CRITICAL(&lock);
+  if (deferredCommand != CMD_NONE && holdRemaining(millis()) == 0)
+  {
+    cmd = deferredCommand;
+    source = deferredSource;
+    deferredCommand = CMD_NONE;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (cmd != CMD_NONE)
+  {
+    Console.print("[Commands] Manual override expired, running deferred ");
+    Console.print(sourceName(source));
+    Console.println(" command");
+    MotionSupervisor::noteCommand();
+  }
+  return cmd;
+}
+
+MotorCommand CommandArbiter::peekDeferred()
+{
+  return deferredCommand;
+}
+
+uint32_t CommandArbiter::getHoldRemainingMs()
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  uint32_t remaining = holdRemaining(now);
+  portEXIT_CRITICAL(&lock);
+  return remaining;
+}
+
+uint32_t CommandArbiter::getHoldMs()
+{
+  return holdMs;
+}
+
+bool CommandArbiter::getDeferDuringHold()
+{
+  return deferDuringHold;
+}
+
+void CommandArbiter::setHold(uint32_t newHoldMs, bool newDefer)
+{
+  portENTER_CRITICAL(&lock);
+  holdMs = newHoldMs;
+  deferDuringHold = newDefer;
+  portEXIT_CRITICAL(&lock);
+  Storage::saveArbitration(newHoldMs, newDefer);
+}
+
+// "manual" for a person at the controls; anything else is automation
+CommandSource CommandArbiter::parseSource(const String &name)
+{
+  for (int i = 0; i < SOURCE_COUNT; i++)
+  {
+    if (name == SOURCE_NAMES[i])
+      return (CommandSource)i;
+  }
+  return SOURCE_API;
+}
+
+const char *CommandArbiter::sourceName(CommandSource source)
+{
+  return SOURCE_NAMES[source];
+}
+
+void CommandArbiter::writeJSON(Print &out)
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  SourceStats snapshot[SOURCE_COUNT];
+  memcpy(snapshot, stats, sizeof(snapshot));
+  uint32_t remaining = holdRemaining(now);
+  MotorCommand deferred = deferredCommand;
+  CommandSource deferredFrom = deferredSource;
+  portEXIT_CRITICAL(&lock);
+
+  out.print("{\"holdSeconds\":");
+  out.print(holdMs / 1000);
+  out.print(",\"policy\":\"");
+  out.print(deferDuringHold ? "defer" : "drop");
+  out.print("\",\"holdRemainingMs\":");
+  out.print(remaining);
+  out.print(",\"deferred\":");
+  if (deferred == CMD_NONE)
+  {
+    out.print("null");
+  }
+  else
+  {
+    out.print("{\"command\":\"");
+    out.print(COMMAND_NAMES[deferred]);
+    out.print("\",\"source\":\"");
+    out.print(sourceName(deferredFrom));
+    out.print("\"}");
+  }
+  out.print(",\"sources\":[");
+  for (int i = 0; i < SOURCE_COUNT; i++)
+  {
+    if (i > 0)
+      out.print(",");
+    out.print("{\"name\":\"");
+    out.print(SOURCE_NAMES[i]);
+    out.print("\",\"received\":");
+    out.print(snapshot[i].received);
+    out.print(",\"accepted\":");
+    out.print(snapshot[i].accepted);
+    out.print(",\"deferred\":");
+    out.print(snapshot[i].deferred);
+    out.print(",\"dropped\":");
+    out.print(snapshot[i].dropped);
+    out.print(",\"preempted\":");
+    out.print(snapshot[i].preempted);
+    out.print("}");
+  }
+  out.print("]}");
+}
+
+// Prometheus samples, one series per source and outcome
+void CommandArbiter::writeMetrics(Print &out)
+{
+  static const char *OUTCOMES[] = {"accepted", "deferred", "dropped", "preempted"};
+
+  portENTER_CRITICAL(&lock);
+  SourceStats snapshot[SOURCE_COUNT];
+  memcpy(snapshot, stats, sizeof(snapshot));
+  portEXIT_CRITICAL(&lock);
+
+  out.print("# HELP birdblinds_commands_total Motor commands by source and what became of them.\n");
+  out.print("# TYPE birdblinds_commands_total counter\n");
+  for (int i = 0; i < SOURCE_COUNT; i++)
+  {
+    uint32_t values[] = {snapshot[i].accepted, snapshot[i].deferred, snapshot[i].dropped, snapshot[i].preempted};
+    for (int o = 0; o < 4; o++)
+    {
+      out.print("birdblinds_commands_total{source=\"");
+      out.print(SOURCE_NAMES[i]);
+      out.print("\",outcome=\"");
+      out.print(OUTCOMES[o]);
+      out.print("\"} ");
+      out.print(values[o]);
+      out.print("\n");
+    }
+  }
+}
@@ -0,0 +1,244 @@
+#include "CommandBus.h"
+#include "Storage.h"
+#include "EspNowTransport.h"
+#include "UdpTransport.h"
+#include "LogShipper.h"
+
+static const char *COMMAND_NAMES[] = {"none", "deploy", "retract", "calibrate"};
+
+// Static member initialization
+CommandTransport *CommandBus::transports[REMOTE_MAX_TRANSPORTS] = {};
+CommandBus::TransportStats CommandBus::stats[REMOTE_MAX_TRANSPORTS] = {};
+size_t CommandBus::transportCount = 0;
+CommandBus::PeerState CommandBus::peers[REMOTE_DEDUP_SLOTS] = {};
+uint32_t CommandBus::nodeId = 0;
+uint32_t CommandBus::sequence = 0;
+uint8_t CommandBus::groups = REMOTE_DEFAULT_GROUPS;
+uint32_t CommandBus::accepted = 0;
+uint32_t CommandBus::repeats = 0;
+uint32_t CommandBus::rejected = 0;
+portMUX_TYPE CommandBus::lock = portMUX_INITIALIZER_UNLOCKED;
+
+void CommandBus::begin()
+{
+  // A fresh identity per boot keeps sequence numbers unambiguous
+  do
+  {
+    nodeId = esp_random();
+  } while (nodeId == 0);
+
+  if (!Storage::loadRemoteGroups(groups))
+    groups = REMOTE_DEFAULT_GROUPS;
+
+  static EspNowTransport espNow;
+  addTransport(&espNow);
+#if REMOTE_UDP_ENABLED
+  static UdpTransport udp(REMOTE_UDP_ADDRESS, REMOTE_UDP_PORT);
+  addTransport(&udp);
+#endif
+
+  Console.print("Remote commands: node ");
+  Console.print(String(nodeId, HEX));
+  Console.print(", groups 0x");
+  Console.print(String(groups, HEX));
+  Console.print(", ");
+  Console.print(transportCount);
+  Console.println(" transport(s)");
+}
+
+void CommandBus::addTransport(CommandTransport *transport)
+{
+  if (transportCount >= REMOTE_MAX_TRANSPORTS)
+    return;
+
+  if (!transport->begin())
+  {
+    Console.print("Warning: Command transport ");
+    Console.print(transport->name());
+    Console.println(" unavailable");
+    return;
+  }
+  transports[transportCount++] = transport;
+}
+
+void CommandBus::service()
+{
+  for (size_t i = 0; i < transportCount; i++)
+    transports[i]->poll();
+}
+
+bool CommandBus::broadcast(MotorCommand command, uint8_t targetGroups)
+{
+  CommandPacket packet = {};
+  packet.magic = COMMAND_PACKET_MAGIC;
+  packet.networkId = REMOTE_NETWORK_ID;
+  packet.nodeId = nodeId;
+  packet.command = command;
+  packet.groups = targetGroups;
+
+  portENTER_CRITICAL(&lock);
+  packet.sequence = ++sequence;
+  portEXIT_CRITICAL(&lock);
+
+  bool sent = false;
+  for (size_t i = 0; i < transportCount; i++)
+  {
+    if (transports[i]->send(packet))
+    {
+      portENTER_CRITICAL(&lock);
+      stats[i].sent++;
+      portEXIT_CRITICAL(&lock);
+      sent = true;
+    }
+  }
+
+  // The sending node is a member of its own groups too
+  if (targetGroups & groups)
+    MotorControl::queueCommand(command, SOURCE_REMOTE);
+
+  return sent;
+}
+
+void CommandBus::receive(const uint8_t *data, size_t length, CommandTransport *source)
+{
+  CommandPacket packet;
+  if (length != sizeof(packet))
+    return;
+  memcpy(&packet, data, sizeof(packet));
+
+  // Other installations and our own echoes
+  if (packet.magic != COMMAND_PACKET_MAGIC || packet.networkId != REMOTE_NETWORK_ID || packet.nodeId == nodeId)
+    return;
+
+  portENTER_CRITICAL(&lock);
+  for (size_t i = 0; i < transportCount; i++)
+  {
+    if (transports[i] == source)
+      stats[i].received++;
+  }
+  bool repeat = isRepeat(packet.nodeId, packet.sequence);
+  bool valid = packet.command == CMD_DEPLOY || packet.command == CMD_RETRACT || packet.command == CMD_CALIBRATE;
+  bool member = (packet.groups & groups) != 0;
+  if (repeat)
+    repeats++;
+  else if (!valid)
+    rejected++;
+  else if (member)
+    accepted++;
+  portEXIT_CRITICAL(&lock);
+
+  if (repeat || !valid || !member)
+    return;
+
+  MotorControl::queueCommand((MotorCommand)packet.command, SOURCE_REMOTE);
+
+  Console.print("[Remote] ");
+  Console.print(COMMAND_NAMES[packet.command]);
+  Console.print(" from node ");
+  Console.print(String(packet.nodeId, HEX));
+  Console.print(" via ");
+  Console.println(source->name());
+}
+
+// Called with the lock held
+bool CommandBus::isRepeat(uint32_t sender, uint32_t senderSequence)
+{
+  uint32_t now = millis();
+  size_t oldest = 0;
+
+  for (size_t i = 0; i < REMOTE_DEDUP_SLOTS; i++)
+  {
+    if (peers[i].nodeId == sender)
+    {
+      if ((int32_t)(senderSequence - peers[i].sequence) <= 0)
+        return true;
+      peers[i].sequence = senderSequence;
+      peers[i].lastSeenMs = now;
+      return false;
+    }
+    if (now - peers[i].lastSeenMs > now - peers[oldest].lastSeenMs || peers[i].nodeId == 0)
+      oldest = i;
+  }
+
+  // New sender replaces the least recently heard one
+  peers[oldest].nodeId = sender;
+  peers[oldest].sequence = senderSequence;
+  peers[oldest].lastSeenMs = now;
+  return false;
+}
+
+uint8_t CommandBus::getGroups()
+{
+  return groups;
+}
+
+void CommandBus::setGroups(uint8_t newGroups)
+{
+  groups = newGroups;
+  Storage::saveRemoteGroups(groups);
+}
+
+// "all" or a list of group numbers 1-8, e.g. "1,3-4"
+uint8_t CommandBus::parseGroups(const String &list)
+{
+  if (list == "all")
+    return 0xFF;
+
+  uint8_t mask = 0;
+  int start = 0;
+  while (start < (int)list.length())
+  {
+    int comma = list.indexOf(',', start);
+    String part = list.substring(start, comma < 0 ? list.length() : comma);
+    int dash = part.indexOf('-');
+    int from = part.substring(0, dash < 0 ? part.length() : dash).toInt();
+    int to = dash < 0 ? from : part.substring(dash + 1).toInt();
+
+    if (from < 1 || to > 8 || from > to)
+      return 0;
+
+    for (int g = from; g <= to; g++)
+      mask |= 1 << (g - 1);
+
+    if (comma < 0)
+      break;
+    start = comma + 1;
+  }
+  return mask;
+}
+
+void CommandBus::writeJSON(Print &out)
+{
+  portENTER_CRITICAL(&lock);
+  uint32_t acceptedCount = accepted;
+  uint32_t repeatCount = repeats;
+  uint32_t rejectedCount = rejected;
+  TransportStats snapshot[REMOTE_MAX_TRANSPORTS];
+  memcpy(snapshot, stats, sizeof(snapshot));
+  portEXIT_CRITICAL(&lock);
+
+  out.print("{\"nodeId\":\"");
+  out.print(nodeId, HEX);
+  out.print("\",\"groups\":");
+  out.print(groups);
+  out.print(",\"accepted\":");
+  out.print(acceptedCount);
+  out.print(",\"repeats\":");
+  out.print(repeatCount);
+  out.print(",\"rejected\":");
+  out.print(rejectedCount);
+  out.print(",\"transports\":[");
+  for (size_t i = 0; i < transportCount; i++)
+  {
+    if (i > 0)
+      out.print(",");
+    out.print("{\"name\":\"");
+    out.print(transports[i]->name());
+    out.print("\",\"sent\":");
+    out.print(snapshot[i].sent);
+    out.print(",\"received\":");
+    out.print(snapshot[i].received);
+    out.print("}");
+  }
+  out.print("]}");
+}
@@ -0,0 +1,300 @@
+#include "DeltaPatch.h"
+#include <string.h>
+
+const uint8_t DeltaPatch::MAGIC[4] = {'B', 'B', 'D', 'P'};
+
+static const uint8_t OP_END = 0x00;
+static const uint8_t OP_COPY = 0x01;
+static const uint8_t OP_INSERT = 0x02;
+
+// Scratch size for source reads during COPY and source verification
+static const size_t COPY_CHUNK = 256;
+
+static uint32_t readU32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void DeltaPatch::begin(SourceReader sourceReader, TargetWriter targetWriter, void *callbackContext)
+{
+  reader = sourceReader;
+  writer = targetWriter;
+  context = callbackContext;
+
+  state = ST_HEADER;
+  failure = PATCH_OK;
+  headerLength = 0;
+  opcode = 0;
+  arg1 = 0;
+  arg2 = 0;
+  varintValue = 0;
+  varintShift = 0;
+  insertRemaining = 0;
+  sourceSize = 0;
+  sourceCrc = 0;
+  targetSize = 0;
+  targetCrc = 0;
+  written = 0;
+  runningCrc = 0;
+}
+
+DeltaPatch::Status DeltaPatch::feed(const uint8_t *data, size_t length)
+{
+  size_t pos = 0;
+
+  while (pos < length)
+  {
+    switch (state)
+    {
+    case ST_HEADER:
+    {
+      size_t take = HEADER_SIZE - headerLength;
+      if (take > length - pos)
+        take = length - pos;
+      memcpy(header + headerLength, data + pos, take);
+      headerLength += take;
+      pos += take;
+
+      if (headerLength == HEADER_SIZE)
+      {
+        Status status = parseHeader();
+        if (status != PATCH_OK)
+          return fail(status);
+        state = ST_OPCODE;
+      }
+      break;
+    }
+
+    case ST_OPCODE:
+      opcode = data[pos++];
+      if (opcode == OP_END)
+      {
+        if (written != targetSize)
+          return fail(PATCH_SIZE_MISMATCH);
+        if (runningCrc != targetCrc)
+          return fail(PATCH_CRC_MISMATCH);
+        state = ST_DONE;
+      }
+      else if (opcode == OP_COPY || opcode == OP_INSERT)
+      {
+        varintValue = 0;
+        varintShift = 0;
+        state = ST_ARG1;
+      }
+      else
+      {
+        return fail(PATCH_BAD_OPCODE);
+      }
+      break;
+
+    case ST_ARG1:
+      if (varintOverflows(data[pos]))
+        return fail(PATCH_BAD_OPCODE);
+      if (!readVarint(data[pos++], arg1))
+        break;
+
+      if (opcode == OP_INSERT)
+      {
+        if ((uint64_t)written + arg1 > targetSize)
+          return fail(PATCH_SIZE_MISMATCH);
+        insertRemaining = arg1;
+        state = insertRemaining > 0 ? ST_INSERT : ST_OPCODE;
+      }
+      else
+      {
+        varintValue = 0;
+        varintShift = 0;
+        state = ST_ARG2;
+      }
+      break;
+
+    case ST_ARG2:
+    {
+      if (varintOverflows(data[pos]))
+        return fail(PATCH_BAD_OPCODE);
+      if (!readVarint(data[pos++], arg2))
+        break;
+
+      Status status = copyFromSource(arg1, arg2);
+      if (status != PATCH_OK)
+        return fail(status);
+      state = ST_OPCODE;
+      break;
+    }
+
+    case ST_INSERT:
+    {
+      size_t take = insertRemaining;
+      if (take > length - pos)
+        take = length - pos;
+
+      Status status = emit(data + pos, take);
+      if (status != PATCH_OK)
+        return fail(status);
+      pos += take;
+      insertRemaining -= take;
+      if (insertRemaining == 0)
+        state = ST_OPCODE;
+      break;
+    }
+
+    case ST_DONE:
+      return fail(PATCH_TRAILING_DATA);
+
+    case ST_FAILED:
+      return failure;
+    }
+  }
+
+  return state == ST_DONE ? PATCH_DONE : PATCH_OK;
+}
+
+DeltaPatch::Status DeltaPatch::finish()
+{
+  if (state == ST_FAILED)
+    return failure;
+  if (state != ST_DONE)
+    return fail(PATCH_INCOMPLETE);
+  return PATCH_DONE;
+}
+
+DeltaPatch::Status DeltaPatch::parseHeader()
+{
+  if (memcmp(header, MAGIC, sizeof(MAGIC)) != 0 || header[4] != VERSION)
+    return PATCH_BAD_HEADER;
+
+  sourceSize = readU32(header + 8);
+  sourceCrc = readU32(header + 12);
+  targetSize = readU32(header + 16);
+  targetCrc = readU32(header + 20);
+
+  return verifySource();
+}
+
+// A delta only applies to the exact image it was built against
+DeltaPatch::Status DeltaPatch::verifySource()
+{
+  uint8_t buffer[COPY_CHUNK];
+  uint32_t crc = 0;
+
+  for (uint32_t offset = 0; offset < sourceSize; offset += COPY_CHUNK)
+  {
+    size_t chunk = sourceSize - offset < COPY_CHUNK ? sourceSize - offset : COPY_CHUNK;
+    if (!reader(offset, buffer, chunk, context))
+      return PATCH_READ_FAILED;
+    crc = crc32(crc, buffer, chunk);
+  }
+
+  return crc == sourceCrc ? PATCH_OK : PATCH_SOURCE_MISMATCH;
+}
+
+DeltaPatch::Status DeltaPatch::copyFromSource(uint32_t offset, uint32_t length)
+{
+  if ((uint64_t)offset + length > sourceSize)
+    return PATCH_SOURCE_RANGE;
+  if ((uint64_t)written + length > targetSize)
+    return PATCH_SIZE_MISMATCH;
+
+  uint8_t buffer[COPY_CHUNK];
+  while (length > 0)
+  {
+    size_t chunk = length < COPY_CHUNK ? length : COPY_CHUNK;
+    if (!reader(offset, buffer, chunk, context))
+      return PATCH_READ_FAILED;
+
+    Status status = emit(buffer, chunk);
+    if (status != PATCH_OK)
+      return status;
+
+    offset += chunk;
+    length -= chunk;
+  }
+  return PATCH_OK;
+}
+
+DeltaPatch::Status DeltaPatch::emit(const uint8_t *data, size_t length)
+{
+  if (length == 0)
+    return PATCH_OK;
+  if (!writer(data, length, context))
+    return PATCH_WRITE_FAILED;
+
+  runningCrc = crc32(runningCrc, data, length);
+  written += length;
+  return PATCH_OK;
+}
+
+// LEB128: returns true once the final byte of the varint has been read
+bool DeltaPatch::readVarint(uint8_t byte, uint32_t &value)
+{
+  varintValue |= (uint32_t)(byte & 0x7F) << varintShift;
+  varintShift += 7;
+  if (byte & 0x80)
+    return false;
+
+  value = varintValue;
+  return true;
+}
+
+// A 32-bit value takes at most five bytes, and the fifth carries only the
+// top 4 bits; anything more would be silently truncated
+bool DeltaPatch::varintOverflows(uint8_t byte) const
+{
+  return varintShift >= 28 && (byte & 0xF0) != 0;
+}
+
+DeltaPatch::Status DeltaPatch::fail(Status status)
+{
+  state = ST_FAILED;
+  failure = status;
+  return status;
+}
+
+const char *DeltaPatch::statusName(Status status)
+{
+  switch (status)
+  {
+  case PATCH_OK:
+    return "ok";
+  case PATCH_DONE:
+    return "done";
+  case PATCH_BAD_HEADER:
+    return "bad patch header";
+  case PATCH_BAD_OPCODE:
+    return "corrupt patch operation";
+  case PATCH_SOURCE_MISMATCH:
+    return "patch was built for different firmware";
+  case PATCH_SOURCE_RANGE:
+    return "copy outside source image";
+  case PATCH_READ_FAILED:
+    return "source read failed";
+  case PATCH_WRITE_FAILED:
+    return "target write failed";
+  case PATCH_SIZE_MISMATCH:
+    return "target size mismatch";
+  case PATCH_CRC_MISMATCH:
+    return "target CRC mismatch";
+  case PATCH_TRAILING_DATA:
+    return "data after end of patch";
+  case PATCH_INCOMPLETE:
+    return "patch truncated";
+  }
+  return "unknown";
+}
+
+// CRC-32 (IEEE 802.3, same as zlib.crc32), nibble table to stay small
+uint32_t DeltaPatch::crc32(uint32_t crc, const uint8_t *data, size_t length)
+{
+  static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C};
+
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+    crc = (crc >> 4) ^ table[crc & 0x0F];
+  }
+  return ~crc;
+}
@@ -0,0 +1,98 @@
+#include "Discovery.h"
+#include "config.h"
+#include "MotorControl.h"
+#include "MotionSupervisor.h"
+#include "WiFiManager.h"
+#include "LogShipper.h"
+#include <ESPmDNS.h>
+#include <mdns.h>
+#include <WiFi.h>
+
+// Static member initialization
+bool Discovery::started = false;
+unsigned long Discovery::lastUpdateMs = 0;
+bool Discovery::lastCalibrated = false;
+int Discovery::lastPercent = -1;
+const char *Discovery::lastState = "";
+
+String Discovery::getHostname()
+{
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+
+  char hostname[32];
+  snprintf(hostname, sizeof(hostname), "%s-%02x%02x%02x", DISCOVERY_HOSTNAME_PREFIX, mac[3], mac[4], mac[5]);
+  return String(hostname);
+}
+
+bool Discovery::start()
+{
+  String hostname = getHostname();
+  if (!MDNS.begin(hostname.c_str()))
+  {
+    Console.println("ERROR: mDNS responder failed to start");
+    return false;
+  }
+
+  MDNS.addService(DISCOVERY_SERVICE, "tcp", 80);
+
+  Console.print("mDNS: ");
+  Console.print(hostname);
+  Console.println(".local advertising _" DISCOVERY_SERVICE "._tcp");
+  return true;
+}
+
+void Discovery::service()
+{
+  if (!started)
+  {
+    // Retried on every call until the network comes up
+    if (!WiFiManager::isConnected() || !start())
+      return;
+    started = true;
+    publish(true);
+    return;
+  }
+
+  if (millis() - lastUpdateMs >= DISCOVERY_MIN_UPDATE_MS)
+    publish(false);
+}
+
+void Discovery::publish(bool force)
+{
+  bool calibrated = MotorControl::isCalibrated();
+  int64_t position = MotorControl::getPosition();
+  int64_t deployed = MotorControl::getDeployedPosition();
+  int percent = calibrated && deployed > 0 ? (int)(position * 100 / deployed) : 0;
+
+  const char *state;
+  if (MotionSupervisor::isMoveActive())
+    state = "moving";
+  else if (!calibrated)
+    state = "uncalibrated";
+  else if (position <= 0)
+    state = "retracted";
+  else if (position >= MotorControl::getSafeDeployedPosition())
+    state = "deployed";
+  else
+    state = "partial";
+
+  if (!force && calibrated == lastCalibrated && percent == lastPercent && strcmp(state, lastState) == 0)
+    return;
+
+  // Replace the whole record set at once, so a change is a single announcement
+  char percentText[8];
+  snprintf(percentText, sizeof(percentText), "%d", percent);
+  mdns_txt_item_t items[] = {
+      {"version", FIRMWARE_VERSION},
+      {"calibrated", calibrated ? "1" : "0"},
+      {"position", percentText},
+      {"state", state},
+  };
+  mdns_service_txt_set("_" DISCOVERY_SERVICE, "_tcp", items, sizeof(items) / sizeof(items[0]));
+
+  lastCalibrated = calibrated;
+  lastPercent = percent;
+  lastState = state;
+  lastUpdateMs = millis();
+}
@@ -0,0 +1,74 @@
+#include "EspNowTransport.h"
+#include "CommandBus.h"
+#include "config.h"
+#include "WiFiManager.h"
+#include "LogShipper.h"
+#include <esp_now.h>
+#include <esp_wifi.h>
+#include <esp_idf_version.h>
+
+static const uint8_t BROADCAST_ADDRESS[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// ESP-NOW has a single receive callback
+static EspNowTransport *receiver = NULL;
+
+// Runs in the WiFi task
+#if ESP_IDF_VERSION_MAJOR >= 5
+static void onReceive(const esp_now_recv_info_t *info, const uint8_t *data, int length)
+#else
+static void onReceive(const uint8_t *mac, const uint8_t *data, int length)
+#endif
+{
+  if (receiver != NULL && length > 0)
+    CommandBus::receive(data, length, receiver);
+}
+
+bool EspNowTransport::begin()
+{
+  if (esp_now_init() != ESP_OK)
+  {
+    Console.println("ERROR: ESP-NOW init failed");
+    return false;
+  }
+
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, BROADCAST_ADDRESS, sizeof(BROADCAST_ADDRESS));
+  peer.channel = 0; // Follow the radio's current channel
+  peer.ifidx = WIFI_IF_STA;
+  peer.encrypt = false;
+  if (esp_now_add_peer(&peer) != ESP_OK)
+  {
+    Console.println("ERROR: ESP-NOW broadcast peer rejected");
+    esp_now_deinit();
+    return false;
+  }
+
+  receiver = this;
+  esp_now_register_recv_cb(onReceive);
+  return true;
+}
+
+bool EspNowTransport::send(const CommandPacket &packet)
+{
+  // Broadcasts are not acknowledged; receivers drop the repeats
+  bool sent = false;
+  for (int i = 0; i < REMOTE_ESPNOW_REPEATS; i++)
+  {
+    if (esp_now_send(BROADCAST_ADDRESS, (const uint8_t *)&packet, sizeof(packet)) == ESP_OK)
+      sent = true;
+  }
+  return sent;
+}
+
+void EspNowTransport::poll()
+{
+  // Connected nodes share the AP's channel. Without the AP, hold the agreed
+  // channel so that nodes can still hear each other.
+  if (WiFiManager::isConnected())
+    return;
+
+  uint8_t primary;
+  wifi_second_chan_t secondary;
+  if (esp_wifi_get_channel(&primary, &secondary) == ESP_OK && primary != REMOTE_ESPNOW_CHANNEL)
+    esp_wifi_set_channel(REMOTE_ESPNOW_CHANNEL, WIFI_SECOND_CHAN_NONE);
+}
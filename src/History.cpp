@@ -0,0 +1,507 @@
+#include "History.h"
+#include "MotionSupervisor.h"
+#include "MotorControl.h"
+#include "Trace.h"
+#include "LogShipper.h"
+#include <esp_partition.h>
+#include <sys/time.h>
+
+static const uint32_t BLOCK_MAGIC = 0x31484242; // "BBH1"
+static const size_t BLOCK_SIZE = 4096;          // One flash sector
+static const size_t CHUNK_HEADER = 2;           // u16 length, 0xFFFF = end of data
+static const size_t MAX_RECORD = 20;            // Two 64-bit varints
+
+// Earlier times come from a clock NTP has not set yet (ms since boot)
+static const int64_t VALID_TIME_THRESHOLD_MS = 1700000000000LL;
+
+static const char *EVENT_NAMES[] = {"sample", "move_start", "move_end", "limit_retracted",
+                                    "limit_deployed", "calibrated", "abort", "boot"};
+
+struct BlockHeader
+{
+  uint32_t magic;
+  uint32_t sequence;
+  int64_t baseTimeMs;
+  int64_t basePosition;
+};
+
+static const esp_partition_t *partition = NULL;
+
+// Static member initialization
+QueueHandle_t History::queue = NULL;
+bool History::available = false;
+uint32_t History::blockCount = 0;
+uint32_t History::headIndex = 0;
+uint32_t History::headSequence = 0;
+size_t History::writeOffset = BLOCK_SIZE;
+int64_t History::lastTimeMs = 0;
+int64_t History::lastPosition = 0;
+uint8_t History::staging[HISTORY_STAGING_BYTES];
+size_t History::stagingLength = 0;
+unsigned long History::stagingSince = 0;
+unsigned long History::lastSampleMs = 0;
+bool History::moveEnded = false;
+volatile uint32_t History::dropped = 0;
+History::Entry History::held[HISTORY_HELD_RECORDS];
+uint8_t History::heldCount = 0;
+
+static int64_t nowMs()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static size_t putVarint(uint8_t *out, uint64_t value)
+{
+  size_t length = 0;
+  while (value >= 0x80)
+  {
+    out[length++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  out[length++] = (uint8_t)value;
+  return length;
+}
+
+static bool getVarint(const uint8_t *data, size_t end, size_t &offset, uint64_t &value)
+{
+  value = 0;
+  for (int shift = 0; shift < 64 && offset < end; shift += 7)
+  {
+    uint8_t byte = data[offset++];
+    value |= (uint64_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static size_t encodeRecord(uint8_t *out, int64_t deltaMs, int64_t deltaPosition, uint8_t event)
+{
+  uint64_t zigzag = ((uint64_t)deltaPosition << 1) ^ (uint64_t)(deltaPosition >> 63);
+  size_t length = putVarint(out, ((uint64_t)deltaMs << 3) | event);
+  return length + putVarint(out + length, zigzag);
+}
+
+static bool decodeRecord(const uint8_t *data, size_t end, size_t &offset, int64_t &timeMs, int64_t &position, uint8_t &event)
+{
+  uint64_t head, zigzag;
+  if (!getVarint(data, end, offset, head) || !getVarint(data, end, offset, zigzag))
+    return false;
+
+  event = head & 0x07;
+  timeMs += (int64_t)(head >> 3);
+  position += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+  return true;
+}
+
+void History::begin()
+{
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HISTORY_PARTITION_LABEL);
+  if (partition == NULL)
+  {
+    Console.println("Warning: No history partition, motion history disabled");
+    return;
+  }
+
+  queue = xQueueCreate(HISTORY_QUEUE_LENGTH, sizeof(Entry));
+  blockCount = partition->size / BLOCK_SIZE;
+  scan();
+  available = true;
+
+  Console.print("History: ");
+  Console.print(blockCount);
+  Console.print(" blocks, head block ");
+  Console.print(headIndex);
+  Console.print(" (sequence ");
+  Console.print(headSequence);
+  Console.println(")");
+}
+
+// Find the newest block and the append point inside it
+void History::scan()
+{
+  BlockHeader header;
+  bool found = false;
+
+  for (uint32_t i = 0; i < blockCount; i++)
+  {
+    if (esp_partition_read(partition, i * BLOCK_SIZE, &header, sizeof(header)) != ESP_OK)
+      continue;
+    if (header.magic != BLOCK_MAGIC)
+      continue;
+    if (!found || (int32_t)(header.sequence - headSequence) > 0)
+    {
+      found = true;
+      headIndex = i;
+      headSequence = header.sequence;
+    }
+  }
+
+  writeOffset = BLOCK_SIZE; // Forces a fresh block unless the head can be resumed
+  if (!found)
+  {
+    headIndex = blockCount - 1;
+    return;
+  }
+
+  uint8_t *block = (uint8_t *)malloc(BLOCK_SIZE);
+  if (block == NULL || esp_partition_read(partition, headIndex * BLOCK_SIZE, block, BLOCK_SIZE) != ESP_OK)
+  {
+    free(block);
+    return;
+  }
+
+  memcpy(&header, block, sizeof(header));
+  int64_t timeMs = header.baseTimeMs;
+  int64_t position = header.basePosition;
+  size_t offset = sizeof(header);
+
+  while (offset + CHUNK_HEADER <= BLOCK_SIZE)
+  {
+    uint16_t length = block[offset] | (block[offset + 1] << 8);
+    if (length == 0xFFFF)
+      break;
+
+    size_t end = offset + CHUNK_HEADER + length;
+    size_t pos = offset + CHUNK_HEADER;
+    uint8_t event;
+    while (end <= BLOCK_SIZE && pos < end && decodeRecord(block, end, pos, timeMs, position, event))
+      ;
+    if (end > BLOCK_SIZE || pos != end)
+    {
+      offset = BLOCK_SIZE; // Corrupt chunk, seal the block
+      break;
+    }
+    offset = end;
+  }
+
+  // Resume only if everything past the append point is still erased
+  for (size_t i = offset; i < BLOCK_SIZE; i++)
+  {
+    if (block[i] != 0xFF)
+    {
+      offset = BLOCK_SIZE;
+      break;
+    }
+  }
+  free(block);
+
+  writeOffset = offset;
+  lastTimeMs = timeMs;
+  lastPosition = position;
+}
+
+void History::record(HistoryEvent event, int64_t position)
+{
+  if (!available)
+    return;
+
+  int64_t timeMs = nowMs();
+  bool clockSet = timeMs > VALID_TIME_THRESHOLD_MS;
+  Entry entry = {clockSet ? timeMs : (int64_t)millis(), position, (uint8_t)event, clockSet};
+  if (xQueueSend(queue, &entry, 0) != pdTRUE)
+    dropped++;
+}
+
+void History::service()
+{
+  if (!available)
+    return;
+
+  unsigned long now = millis();
+  bool moving = MotionSupervisor::isMoveActive();
+
+  if (moving && now - lastSampleMs >= HISTORY_SAMPLE_INTERVAL_MS)
+  {
+    lastSampleMs = now;
+    record(HIST_SAMPLE, MotorControl::getPosition());
+  }
+
+  Entry entry;
+  while (xQueueReceive(queue, &entry, 0) == pdTRUE)
+  {
+    if (entry.clockSet)
+    {
+      releaseHeld();
+      append(entry);
+    }
+    else
+    {
+      hold(entry);
+    }
+    if (entry.event == HIST_MOVE_END || entry.event == HIST_ABORT)
+      moveEnded = true;
+  }
+
+  // Without a network the clock may never be set; stop waiting eventually
+  if (heldCount > 0 && (nowMs() > VALID_TIME_THRESHOLD_MS || millis() >= HISTORY_CLOCK_WAIT_MS))
+    releaseHeld();
+
+  // Flash writes stall both cores, so wait until the motor is idle
+  if (moving || stagingLength == 0)
+    return;
+
+  if (moveEnded || stagingLength >= HISTORY_FLUSH_BYTES || now - stagingSince >= HISTORY_FLUSH_INTERVAL_MS)
+  {
+    flush();
+    moveEnded = false;
+  }
+}
+
+// Keep a record from before NTP sync until its epoch time is known
+void History::hold(const Entry &entry)
+{
+  if (heldCount == HISTORY_HELD_RECORDS)
+    releaseHeld();
+  held[heldCount++] = entry;
+}
+
+// Write the held records, dated from the boot time if the clock is set by
+// now and with times since boot otherwise
+void History::releaseHeld()
+{
+  if (heldCount == 0)
+    return;
+
+  // Epoch time of millis() == 0, if the clock has been set since
+  int64_t bootMs = nowMs() - (int64_t)millis();
+  bool clockSet = bootMs > VALID_TIME_THRESHOLD_MS;
+  if (clockSet)
+  {
+    Console.print("History: Dating ");
+    Console.print(heldCount);
+    Console.println(" records taken before the clock was set");
+  }
+
+  for (uint8_t i = 0; i < heldCount; i++)
+  {
+    if (clockSet)
+      held[i].timeMs += bootMs;
+    append(held[i]);
+  }
+  heldCount = 0;
+}
+
+void History::append(const Entry &entry)
+{
+  // The RAM buffer is full: write now, even mid-move
+  if (stagingLength + MAX_RECORD > sizeof(staging))
+    flush();
+
+  uint8_t encoded[MAX_RECORD];
+  int64_t deltaMs = entry.timeMs - lastTimeMs;
+  size_t length = deltaMs >= 0 ? encodeRecord(encoded, deltaMs, entry.position - lastPosition, entry.event) : 0;
+
+  // Start a new block when this one is full or the clock went backwards
+  if (deltaMs < 0 || writeOffset + CHUNK_HEADER + stagingLength + length > BLOCK_SIZE)
+  {
+    flush();
+    if (!openBlock(entry))
+      return;
+    length = encodeRecord(encoded, 0, 0, entry.event);
+  }
+
+  if (stagingLength == 0)
+    stagingSince = millis();
+  memcpy(staging + stagingLength, encoded, length);
+  stagingLength += length;
+  lastTimeMs = entry.timeMs;
+  lastPosition = entry.position;
+}
+
+bool History::flush()
+{
+  if (stagingLength == 0)
+    return true;
+
+  // Data first, then the length that makes the chunk visible
+  uint32_t base = headIndex * BLOCK_SIZE + writeOffset;
+  uint16_t length = stagingLength;
+  TRACE_BEGIN("history flush");
+  bool written = esp_partition_write(partition, base + CHUNK_HEADER, staging, stagingLength) == ESP_OK &&
+                 esp_partition_write(partition, base, &length, sizeof(length)) == ESP_OK;
+  TRACE_END("history flush");
+  if (!written)
+  {
+    Console.println("ERROR: History write failed");
+    writeOffset = BLOCK_SIZE; // Don't append to a damaged block
+    stagingLength = 0;
+    return false;
+  }
+
+  writeOffset += CHUNK_HEADER + stagingLength;
+  stagingLength = 0;
+  return true;
+}
+
+// Reclaim the oldest block and make it the new head
+bool History::openBlock(const Entry &first)
+{
+  uint32_t index = (headIndex + 1) % blockCount;
+  BlockHeader header = {BLOCK_MAGIC, headSequence + 1, first.timeMs, first.position};
+
+  TRACE_BEGIN("history erase");
+  bool opened = esp_partition_erase_range(partition, index * BLOCK_SIZE, BLOCK_SIZE) == ESP_OK &&
+                esp_partition_write(partition, index * BLOCK_SIZE, &header, sizeof(header)) == ESP_OK;
+  TRACE_END("history erase");
+  if (!opened)
+  {
+    Console.println("ERROR: History block erase failed");
+    return false;
+  }
+
+  headIndex = index;
+  headSequence = header.sequence;
+  writeOffset = sizeof(header);
+  lastTimeMs = first.timeMs;
+  lastPosition = first.position;
+  return true;
+}
+
+bool History::isAvailable()
+{
+  return available;
+}
+
+uint32_t History::getDroppedRecords()
+{
+  return dropped;
+}
+
+// ========================================
+// Range query cursor
+// ========================================
+
+History::Cursor::Cursor(int64_t from, int64_t to)
+    : fromMs(from), toMs(to), block(NULL), blocksVisited(0),
+      chunkEnd(BLOCK_SIZE), offset(BLOCK_SIZE), timeMs(0), position(0), event(0),
+      started(false), finished(false), emitted(0), pendingLength(0), pendingOffset(0)
+{
+  if (available)
+    block = (uint8_t *)(psramFound() ? ps_malloc(BLOCK_SIZE) : malloc(BLOCK_SIZE));
+}
+
+History::Cursor::~Cursor()
+{
+  free(block);
+}
+
+bool History::Cursor::loadBlock()
+{
+  if (block == NULL)
+    return false;
+
+  while (blocksVisited < blockCount)
+  {
+    uint32_t index = (headIndex + 1 + blocksVisited) % blockCount;
+    blocksVisited++;
+
+    if (esp_partition_read(partition, index * BLOCK_SIZE, block, BLOCK_SIZE) != ESP_OK)
+      continue;
+
+    BlockHeader header;
+    memcpy(&header, block, sizeof(header));
+    if (header.magic != BLOCK_MAGIC || header.baseTimeMs > toMs)
+      continue;
+
+    timeMs = header.baseTimeMs;
+    position = header.basePosition;
+    offset = sizeof(header);
+    chunkEnd = offset;
+    return true;
+  }
+  return false;
+}
+
+bool History::Cursor::nextRecord()
+{
+  while (true)
+  {
+    if (offset < chunkEnd)
+    {
+      if (decodeRecord(block, chunkEnd, offset, timeMs, position, event))
+        return true;
+      offset = chunkEnd = BLOCK_SIZE; // Corrupt chunk, skip the rest of the block
+      continue;
+    }
+
+    // Next chunk of the current block
+    if (offset + CHUNK_HEADER <= BLOCK_SIZE)
+    {
+      uint16_t length = block[offset] | (block[offset + 1] << 8);
+      if (length != 0xFFFF && offset + CHUNK_HEADER + length <= BLOCK_SIZE)
+      {
+        offset += CHUNK_HEADER;
+        chunkEnd = offset + length;
+        continue;
+      }
+    }
+
+    if (!loadBlock())
+      return false;
+  }
+}
+
+size_t History::Cursor::read(uint8_t *buffer, size_t maxLength)
+{
+  size_t written = 0;
+
+  while (written < maxLength)
+  {
+    if (pendingOffset < pendingLength)
+    {
+      size_t take = pendingLength - pendingOffset;
+      if (take > maxLength - written)
+        take = maxLength - written;
+      memcpy(buffer + written, pending + pendingOffset, take);
+      pendingOffset += take;
+      written += take;
+      continue;
+    }
+
+    if (finished)
+      break;
+
+    pendingOffset = 0;
+    if (!started)
+    {
+      started = true;
+      pendingLength = snprintf(pending, sizeof(pending), "{\"records\":[");
+      continue;
+    }
+
+    bool found = false;
+    while (nextRecord())
+    {
+      if (timeMs > toMs)
+      {
+        // Records within a block are in time order
+        offset = chunkEnd = BLOCK_SIZE;
+        continue;
+      }
+      if (timeMs >= fromMs)
+      {
+        found = true;
+        break;
+      }
+    }
+
+    if (found)
+    {
+      // Times since boot (the clock was never set) are tagged
+      pendingLength = snprintf(pending, sizeof(pending), "%s[%lld,%lld,\"%s\"%s]", emitted > 0 ? "," : "",
+                               (long long)timeMs, (long long)position, EVENT_NAMES[event],
+                               timeMs <= VALID_TIME_THRESHOLD_MS ? ",\"uptime\"" : "");
+      emitted++;
+    }
+    else
+    {
+      pendingLength = snprintf(pending, sizeof(pending), "],\"count\":%u}", (unsigned int)emitted);
+      finished = true;
+    }
+  }
+
+  return written;
+}
@@ -0,0 +1,359 @@
+#include "LimitSwitches.h"
+#include "Storage.h"
+#include "Metrics.h"
+#include "LogShipper.h"
+
+static const char *SWITCH_NAMES[] = {"retracted", "deployed"};
+static const uint32_t DURATION_BOUNDS_US[SWITCH_DURATION_BUCKETS - 1] = {100, 500, 1000, 2000, 5000, 10000, 20000};
+
+// Static member initialization
+LimitSwitches::Contact LimitSwitches::contacts[SWITCH_COUNT] = {};
+LimitSwitches::BounceStats LimitSwitches::stats[SWITCH_COUNT] = {};
+uint32_t LimitSwitches::debounceUs[SWITCH_COUNT] = {SWITCH_DEBOUNCE_DEFAULT_US, SWITCH_DEBOUNCE_DEFAULT_US};
+SwitchEdge LimitSwitches::edges[SWITCH_EDGE_BUFFER];
+uint32_t LimitSwitches::head = 0;
+uint32_t LimitSwitches::tail = 0;
+uint32_t LimitSwitches::dropped = 0;
+bool LimitSwitches::capturing = SWITCH_CAPTURE_DEFAULT;
+portMUX_TYPE LimitSwitches::lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Called after MotorControl::begin() has configured the pins
+void LimitSwitches::begin()
+{
+  uint32_t stored[SWITCH_COUNT];
+  if (Storage::loadDebounce(stored, SWITCH_COUNT))
+    memcpy(debounceUs, stored, sizeof(debounceUs));
+
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    bool closed = digitalRead(pinOf((LimitSwitch)i)) == LOW;
+    contacts[i].closed = closed;
+    contacts[i].raw = closed;
+    contacts[i].lastEdgeUs = micros();
+  }
+  attachInterrupt(digitalPinToInterrupt(LIMIT_RETRACTED), retractedEdge, CHANGE);
+  attachInterrupt(digitalPinToInterrupt(LIMIT_DEPLOYED), deployedEdge, CHANGE);
+
+  Console.print("Limit switch debounce: ");
+  Console.print(debounceUs[SWITCH_RETRACTED]);
+  Console.print(" us retracted, ");
+  Console.print(debounceUs[SWITCH_DEPLOYED]);
+  Console.print(" us deployed, edge capture ");
+  Console.println(capturing ? "on" : "off");
+}
+
+uint8_t LimitSwitches::pinOf(LimitSwitch sw)
+{
+  return sw == SWITCH_RETRACTED ? LIMIT_RETRACTED : LIMIT_DEPLOYED;
+}
+
+// Callers hold the lock
+void IRAM_ATTR LimitSwitches::onEdge(LimitSwitch sw, bool closed, uint32_t now)
+{
+  Contact &contact = contacts[sw];
+  if (closed == contact.raw)
+    return;
+  contact.raw = closed;
+  contact.lastEdgeUs = now;
+
+  if (!capturing)
+    return;
+  if (head - tail >= SWITCH_EDGE_BUFFER)
+  {
+    dropped++;
+    return;
+  }
+  SwitchEdge &edge = edges[head++ % SWITCH_EDGE_BUFFER];
+  edge.us = now;
+  edge.sw = sw;
+  edge.closed = closed;
+}
+
+void IRAM_ATTR LimitSwitches::retractedEdge()
+{
+  bool closed = digitalRead(LIMIT_RETRACTED) == LOW;
+  portENTER_CRITICAL_ISR(&lock);
+  onEdge(SWITCH_RETRACTED, closed, micros());
+  portEXIT_CRITICAL_ISR(&lock);
+}
+
+void IRAM_ATTR LimitSwitches::deployedEdge()
+{
+  bool closed = digitalRead(LIMIT_DEPLOYED) == LOW;
+  portENTER_CRITICAL_ISR(&lock);
+  onEdge(SWITCH_DEPLOYED, closed, micros());
+  portEXIT_CRITICAL_ISR(&lock);
+}
+
+// The pin is read here as well, so a missed interrupt only costs time
+bool LimitSwitches::isClosed(LimitSwitch sw)
+{
+  bool level = digitalRead(pinOf(sw)) == LOW;
+
+  portENTER_CRITICAL(&lock);
+  uint32_t now = micros();
+  onEdge(sw, level, now);
+  Contact &contact = contacts[sw];
+  bool hit = false;
+  if (contact.closed != contact.raw && now - contact.lastEdgeUs >= debounceUs[sw])
+  {
+    contact.closed = contact.raw;
+    hit = contact.closed;
+  }
+  bool closed = contact.closed;
+  portEXIT_CRITICAL(&lock);
+
+  if (hit)
+    Metrics::recordLimitHit(sw == SWITCH_DEPLOYED);
+  return closed;
+}
+
+bool LimitSwitches::isHeld(LimitSwitch sw, bool closed, uint32_t minUs)
+{
+  if (isClosed(sw) != closed)
+    return false;
+  portENTER_CRITICAL(&lock);
+  const Contact &contact = contacts[sw];
+  bool held = contact.raw == closed && micros() - contact.lastEdgeUs >= minUs;
+  portEXIT_CRITICAL(&lock);
+  return held;
+}
+
+uint32_t LimitSwitches::getSettledUs(LimitSwitch sw)
+{
+  portENTER_CRITICAL(&lock);
+  uint32_t settled = micros() - contacts[sw].lastEdgeUs;
+  portEXIT_CRITICAL(&lock);
+  return settled;
+}
+
+// Callers hold the lock
+void LimitSwitches::closeBurst(BounceStats &s)
+{
+  s.open = false;
+  s.bursts++;
+
+  uint32_t bounces = s.burstEdges - 1;
+  s.bounces += bounces;
+  int bucket = 0;
+  while (bucket < SWITCH_BOUNCE_BUCKETS - 1 && bounces >= (1u << bucket))
+    bucket++;
+  s.bounceHistogram[bucket]++;
+
+  uint32_t duration = s.lastEdgeUs - s.burstStartUs;
+  if (duration > s.maxDurationUs)
+    s.maxDurationUs = duration;
+  bucket = 0;
+  while (bucket < SWITCH_DURATION_BUCKETS - 1 && duration > DURATION_BOUNDS_US[bucket])
+    bucket++;
+  s.durationHistogram[bucket]++;
+}
+
+// Motor task after each move, and the web task before reporting
+void LimitSwitches::update()
+{
+  bool retuned = false;
+  uint32_t tuned[SWITCH_COUNT];
+
+  portENTER_CRITICAL(&lock);
+  uint32_t now = micros();
+  while (tail != head)
+  {
+    const SwitchEdge &edge = edges[tail++ % SWITCH_EDGE_BUFFER];
+    BounceStats &s = stats[edge.sw];
+    if (s.open && edge.us - s.lastEdgeUs >= SWITCH_QUIET_US)
+      closeBurst(s);
+    s.edges++;
+    if (!s.open)
+    {
+      s.open = true;
+      s.burstEdges = 0;
+      s.burstStartUs = edge.us;
+    }
+    else if (edge.us - s.lastEdgeUs > s.maxGapUs)
+      s.maxGapUs = edge.us - s.lastEdgeUs;
+    s.burstEdges++;
+    s.lastEdgeUs = edge.us;
+  }
+
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    BounceStats &s = stats[i];
+    if (s.open && now - s.lastEdgeUs >= SWITCH_QUIET_US)
+      closeBurst(s);
+    if (s.bursts < SWITCH_TUNE_MIN_BURSTS)
+      continue;
+
+    // Long enough to outlast the stillest contact bounce seen
+    uint64_t target = (uint64_t)s.maxGapUs * SWITCH_DEBOUNCE_MARGIN_PERCENT / 100;
+    if (target < SWITCH_DEBOUNCE_MIN_US)
+      target = SWITCH_DEBOUNCE_MIN_US;
+    if (target > SWITCH_DEBOUNCE_MAX_US)
+      target = SWITCH_DEBOUNCE_MAX_US;
+    if (target != debounceUs[i])
+    {
+      debounceUs[i] = target;
+      retuned = true;
+    }
+  }
+  memcpy(tuned, debounceUs, sizeof(tuned));
+  portEXIT_CRITICAL(&lock);
+
+  if (!retuned)
+    return;
+  Storage::saveDebounce(tuned, SWITCH_COUNT);
+  Console.print("[Switches] Debounce tuned: ");
+  Console.print(tuned[SWITCH_RETRACTED]);
+  Console.print(" us retracted, ");
+  Console.print(tuned[SWITCH_DEPLOYED]);
+  Console.println(" us deployed");
+}
+
+void LimitSwitches::setCapture(bool enabled)
+{
+  portENTER_CRITICAL(&lock);
+  capturing = enabled;
+  portEXIT_CRITICAL(&lock);
+}
+
+bool LimitSwitches::isCapturing()
+{
+  return capturing;
+}
+
+void LimitSwitches::resetStats()
+{
+  portENTER_CRITICAL(&lock);
+  memset(stats, 0, sizeof(stats));
+  tail = head;
+  dropped = 0;
+  portEXIT_CRITICAL(&lock);
+}
+
+uint32_t LimitSwitches::getDebounceUs(LimitSwitch sw)
+{
+  return debounceUs[sw];
+}
+
+void LimitSwitches::writeJSON(Print &out)
+{
+  update();
+
+  bool closed[SWITCH_COUNT];
+  for (int i = 0; i < SWITCH_COUNT; i++)
+    closed[i] = isClosed((LimitSwitch)i);
+
+  portENTER_CRITICAL(&lock);
+  BounceStats snapshot[SWITCH_COUNT];
+  memcpy(snapshot, stats, sizeof(snapshot));
+  uint32_t debounce[SWITCH_COUNT];
+  memcpy(debounce, debounceUs, sizeof(debounce));
+  uint32_t lost = dropped;
+  uint32_t pending = head - tail;
+  portEXIT_CRITICAL(&lock);
+
+  out.print("{\"capture\":");
+  out.print(capturing ? "true" : "false");
+  out.print(",\"pendingEdges\":");
+  out.print(pending);
+  out.print(",\"droppedEdges\":");
+  out.print(lost);
+  out.print(",\"bounceBuckets\":[\"0\",\"1\",\"2-3\",\"4-7\",\"8-15\",\"16+\"],");
+  out.print("\"durationBucketsUs\":[");
+  for (int b = 0; b < SWITCH_DURATION_BUCKETS - 1; b++)
+  {
+    out.print(DURATION_BOUNDS_US[b]);
+    out.print(",");
+  }
+  out.print("null],\"switches\":[");
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    const BounceStats &s = snapshot[i];
+    if (i > 0)
+      out.print(",");
+    out.print("{\"name\":\"");
+    out.print(SWITCH_NAMES[i]);
+    out.print("\",\"closed\":");
+    out.print(closed[i] ? "true" : "false");
+    out.print(",\"debounceUs\":");
+    out.print(debounce[i]);
+    out.print(",\"edges\":");
+    out.print(s.edges);
+    out.print(",\"bursts\":");
+    out.print(s.bursts);
+    out.print(",\"bounces\":");
+    out.print(s.bounces);
+    out.print(",\"maxGapUs\":");
+    out.print(s.maxGapUs);
+    out.print(",\"maxDurationUs\":");
+    out.print(s.maxDurationUs);
+    out.print(",\"bounceHistogram\":[");
+    for (int b = 0; b < SWITCH_BOUNCE_BUCKETS; b++)
+    {
+      if (b > 0)
+        out.print(",");
+      out.print(s.bounceHistogram[b]);
+    }
+    out.print("],\"durationHistogram\":[");
+    for (int b = 0; b < SWITCH_DURATION_BUCKETS; b++)
+    {
+      if (b > 0)
+        out.print(",");
+      out.print(s.durationHistogram[b]);
+    }
+    out.print("]}");
+  }
+  out.print("]}");
+}
+
+// Prometheus samples, one series per switch
+void LimitSwitches::writeMetrics(Print &out)
+{
+  portENTER_CRITICAL(&lock);
+  uint32_t debounce[SWITCH_COUNT];
+  memcpy(debounce, debounceUs, sizeof(debounce));
+  uint32_t bursts[SWITCH_COUNT], bounces[SWITCH_COUNT];
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    bursts[i] = stats[i].bursts;
+    bounces[i] = stats[i].bounces;
+  }
+  uint32_t lost = dropped;
+  portEXIT_CRITICAL(&lock);
+
+  out.print("# HELP birdblinds_switch_debounce_us Time a limit switch must hold a new level before it counts.\n");
+  out.print("# TYPE birdblinds_switch_debounce_us gauge\n");
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    out.print("birdblinds_switch_debounce_us{switch=\"");
+    out.print(SWITCH_NAMES[i]);
+    out.print("\"} ");
+    out.print(debounce[i]);
+    out.print("\n");
+  }
+  out.print("# HELP birdblinds_switch_bursts_total Captured limit switch transitions.\n");
+  out.print("# TYPE birdblinds_switch_bursts_total counter\n");
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    out.print("birdblinds_switch_bursts_total{switch=\"");
+    out.print(SWITCH_NAMES[i]);
+    out.print("\"} ");
+    out.print(bursts[i]);
+    out.print("\n");
+  }
+  out.print("# HELP birdblinds_switch_bounces_total Extra edges within captured transitions.\n");
+  out.print("# TYPE birdblinds_switch_bounces_total counter\n");
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    out.print("birdblinds_switch_bounces_total{switch=\"");
+    out.print(SWITCH_NAMES[i]);
+    out.print("\"} ");
+    out.print(bounces[i]);
+    out.print("\n");
+  }
+  out.print("# HELP birdblinds_switch_edges_dropped_total Edges lost to a full capture buffer.\n");
+  out.print("# TYPE birdblinds_switch_edges_dropped_total counter\n");
+  out.print("birdblinds_switch_edges_dropped_total ");
+  out.print(lost);
+  out.print("\n");
+}
@@ -0,0 +1,394 @@
+#include "LogShipper.h"
+#include "Storage.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+// Before NTP has set the clock, messages go out without a timestamp
+static const time_t VALID_TIME_THRESHOLD = 1700000000;
+
+static const char *SEVERITY_NAMES[] = {"emergency", "alert", "critical", "error", "warning", "notice", "info", "debug"};
+
+ConsoleOutput Console;
+
+// Static member initialization
+LogShippingSettings LogShipper::settings = {};
+bool LogShipper::active = false;
+char LogShipper::hostname[32] = "-";
+LogShipper::Slot LogShipper::slots[LOG_SHIP_SLOTS] = {};
+uint32_t LogShipper::nextSeq = 1;
+char LogShipper::partial[LOG_SHIP_LINE_BYTES];
+size_t LogShipper::partialLength = 0;
+uint32_t LogShipper::sentLines = 0;
+uint32_t LogShipper::datagrams = 0;
+uint32_t LogShipper::sendFailures = 0;
+uint32_t LogShipper::dropped[8] = {};
+int LogShipper::sock = -1;
+portMUX_TYPE LogShipper::lock = portMUX_INITIALIZER_UNLOCKED;
+
+size_t ConsoleOutput::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t ConsoleOutput::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = Serial.write(buffer, size);
+  LogShipper::append(buffer, size);
+  return written;
+}
+
+void LogShipper::begin()
+{
+  LogShippingSettings stored;
+  if (Storage::loadLogShipping(stored))
+    setSettings(stored);
+  else
+    setSettings(LogShippingSettings{"", LOG_SHIP_DEFAULT_PORT, LOG_SHIP_DEFAULT_SEVERITY, 0});
+
+  if (active)
+  {
+    Console.print("Log shipping: ");
+    Console.print(settings.host);
+    Console.print(":");
+    Console.print(settings.port);
+    Console.print(", ");
+    Console.print(SEVERITY_NAMES[settings.maxSeverity]);
+    Console.println(" and more urgent");
+  }
+  else
+  {
+    Console.println("Log shipping: off");
+  }
+}
+
+void LogShipper::setHostname(const String &name)
+{
+  portENTER_CRITICAL(&lock);
+  strncpy(hostname, name.c_str(), sizeof(hostname) - 1);
+  hostname[sizeof(hostname) - 1] = '\0';
+  portEXIT_CRITICAL(&lock);
+}
+
+LogShippingSettings LogShipper::getSettings()
+{
+  portENTER_CRITICAL(&lock);
+  LogShippingSettings copy = settings;
+  portEXIT_CRITICAL(&lock);
+  return copy;
+}
+
+// The caller has checked the address and port; pooled lines are kept
+// for the new collector
+void LogShipper::setSettings(const LogShippingSettings &newSettings)
+{
+  portENTER_CRITICAL(&lock);
+  settings = newSettings;
+  settings.host[sizeof(settings.host) - 1] = '\0';
+  if (settings.maxSeverity > 7)
+    settings.maxSeverity = 7;
+  active = settings.host[0] != '\0';
+  if (!active)
+  {
+    for (size_t i = 0; i < LOG_SHIP_SLOTS; i++)
+      slots[i].seq = 0;
+    partialLength = 0;
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+bool LogShipper::isValidHost(const String &host)
+{
+  struct in_addr address;
+  return host.length() < sizeof(settings.host) && inet_aton(host.c_str(), &address) != 0;
+}
+
+int LogShipper::parseSeverity(const String &name)
+{
+  for (int i = 0; i < 8; i++)
+  {
+    if (name == SEVERITY_NAMES[i])
+      return i;
+  }
+  if (name.length() == 1 && name[0] >= '0' && name[0] <= '7')
+    return name[0] - '0';
+  return -1;
+}
+
+// Any task: gather printed text into lines
+void LogShipper::append(const uint8_t *data, size_t size)
+{
+  if (!active)
+    return;
+
+  portENTER_CRITICAL(&lock);
+  for (size_t i = 0; i < size; i++)
+  {
+    char c = data[i];
+    if (c == '\n')
+      commitLine();
+    else if (c != '\r' && partialLength < sizeof(partial))
+      partial[partialLength++] = c;
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+// Callers hold the lock. Lines from different tasks can interleave, as
+// they already do on the serial port.
+void LogShipper::commitLine()
+{
+  size_t length = partialLength;
+  partialLength = 0;
+  if (length == 0 || !active)
+    return;
+
+  // Past a leading "[Task] " tag, the first word says how urgent it is
+  size_t start = 0;
+  if (partial[0] == '[')
+  {
+    while (start < length && partial[start] != ']')
+      start++;
+    start += 2;
+  }
+  uint8_t severity = LOG_SEVERITY_INFO;
+  if (start + 5 <= length && (strncmp(partial + start, "ERROR", 5) == 0 || strncmp(partial + start, "Error", 5) == 0))
+    severity = LOG_SEVERITY_ERROR;
+  else if (start + 7 <= length && (strncmp(partial + start, "WARNING", 7) == 0 || strncmp(partial + start, "Warning", 7) == 0))
+    severity = LOG_SEVERITY_WARNING;
+  if (severity > settings.maxSeverity)
+    return;
+
+  // A free slot, or else the oldest of the least urgent lines
+  Slot *slot = NULL;
+  Slot *victim = NULL;
+  for (size_t i = 0; i < LOG_SHIP_SLOTS && slot == NULL; i++)
+  {
+    Slot &s = slots[i];
+    if (s.seq == 0)
+      slot = &s;
+    else if (victim == NULL || s.severity > victim->severity || (s.severity == victim->severity && s.seq < victim->seq))
+      victim = &s;
+  }
+  if (slot == NULL)
+  {
+    if (victim->severity < severity)
+    {
+      dropped[severity]++;
+      return;
+    }
+    dropped[victim->severity]++;
+    slot = victim;
+  }
+
+  slot->seq = nextSeq++;
+  slot->ms = millis();
+  slot->severity = severity;
+  slot->length = length;
+  memcpy(slot->text, partial, length);
+}
+
+// Copy out the oldest line newer than `after`
+bool LogShipper::takeNext(uint32_t after, Slot &out)
+{
+  portENTER_CRITICAL(&lock);
+  const Slot *next = NULL;
+  for (size_t i = 0; i < LOG_SHIP_SLOTS; i++)
+  {
+    const Slot &s = slots[i];
+    if (s.seq > after && (next == NULL || s.seq < next->seq))
+      next = &s;
+  }
+  if (next != NULL)
+    out = *next;
+  portEXIT_CRITICAL(&lock);
+  return next != NULL;
+}
+
+// Free every line up to and including `upTo`: the ones just sent, as
+// lines pooled meanwhile have higher numbers
+void LogShipper::release(uint32_t upTo)
+{
+  portENTER_CRITICAL(&lock);
+  for (size_t i = 0; i < LOG_SHIP_SLOTS; i++)
+  {
+    if (slots[i].seq != 0 && slots[i].seq <= upTo)
+      slots[i].seq = 0;
+  }
+  portEXIT_CRITICAL(&lock);
+}
+
+// <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID SD MSG
+size_t LogShipper::format(const Slot &slot, char *out, size_t capacity)
+{
+  char timestamp[24] = "-";
+  time_t now = time(NULL);
+  if (now > VALID_TIME_THRESHOLD)
+  {
+    time_t at = now - (time_t)((millis() - slot.ms) / 1000);
+    struct tm utc;
+    gmtime_r(&at, &utc);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+  }
+
+  char name[sizeof(hostname)];
+  portENTER_CRITICAL(&lock);
+  memcpy(name, hostname, sizeof(name));
+  portEXIT_CRITICAL(&lock);
+
+  int length = snprintf(out, capacity, "<%u>1 %s %s birdblinds - - - %.*s", LOG_SHIP_FACILITY * 8 + slot.severity,
+                        timestamp, name, (int)slot.length, slot.text);
+  if (length < 0)
+    return 0;
+  return (size_t)length < capacity ? length : capacity - 1;
+}
+
+bool LogShipper::openSocket()
+{
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0)
+    return false;
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+  return true;
+}
+
+// Web task: once a batch has had time to gather, or the pool is filling
+// up, send lines until the pool is empty or the network pushes back
+void LogShipper::service()
+{
+  static char datagram[LOG_SHIP_DATAGRAM_BYTES];
+
+  if (!active)
+    return;
+
+  unsigned long now = millis();
+  size_t pending = 0;
+  uint32_t oldestMs = now;
+  portENTER_CRITICAL(&lock);
+  for (size_t i = 0; i < LOG_SHIP_SLOTS; i++)
+  {
+    if (slots[i].seq != 0)
+    {
+      pending++;
+      if ((int32_t)(slots[i].ms - oldestMs) < 0)
+        oldestMs = slots[i].ms;
+    }
+  }
+  LogShippingSettings target = settings;
+  portEXIT_CRITICAL(&lock);
+
+  if (pending == 0 || (pending < LOG_SHIP_SLOTS * 3 / 4 && now - oldestMs < LOG_SHIP_BATCH_MS))
+    return;
+  if (sock < 0 && !openSocket())
+    return;
+
+  struct sockaddr_in destination = {};
+  destination.sin_family = AF_INET;
+  destination.sin_port = htons(target.port);
+  destination.sin_addr.s_addr = inet_addr(target.host);
+
+  while (true)
+  {
+    size_t length = 0;
+    size_t lines = 0;
+    uint32_t last = 0;
+    Slot slot;
+    while (takeNext(last, slot))
+    {
+      char message[LOG_SHIP_LINE_BYTES + 96];
+      size_t size = format(slot, message, sizeof(message));
+      if (length > 0 && length + 1 + size > sizeof(datagram))
+        break;
+      if (length > 0)
+        datagram[length++] = '\n';
+      memcpy(datagram + length, message, size);
+      length += size;
+      lines++;
+      last = slot.seq;
+    }
+    if (lines == 0)
+      break;
+
+    if (sendto(sock, datagram, length, MSG_DONTWAIT, (struct sockaddr *)&destination, sizeof(destination)) < 0)
+    {
+      // No route yet or no buffers: the lines wait for the next round
+      sendFailures++;
+      break;
+    }
+    release(last);
+    sentLines += lines;
+    datagrams++;
+  }
+}
+
+void LogShipper::writeJSON(Print &out)
+{
+  LogShippingSettings current = getSettings();
+  portENTER_CRITICAL(&lock);
+  size_t pending = 0;
+  for (size_t i = 0; i < LOG_SHIP_SLOTS; i++)
+    pending += slots[i].seq != 0;
+  uint32_t droppedTotal = 0;
+  for (int i = 0; i < 8; i++)
+    droppedTotal += dropped[i];
+  uint32_t sent = sentLines;
+  uint32_t sentDatagrams = datagrams;
+  uint32_t failures = sendFailures;
+  portEXIT_CRITICAL(&lock);
+
+  out.print("{\"host\":\"");
+  out.print(current.host);
+  out.print("\",\"port\":");
+  out.print(current.port);
+  out.print(",\"level\":\"");
+  out.print(SEVERITY_NAMES[current.maxSeverity]);
+  out.print("\",\"pending\":");
+  out.print((unsigned int)pending);
+  out.print(",\"sent\":");
+  out.print(sent);
+  out.print(",\"datagrams\":");
+  out.print(sentDatagrams);
+  out.print(",\"dropped\":");
+  out.print(droppedTotal);
+  out.print(",\"sendFailures\":");
+  out.print(failures);
+  out.print("}");
+}
+
+// Prometheus samples
+void LogShipper::writeMetrics(Print &out)
+{
+  portENTER_CRITICAL(&lock);
+  uint32_t sent = sentLines;
+  uint32_t sentDatagrams = datagrams;
+  uint32_t failures = sendFailures;
+  uint32_t lost[8];
+  memcpy(lost, dropped, sizeof(lost));
+  portEXIT_CRITICAL(&lock);
+
+  out.print("# HELP birdblinds_log_lines_shipped_total Log lines sent to the collector.\n");
+  out.print("# TYPE birdblinds_log_lines_shipped_total counter\n");
+  out.print("birdblinds_log_lines_shipped_total ");
+  out.print(sent);
+  out.print("\n# HELP birdblinds_log_datagrams_total Datagrams sent to the collector.\n");
+  out.print("# TYPE birdblinds_log_datagrams_total counter\n");
+  out.print("birdblinds_log_datagrams_total ");
+  out.print(sentDatagrams);
+  out.print("\n# HELP birdblinds_log_send_failures_total Sends that failed; their lines were kept for the next try.\n");
+  out.print("# TYPE birdblinds_log_send_failures_total counter\n");
+  out.print("birdblinds_log_send_failures_total ");
+  out.print(failures);
+  out.print("\n# HELP birdblinds_log_lines_dropped_total Log lines dropped from a full pool, by severity.\n");
+  out.print("# TYPE birdblinds_log_lines_dropped_total counter\n");
+  const uint8_t shown[] = {LOG_SEVERITY_ERROR, LOG_SEVERITY_WARNING, LOG_SEVERITY_INFO};
+  for (uint8_t severity : shown)
+  {
+    out.print("birdblinds_log_lines_dropped_total{severity=\"");
+    out.print(SEVERITY_NAMES[severity]);
+    out.print("\"} ");
+    out.print(lost[severity]);
+    out.print("\n");
+  }
+}
@@ -0,0 +1,222 @@
+#include "Metrics.h"
+#include "Storage.h"
+#include "Watchdog.h"
+#include "MotionSupervisor.h"
+#include "LogShipper.h"
+
+#define RTC_COUNTERS_MAGIC 0x4C494645 // "LIFE"
+
+// The live lifetime totals. Power-on leaves RTC memory undefined, so the
+// copy is only trusted with the right magic and checksum.
+struct RtcCounters
+{
+  uint32_t magic;
+  LifetimeCounters totals;
+  uint32_t checksum;
+};
+
+static RTC_NOINIT_ATTR RtcCounters rtc;
+
+// Static member initialization
+portMUX_TYPE Metrics::lock = portMUX_INITIALIZER_UNLOCKED;
+uint32_t Metrics::watchdogResets = 0;
+uint32_t Metrics::motionAborts = 0;
+bool Metrics::dirty = false;
+uint32_t Metrics::unsavedMoves = 0;
+unsigned long Metrics::lastCheckpointMs = 0;
+unsigned long Metrics::runtimeMarkMs = 0;
+
+void Metrics::begin()
+{
+  Storage::loadMetrics(watchdogResets, motionAborts);
+
+  // RTC memory holds everything since the last checkpoint, unless the
+  // power went or EEPROM is somehow ahead of it
+  LifetimeCounters stored = {};
+  bool haveStored = Storage::loadLifetime(stored);
+  bool rtcValid = rtc.magic == RTC_COUNTERS_MAGIC && rtc.checksum == checksum(rtc.totals) &&
+                  (!haveStored || rtc.totals.runtimeSeconds >= stored.runtimeSeconds);
+  if (!rtcValid)
+  {
+    rtc.magic = RTC_COUNTERS_MAGIC;
+    rtc.totals = stored;
+  }
+  rtc.totals.boots++;
+  seal();
+  lastCheckpointMs = millis();
+  runtimeMarkMs = lastCheckpointMs;
+
+  Console.print("Lifetime: ");
+  Console.print(rtc.totals.moves);
+  Console.print(" moves, ");
+  Console.print((unsigned long)(rtc.totals.steps / 1000));
+  Console.print("k steps, boot ");
+  Console.print(rtc.totals.boots);
+  Console.println(rtcValid ? " (from RTC memory)" : haveStored ? " (from EEPROM)" : " (starting from zero)");
+
+  if (Watchdog::wasWatchdogReset())
+  {
+    Console.println("WARNING: Last reset was caused by a watchdog");
+    recordWatchdogReset();
+    flush();
+  }
+}
+
+void Metrics::recordWatchdogReset()
+{
+  portENTER_CRITICAL(&lock);
+  watchdogResets++;
+  dirty = true;
+  portEXIT_CRITICAL(&lock);
+}
+
+void Metrics::recordMotionAbort()
+{
+  portENTER_CRITICAL(&lock);
+  motionAborts++;
+  dirty = true;
+  portEXIT_CRITICAL(&lock);
+}
+
+void Metrics::recordMove(int64_t steps)
+{
+  portENTER_CRITICAL(&lock);
+  rtc.totals.moves++;
+  rtc.totals.steps += steps > 0 ? steps : 0;
+  unsavedMoves++;
+  seal();
+  portEXIT_CRITICAL(&lock);
+}
+
+void Metrics::recordLimitHit(bool deployed)
+{
+  portENTER_CRITICAL(&lock);
+  if (deployed)
+    rtc.totals.deployedLimitHits++;
+  else
+    rtc.totals.retractedLimitHits++;
+  seal();
+  portEXIT_CRITICAL(&lock);
+}
+
+uint32_t Metrics::getWatchdogResets()
+{
+  return watchdogResets;
+}
+
+uint32_t Metrics::getMotionAborts()
+{
+  return motionAborts;
+}
+
+LifetimeCounters Metrics::getLifetime()
+{
+  portENTER_CRITICAL(&lock);
+  accumulateRuntime(millis());
+  LifetimeCounters totals = rtc.totals;
+  portEXIT_CRITICAL(&lock);
+  return totals;
+}
+
+uint32_t Metrics::checksum(const LifetimeCounters &totals)
+{
+  const uint8_t *bytes = (const uint8_t *)&totals;
+  uint32_t hash = 2166136261u; // FNV-1a
+  for (size_t i = 0; i < sizeof(totals); i++)
+    hash = (hash ^ bytes[i]) * 16777619u;
+  return hash;
+}
+
+// Callers hold the lock, or run before other tasks start
+void Metrics::seal()
+{
+  rtc.checksum = checksum(rtc.totals);
+}
+
+// Whole seconds only, so no time is lost to rounding; callers hold the lock
+void Metrics::accumulateRuntime(unsigned long now)
+{
+  unsigned long seconds = (now - runtimeMarkMs) / 1000;
+  if (seconds == 0)
+    return;
+  rtc.totals.runtimeSeconds += seconds;
+  runtimeMarkMs += seconds * 1000;
+  seal();
+}
+
+void Metrics::flush()
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  bool needsSave = dirty;
+  uint32_t resets = watchdogResets;
+  uint32_t aborts = motionAborts;
+  dirty = false;
+  accumulateRuntime(now);
+  bool checkpointDue = unsavedMoves >= LIFETIME_CHECKPOINT_MOVES ||
+                       now - lastCheckpointMs >= (unsigned long)LIFETIME_CHECKPOINT_INTERVAL_S * 1000;
+  portEXIT_CRITICAL(&lock);
+
+  if (needsSave)
+  {
+    Storage::saveMetrics(resets, aborts);
+  }
+
+  // A commit stalls flash reads, so never in the middle of a move
+  if (checkpointDue && !MotionSupervisor::isMoveActive())
+    checkpoint();
+}
+
+void Metrics::checkpoint()
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  bool needsSave = dirty;
+  uint32_t resets = watchdogResets;
+  uint32_t aborts = motionAborts;
+  dirty = false;
+  accumulateRuntime(now);
+  rtc.totals.checkpoints++;
+  seal();
+  LifetimeCounters snapshot = rtc.totals;
+  unsavedMoves = 0;
+  lastCheckpointMs = now;
+  portEXIT_CRITICAL(&lock);
+
+  if (needsSave)
+    Storage::saveMetrics(resets, aborts);
+  Storage::saveLifetime(snapshot);
+}
+
+void Metrics::writeMetrics(Print &out)
+{
+  LifetimeCounters totals = getLifetime();
+
+  out.print("# HELP birdblinds_lifetime_steps_total Step pulses over the life of the unit.\n");
+  out.print("# TYPE birdblinds_lifetime_steps_total counter\n");
+  out.print("birdblinds_lifetime_steps_total ");
+  out.print((unsigned long long)totals.steps);
+  out.print("\n# HELP birdblinds_lifetime_moves_total Moves over the life of the unit.\n");
+  out.print("# TYPE birdblinds_lifetime_moves_total counter\n");
+  out.print("birdblinds_lifetime_moves_total ");
+  out.print(totals.moves);
+  out.print("\n# HELP birdblinds_lifetime_limit_hits_total Limit switch closures over the life of the unit.\n");
+  out.print("# TYPE birdblinds_lifetime_limit_hits_total counter\n");
+  out.print("birdblinds_lifetime_limit_hits_total{switch=\"retracted\"} ");
+  out.print(totals.retractedLimitHits);
+  out.print("\nbirdblinds_lifetime_limit_hits_total{switch=\"deployed\"} ");
+  out.print(totals.deployedLimitHits);
+  out.print("\n# HELP birdblinds_lifetime_runtime_seconds_total Time powered on over the life of the unit.\n");
+  out.print("# TYPE birdblinds_lifetime_runtime_seconds_total counter\n");
+  out.print("birdblinds_lifetime_runtime_seconds_total ");
+  out.print(totals.runtimeSeconds);
+  out.print("\n# HELP birdblinds_boots_total Boots over the life of the unit.\n");
+  out.print("# TYPE birdblinds_boots_total counter\n");
+  out.print("birdblinds_boots_total ");
+  out.print(totals.boots);
+  out.print("\n# HELP birdblinds_lifetime_checkpoints_total EEPROM writes of the lifetime totals.\n");
+  out.print("# TYPE birdblinds_lifetime_checkpoints_total counter\n");
+  out.print("birdblinds_lifetime_checkpoints_total ");
+  out.print(totals.checkpoints);
+  out.print("\n");
+}
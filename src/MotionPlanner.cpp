@@ -0,0 +1,44 @@
+#include "MotionPlanner.h"
+#include "config.h"
+
+MotionPlan MotionPlanner::plan(int64_t from, int64_t to, int64_t steps, SpeedProfile profile)
+{
+  MotionPlan plan = {};
+  plan.from = from;
+  plan.to = to;
+  plan.steps = steps;
+  if (steps <= 0)
+    return plan;
+
+  plan.profile = profile;
+  plan.segments = 1;
+  plan.peakSpeed = stepRate(profile);
+  plan.durationUs = DIRECTION_SETUP_US + stepsDurationUs(steps, profile);
+  return plan;
+}
+
+uint64_t MotionPlanner::stepsDurationUs(int64_t steps, SpeedProfile profile)
+{
+  return steps > 0 ? (uint64_t)steps * stepPeriodUs(profile) : 0;
+}
+
+// Each step is two half-periods
+uint32_t MotionPlanner::stepPeriodUs(SpeedProfile profile)
+{
+  return 2 * halfPeriodUs(profile);
+}
+
+uint32_t MotionPlanner::stepRate(SpeedProfile profile)
+{
+  return 1000000 / stepPeriodUs(profile);
+}
+
+uint32_t MotionPlanner::halfPeriodUs(SpeedProfile profile)
+{
+  return profile == PROFILE_BURST ? BURST_SPEED_DELAY : SPEED_DELAY;
+}
+
+const char *MotionPlanner::profileName(SpeedProfile profile)
+{
+  return profile == PROFILE_BURST ? "burst" : "conservative";
+}
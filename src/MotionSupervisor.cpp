@@ -0,0 +1,250 @@
+#include "MotionSupervisor.h"
+#include "config.h"
+#include "Metrics.h"
+#include "Watchdog.h"
+#include "History.h"
+#include "MotorControl.h"
+#include "MoveReports.h"
+#include "MotionPlanner.h"
+#include "ThermalModel.h"
+#include "LimitSwitches.h"
+#include "Trace.h"
+#include "LogShipper.h"
+#include <limits.h>
+
+// Static member initialization
+const char *MotionSupervisor::moveLabel = "";
+SpeedProfile MotionSupervisor::moveProfile = PROFILE_CONSERVATIVE;
+int64_t MotionSupervisor::expectedSteps = 0;
+unsigned long MotionSupervisor::moveStartUs = 0;
+unsigned long MotionSupervisor::moveStartMs = 0;
+unsigned long MotionSupervisor::originUs = 0;
+unsigned long MotionSupervisor::firstStepUs = 0;
+unsigned long MotionSupervisor::lastStepUs = 0;
+unsigned long MotionSupervisor::minStepUs = 0;
+int64_t MotionSupervisor::startPosition = 0;
+uint8_t MotionSupervisor::moveFlags = 0;
+volatile unsigned long MotionSupervisor::commandUs = 0;
+volatile bool MotionSupervisor::commandPending = false;
+int64_t MotionSupervisor::plannedSteps = 0;
+int64_t MotionSupervisor::stepsSoFar = 0;
+portMUX_TYPE MotionSupervisor::progressLock = portMUX_INITIALIZER_UNLOCKED;
+unsigned long MotionSupervisor::lastFeedUs = 0;
+uint64_t MotionSupervisor::budgetUs = 0;
+bool MotionSupervisor::aborted = false;
+volatile bool MotionSupervisor::preemptRequested = false;
+bool MotionSupervisor::preempted = false;
+volatile bool MotionSupervisor::active = false;
+
+void MotionSupervisor::beginMove(const char *label, int64_t steps, SpeedProfile profile)
+{
+  moveLabel = label;
+  moveProfile = profile;
+  expectedSteps = steps;
+  portENTER_CRITICAL(&progressLock);
+  plannedSteps = steps;
+  stepsSoFar = 0;
+  portEXIT_CRITICAL(&progressLock);
+  moveStartUs = micros();
+  moveStartMs = millis();
+  lastFeedUs = moveStartUs;
+  aborted = false;
+  preemptRequested = false;
+  preempted = false;
+  active = true;
+  startPosition = MotorControl::getPosition();
+  History::record(HIST_MOVE_START, startPosition);
+
+  // Start latency runs from the queued command, if this move serves one
+  originUs = commandPending ? commandUs : moveStartUs;
+  commandPending = false;
+  firstStepUs = moveStartUs;
+  lastStepUs = moveStartUs;
+  minStepUs = ULONG_MAX;
+  moveFlags = profile == PROFILE_BURST ? MOVE_BURST : 0;
+
+  uint64_t nominalUs = MotionPlanner::stepsDurationUs(steps, profile);
+  budgetUs = nominalUs * MOTION_BUDGET_PERCENT / 100 + (uint64_t)MOTION_BUDGET_MARGIN_MS * 1000;
+  ThermalModel::startMoving(profile);
+
+  TRACE_BEGIN(label);
+  TRACE_BEGIN("step burst");
+}
+
+bool MotionSupervisor::checkProgress(int64_t stepsDone)
+{
+  if (aborted || preempted)
+    return false;
+  if (preemptRequested)
+  {
+    preempted = true;
+    moveFlags |= MOVE_PREEMPTED;
+    Console.print("Move preempted (");
+    Console.print(moveLabel);
+    Console.print(") after ");
+    Console.print(stepsDone);
+    Console.println(" steps");
+    return false;
+  }
+
+  unsigned long now = micros();
+  unsigned long elapsedUs = now - moveStartUs;
+  portENTER_CRITICAL(&progressLock);
+  stepsSoFar = stepsDone;
+  portEXIT_CRITICAL(&progressLock);
+
+  // Called once per step period, just before the pulse
+  if (stepsDone == 0)
+    firstStepUs = now;
+  else if (now - lastStepUs < minStepUs)
+    minStepUs = now - lastStepUs;
+  lastStepUs = now;
+
+  if (elapsedUs > budgetUs)
+  {
+    abortMove("time budget exceeded", stepsDone);
+    return false;
+  }
+
+  // Compare actual against expected progress once the move is under way
+  if (elapsedUs > (unsigned long)MOTION_STALL_GRACE_MS * 1000)
+  {
+    int64_t expectedByNow = elapsedUs / MotionPlanner::stepPeriodUs(moveProfile);
+    if (expectedByNow > expectedSteps)
+      expectedByNow = expectedSteps;
+
+    if ((int64_t)stepsDone * 100 < (int64_t)expectedByNow * MOTION_MIN_PROGRESS_PERCENT)
+    {
+      abortMove("progress stalled", stepsDone);
+      return false;
+    }
+  }
+
+  // Steps run in bursts between watchdog feeds; on the trace timeline a
+  // stretched burst is a slow stretch of the move
+  if (now - lastFeedUs > (unsigned long)MOTION_WDT_FEED_INTERVAL_MS * 1000)
+  {
+    TRACE_END("step burst");
+    lastFeedUs = now;
+    Watchdog::feed();
+    TRACE_COUNTER("steps", stepsDone);
+    TRACE_BEGIN("step burst");
+  }
+
+  return true;
+}
+
+void MotionSupervisor::endMove(int64_t stepsTaken)
+{
+  unsigned long now = micros();
+  ThermalModel::stopMoving();
+  LimitSwitches::update();
+  Metrics::recordMove(stepsTaken);
+  TRACE_END("step burst");
+  TRACE_COUNTER("steps", stepsTaken);
+  TRACE_END(moveLabel);
+  int64_t endPosition = MotorControl::getPosition();
+  History::record(HIST_MOVE_END, endPosition);
+
+  MoveReport report = {};
+  report.label = moveLabel;
+  report.startMs = moveStartMs;
+  report.durationMs = (now - moveStartUs) / 1000;
+  report.startPosition = startPosition;
+  report.endPosition = endPosition;
+  report.stepsRequested = expectedSteps;
+  report.stepsTaken = stepsTaken;
+  if (stepsTaken > 0)
+  {
+    // The last pulse ends one step period after its progress check
+    unsigned long lastPulseEndUs = lastStepUs + MotionPlanner::stepPeriodUs(moveProfile);
+    report.averageSpeed = (uint64_t)stepsTaken * 1000000 / (lastPulseEndUs - firstStepUs);
+    report.peakSpeed = minStepUs != ULONG_MAX ? 1000000 / minStepUs : report.averageSpeed;
+    report.startLatencyUs = firstStepUs - originUs;
+    report.finishLatencyUs = (long)(now - lastPulseEndUs) > 0 ? now - lastPulseEndUs : 0;
+  }
+
+  uint32_t nominalSpeed = MotionPlanner::stepRate(moveProfile);
+  if (stepsTaken >= MOVE_SLOW_MIN_STEPS && (uint64_t)report.averageSpeed * 100 < (uint64_t)nominalSpeed * MOVE_SLOW_PERCENT)
+    moveFlags |= MOVE_SLOW;
+  if (aborted)
+    moveFlags |= MOVE_ABORTED;
+  report.flags = moveFlags;
+  MoveReports::add(report);
+  moveLabel = "";
+  expectedSteps = 0;
+  active = false;
+}
+
+bool MotionSupervisor::wasAborted()
+{
+  return aborted;
+}
+
+void MotionSupervisor::preempt()
+{
+  preemptRequested = true;
+}
+
+bool MotionSupervisor::wasPreempted()
+{
+  return preempted;
+}
+
+bool MotionSupervisor::isMoveActive()
+{
+  return active;
+}
+
+// 64-bit counts tear on a 32-bit core, so both are read under the lock
+float MotionSupervisor::getProgress()
+{
+  portENTER_CRITICAL(&progressLock);
+  int64_t planned = plannedSteps;
+  int64_t done = stepsSoFar;
+  portEXIT_CRITICAL(&progressLock);
+  if (!active || planned <= 0)
+    return 0;
+  return done >= planned ? 1.0f : (float)done / planned;
+}
+
+uint32_t MotionSupervisor::getEtaMs()
+{
+  portENTER_CRITICAL(&progressLock);
+  int64_t planned = plannedSteps;
+  int64_t done = stepsSoFar;
+  portEXIT_CRITICAL(&progressLock);
+  if (!active || done >= planned)
+    return 0;
+  return MotionPlanner::stepsDurationUs(planned - done, moveProfile) / 1000;
+}
+
+void MotionSupervisor::abortMove(const char *reason, int64_t stepsDone)
+{
+  aborted = true;
+  Metrics::recordMotionAbort();
+  History::record(HIST_ABORT, MotorControl::getPosition());
+
+  Console.print("ERROR: Motion aborted (");
+  Console.print(moveLabel);
+  Console.print("): ");
+  Console.print(reason);
+  Console.print(" after ");
+  Console.print(stepsDone);
+  Console.print(" of ");
+  Console.print(expectedSteps);
+  Console.print(" steps in ");
+  Console.print((micros() - moveStartUs) / 1000);
+  Console.println(" ms");
+}
+
+void MotionSupervisor::flagMove(uint8_t flags)
+{
+  moveFlags |= flags;
+}
+
+void MotionSupervisor::noteCommand()
+{
+  commandUs = micros();
+  commandPending = true;
+}
@@ -1,17 +1,36 @@
 #include "MotorControl.h"
 #include "config.h"
 #include "Storage.h"
+#include "MotionSupervisor.h"
+#include "History.h"
+#include "MoveReports.h"
+#include "Trace.h"
+#include "CommandArbiter.h"
+#include "ThermalModel.h"
+#include "SafetyBuffer.h"
+#include "LimitSwitches.h"
+#include "LogShipper.h"
 
 // Static member initialization
 SemaphoreHandle_t MotorControl::positionMutex = NULL;
 SemaphoreHandle_t MotorControl::commandMutex = NULL;
-long MotorControl::currentPosition = 0;
-long MotorControl::retractedPosition = 0;
-long MotorControl::deployedPosition = 0;
-long MotorControl::safeDeployedPosition = 0;
-long MotorControl::safetyBuffer = DEFAULT_SAFETY_BUFFER;
+int64_t MotorControl::currentPosition = 0;
+int64_t MotorControl::retractedPosition = 0;
+int64_t MotorControl::deployedPosition = 0;
+int64_t MotorControl::safeDeployedPosition = 0;
+int64_t MotorControl::safetyBuffer = DEFAULT_SAFETY_BUFFER;
+int64_t MotorControl::secondPosition = 0;
+int64_t MotorControl::skewSteps = 0;
+int64_t MotorControl::moveTarget = 0;
 bool MotorControl::calibrated = false;
+bool MotorControl::calibrationSuspect = false;
+MotorCommand MotorControl::lastEndCommand = CMD_NONE;
+CalibrationStats MotorControl::calibrationStats = {};
 volatile MotorCommand MotorControl::pendingCommand = CMD_NONE;
+volatile CommandSource MotorControl::pendingSource = SOURCE_API;
+volatile bool MotorControl::firmwareUpdating = false;
+uint32_t MotorControl::halfPeriodUs = SPEED_DELAY;
+volatile uint32_t MotorControl::stateGeneration = 0;
 
 void MotorControl::begin()
 {
@@ -26,7 +45,7 @@ void MotorControl::createMutexes()
 
   if (positionMutex == NULL || commandMutex == NULL)
   {
-    Serial.println("FATAL: Failed to create motor control mutexes!");
+    Console.println("FATAL: Failed to create motor control mutexes!");
     while (1)
     {
       delay(1000);
@@ -41,39 +60,143 @@ void MotorControl::initializePins()
   pinMode(DIR_PIN, OUTPUT);
   pinMode(LIMIT_RETRACTED, INPUT_PULLUP);
   pinMode(LIMIT_DEPLOYED, INPUT_PULLUP);
+  if (DUAL_MOTOR_ENABLED)
+  {
+    pinMode(STEP2_PIN, OUTPUT);
+    pinMode(DIR2_PIN, OUTPUT);
+    pinMode(LIMIT_RETRACTED2, INPUT_PULLUP);
+    pinMode(LIMIT_DEPLOYED2, INPUT_PULLUP);
+  }
+
+  if (VREF_PWM_PIN >= 0)
+  {
+    pinMode(VREF_PWM_PIN, OUTPUT);
+    setProfile(PROFILE_CONSERVATIVE);
+  }
 
   // Enable the driver (active low)
   digitalWrite(EN_PIN, LOW);
   delay(100);
 
   // Print diagnostics
-  Serial.println("\n=== Limit Switch Diagnostics ===");
-  Serial.print("LIMIT_RETRACTED (pin ");
-  Serial.print(LIMIT_RETRACTED);
-  Serial.print(") state: ");
-  Serial.println(digitalRead(LIMIT_RETRACTED) == LOW ? "TRIGGERED (LOW)" : "NOT TRIGGERED (HIGH)");
-  Serial.print("LIMIT_DEPLOYED (pin ");
-  Serial.print(LIMIT_DEPLOYED);
-  Serial.print(") state: ");
-  Serial.println(digitalRead(LIMIT_DEPLOYED) == LOW ? "TRIGGERED (LOW)" : "NOT TRIGGERED (HIGH)");
-  Serial.println("If both show TRIGGERED when switches are not pressed,");
-  Serial.println("your switches may be normally-closed or wired incorrectly.");
-  Serial.println("================================\n");
+  Console.println("\n=== Limit Switch Diagnostics ===");
+  Console.print("LIMIT_RETRACTED (pin ");
+  Console.print(LIMIT_RETRACTED);
+  Console.print(") state: ");
+  Console.println(digitalRead(LIMIT_RETRACTED) == LOW ? "TRIGGERED (LOW)" : "NOT TRIGGERED (HIGH)");
+  Console.print("LIMIT_DEPLOYED (pin ");
+  Console.print(LIMIT_DEPLOYED);
+  Console.print(") state: ");
+  Console.println(digitalRead(LIMIT_DEPLOYED) == LOW ? "TRIGGERED (LOW)" : "NOT TRIGGERED (HIGH)");
+  Console.println("If both show TRIGGERED when switches are not pressed,");
+  Console.println("your switches may be normally-closed or wired incorrectly.");
+  Console.println("================================\n");
 }
 
 bool MotorControl::isRetractedLimitHit()
 {
-  return digitalRead(LIMIT_RETRACTED) == LOW;
+  return LimitSwitches::isClosed(SWITCH_RETRACTED);
 }
 
 bool MotorControl::isDeployedLimitHit()
 {
-  return digitalRead(LIMIT_DEPLOYED) == LOW;
+  return LimitSwitches::isClosed(SWITCH_DEPLOYED);
+}
+
+bool MotorControl::isSecondRetractedLimitHit()
+{
+  return DUAL_MOTOR_ENABLED && digitalRead(LIMIT_RETRACTED2) == LOW;
+}
+
+bool MotorControl::isSecondDeployedLimitHit()
+{
+  return DUAL_MOTOR_ENABLED && digitalRead(LIMIT_DEPLOYED2) == LOW;
+}
+
+// Closed, and without a break for SWITCH_SETTLE_STEPS steps at the
+// current speed. Chatter comes from the lever brushing its contact over
+// the last few steps of travel, so it is bounded in steps, not time: a
+// debounce that filters it at one speed lets a run of closed readings
+// through at a slower one, which would stop the carriage short and set
+// the position from there.
+bool MotorControl::switchHeld(LimitSwitch sw, bool closed)
+{
+  return LimitSwitches::isHeld(sw, closed, SWITCH_SETTLE_STEPS * 2 * halfPeriodUs);
+}
+
+// Steps taken after the switch's contacts closed, while its debounce ran
+// out; the switch position is where they closed, not where it counted
+int64_t MotorControl::stepsPastSwitch(LimitSwitch sw)
+{
+  uint32_t periodUs = 2 * halfPeriodUs;
+  uint32_t settledUs = LimitSwitches::getSettledUs(sw);
+  if (settledUs < periodUs)
+    return 0;
+  return (settledUs - periodUs / 2) / periodUs;
+}
+
+void MotorControl::setDirection(bool forward, bool secondForward)
+{
+  digitalWrite(DIR_PIN, forward ? HIGH : LOW);
+  if (DUAL_MOTOR_ENABLED)
+    digitalWrite(DIR2_PIN, secondForward != (bool)DIR2_INVERTED ? HIGH : LOW);
+  delayMicroseconds(DIRECTION_SETUP_US);
+}
+
+// One step period; both sides share the same edges
+void MotorControl::stepPulse(bool first, bool second)
+{
+  if (first)
+    digitalWrite(STEP_PIN, HIGH);
+  if (second)
+    digitalWrite(STEP2_PIN, HIGH);
+  delayMicroseconds(halfPeriodUs);
+  digitalWrite(STEP_PIN, LOW);
+  if (DUAL_MOTOR_ENABLED)
+    digitalWrite(STEP2_PIN, LOW);
+  delayMicroseconds(halfPeriodUs);
+}
+
+// Step speed and, with VREF_PWM_PIN, drive current for the next move.
+// The driver derives its standstill current from VREF, so every move
+// ends back on the conservative profile.
+void MotorControl::setProfile(SpeedProfile profile)
+{
+  halfPeriodUs = MotionPlanner::halfPeriodUs(profile);
+  if (VREF_PWM_PIN >= 0)
+  {
+    uint32_t vrefMv = ThermalModel::runCurrentMa(profile) * VREF_MV_PER_AMP / 1000;
+    analogWrite(VREF_PWM_PIN, vrefMv >= 3300 ? 255 : vrefMv * 255 / 3300);
+  }
+}
+
+void MotorControl::finishMove(int64_t stepsTaken)
+{
+  setProfile(PROFILE_CONSERVATIVE);
+  MotionSupervisor::endMove(stepsTaken);
+}
+
+// Where the second side belongs when the first is at position: the skew
+// is spread linearly over the travel
+int64_t MotorControl::secondTargetFor(int64_t position)
+{
+  if (deployedPosition <= 0)
+    return position;
+  return position + skewSteps * position / deployedPosition;
+}
+
+// Step periods for a move of steps from from: the longer of the two
+// sides' spans in dual-motor mode
+int64_t MotorControl::moveTicks(int64_t from, int64_t steps, int64_t secondFrom)
+{
+  int64_t firstSteps = llabs(steps);
+  int64_t secondSteps = DUAL_MOTOR_ENABLED ? llabs(secondTargetFor(from + steps) - secondFrom) : 0;
+  return firstSteps > secondSteps ? firstSteps : secondSteps;
 }
 
-long MotorControl::getPosition()
+int64_t MotorControl::getPosition()
 {
-  long pos = 0;
+  int64_t pos = 0;
   if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(100)) == pdTRUE)
   {
     pos = currentPosition;
@@ -82,22 +205,75 @@ long MotorControl::getPosition()
   return pos;
 }
 
-void MotorControl::setPosition(long pos)
+void MotorControl::setPosition(int64_t pos)
 {
   if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(100)) == pdTRUE)
   {
     currentPosition = pos;
+    stateGeneration++;
+    xSemaphoreGive(positionMutex);
+  }
+}
+
+// Where the current move ends, for planning the next one
+void MotorControl::setMoveTarget(int64_t pos)
+{
+  if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(100)) == pdTRUE)
+  {
+    moveTarget = pos;
+    xSemaphoreGive(positionMutex);
+  }
+}
+
+int64_t MotorControl::getSecondPosition()
+{
+  int64_t pos = 0;
+  if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(100)) == pdTRUE)
+  {
+    pos = secondPosition;
+    xSemaphoreGive(positionMutex);
+  }
+  return pos;
+}
+
+void MotorControl::setSecondPosition(int64_t pos)
+{
+  if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(100)) == pdTRUE)
+  {
+    secondPosition = pos;
+    stateGeneration++;
     xSemaphoreGive(positionMutex);
   }
 }
 
-void MotorControl::queueCommand(MotorCommand cmd)
+CommandDecision MotorControl::queueCommand(MotorCommand cmd, CommandSource source)
 {
+  // Before the arbiter, so a refused command starts no manual hold
+  if (firmwareUpdating)
+  {
+    Console.println("Firmware update in progress, command refused");
+    return COMMAND_REFUSED;
+  }
+
+  CommandDecision decision = CommandArbiter::admit(cmd, source);
+  if (decision != COMMAND_ACCEPTED)
+    return decision;
+
   if (xSemaphoreTake(commandMutex, pdMS_TO_TICKS(100)) == pdTRUE)
   {
     pendingCommand = cmd;
+    pendingSource = source;
     xSemaphoreGive(commandMutex);
+    MotionSupervisor::noteCommand();
+    TRACE_INSTANT("command queued", cmd);
+    CommandArbiter::preemptFor(source);
   }
+  return decision;
+}
+
+void MotorControl::setFirmwareUpdating(bool updating)
+{
+  firmwareUpdating = updating;
 }
 
 MotorCommand MotorControl::getQueuedCommand()
@@ -120,161 +296,540 @@ void MotorControl::clearQueuedCommand()
   }
 }
 
-void MotorControl::moveSteps(int steps, bool checkLimits)
+// Read and clear the pending command in one step, so a command queued
+// in between is not lost
+MotorCommand MotorControl::takeQueuedCommand(CommandSource &source)
+{
+  MotorCommand cmd = CMD_NONE;
+  if (xSemaphoreTake(commandMutex, pdMS_TO_TICKS(10)) == pdTRUE)
+  {
+    cmd = pendingCommand;
+    source = pendingSource;
+    pendingCommand = CMD_NONE;
+    xSemaphoreGive(commandMutex);
+  }
+  return cmd;
+}
+
+bool MotorControl::processQueuedCommand()
+{
+  if (firmwareUpdating)
+    return false;
+
+  CommandSource source = SOURCE_API;
+  MotorCommand cmd = takeQueuedCommand(source);
+  if (cmd == CMD_NONE)
+    cmd = CommandArbiter::takeDeferred(source);
+  if (cmd == CMD_NONE)
+    return false;
+
+  TRACE_INSTANT("command taken", cmd);
+  CommandArbiter::beginCommand(cmd, source);
+
+  switch (cmd)
+  {
+  case CMD_DEPLOY:
+    Console.println("[Web] Deploying blinds...");
+    deploy();
+    Console.println("[Web] Blinds deployed");
+    break;
+
+  case CMD_RETRACT:
+    Console.println("[Web] Retracting blinds...");
+    retract();
+    Console.println("[Web] Blinds retracted");
+    break;
+
+  case CMD_CALIBRATE:
+    Console.println("[Web] Starting calibration...");
+    calibrate();
+    Console.println("[Web] Calibration complete");
+    break;
+
+  case CMD_NONE:
+    // No command pending
+    break;
+  }
+  CommandArbiter::endCommand();
+  return true;
+}
+
+void MotorControl::moveSteps(int64_t steps, bool checkLimits)
 {
   if (steps == 0)
     return;
 
+  // In dual-motor mode the second side covers its own span of the move.
+  // Its steps are spread over the first side's (Bresenham), both sides
+  // pulsing on the same edges, so they never drift more than a step apart.
+  int64_t from = getPosition();
+  int64_t firstSteps = llabs(steps);
+  int64_t secondDelta = DUAL_MOTOR_ENABLED ? secondTargetFor(from + steps) - getSecondPosition() : 0;
+  int64_t secondSteps = llabs(secondDelta);
+  int64_t ticks = moveTicks(from, steps, getSecondPosition());
+  int64_t error = 0;
+  bool secondStopped = false;
+
   // Set direction
   bool forward = steps > 0;
-  digitalWrite(DIR_PIN, forward ? HIGH : LOW);
-  delayMicroseconds(10); // Direction setup time
+  bool secondForward = secondDelta > 0;
+  setDirection(forward, secondForward);
+
+  // Searches never burst; a commanded move does while the motor is cool
+  SpeedProfile profile = ThermalModel::chooseProfile(ticks);
+  setProfile(profile);
 
-  int absSteps = abs(steps);
+  setMoveTarget(from + steps);
+  MotionSupervisor::beginMove(forward ? "deploy" : "retract", ticks, profile);
 
-  for (int i = 0; i < absSteps; i++)
+  int64_t i = 0;
+  for (; i < ticks; i++)
   {
+    if (!MotionSupervisor::checkProgress(i))
+      break;
+
     // Check limit switches if enabled
     if (checkLimits)
     {
-      if (forward && isDeployedLimitHit())
+      if (forward && switchHeld(SWITCH_DEPLOYED))
       {
-        Serial.println("WARNING: Deployed limit switch triggered!");
-
-        // Update the deployed endpoint if we hit the switch unexpectedly
-        long currPos = getPosition();
-        if (currPos != deployedPosition)
-        {
-          Serial.print("Updating deployed endpoint from ");
-          Serial.print(deployedPosition);
-          Serial.print(" to ");
-          Serial.println(currPos);
-
-          deployedPosition = currPos;
-          safeDeployedPosition = deployedPosition - safetyBuffer;
-          saveCurrentCalibration();
-        }
-
-        setPosition(deployedPosition);
+        // The switch marks the calibrated endpoint: re-home there and let
+        // the shortfall widen the safety buffer, rather than pulling the
+        // endpoint in after every stray trip. A trip further out than any
+        // buffer could cover means the endpoint itself moved (or steps were
+        // lost); neither the position nor the shortfall can be trusted then.
+        int64_t past = stepsPastSwitch(SWITCH_DEPLOYED);
+        int64_t shortfall = deployedPosition - (getPosition() - past);
+        Console.print("WARNING: Deployed limit switch triggered ");
+        Console.print(shortfall);
+        Console.println(" steps before the endpoint");
+
+        bool plausible = shortfall >= 0 && shortfall <= SAFETY_TRIP_MAX_SHORTFALL;
+        if (plausible)
+          setPosition(deployedPosition + past);
+        History::record(HIST_LIMIT_DEPLOYED, plausible ? deployedPosition : getPosition());
+        MotionSupervisor::flagMove(MOVE_EARLY_DEPLOYED_LIMIT);
+        finishMove(i);
+        if (plausible)
+          setSafetyBuffer(SafetyBuffer::recordTrip(shortfall, safetyBuffer));
+        else
+          requestRecalibration();
         return;
       }
-      if (!forward && isRetractedLimitHit())
+      if (!forward && switchHeld(SWITCH_RETRACTED))
       {
-        Serial.println("Retracted limit reached");
+        Console.println("Retracted limit reached");
 
         // Always reset to zero when retracted limit is hit
-        long currPos = getPosition();
-        if (currPos != 0)
+        int64_t currPos = getPosition();
+        int64_t past = stepsPastSwitch(SWITCH_RETRACTED);
+        if (currPos != -past)
         {
-          Serial.println("Resetting position to 0");
-          setPosition(0);
+          Console.println("Resetting position to 0");
+          setPosition(-past);
           retractedPosition = 0;
+          MotionSupervisor::flagMove(MOVE_EARLY_RETRACTED_LIMIT);
         }
+        History::record(HIST_LIMIT_RETRACTED, 0);
+        finishMove(i);
         return;
       }
+
+      // The second side stops at its own switches; the first keeps going
+      if (!secondStopped && secondForward && isSecondDeployedLimitHit())
+      {
+        int64_t learned = getSecondPosition() - deployedPosition;
+        Console.print("WARNING: Second deployed limit switch triggered, skew now ");
+        Console.println(learned);
+        if (learned != skewSteps)
+        {
+          skewSteps = learned;
+          touchState();
+          Storage::saveSkew(skewSteps);
+        }
+        secondStopped = true;
+      }
+      if (!secondStopped && !secondForward && isSecondRetractedLimitHit())
+      {
+        setSecondPosition(0);
+        secondStopped = true;
+      }
     }
 
-    digitalWrite(STEP_PIN, HIGH);
-    delayMicroseconds(SPEED_DELAY);
-    digitalWrite(STEP_PIN, LOW);
-    delayMicroseconds(SPEED_DELAY);
+    bool stepFirst = true;
+    bool stepSecond = false;
+    if (firstSteps >= secondSteps)
+    {
+      error += secondSteps;
+      stepSecond = 2 * error >= firstSteps;
+      if (stepSecond)
+        error -= firstSteps;
+    }
+    else
+    {
+      error += firstSteps;
+      stepFirst = 2 * error >= secondSteps;
+      stepSecond = true;
+      if (stepFirst)
+        error -= secondSteps;
+    }
+    stepSecond = stepSecond && !secondStopped;
+
+    stepPulse(stepFirst, stepSecond);
 
     // Update position (thread-safe)
     if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(1)) == pdTRUE)
     {
-      currentPosition += forward ? 1 : -1;
+      if (stepFirst)
+        currentPosition += forward ? 1 : -1;
+      if (stepSecond)
+        secondPosition += secondForward ? 1 : -1;
+      stateGeneration++;
       xSemaphoreGive(positionMutex);
     }
   }
+
+  finishMove(i);
+
+  // A full deploy that never saw the switch may narrow the buffer
+  if (forward && checkLimits && i == ticks && from + steps == safeDeployedPosition)
+    setSafetyBuffer(SafetyBuffer::recordCleanDeploy(safetyBuffer));
 }
 
-void MotorControl::calibrate()
+// Apply a new buffer and store it with the calibration
+void MotorControl::setSafetyBuffer(int64_t buffer)
 {
-  Serial.println("Starting calibration sequence...");
+  if (buffer == safetyBuffer)
+    return;
 
-  // Step 1: Move to retracted position (limit switch hit)
-  Serial.println("Moving to retracted position...");
-  digitalWrite(DIR_PIN, LOW); // Direction to retracted
-  delayMicroseconds(10);
+  Console.print("Safety buffer ");
+  Console.print(safetyBuffer);
+  Console.print(" -> ");
+  Console.print(buffer);
+  Console.println(" steps");
+  safetyBuffer = buffer;
+  safeDeployedPosition = deployedPosition - safetyBuffer;
+  saveCurrentCalibration();
+}
+
+int64_t MotorControl::getSafetyBuffer()
+{
+  return safetyBuffer;
+}
 
-  // Move until retracted limit is hit (with timeout)
-  int maxCalibrationSteps = 50000;
-  for (int i = 0; i < maxCalibrationSteps; i++)
+// Step towards one end until the switches there have closed, each side
+// stopping at its own (which squares the blind in dual-motor mode).
+// Returns false if they were not all reached within maxSteps or the move
+// was aborted. Steps are counted per side, and the positions follow
+// them; past is how far the first side ran on after its switch closed.
+//
+// The first side's switch counts once it is held (see switchHeld()), and
+// past is counted from its last closing edge, the start of solid contact.
+// Starting on a held switch, there is no telling how far past it the
+// carriage stopped, so the first side backs off until the switch holds
+// open and then approaches like any other search.
+bool MotorControl::seekEnd(bool forward, const char *label, int64_t maxSteps, SpeedProfile profile,
+                           int64_t &firstSteps, int64_t &secondSteps, int64_t &past)
+{
+  firstSteps = 0;
+  secondSteps = 0;
+  past = 0;
+  setDirection(forward, forward);
+  setProfile(profile);
+  LimitSwitch sw = forward ? SWITCH_DEPLOYED : SWITCH_RETRACTED;
+
+  bool found = false;
+  bool firstArrived = false;
+  int64_t i = 0;
+  MotionSupervisor::beginMove(label, maxSteps, profile);
+  if (switchHeld(sw))
+  {
+    setDirection(!forward, !forward);
+    for (; i < maxSteps && !switchHeld(sw, false); i++)
+    {
+      if (!MotionSupervisor::checkProgress(i))
+        break;
+      stepPulse(true, false);
+      firstSteps++;
+      if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(1)) == pdTRUE)
+      {
+        currentPosition += forward ? -1 : 1;
+        stateGeneration++;
+        xSemaphoreGive(positionMutex);
+      }
+    }
+    setDirection(forward, forward);
+  }
+  for (; i < maxSteps; i++)
   {
-    if (isRetractedLimitHit())
+    if (!MotionSupervisor::checkProgress(i))
+      break;
+    bool first = !firstArrived && !switchHeld(sw);
+    bool second = DUAL_MOTOR_ENABLED && !(forward ? isSecondDeployedLimitHit() : isSecondRetractedLimitHit());
+
+    // Overshoot is timed from the switch, so take it as soon as the first
+    // side stops; the second side may still have steps to go. It depends
+    // on the step period, so this also has to come before finishMove().
+    if (!first && !firstArrived)
+    {
+      firstArrived = true;
+      past = stepsPastSwitch(sw);
+    }
+    if (!first && !second)
     {
-      Serial.println("Retracted limit found");
+      found = true;
       break;
     }
-    digitalWrite(STEP_PIN, HIGH);
-    delayMicroseconds(SPEED_DELAY);
-    digitalWrite(STEP_PIN, LOW);
-    delayMicroseconds(SPEED_DELAY);
+    stepPulse(first, second);
+    if (first)
+      firstSteps++;
+    if (second)
+      secondSteps++;
+
+    if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(1)) == pdTRUE)
+    {
+      if (first)
+        currentPosition += forward ? 1 : -1;
+      if (second)
+        secondPosition += forward ? 1 : -1;
+      stateGeneration++;
+      xSemaphoreGive(positionMutex);
+    }
   }
 
-  // Set retracted position as zero
-  setPosition(0);
-  retractedPosition = 0;
+  if (!found)
+    past = 0;
+  finishMove(i);
+  return found && !MotionSupervisor::wasAborted();
+}
+
+// Where a calibration starts: at the switch that is closed, else at the
+// nearer end (retracted when the carriage could be anywhere)
+bool MotorControl::calibrationStartsDeployed()
+{
+  if (isDeployedLimitHit() != isRetractedLimitHit())
+    return isDeployedLimitHit();
+  return calibrated && 2 * getPosition() > deployedPosition;
+}
+
+// Where a calibration leaves the blind: where a queued deploy or retract
+// wants it, else where the last one sent it, else where the run started
+bool MotorControl::calibrationFinishesDeployed(bool startDeployed)
+{
+  MotorCommand queued = getQueuedCommand();
+  if (queued == CMD_DEPLOY || queued == CMD_RETRACT)
+    return queued == CMD_DEPLOY;
+  if (lastEndCommand != CMD_NONE)
+    return lastEndCommand == CMD_DEPLOY;
+  return startDeployed;
+}
 
-  delay(500); // Brief pause
+void MotorControl::calibrationFailed(const char *reason, bool positionKnown)
+{
+  // Otherwise the carriage position is unknown until the next successful
+  // calibration; the previous one still holds if it is known
+  if (!positionKnown)
+  {
+    calibrated = false;
+    touchState();
+  }
+  Console.print("Error: Calibration aborted while ");
+  Console.println(reason);
+}
 
-  // Step 2: Move to deployed position (opposite limit switch hit)
-  Serial.println("Moving to deployed position...");
-  digitalWrite(DIR_PIN, HIGH); // Direction to deployed
-  delayMicroseconds(10);
+// Through the arbiter like any other request, so a manual hold still
+// defers or drops it; the flag stays up in /api/status until a
+// calibration succeeds
+void MotorControl::requestRecalibration()
+{
+  calibrationSuspect = true;
+  touchState();
+  Console.println("WARNING: Calibration suspect, requesting recalibration");
+  queueCommand(CMD_CALIBRATE, SOURCE_API);
+}
 
-  long stepCount = 0;
-  for (int i = 0; i < maxCalibrationSteps; i++)
+// The travel is measured in both directions, so a run comes back to the
+// switch it started from: it starts at the nearer one, where the first
+// search is short, and moves to the end the blind is wanted at last.
+void MotorControl::calibrate()
+{
+  Console.println("Starting calibration sequence...");
+  Console.print("Search limit: ");
+  Console.print(getSearchLimit());
+  Console.print(" steps (");
+  Console.print((uint32_t)(MotionPlanner::stepsDurationUs(getSearchLimit()) / 1000000));
+  Console.println(" s at the configured speed)");
+
+  unsigned long startUs = micros();
+  bool atDeployed = calibrationStartsDeployed();
+  const char *startLabel = atDeployed ? "calibrate deployed" : "calibrate retracted";
+  const char *otherLabel = atDeployed ? "calibrate retracted" : "calibrate deployed";
+  setMoveTarget(calibrationFinishesDeployed(atDeployed) && calibrated ? safeDeployedPosition : 0);
+
+  // Step 1: Find the switch at the starting end
+  Console.println(atDeployed ? "Moving to deployed position..." : "Moving to retracted position...");
+  int64_t maxCalibrationSteps = getSearchLimit();
+  int64_t searched, secondSearched, searchPast;
+  if (!seekEnd(atDeployed, startLabel, maxCalibrationSteps, PROFILE_CONSERVATIVE, searched, secondSearched, searchPast))
   {
-    if (isDeployedLimitHit())
-    {
-      Serial.println("Deployed limit found");
-      break;
-    }
-    digitalWrite(STEP_PIN, HIGH);
-    delayMicroseconds(SPEED_DELAY);
-    digitalWrite(STEP_PIN, LOW);
-    delayMicroseconds(SPEED_DELAY);
-    stepCount++;
+    calibrationFailed(atDeployed ? "searching for deployed limit" : "searching for retracted limit", false);
+    return;
+  }
+  Console.println(atDeployed ? "Deployed limit found" : "Retracted limit found");
+
+  // From here the position is known relative to the starting switch; at
+  // the deployed end that takes the previous calibration
+  bool positionKnown = !atDeployed || calibrated;
+  if (positionKnown)
+  {
+    setPosition(atDeployed ? deployedPosition + searchPast : -searchPast);
+    setSecondPosition(atDeployed ? secondTargetFor(deployedPosition) : 0);
+  }
+
+  // Brief pause before reversing, unless the carriage was parked there
+  if (searched > 0)
+    delay(500);
+
+  // Step 2: Across to the other end, measuring the travel one way
+  Console.println(atDeployed ? "Moving to retracted position..." : "Moving to deployed position...");
+  int64_t across, secondAcross, acrossPast;
+  if (!seekEnd(!atDeployed, otherLabel, maxCalibrationSteps, PROFILE_CONSERVATIVE, across, secondAcross, acrossPast))
+  {
+    calibrationFailed(atDeployed ? "searching for retracted limit" : "searching for deployed limit", positionKnown);
+    return;
+  }
+  Console.println(atDeployed ? "Retracted limit found" : "Deployed limit found");
+  int64_t travelOut = across - searchPast - acrossPast;
+  if (travelOut < CALIBRATION_MIN_STEPS || travelOut > CALIBRATION_MAX_STEPS)
+  {
+    // Would not load back on the next boot
+    calibrationFailed("checking the travel against CALIBRATION_MIN_STEPS..CALIBRATION_MAX_STEPS", positionKnown);
+    return;
   }
 
-  // Set deployed position
-  deployedPosition = stepCount;
-  setPosition(deployedPosition);
+  // At the retracted switch the origin is known whatever the start was
+  if (atDeployed)
+  {
+    setPosition(-acrossPast);
+    setSecondPosition(0);
+    positionKnown = true;
+  }
+
+  // Step 3: Back to the starting switch, measuring the other way. The
+  // travel is known by now: the run moves at full speed until a safety
+  // buffer short of where the switch should be, and only searches from
+  // there.
+  Console.println("Measuring the travel back...");
+  int64_t back = 0, secondBack = 0, backPast = 0;
+  int64_t approach = travelOut + acrossPast - safetyBuffer;
+  bool found = false;
+  if (approach > 0)
+    found = seekEnd(atDeployed, "calibrate return", approach, ThermalModel::chooseProfile(approach), back, secondBack, backPast);
+  if (!found && !MotionSupervisor::wasAborted())
+  {
+    int64_t rest, secondRest;
+    found = seekEnd(atDeployed, startLabel, maxCalibrationSteps, PROFILE_CONSERVATIVE, rest, secondRest, backPast);
+    back += rest;
+    secondBack += secondRest;
+  }
+  if (!found)
+  {
+    calibrationFailed("measuring the travel back", positionKnown);
+    return;
+  }
+  int64_t travelBack = back - acrossPast - backPast;
+
+  // Average the two directions, so switch hysteresis and backlash split
+  // evenly between the ends; the second side's difference is the skew
+  deployedPosition = (travelOut + travelBack) / 2;
+  int64_t secondRange = (secondAcross + secondBack) / 2;
+  setPosition(atDeployed ? deployedPosition + backPast : -backPast);
+  setSecondPosition(atDeployed ? secondRange : 0);
+  Console.print("Travel: ");
+  Console.print(travelOut);
+  Console.print(" steps one way, ");
+  Console.print(travelBack);
+  Console.println(" steps back");
+
+  retractedPosition = 0;
+  if (DUAL_MOTOR_ENABLED)
+  {
+    skewSteps = secondRange - deployedPosition;
+    Console.print("Second side range: 0 to ");
+    Console.print(secondRange);
+    Console.print(" steps (skew ");
+    Console.print(skewSteps);
+    Console.println(")");
+  }
 
   // Calculate safe deployed position (stop before limit switch)
   safeDeployedPosition = deployedPosition - safetyBuffer;
 
   calibrated = true;
-
-  Serial.print("Calibration complete. Range: 0 to ");
-  Serial.print(deployedPosition);
-  Serial.println(" steps");
-  Serial.print("Safe deployed position: ");
-  Serial.print(safeDeployedPosition);
-  Serial.print(" (");
-  Serial.print(safetyBuffer);
-  Serial.println(" steps before limit)");
+  calibrationSuspect = false;
+  touchState();
+  History::record(HIST_CALIBRATED, deployedPosition);
+
+  Console.print("Calibration complete. Range: 0 to ");
+  Console.print(deployedPosition);
+  Console.println(" steps");
+  Console.print("Safe deployed position: ");
+  Console.print(safeDeployedPosition);
+  Console.print(" (");
+  Console.print(safetyBuffer);
+  Console.println(" steps before limit)");
 
   // Save calibration to EEPROM
   saveCurrentCalibration();
 
-  // Return to retracted position
-  retract();
+  // Checked again, as a deploy or retract may have been queued meanwhile
+  int64_t target = calibrationFinishesDeployed(atDeployed) ? safeDeployedPosition : retractedPosition;
+  int64_t finalSteps = llabs(target - getPosition());
+  moveToPosition(target);
+
+  // Compare with the retracted-first run: search retracted, the same
+  // searched traverse to deployed (overshoot included), the same return
+  // search back to retracted, then move to the target
+  int64_t toRetracted = atDeployed ? deployedPosition - searched : searched;
+  if (toRetracted < 0)
+    toRetracted = 0;
+  int64_t fastSteps = approach > 0 ? approach : 0;
+  int64_t retractSteps = deployedPosition + acrossPast;
+  uint64_t fixedUs = MotionPlanner::stepsDurationUs(toRetracted + across) + 500000ULL +
+                     MotionPlanner::stepsDurationUs(fastSteps, ThermalModel::predictProfile(fastSteps)) +
+                     MotionPlanner::stepsDurationUs(retractSteps - fastSteps) +
+                     MotionPlanner::stepsDurationUs(target, ThermalModel::predictProfile(target));
+  uint64_t tookUs = micros() - startUs;
+  int64_t moved = searched + across + back + finalSteps;
+  uint32_t tenths = deployedPosition > 0 ? (uint32_t)((moved * 10 + deployedPosition / 2) / deployedPosition) : 0;
+
+  calibrationStats.runs++;
+  calibrationStats.traverseTenths += tenths;
+  calibrationStats.durationUs += tookUs;
+  calibrationStats.savedUs += (int64_t)fixedUs - (int64_t)tookUs;
+
+  Console.print("Calibration took ");
+  Console.print(tookUs / 1000000.0f, 1);
+  Console.print(" s over ");
+  Console.print(tenths / 10.0f, 1);
+  Console.print(" traverses, ");
+  Console.print(((int64_t)fixedUs - (int64_t)tookUs) / 1000000.0f, 1);
+  Console.println(" s less than starting retracted");
 }
 
 void MotorControl::deploy()
 {
   if (!calibrated)
   {
-    Serial.println("Error: Not calibrated. Run calibration first.");
+    Console.println("Error: Not calibrated. Run calibration first.");
     return;
   }
+  lastEndCommand = CMD_DEPLOY;
 
   // Deploy to safe position (before the limit switch)
-  Serial.print("Deploying to safe position: ");
-  Serial.print(safeDeployedPosition);
-  Serial.println(" steps");
+  Console.print("Deploying to safe position: ");
+  Console.print(safeDeployedPosition);
+  Console.println(" steps");
   moveToPosition(safeDeployedPosition);
 }
 
@@ -282,66 +837,107 @@ void MotorControl::retract()
 {
   if (!calibrated)
   {
-    Serial.println("Error: Not calibrated. Run calibration first.");
+    Console.println("Error: Not calibrated. Run calibration first.");
     return;
   }
+  lastEndCommand = CMD_RETRACT;
 
   moveToPosition(retractedPosition);
 }
 
-void MotorControl::moveToPosition(long targetPosition)
+void MotorControl::moveToPosition(int64_t targetPosition)
 {
-  long stepsToMove = targetPosition - getPosition();
+  int64_t stepsToMove = targetPosition - getPosition();
 
   if (stepsToMove == 0)
   {
-    Serial.println("Already at target position");
+    Console.println("Already at target position");
     return;
   }
 
-  Serial.print("Moving ");
-  Serial.print(abs(stepsToMove));
-  Serial.println(" steps");
+  Console.print("Moving ");
+  Console.print(llabs(stepsToMove));
+  Console.println(" steps");
 
   moveSteps(stepsToMove, true);
 }
 
-void MotorControl::homeToRetractedPosition()
+MotionPlan MotorControl::planMove(int64_t targetPosition)
 {
-  Serial.println("Homing to retracted position...");
-
-  // Move towards retracted position until limit switch is hit
-  digitalWrite(DIR_PIN, LOW); // Direction to retracted
-  delayMicroseconds(10);
+  int64_t from = 0;
+  int64_t secondFrom = 0;
+  if (xSemaphoreTake(positionMutex, pdMS_TO_TICKS(100)) == pdTRUE)
+  {
+    // Searches (calibration, homing) set where they will finish
+    bool busy = MotionSupervisor::isMoveActive();
+    from = busy ? moveTarget : currentPosition;
+    secondFrom = busy ? secondTargetFor(moveTarget) : secondPosition;
+    xSemaphoreGive(positionMutex);
+  }
+  int64_t steps = targetPosition - from;
+  int64_t ticks = moveTicks(from, steps, secondFrom);
+  return MotionPlanner::plan(from, targetPosition, ticks, ThermalModel::predictProfile(ticks));
+}
 
-  int maxSteps = 50000;
-  int stepCount = 0;
+void MotorControl::homeToRetractedPosition()
+{
+  Console.println("Homing to retracted position...");
+
+  // The same search as calibration's: the switch counts once it is held,
+  // the overshoot runs from its last closing edge, and the position
+  // follows the steps. In dual-motor mode each side homes to its own
+  // switch.
+  int64_t steps, secondSteps, past;
+  setMoveTarget(0);
+  if (seekEnd(false, "home", getSearchLimit(), PROFILE_CONSERVATIVE, steps, secondSteps, past))
+  {
+    Console.println("Retracted limit switch reached");
+    setPosition(-past);
+    setSecondPosition(0);
+    retractedPosition = 0;
+    History::record(HIST_LIMIT_RETRACTED, 0);
 
-  while (!isRetractedLimitHit() && stepCount < maxSteps)
+    // Settling the switch runs the carriage past the origin; come back to
+    // it, as calibration does
+    if (past > 0)
+      moveToPosition(retractedPosition);
+    Console.println("Home position established");
+  }
+  else
   {
-    digitalWrite(STEP_PIN, HIGH);
-    delayMicroseconds(SPEED_DELAY);
-    digitalWrite(STEP_PIN, LOW);
-    delayMicroseconds(SPEED_DELAY);
-    stepCount++;
+    Console.println("Warning: Retracted limit not found during homing!");
   }
+}
 
-  if (isRetractedLimitHit())
+void MotorControl::startup()
+{
+  // Try to load stored calibration
+  if (loadStoredCalibration())
   {
-    Serial.println("Retracted limit switch reached");
-    setPosition(0);
-    retractedPosition = 0;
-    Serial.println("Home position established");
+    Console.println("Using stored calibration");
+
+    // Home to retracted position
+    homeToRetractedPosition();
+
+    Console.println("Ready! System is calibrated and homed.");
   }
   else
   {
-    Serial.println("Warning: Retracted limit not found during homing!");
+    Console.println("No stored calibration found. Performing full calibration...");
+    calibrate();
+    Console.println("Calibration complete!");
   }
 }
 
 bool MotorControl::loadStoredCalibration()
 {
-  long storedDeployed, storedBuffer;
+  int64_t storedDeployed, storedBuffer;
+  if (DUAL_MOTOR_ENABLED && !Storage::loadSkew(skewSteps))
+  {
+    Console.println("No stored skew for the second motor");
+    return false;
+  }
+
   if (Storage::loadCalibration(storedDeployed, storedBuffer))
   {
     deployedPosition = storedDeployed;
@@ -349,9 +945,10 @@ bool MotorControl::loadStoredCalibration()
     safeDeployedPosition = deployedPosition - safetyBuffer;
     retractedPosition = 0;
     calibrated = true;
+    touchState();
 
-    Serial.print("  Safe deployed position: ");
-    Serial.println(safeDeployedPosition);
+    Console.print("  Safe deployed position: ");
+    Console.println(safeDeployedPosition);
     return true;
   }
   return false;
@@ -360,6 +957,8 @@ bool MotorControl::loadStoredCalibration()
 void MotorControl::saveCurrentCalibration()
 {
   Storage::saveCalibration(deployedPosition, safetyBuffer);
+  if (DUAL_MOTOR_ENABLED)
+    Storage::saveSkew(skewSteps);
 }
 
 bool MotorControl::isCalibrated()
@@ -367,7 +966,47 @@ bool MotorControl::isCalibrated()
   return calibrated;
 }
 
-long MotorControl::getDeployedPosition()
+bool MotorControl::isCalibrationSuspect()
+{
+  return calibrationSuspect;
+}
+
+int64_t MotorControl::getDeployedPosition()
 {
   return deployedPosition;
 }
+
+int64_t MotorControl::getSafeDeployedPosition()
+{
+  return safeDeployedPosition;
+}
+
+int64_t MotorControl::getSkew()
+{
+  return skewSteps;
+}
+
+// Longest possible travel plus a margin, the same bound a stored
+// calibration is checked against. It is a distance: the configured speed
+// only sets how long a search takes, which MotionSupervisor bounds with the
+// same timing model.
+int64_t MotorControl::getSearchLimit()
+{
+  return CALIBRATION_MAX_STEPS;
+}
+
+CalibrationStats MotorControl::getCalibrationStats()
+{
+  return calibrationStats;
+}
+
+uint32_t MotorControl::getStateGeneration()
+{
+  return stateGeneration;
+}
+
+// Motor task only (steps and position setters bump it under the mutex)
+void MotorControl::touchState()
+{
+  stateGeneration++;
+}
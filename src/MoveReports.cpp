@@ -0,0 +1,109 @@
+#include "MoveReports.h"
+#include "LogShipper.h"
+
+static const char *FLAG_NAMES[] = {"aborted", "early_deployed_limit", "early_retracted_limit", "slow", "preempted", "burst"};
+
+// Static member initialization
+MoveReport MoveReports::ring[MOVE_REPORT_SLOTS] = {};
+uint32_t MoveReports::nextId = 1;
+portMUX_TYPE MoveReports::lock = portMUX_INITIALIZER_UNLOCKED;
+
+void MoveReports::add(MoveReport &report)
+{
+  portENTER_CRITICAL(&lock);
+  report.id = nextId++;
+  ring[report.id % MOVE_REPORT_SLOTS] = report;
+  portEXIT_CRITICAL(&lock);
+}
+
+size_t MoveReports::collect(uint32_t since, MoveReport *out, size_t maxCount)
+{
+  portENTER_CRITICAL(&lock);
+  uint32_t last = nextId - 1;
+  uint32_t first = last >= MOVE_REPORT_SLOTS ? last - MOVE_REPORT_SLOTS + 1 : 1;
+  if (first <= since)
+    first = since + 1;
+  if (last >= first && last - first + 1 > maxCount)
+    first = last - maxCount + 1;
+
+  size_t count = 0;
+  for (uint32_t id = first; id <= last; id++)
+    out[count++] = ring[id % MOVE_REPORT_SLOTS];
+  portEXIT_CRITICAL(&lock);
+  return count;
+}
+
+// Built from print() pieces: Print::printf mallocs for long output, and
+// this usually writes into a request arena
+void MoveReports::writeJSON(Print &out, uint32_t since)
+{
+  static MoveReport reports[MOVE_REPORT_SLOTS];
+  size_t count = collect(since, reports, MOVE_REPORT_SLOTS);
+
+  out.print("{\"latest\":");
+  out.print(nextId - 1);
+  out.print(",\"moves\":[");
+  for (size_t i = 0; i < count; i++)
+  {
+    const MoveReport &r = reports[i];
+    if (i > 0)
+      out.print(",");
+    out.print("{\"id\":");
+    out.print(r.id);
+    out.print(",\"label\":\"");
+    out.print(r.label);
+    out.print("\",\"startMs\":");
+    out.print(r.startMs);
+    out.print(",\"durationMs\":");
+    out.print(r.durationMs);
+    out.print(",\"startPosition\":");
+    out.print(r.startPosition);
+    out.print(",\"endPosition\":");
+    out.print(r.endPosition);
+    out.print(",\"stepsRequested\":");
+    out.print(r.stepsRequested);
+    out.print(",\"stepsTaken\":");
+    out.print(r.stepsTaken);
+    out.print(",\"peakSpeed\":");
+    out.print(r.peakSpeed);
+    out.print(",\"averageSpeed\":");
+    out.print(r.averageSpeed);
+    out.print(",\"startLatencyUs\":");
+    out.print(r.startLatencyUs);
+    out.print(",\"finishLatencyUs\":");
+    out.print(r.finishLatencyUs);
+    out.print(",\"flags\":[");
+    bool first = true;
+    for (size_t bit = 0; bit < sizeof(FLAG_NAMES) / sizeof(FLAG_NAMES[0]); bit++)
+    {
+      if (!(r.flags & (1 << bit)))
+        continue;
+      out.print(first ? "\"" : ",\"");
+      out.print(FLAG_NAMES[bit]);
+      out.print("\"");
+      first = false;
+    }
+    out.print("]}");
+  }
+  out.print("]}");
+}
+
+void MoveReports::print(size_t count)
+{
+  static MoveReport reports[MOVE_REPORT_SLOTS];
+  if (count > MOVE_REPORT_SLOTS)
+    count = MOVE_REPORT_SLOTS;
+  size_t found = collect(0, reports, count);
+
+  Console.println("\n=== Recent Moves ===");
+  Console.println("  id  label                 steps     ms  avg/s  peak/s  start/finish us  flags");
+  for (size_t i = 0; i < found; i++)
+  {
+    const MoveReport &r = reports[i];
+    Console.printf("%4u  %-20s %6lld %6u %6u %7u  %7u/%-7u  0x%02x\n",
+                  (unsigned)r.id, r.label, (long long)r.stepsTaken, (unsigned)r.durationMs,
+                  (unsigned)r.averageSpeed, (unsigned)r.peakSpeed,
+                  (unsigned)r.startLatencyUs, (unsigned)r.finishLatencyUs, r.flags);
+  }
+  Console.println("====================\n");
+}
@@ -0,0 +1,532 @@
+#include "OtaUpdater.h"
+#include "config.h"
+#include "Storage.h"
+#include "Metrics.h"
+#include "MotionSupervisor.h"
+#include "MotorControl.h"
+#include "Watchdog.h"
+#include "TaskConfig.h"
+#include "LogShipper.h"
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+#if CONFIG_IDF_TARGET_ESP32S3
+#include <esp32s3/rom/miniz.h>
+#else
+#include <esp32/rom/miniz.h>
+#endif
+
+// OTA session state that uses IDF types
+static esp_ota_handle_t otaHandle = 0;
+static const esp_partition_t *runningPartition = NULL;
+static const esp_partition_t *targetPartition = NULL;
+
+// Static member initialization
+bool OtaUpdater::uploading = false;
+bool OtaUpdater::failed = false;
+bool OtaUpdater::compressed = false;
+OtaUpdater::Format OtaUpdater::format = FORMAT_UNKNOWN;
+String OtaUpdater::lastError = "";
+uint32_t OtaUpdater::received = 0;
+uint32_t OtaUpdater::flashed = 0;
+unsigned long OtaUpdater::lastChunkMs = 0;
+unsigned long OtaUpdater::restartAt = 0;
+const char *OtaUpdater::restartReason = "";
+uint8_t OtaUpdater::zlibHeader[2] = {0, 0};
+size_t OtaUpdater::zlibHeaderLength = 0;
+uint8_t OtaUpdater::probe[4] = {0, 0, 0, 0};
+size_t OtaUpdater::probeLength = 0;
+DeltaPatch OtaUpdater::patch;
+void *OtaUpdater::inflator = NULL;
+uint8_t *OtaUpdater::dictionary = NULL;
+size_t OtaUpdater::dictionaryOffset = 0;
+bool OtaUpdater::inflateDone = false;
+bool OtaUpdater::trialPending = false;
+
+// The Arduino core confirms a new image as soon as it boots unless told
+// otherwise; confirmation is left to checkHealth()
+extern "C" bool verifyRollbackLater()
+{
+  return true;
+}
+
+static const esp_partition_t *findAppPartition(uint32_t address)
+{
+  const esp_partition_t *found = NULL;
+  esp_partition_iterator_t it = esp_partition_find(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, NULL);
+  while (it != NULL)
+  {
+    const esp_partition_t *partition = esp_partition_get(it);
+    if (partition->address == address)
+    {
+      found = partition;
+      break;
+    }
+    it = esp_partition_next(it);
+  }
+  esp_partition_iterator_release(it);
+  return found;
+}
+
+// Large buffers go to PSRAM when available
+static void *allocate(size_t size)
+{
+  return psramFound() ? ps_malloc(size) : malloc(size);
+}
+
+void OtaUpdater::begin()
+{
+  runningPartition = esp_ota_get_running_partition();
+
+  esp_ota_img_states_t state;
+  bool pendingVerify = esp_ota_get_state_partition(runningPartition, &state) == ESP_OK &&
+                       state == ESP_OTA_IMG_PENDING_VERIFY;
+
+  uint32_t previousAddress, trialAddress;
+  uint8_t attempts;
+  bool haveTrial = Storage::loadOtaTrial(previousAddress, trialAddress, attempts);
+
+  if (haveTrial && trialAddress != runningPartition->address)
+  {
+    // The bootloader already refused the new image
+    Console.println("WARNING: Updated firmware did not boot, running previous image");
+    Storage::clearOtaTrial();
+    haveTrial = false;
+  }
+
+  if (!haveTrial && !pendingVerify)
+    return;
+
+  trialPending = true;
+  Console.print("Running new firmware ");
+  Console.print(FIRMWARE_VERSION);
+  Console.print(" from ");
+  Console.print(runningPartition->label);
+  Console.println(" on trial");
+
+  if (haveTrial)
+  {
+    attempts++;
+    if (attempts > OTA_MAX_TRIAL_BOOTS)
+    {
+      rollback("too many unconfirmed boots");
+      return;
+    }
+    Storage::saveOtaTrial(previousAddress, trialAddress, attempts);
+  }
+}
+
+void OtaUpdater::checkHealth()
+{
+  if (!trialPending)
+    return;
+
+  unsigned long uptime = millis();
+  if (uptime < OTA_HEALTH_MIN_UPTIME_MS)
+    return;
+
+  if (isHealthy())
+  {
+    esp_ota_mark_app_valid_cancel_rollback();
+    Storage::clearOtaTrial();
+    trialPending = false;
+    Console.print("New firmware ");
+    Console.print(FIRMWARE_VERSION);
+    Console.println(" passed health check and is confirmed");
+    return;
+  }
+
+  if (uptime > OTA_HEALTH_DEADLINE_MS)
+    rollback("post-boot health check failed");
+}
+
+bool OtaUpdater::isHealthy()
+{
+  // Local checks only: hides often sit at the edge of an access point, and
+  // WiFi dropping out during the trial says nothing about the image
+  return MotorControl::isCalibrated() && !Watchdog::wasWatchdogReset() && TaskConfig::ownTasksRunning();
+}
+
+void OtaUpdater::rollback(const char *reason)
+{
+  Console.print("ERROR: Rolling back firmware: ");
+  Console.println(reason);
+
+  uint32_t previousAddress = 0, trialAddress;
+  uint8_t attempts;
+  bool haveTrial = Storage::loadOtaTrial(previousAddress, trialAddress, attempts);
+  Storage::clearOtaTrial();
+  Metrics::checkpoint();
+
+  // Prefer the bootloader's rollback; it only returns if not applicable
+  esp_ota_img_states_t state;
+  if (esp_ota_get_state_partition(runningPartition, &state) == ESP_OK && state == ESP_OTA_IMG_PENDING_VERIFY)
+  {
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+
+  const esp_partition_t *previous = haveTrial ? findAppPartition(previousAddress) : NULL;
+  if (previous != NULL && esp_ota_set_boot_partition(previous) == ESP_OK)
+  {
+    Console.print("Restarting into ");
+    Console.println(previous->label);
+    delay(100);
+    ESP.restart();
+  }
+
+  Console.println("ERROR: No previous firmware to roll back to, keeping this one");
+  trialPending = false;
+}
+
+bool OtaUpdater::start(size_t expectedSize, String &error)
+{
+  lastError = "";
+  if (uploading)
+  {
+    Console.println("WARNING: Abandoning incomplete firmware upload");
+    abandon();
+  }
+
+  // Commands first, so none can start a move once this check has passed
+  MotorControl::setFirmwareUpdating(true);
+  if (MotionSupervisor::isMoveActive())
+  {
+    // Flash writes stall both cores and would disturb step timing
+    MotorControl::setFirmwareUpdating(false);
+    error = lastError = "Motor is moving, retry when idle";
+    return false;
+  }
+
+  runningPartition = esp_ota_get_running_partition();
+  targetPartition = esp_ota_get_next_update_partition(NULL);
+  if (targetPartition == NULL)
+  {
+    error = lastError = "No OTA partition, flash the A/B partition table over USB first";
+    MotorControl::setFirmwareUpdating(false);
+    return false;
+  }
+
+  esp_err_t err = esp_ota_begin(targetPartition, OTA_WITH_SEQUENTIAL_WRITES, &otaHandle);
+  if (err != ESP_OK)
+  {
+    error = lastError = String("OTA begin failed: ") + esp_err_to_name(err);
+    MotorControl::setFirmwareUpdating(false);
+    return false;
+  }
+
+  uploading = true;
+  failed = false;
+  compressed = false;
+  format = FORMAT_UNKNOWN;
+  received = 0;
+  flashed = 0;
+  zlibHeaderLength = 0;
+  probeLength = 0;
+  inflateDone = false;
+  lastChunkMs = millis();
+
+  Console.print("Firmware upload started into ");
+  Console.print(targetPartition->label);
+  if (expectedSize > 0)
+  {
+    Console.print(" (");
+    Console.print(expectedSize);
+    Console.print(" bytes)");
+  }
+  Console.println();
+  return true;
+}
+
+bool OtaUpdater::write(const uint8_t *data, size_t length)
+{
+  if (!uploading || failed)
+    return false;
+
+  lastChunkMs = millis();
+  received += length;
+
+  // A zlib stream is recognized by its two-byte header
+  if (zlibHeaderLength < sizeof(zlibHeader))
+  {
+    size_t take = sizeof(zlibHeader) - zlibHeaderLength;
+    if (take > length)
+      take = length;
+    memcpy(zlibHeader + zlibHeaderLength, data, take);
+    zlibHeaderLength += take;
+    data += take;
+    length -= take;
+
+    if (zlibHeaderLength < sizeof(zlibHeader))
+      return true;
+
+    uint16_t header = (zlibHeader[0] << 8) | zlibHeader[1];
+    compressed = (zlibHeader[0] & 0x0F) == 8 && header % 31 == 0;
+    if (compressed)
+    {
+      inflator = allocate(sizeof(tinfl_decompressor));
+      dictionary = (uint8_t *)allocate(TINFL_LZ_DICT_SIZE);
+      if (inflator == NULL || dictionary == NULL)
+        return fail("Out of memory for decompression");
+      tinfl_init((tinfl_decompressor *)inflator);
+      dictionaryOffset = 0;
+    }
+
+    if (!(compressed ? inflate(zlibHeader, sizeof(zlibHeader)) : route(zlibHeader, sizeof(zlibHeader))))
+      return false;
+  }
+
+  if (length == 0)
+    return true;
+  return compressed ? inflate(data, length) : route(data, length);
+}
+
+bool OtaUpdater::inflate(const uint8_t *data, size_t length)
+{
+  if (inflateDone)
+    return fail("Data after end of compressed stream");
+
+  tinfl_decompressor *decompressor = (tinfl_decompressor *)inflator;
+  tinfl_status status;
+
+  do
+  {
+    size_t inBytes = length;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - dictionaryOffset;
+    status = tinfl_decompress(decompressor, data, &inBytes, dictionary, dictionary + dictionaryOffset, &outBytes,
+                              TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+    data += inBytes;
+    length -= inBytes;
+
+    if (outBytes > 0)
+    {
+      if (!route(dictionary + dictionaryOffset, outBytes))
+        return false;
+      dictionaryOffset = (dictionaryOffset + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+    }
+
+    if (status < TINFL_STATUS_DONE)
+      return fail("Corrupt compressed stream");
+    if (status == TINFL_STATUS_DONE)
+    {
+      inflateDone = true;
+      if (length > 0)
+        return fail("Data after end of compressed stream");
+      break;
+    }
+  } while (length > 0 || status == TINFL_STATUS_HAS_MORE_OUTPUT);
+
+  return true;
+}
+
+bool OtaUpdater::route(const uint8_t *data, size_t length)
+{
+  if (format == FORMAT_UNKNOWN)
+  {
+    size_t take = sizeof(probe) - probeLength;
+    if (take > length)
+      take = length;
+    memcpy(probe + probeLength, data, take);
+    probeLength += take;
+    data += take;
+    length -= take;
+
+    if (probeLength < sizeof(probe))
+      return true;
+
+    if (probe[0] == 0xE9)
+    {
+      format = FORMAT_IMAGE;
+    }
+    else if (memcmp(probe, DeltaPatch::MAGIC, sizeof(probe)) == 0)
+    {
+      format = FORMAT_DELTA;
+      patch.begin(readSource, writeTarget, NULL);
+    }
+    else
+    {
+      return fail("Unrecognized firmware image format");
+    }
+
+    Console.print("Firmware image format: ");
+    Console.print(compressed ? "compressed " : "");
+    Console.println(format == FORMAT_DELTA ? "delta" : "full image");
+
+    if (!deliver(probe, sizeof(probe)))
+      return false;
+  }
+
+  return length == 0 || deliver(data, length);
+}
+
+bool OtaUpdater::deliver(const uint8_t *data, size_t length)
+{
+  if (format == FORMAT_IMAGE)
+    return writeTarget(data, length, NULL);
+
+  DeltaPatch::Status status = patch.feed(data, length);
+  if (status != DeltaPatch::PATCH_OK && status != DeltaPatch::PATCH_DONE)
+    return fail(String("Delta patch failed: ") + DeltaPatch::statusName(status));
+  return true;
+}
+
+bool OtaUpdater::readSource(uint32_t offset, uint8_t *buffer, size_t length, void *context)
+{
+  if (offset + length > runningPartition->size)
+    return false;
+  return esp_partition_read(runningPartition, offset, buffer, length) == ESP_OK;
+}
+
+bool OtaUpdater::writeTarget(const uint8_t *data, size_t length, void *context)
+{
+  esp_err_t err = esp_ota_write(otaHandle, data, length);
+  if (err != ESP_OK)
+    return fail(String("Flash write failed: ") + esp_err_to_name(err));
+
+  flashed += length;
+  return true;
+}
+
+bool OtaUpdater::finish(String &error)
+{
+  if (!uploading)
+  {
+    error = lastError.length() > 0 ? lastError : String("No firmware received");
+    return false;
+  }
+  uploading = false;
+
+  if (!failed)
+  {
+    if (format == FORMAT_UNKNOWN)
+      fail("Upload too short");
+    else if (compressed && !inflateDone)
+      fail("Compressed stream truncated");
+    else if (format == FORMAT_DELTA)
+    {
+      DeltaPatch::Status status = patch.finish();
+      if (status != DeltaPatch::PATCH_DONE)
+        fail(String("Delta patch failed: ") + DeltaPatch::statusName(status));
+    }
+  }
+
+  if (failed)
+  {
+    esp_ota_abort(otaHandle);
+    release();
+    error = lastError;
+    return false;
+  }
+
+  // Validates the image header and checksum
+  esp_err_t err = esp_ota_end(otaHandle);
+  release();
+  if (err == ESP_OK)
+    err = esp_ota_set_boot_partition(targetPartition);
+  if (err != ESP_OK)
+  {
+    fail(String("Image rejected: ") + esp_err_to_name(err));
+    error = lastError;
+    return false;
+  }
+
+  Storage::saveOtaTrial(runningPartition->address, targetPartition->address, 0);
+  scheduleRestart("Restarting into updated firmware...");
+
+  Console.print("Firmware update staged: ");
+  Console.print(received);
+  Console.print(" bytes received, ");
+  Console.print(flashed);
+  Console.print(" bytes written to ");
+  Console.println(targetPartition->label);
+  return true;
+}
+
+bool OtaUpdater::isUploading()
+{
+  return uploading;
+}
+
+// A client that goes away mid-upload never reaches finish()
+void OtaUpdater::checkStall()
+{
+  if (!uploading || millis() - lastChunkMs < OTA_STALL_TIMEOUT_MS)
+    return;
+
+  Console.println("WARNING: Abandoning stalled firmware upload");
+  abandon();
+  if (!failed)
+    lastError = "Upload stalled";
+}
+
+void OtaUpdater::scheduleRestart(const char *reason)
+{
+  restartReason = reason;
+  restartAt = millis() + OTA_RESTART_DELAY_MS;
+  if (restartAt == 0)
+    restartAt = 1;
+}
+
+void OtaUpdater::pollRestart()
+{
+  if (restartAt == 0 || (long)(millis() - restartAt) < 0)
+    return;
+
+  Console.println(restartReason);
+  Metrics::checkpoint();
+  delay(100);
+  ESP.restart();
+}
+
+bool OtaUpdater::fail(const String &error)
+{
+  // Keep the first error; later ones are usually consequences of it
+  if (!failed)
+  {
+    failed = true;
+    lastError = error;
+    MotorControl::setFirmwareUpdating(false);
+    Console.print("ERROR: Firmware update failed: ");
+    Console.println(error);
+  }
+  return false;
+}
+
+void OtaUpdater::abandon()
+{
+  esp_ota_abort(otaHandle);
+  release();
+  uploading = false;
+  MotorControl::setFirmwareUpdating(false);
+}
+
+void OtaUpdater::release()
+{
+  free(inflator);
+  free(dictionary);
+  inflator = NULL;
+  dictionary = NULL;
+}
+
+void OtaUpdater::writeStatusJSON(Print &out)
+{
+  const esp_partition_t *running = esp_ota_get_running_partition();
+  const esp_partition_t *next = esp_ota_get_next_update_partition(NULL);
+
+  out.print("{\"version\":\"");
+  out.print(FIRMWARE_VERSION);
+  out.print("\",\"runningPartition\":\"");
+  out.print(running->label);
+  out.print("\",\"nextPartition\":\"");
+  out.print(next != NULL ? next->label : "");
+  out.print("\",\"state\":\"");
+  out.print(trialPending ? "trial" : "confirmed");
+  out.print("\",\"uploading\":");
+  out.print(uploading ? "true" : "false");
+  out.print(",\"received\":");
+  out.print(received);
+  out.print(",\"written\":");
+  out.print(flashed);
+  out.print(",\"lastError\":\"");
+  out.print(lastError);
+  out.print("\"}");
+}
@@ -0,0 +1,144 @@
+#include "RequestArena.h"
+#include "LogShipper.h"
+
+// Static member initialization
+RequestArena RequestArena::pool[REQUEST_ARENA_COUNT];
+uint32_t RequestArena::busyMask = 0;
+size_t RequestArena::highWaterBytes = 0;
+uint32_t RequestArena::highWaterInUse = 0;
+uint32_t RequestArena::fallbacks = 0;
+uint32_t RequestArena::overflows = 0;
+bool RequestArena::psram = false;
+portMUX_TYPE RequestArena::lock = portMUX_INITIALIZER_UNLOCKED;
+
+RequestArena::RequestArena(uint8_t *buffer, size_t size) : base(buffer), capacity(size)
+{
+}
+
+void RequestArena::begin()
+{
+  psram = psramFound();
+  size_t total = (size_t)REQUEST_ARENA_COUNT * REQUEST_ARENA_BYTES;
+  uint8_t *block = (uint8_t *)(psram ? ps_malloc(total) : malloc(total));
+  if (block == NULL)
+  {
+    // Every response falls back to the heap
+    Console.println("Warning: Failed to allocate web response arenas");
+    busyMask = (1UL << REQUEST_ARENA_COUNT) - 1;
+    return;
+  }
+
+  for (size_t i = 0; i < REQUEST_ARENA_COUNT; i++)
+    pool[i].base = block + i * REQUEST_ARENA_BYTES;
+
+  Console.print("Web response arenas: ");
+  Console.print(REQUEST_ARENA_COUNT);
+  Console.print(" x ");
+  Console.print(REQUEST_ARENA_BYTES);
+  Console.println(psram ? " bytes in PSRAM" : " bytes in internal RAM (no PSRAM)");
+}
+
+RequestArena *RequestArena::acquire()
+{
+  RequestArena *arena = NULL;
+  portENTER_CRITICAL(&lock);
+  for (size_t i = 0; i < REQUEST_ARENA_COUNT; i++)
+  {
+    if (!(busyMask & (1UL << i)))
+    {
+      busyMask |= 1UL << i;
+      arena = &pool[i];
+      break;
+    }
+  }
+  if (arena == NULL)
+  {
+    fallbacks++;
+  }
+  else
+  {
+    uint32_t inUse = __builtin_popcount(busyMask);
+    if (inUse > highWaterInUse)
+      highWaterInUse = inUse;
+  }
+  portEXIT_CRITICAL(&lock);
+
+  if (arena != NULL)
+  {
+    arena->used = 0;
+    arena->full = false;
+  }
+  return arena;
+}
+
+void RequestArena::release(RequestArena *arena)
+{
+  if (arena == NULL)
+    return;
+
+  portENTER_CRITICAL(&lock);
+  if (arena->used > highWaterBytes)
+    highWaterBytes = arena->used;
+  if (arena->full)
+    overflows++;
+  busyMask &= ~(1UL << (arena - pool));
+  portEXIT_CRITICAL(&lock);
+}
+
+size_t RequestArena::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t RequestArena::write(const uint8_t *buffer, size_t size)
+{
+  if (full || size > capacity - used)
+  {
+    // A truncated body is never sent (see overflowed())
+    full = true;
+    return 0;
+  }
+  memcpy(base + used, buffer, size);
+  used += size;
+  return size;
+}
+
+const uint8_t *RequestArena::data() const
+{
+  return base;
+}
+
+size_t RequestArena::length() const
+{
+  return used;
+}
+
+bool RequestArena::overflowed() const
+{
+  return full;
+}
+
+size_t RequestArena::getHighWaterBytes()
+{
+  return highWaterBytes;
+}
+
+uint32_t RequestArena::getHighWaterInUse()
+{
+  return highWaterInUse;
+}
+
+uint32_t RequestArena::getFallbacks()
+{
+  return fallbacks;
+}
+
+uint32_t RequestArena::getOverflows()
+{
+  return overflows;
+}
+
+bool RequestArena::isInPsram()
+{
+  return psram;
+}
@@ -0,0 +1,170 @@
+#include "SafetyBuffer.h"
+#include "MotorControl.h"
+#include "Storage.h"
+#include "LogShipper.h"
+#include <math.h>
+
+// Static member initialization
+TripSamples SafetyBuffer::samples = {};
+uint32_t SafetyBuffer::cleanStreak = 0;
+portMUX_TYPE SafetyBuffer::lock = portMUX_INITIALIZER_UNLOCKED;
+
+void SafetyBuffer::begin()
+{
+  if (!Storage::loadLimitTrips(samples))
+    samples = TripSamples();
+
+  Console.print("Deployed limit trips: ");
+  Console.print(samples.total);
+  Console.print(", buffer needs at least ");
+  Console.print((long)required());
+  Console.println(" steps");
+}
+
+// Callers hold the lock, or run before other tasks start
+void SafetyBuffer::statistics(float &mean, float &stddev)
+{
+  mean = 0;
+  stddev = 0;
+  if (samples.count == 0)
+    return;
+
+  float sum = 0;
+  for (uint8_t i = 0; i < samples.count; i++)
+    sum += samples.shortfalls[i];
+  mean = sum / samples.count;
+  if (samples.count < 2)
+    return;
+
+  float squares = 0;
+  for (uint8_t i = 0; i < samples.count; i++)
+    squares += (samples.shortfalls[i] - mean) * (samples.shortfalls[i] - mean);
+  stddev = sqrtf(squares / (samples.count - 1));
+}
+
+// The smallest buffer the samples allow; same locking as statistics()
+int64_t SafetyBuffer::required()
+{
+  int64_t steps = SAFETY_BUFFER_MIN_STEPS;
+  if (samples.count > 0 && samples.count < SAFETY_BUFFER_MIN_SAMPLES)
+  {
+    // Too few for a spread: cover the worst one seen
+    int16_t largest = samples.shortfalls[0];
+    for (uint8_t i = 1; i < samples.count; i++)
+    {
+      if (samples.shortfalls[i] > largest)
+        largest = samples.shortfalls[i];
+    }
+    steps = largest + SAFETY_BUFFER_MARGIN_STEPS;
+  }
+  else if (samples.count >= SAFETY_BUFFER_MIN_SAMPLES)
+  {
+    float mean, stddev;
+    statistics(mean, stddev);
+    steps = (int64_t)ceilf(mean + SAFETY_BUFFER_SIGMA_K * stddev) + SAFETY_BUFFER_MARGIN_STEPS;
+  }
+  if (steps < SAFETY_BUFFER_MIN_STEPS)
+    return SAFETY_BUFFER_MIN_STEPS;
+  return steps > SAFETY_BUFFER_MAX_STEPS ? SAFETY_BUFFER_MAX_STEPS : steps;
+}
+
+int64_t SafetyBuffer::recordTrip(int64_t shortfall, int64_t currentBuffer)
+{
+  portENTER_CRITICAL(&lock);
+  if (shortfall < INT16_MIN)
+    shortfall = INT16_MIN;
+  if (shortfall > INT16_MAX)
+    shortfall = INT16_MAX;
+  samples.shortfalls[samples.next] = shortfall;
+  samples.next = (samples.next + 1) % SAFETY_BUFFER_SAMPLES;
+  if (samples.count < SAFETY_BUFFER_SAMPLES)
+    samples.count++;
+  samples.total++;
+  cleanStreak = 0;
+  TripSamples snapshot = samples;
+  int64_t needed = required();
+  portEXIT_CRITICAL(&lock);
+
+  Storage::saveLimitTrips(snapshot);
+
+  // A trip means the buffer was too small, so it never narrows here
+  return needed > currentBuffer ? needed : currentBuffer;
+}
+
+int64_t SafetyBuffer::recordCleanDeploy(int64_t currentBuffer)
+{
+  portENTER_CRITICAL(&lock);
+  bool narrow = ++cleanStreak >= SAFETY_BUFFER_SHRINK_AFTER;
+  if (narrow)
+    cleanStreak = 0;
+  int64_t needed = required();
+  portEXIT_CRITICAL(&lock);
+
+  if (!narrow)
+    return currentBuffer;
+  int64_t narrower = currentBuffer - SAFETY_BUFFER_SHRINK_STEPS;
+  return narrower > needed ? narrower : needed;
+}
+
+void SafetyBuffer::writeJSON(Print &out)
+{
+  portENTER_CRITICAL(&lock);
+  TripSamples snapshot = samples;
+  uint32_t streak = cleanStreak;
+  float mean, stddev;
+  statistics(mean, stddev);
+  int64_t needed = required();
+  portEXIT_CRITICAL(&lock);
+
+  out.print("{\"bufferSteps\":");
+  out.print((long)MotorControl::getSafetyBuffer());
+  out.print(",\"requiredSteps\":");
+  out.print((long)needed);
+  out.print(",\"trips\":");
+  out.print(snapshot.total);
+  out.print(",\"meanShortfall\":");
+  out.print(mean, 1);
+  out.print(",\"stddevShortfall\":");
+  out.print(stddev, 1);
+  out.print(",\"cleanDeploys\":");
+  out.print(streak);
+  out.print(",\"shortfalls\":[");
+
+  // Oldest first
+  uint8_t first = snapshot.count < SAFETY_BUFFER_SAMPLES ? 0 : snapshot.next;
+  for (uint8_t i = 0; i < snapshot.count; i++)
+  {
+    if (i > 0)
+      out.print(",");
+    out.print(snapshot.shortfalls[(first + i) % SAFETY_BUFFER_SAMPLES]);
+  }
+  out.print("]}");
+}
+
+// Prometheus samples
+void SafetyBuffer::writeMetrics(Print &out)
+{
+  portENTER_CRITICAL(&lock);
+  uint16_t total = samples.total;
+  float mean, stddev;
+  statistics(mean, stddev);
+  portEXIT_CRITICAL(&lock);
+
+  out.print("# HELP birdblinds_safety_buffer_steps Steps deploys stop before the calibrated deployed endpoint.\n");
+  out.print("# TYPE birdblinds_safety_buffer_steps gauge\n");
+  out.print("birdblinds_safety_buffer_steps ");
+  out.print((long)MotorControl::getSafetyBuffer());
+  out.print("\n# HELP birdblinds_deployed_limit_trips_total Moves stopped by the deployed limit switch.\n");
+  out.print("# TYPE birdblinds_deployed_limit_trips_total counter\n");
+  out.print("birdblinds_deployed_limit_trips_total ");
+  out.print(total);
+  out.print("\n# HELP birdblinds_deployed_limit_shortfall_mean_steps Mean of recent trip positions short of the endpoint.\n");
+  out.print("# TYPE birdblinds_deployed_limit_shortfall_mean_steps gauge\n");
+  out.print("birdblinds_deployed_limit_shortfall_mean_steps ");
+  out.print(mean, 1);
+  out.print("\n# HELP birdblinds_deployed_limit_shortfall_stddev_steps Standard deviation of the same.\n");
+  out.print("# TYPE birdblinds_deployed_limit_shortfall_stddev_steps gauge\n");
+  out.print("birdblinds_deployed_limit_shortfall_stddev_steps ");
+  out.print(stddev, 1);
+  out.print("\n");
+}
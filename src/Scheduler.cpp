@@ -0,0 +1,472 @@
+#include "Scheduler.h"
+#include "SolarCalculator.h"
+#include "Storage.h"
+#include "WiFiManager.h"
+#include "LogShipper.h"
+#include <sys/time.h>
+#include <esp_sntp.h>
+
+// Static member initialization
+SemaphoreHandle_t Scheduler::mutex = NULL;
+TaskHandle_t Scheduler::taskHandle = NULL;
+ScheduleSettings Scheduler::settings = {};
+Scheduler::HeapEntry Scheduler::heap[SCHEDULE_MAX_RULES] = {};
+uint8_t Scheduler::heapSize = 0;
+volatile bool Scheduler::rebuildPending = true;
+
+// Any clock before this has not been set yet (2023-11-14)
+static const time_t VALID_TIME_THRESHOLD = 1700000000;
+
+static const char *KIND_NAMES[] = {"time", "sunrise", "sunset"};
+
+void Scheduler::begin()
+{
+  mutex = xSemaphoreCreateMutex();
+
+  if (!Storage::loadSchedule(settings))
+  {
+    memset(&settings, 0, sizeof(settings));
+    strncpy(settings.timezone, SCHEDULE_DEFAULT_TZ, sizeof(settings.timezone) - 1);
+  }
+
+  setenv("TZ", settings.timezone, 1);
+  tzset();
+
+  Console.print("Schedule: ");
+  Console.print(settings.ruleCount);
+  Console.print(" rule(s), timezone ");
+  Console.println(settings.timezone);
+}
+
+void Scheduler::startTimeSync()
+{
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  configTzTime(settings.timezone, SCHEDULE_NTP_SERVER);
+}
+
+void Scheduler::onTimeSync(struct timeval *tv)
+{
+  Console.println("[Scheduler] Clock synchronized");
+  rebuildPending = true;
+  wake();
+}
+
+bool Scheduler::isTimeValid()
+{
+  return time(NULL) > VALID_TIME_THRESHOLD;
+}
+
+void Scheduler::wake()
+{
+  if (taskHandle != NULL)
+    xTaskNotifyGive(taskHandle);
+}
+
+// pdMS_TO_TICKS() multiplies in TickType_t, which overflows past about 71
+// minutes at a 1 kHz tick; the maximum sleep is hours
+static TickType_t msToTicks(int64_t ms)
+{
+  return (TickType_t)(ms * configTICK_RATE_HZ / 1000);
+}
+
+void Scheduler::run()
+{
+  taskHandle = xTaskGetCurrentTaskHandle();
+
+  while (true)
+  {
+    TickType_t sleepTicks = msToTicks(SCHEDULE_MAX_SLEEP_MS);
+
+    if (isTimeValid())
+    {
+      time_t now = time(NULL);
+
+      xSemaphoreTake(mutex, portMAX_DELAY);
+      if (rebuildPending)
+      {
+        rebuildPending = false;
+        rebuildHeap(now);
+      }
+
+      // Run everything that is due, then schedule each rule's next occurrence
+      while (heapSize > 0 && heap[0].when <= now)
+      {
+        HeapEntry entry = heapPop();
+        if (now - entry.when <= SCHEDULE_LATE_TOLERANCE_S)
+        {
+          fire(entry.rule);
+        }
+        else
+        {
+          Console.print("[Scheduler] Skipped missed event of rule ");
+          Console.println(entry.rule);
+        }
+
+        time_t next = nextFireTime(settings.rules[entry.rule], now);
+        if (next != 0)
+          heapPush({next, entry.rule});
+      }
+
+      // Sleep until the earliest event
+      if (heapSize > 0)
+      {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        int64_t untilMs = ((int64_t)heap[0].when - tv.tv_sec) * 1000 - tv.tv_usec / 1000;
+        if (untilMs < 0)
+          untilMs = 0;
+        if (untilMs < SCHEDULE_MAX_SLEEP_MS)
+          sleepTicks = msToTicks(untilMs) + 1;
+      }
+      xSemaphoreGive(mutex);
+    }
+
+    ulTaskNotifyTake(pdTRUE, sleepTicks);
+  }
+}
+
+void Scheduler::fire(uint8_t ruleIndex)
+{
+  const ScheduleRule &rule = settings.rules[ruleIndex];
+  const char *action = rule.action == CMD_DEPLOY ? "deploy" : "retract";
+
+  Console.print("[Scheduler] Rule ");
+  Console.print(ruleIndex);
+  Console.print(" (");
+  Console.print(KIND_NAMES[rule.kind]);
+  Console.print("): ");
+  Console.println(action);
+
+  WiFiManager::updateLastAction(String("Scheduled ") + action);
+  MotorControl::queueCommand((MotorCommand)rule.action, SOURCE_SCHEDULE);
+}
+
+time_t Scheduler::nextFireTime(const ScheduleRule &rule, time_t after)
+{
+  if (!rule.enabled)
+    return 0;
+
+  struct tm today;
+  localtime_r(&after, &today);
+
+  // Today plus a full week, so every weekday mask finds its next match
+  for (int i = 0; i <= 7; i++)
+  {
+    struct tm day = today;
+    day.tm_mday += i;
+    day.tm_hour = 12;
+    day.tm_min = 0;
+    day.tm_sec = 0;
+    day.tm_isdst = -1;
+    mktime(&day); // Normalizes the date and fills in tm_wday
+
+    if (!(rule.weekdays & (1 << day.tm_wday)))
+      continue;
+
+    time_t when = eventTime(rule, day);
+    if (when > after)
+      return when;
+  }
+  return 0;
+}
+
+time_t Scheduler::eventTime(const ScheduleRule &rule, const struct tm &localDay)
+{
+  if (rule.kind == RULE_TIME)
+  {
+    struct tm at = localDay;
+    at.tm_hour = rule.minutes / 60;
+    at.tm_min = rule.minutes % 60;
+    at.tm_sec = 0;
+    at.tm_isdst = -1;
+    return mktime(&at);
+  }
+
+  int year = localDay.tm_year + 1900;
+  int month = localDay.tm_mon + 1;
+  SolarTimes sun = SolarCalculator::compute(year, month, localDay.tm_mday, settings.latitudeE6, settings.longitudeE6);
+  if (sun.state != SolarTimes::SOLAR_NORMAL)
+    return 0; // No sunrise/sunset on this day
+
+  time_t midnightUtc = (time_t)SolarCalculator::daysFromCivil(year, month, localDay.tm_mday) * 86400;
+  int32_t offset = rule.kind == RULE_SUNRISE ? sun.sunriseUtc : sun.sunsetUtc;
+  return midnightUtc + offset + rule.minutes * 60;
+}
+
+void Scheduler::rebuildHeap(time_t now)
+{
+  heapSize = 0;
+  for (uint8_t i = 0; i < settings.ruleCount; i++)
+  {
+    time_t next = nextFireTime(settings.rules[i], now);
+    if (next != 0)
+      heapPush({next, i});
+  }
+}
+
+void Scheduler::heapPush(const HeapEntry &entry)
+{
+  uint8_t i = heapSize++;
+  while (i > 0)
+  {
+    uint8_t parent = (i - 1) / 2;
+    if (heap[parent].when <= entry.when)
+      break;
+    heap[i] = heap[parent];
+    i = parent;
+  }
+  heap[i] = entry;
+}
+
+Scheduler::HeapEntry Scheduler::heapPop()
+{
+  HeapEntry top = heap[0];
+  HeapEntry last = heap[--heapSize];
+
+  uint8_t i = 0;
+  while (true)
+  {
+    uint8_t child = 2 * i + 1;
+    if (child >= heapSize)
+      break;
+    if (child + 1 < heapSize && heap[child + 1].when < heap[child].when)
+      child++;
+    if (last.when <= heap[child].when)
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  if (heapSize > 0)
+    heap[i] = last;
+  return top;
+}
+
+bool Scheduler::addRule(const ScheduleRule &rule, String &error)
+{
+  if (rule.kind > RULE_SUNSET)
+  {
+    error = "Unknown rule kind";
+    return false;
+  }
+  if (rule.action != CMD_DEPLOY && rule.action != CMD_RETRACT)
+  {
+    error = "Action must be deploy or retract";
+    return false;
+  }
+  if (rule.weekdays == 0 || rule.weekdays > 0x7F)
+  {
+    error = "Invalid days";
+    return false;
+  }
+  if (rule.kind == RULE_TIME ? (rule.minutes < 0 || rule.minutes >= 1440) : (rule.minutes < -720 || rule.minutes > 720))
+  {
+    error = rule.kind == RULE_TIME ? "Time must be between 00:00 and 23:59" : "Offset must be within 720 minutes";
+    return false;
+  }
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  if (settings.ruleCount >= SCHEDULE_MAX_RULES)
+  {
+    xSemaphoreGive(mutex);
+    error = "Schedule is full";
+    return false;
+  }
+  settings.rules[settings.ruleCount++] = rule;
+  Storage::saveSchedule(settings);
+  rebuildPending = true;
+  xSemaphoreGive(mutex);
+
+  wake();
+  return true;
+}
+
+bool Scheduler::removeRule(int index)
+{
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  if (index < 0 || index >= settings.ruleCount)
+  {
+    xSemaphoreGive(mutex);
+    return false;
+  }
+  for (int i = index; i < settings.ruleCount - 1; i++)
+    settings.rules[i] = settings.rules[i + 1];
+  settings.ruleCount--;
+  Storage::saveSchedule(settings);
+  rebuildPending = true;
+  xSemaphoreGive(mutex);
+
+  wake();
+  return true;
+}
+
+void Scheduler::setLocation(int32_t latitudeE6, int32_t longitudeE6, const String &timezone)
+{
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  settings.latitudeE6 = latitudeE6;
+  settings.longitudeE6 = longitudeE6;
+  if (timezone.length() > 0)
+  {
+    strncpy(settings.timezone, timezone.c_str(), sizeof(settings.timezone) - 1);
+    settings.timezone[sizeof(settings.timezone) - 1] = '\0';
+    setenv("TZ", settings.timezone, 1);
+    tzset();
+  }
+  Storage::saveSchedule(settings);
+  rebuildPending = true;
+  xSemaphoreGive(mutex);
+
+  wake();
+}
+
+// Parse a cron day-of-week field: "*", "1-5", "0,6", "1-3,5"
+uint8_t Scheduler::parseWeekdays(const String &field)
+{
+  if (field == "*")
+    return 0x7F;
+
+  uint8_t mask = 0;
+  int start = 0;
+  while (start < (int)field.length())
+  {
+    int comma = field.indexOf(',', start);
+    String part = field.substring(start, comma < 0 ? field.length() : comma);
+    int dash = part.indexOf('-');
+    int from = part.substring(0, dash < 0 ? part.length() : dash).toInt();
+    int to = dash < 0 ? from : part.substring(dash + 1).toInt();
+
+    if (from < 0 || to > 7 || from > to)
+      return 0;
+
+    // Cron allows 7 as well as 0 for Sunday
+    for (int d = from; d <= to; d++)
+      mask |= 1 << (d % 7);
+
+    if (comma < 0)
+      break;
+    start = comma + 1;
+  }
+  return mask;
+}
+
+void Scheduler::printLocal(Print &out, time_t when)
+{
+  if (when == 0)
+    return;
+
+  struct tm local;
+  char buffer[24];
+  localtime_r(&when, &local);
+  strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M", &local);
+  out.print(buffer);
+}
+
+void Scheduler::writeJSON(Print &out)
+{
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  bool timeValid = isTimeValid();
+  time_t now = time(NULL);
+
+  out.print("{\"timeValid\":");
+  out.print(timeValid ? "true" : "false");
+  out.print(",\"now\":\"");
+  if (timeValid)
+    printLocal(out, now);
+  out.print("\",\"timezone\":\"");
+  out.print(settings.timezone);
+  out.print("\",\"latitude\":");
+  out.print(settings.latitudeE6 / 1e6, 6);
+  out.print(",\"longitude\":");
+  out.print(settings.longitudeE6 / 1e6, 6);
+  out.print(",");
+
+  if (timeValid)
+  {
+    ScheduleRule sunrise = {1, RULE_SUNRISE, CMD_NONE, 0x7F, 0, 0};
+    ScheduleRule sunset = {1, RULE_SUNSET, CMD_NONE, 0x7F, 0, 0};
+    out.print("\"nextSunrise\":\"");
+    printLocal(out, nextFireTime(sunrise, now));
+    out.print("\",\"nextSunset\":\"");
+    printLocal(out, nextFireTime(sunset, now));
+    out.print("\",");
+  }
+
+  out.print("\"rules\":[");
+  for (uint8_t i = 0; i < settings.ruleCount; i++)
+  {
+    const ScheduleRule &rule = settings.rules[i];
+    if (i > 0)
+      out.print(",");
+    out.print("{\"index\":");
+    out.print(i);
+    out.print(",\"kind\":\"");
+    out.print(KIND_NAMES[rule.kind]);
+    out.print("\",\"action\":\"");
+    out.print(rule.action == CMD_DEPLOY ? "deploy" : "retract");
+    out.print("\",\"minutes\":");
+    out.print(rule.minutes);
+    out.print(",\"weekdays\":");
+    out.print(rule.weekdays);
+    out.print(",\"next\":\"");
+    if (timeValid)
+      printLocal(out, nextFireTime(rule, now));
+    out.print("\"}");
+  }
+  out.print("]}");
+  xSemaphoreGive(mutex);
+}
+
+void Scheduler::print()
+{
+  static const char *DAY_NAMES = "SMTWTFS";
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  bool timeValid = isTimeValid();
+  time_t now = time(NULL);
+
+  Console.println("\n=== Schedule ===");
+  Console.print("Clock: ");
+  if (timeValid)
+    printLocal(Console, now);
+  else
+    Console.print("not set");
+  Console.println();
+  Console.print("Location: ");
+  Console.print(settings.latitudeE6 / 1e6, 4);
+  Console.print(", ");
+  Console.print(settings.longitudeE6 / 1e6, 4);
+  Console.print(" (");
+  Console.print(settings.timezone);
+  Console.println(")");
+
+  for (uint8_t i = 0; i < settings.ruleCount; i++)
+  {
+    const ScheduleRule &rule = settings.rules[i];
+    Console.print("  ");
+    Console.print(i);
+    Console.print(": ");
+    Console.print(rule.action == CMD_DEPLOY ? "deploy " : "retract ");
+    if (rule.kind == RULE_TIME)
+    {
+      Console.printf("at %02d:%02d", rule.minutes / 60, rule.minutes % 60);
+    }
+    else
+    {
+      Console.print(KIND_NAMES[rule.kind]);
+      Console.printf(" %+d min", rule.minutes);
+    }
+    Console.print(" [");
+    for (int d = 0; d < 7; d++)
+      Console.print(rule.weekdays & (1 << d) ? DAY_NAMES[d] : '-');
+    Console.print("]");
+    if (timeValid)
+    {
+      Console.print(" next ");
+      printLocal(Console, nextFireTime(rule, now));
+    }
+    Console.println();
+  }
+  if (settings.ruleCount == 0)
+    Console.println("  No rules");
+  Console.println("================\n");
+  xSemaphoreGive(mutex);
+}
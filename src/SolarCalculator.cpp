@@ -0,0 +1,271 @@
+#include "SolarCalculator.h"
+
+static const int CORDIC_ITERATIONS = 24;
+
+// atan(2^-i) in Q16 degrees
+static const int32_t CORDIC_ANGLES[CORDIC_ITERATIONS] = {
+    2949120, 1740967, 919879, 466945, 234379, 117304, 58666, 29335,
+    14668, 7334, 3667, 1833, 917, 458, 229, 115,
+    57, 29, 14, 7, 4, 2, 1, 0};
+
+// 1 / prod(sqrt(1 + 2^-2i)) in Q30
+static const int64_t CORDIC_GAIN = 652032874;
+
+static const int32_t FULL_TURN = 360 * SolarCalculator::DEGREE;
+
+// Coefficients for the solar position (Q30 degrees per day, Q16 degrees)
+static const int64_t MEAN_LONGITUDE_RATE = 1058330837; // 0.9856474 deg/day
+static const int64_t MEAN_ANOMALY_RATE = 1058280264;   // 0.9856003 deg/day
+static const int64_t MEAN_LONGITUDE_J2000 = 18380227;  // 280.460 deg
+static const int64_t MEAN_ANOMALY_J2000 = 23430955;    // 357.528 deg
+static const int64_t CENTER_1 = 125501;                // 1.915 deg
+static const int64_t CENTER_2 = 1311;                  // 0.020 deg
+static const int64_t OBLIQUITY_J2000 = 1536098;        // 23.439 deg
+static const int64_t OBLIQUITY_RATE_E9 = 400;          // 0.0000004 deg/day
+static const int32_t SUNRISE_ALTITUDE = -54591;        // -0.833 deg (refraction + solar radius)
+
+// 2000-01-01 in days since 1970-01-01
+static const int32_t J2000_DAY = 10957;
+
+int32_t SolarCalculator::daysFromCivil(int year, int month, int day)
+{
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yearOfEra = year - era * 400;
+  int32_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+SolarTimes SolarCalculator::compute(int year, int month, int day, int32_t latitudeE6, int32_t longitudeE6)
+{
+  // Angles in Q16 degrees
+  int64_t latitude = (int64_t)latitudeE6 * DEGREE / 1000000;
+  int64_t longitude = (int64_t)longitudeE6 * DEGREE / 1000000;
+
+  // Days since J2000.0 (noon) at the approximate local solar noon, Q16 days
+  int64_t n = (int64_t)(daysFromCivil(year, month, day) - J2000_DAY) * 65536 - longitude / 360;
+
+  SolarTimes times;
+  int32_t declination;
+  times.noonUtc = 43200 + sunPosition(n, longitude, declination);
+
+  int32_t hourAngle;
+  times.state = hourAngleSeconds(latitude, declination, hourAngle);
+  if (times.state != SolarTimes::SOLAR_NORMAL)
+  {
+    times.sunriseUtc = times.noonUtc;
+    times.sunsetUtc = times.noonUtc;
+    return times;
+  }
+
+  times.sunriseUtc = refineEvent(n, longitude, latitude, -hourAngle);
+  times.sunsetUtc = refineEvent(n, longitude, latitude, hourAngle);
+  return times;
+}
+
+// Seconds from 12:00 UTC to the sun's transit at the given Q16 day number,
+// and its declination at that moment
+int32_t SolarCalculator::sunPosition(int64_t n, int64_t longitude, int32_t &declination)
+{
+  int32_t meanLongitude = normalize(MEAN_LONGITUDE_J2000 + ((MEAN_LONGITUDE_RATE * n) >> 30));
+  int32_t meanAnomaly = normalize(MEAN_ANOMALY_J2000 + ((MEAN_ANOMALY_RATE * n) >> 30));
+
+  // Ecliptic longitude and obliquity
+  int64_t lambda = meanLongitude + mulQ30(CENTER_1, sinQ30(meanAnomaly)) +
+                   mulQ30(CENTER_2, sinQ30(normalize(2 * (int64_t)meanAnomaly)));
+  int32_t eclipticLongitude = normalize(lambda);
+  int32_t obliquity = (int32_t)(OBLIQUITY_J2000 - OBLIQUITY_RATE_E9 * n / 1000000000);
+
+  int64_t sinLambda = sinQ30(eclipticLongitude);
+  int64_t cosLambda = cosQ30(eclipticLongitude);
+  int64_t sinObliquity = sinQ30(obliquity);
+  int64_t cosObliquity = cosQ30(obliquity);
+
+  // Declination and right ascension
+  declination = asinDeg((int32_t)mulQ30(sinObliquity, sinLambda));
+  int32_t rightAscension = normalize(atan2Deg(mulQ30(cosObliquity, sinLambda), cosLambda));
+
+  // Equation of time: 4 minutes (240 s) per degree
+  int32_t equation = meanLongitude - rightAscension;
+  if (equation > 180 * DEGREE)
+    equation -= FULL_TURN;
+  if (equation < -180 * DEGREE)
+    equation += FULL_TURN;
+
+  return (int32_t)(-(longitude * 240 + (int64_t)equation * 240) / DEGREE);
+}
+
+// Half the time the sun spends above the sunrise altitude, in seconds
+SolarTimes::State SolarCalculator::hourAngleSeconds(int64_t latitude, int32_t declination, int32_t &seconds)
+{
+  int64_t sinLatitude = sinQ30((int32_t)latitude);
+  int64_t cosLatitude = cosQ30((int32_t)latitude);
+  int64_t sinDeclination = sinQ30(declination);
+  int64_t cosDeclination = cosQ30(declination);
+
+  int64_t numerator = sinQ30(SUNRISE_ALTITUDE) - mulQ30(sinLatitude, sinDeclination);
+  int64_t denominator = mulQ30(cosLatitude, cosDeclination);
+
+  seconds = 0;
+  if (denominator == 0 || numerator >= denominator)
+    return numerator > 0 ? SolarTimes::SOLAR_POLAR_NIGHT : SolarTimes::SOLAR_POLAR_DAY;
+  if (numerator <= -denominator)
+    return SolarTimes::SOLAR_POLAR_DAY;
+
+  int32_t cosHourAngle = (int32_t)((numerator << 30) / denominator);
+  seconds = (int32_t)((int64_t)acosDeg(cosHourAngle) * 240 / DEGREE);
+  return SolarTimes::SOLAR_NORMAL;
+}
+
+// The declination moves by up to 0.4 degrees a day, which shifts sunrise
+// and sunset by minutes at high latitudes. Repeat the calculation with the
+// sun's position at the first estimate of the event (hourAngle negative
+// for sunrise) and keep that estimate if the sun no longer crosses there.
+int32_t SolarCalculator::refineEvent(int64_t n, int64_t longitude, int64_t latitude, int32_t hourAngle)
+{
+  int32_t declination;
+  int32_t transit = sunPosition(n + (int64_t)hourAngle * 65536 / 86400, longitude, declination);
+
+  int32_t seconds;
+  if (hourAngleSeconds(latitude, declination, seconds) != SolarTimes::SOLAR_NORMAL)
+    seconds = hourAngle < 0 ? -hourAngle : hourAngle;
+
+  return 43200 + transit + (hourAngle < 0 ? -seconds : seconds);
+}
+
+// Rotation-mode CORDIC; angle must be within [-90, 90] degrees
+void SolarCalculator::cordicRotate(int32_t angle, int64_t &cosOut, int64_t &sinOut)
+{
+  int64_t x = CORDIC_GAIN;
+  int64_t y = 0;
+  int32_t z = angle;
+
+  for (int i = 0; i < CORDIC_ITERATIONS; i++)
+  {
+    int64_t dx = y >> i;
+    int64_t dy = x >> i;
+    if (z >= 0)
+    {
+      x -= dx;
+      y += dy;
+      z -= CORDIC_ANGLES[i];
+    }
+    else
+    {
+      x += dx;
+      y -= dy;
+      z += CORDIC_ANGLES[i];
+    }
+  }
+
+  cosOut = x;
+  sinOut = y;
+}
+
+int32_t SolarCalculator::sinQ30(int32_t angle)
+{
+  angle = normalize(angle);
+  if (angle > 180 * DEGREE)
+    angle -= FULL_TURN;
+
+  // Fold into [-90, 90]: sin(180 - a) = sin(a)
+  if (angle > 90 * DEGREE)
+    angle = 180 * DEGREE - angle;
+  else if (angle < -90 * DEGREE)
+    angle = -180 * DEGREE - angle;
+
+  int64_t c, s;
+  cordicRotate(angle, c, s);
+  return (int32_t)s;
+}
+
+int32_t SolarCalculator::cosQ30(int32_t angle)
+{
+  return sinQ30(normalize((int64_t)angle + 90 * DEGREE));
+}
+
+// Vectoring-mode CORDIC; result in [-180, 180] degrees
+int32_t SolarCalculator::atan2Deg(int64_t y, int64_t x)
+{
+  if (x == 0 && y == 0)
+    return 0;
+
+  int32_t offset = 0;
+  if (x < 0)
+  {
+    // Rotate by 180 degrees into the right half-plane
+    offset = y >= 0 ? 180 * DEGREE : -180 * DEGREE;
+    x = -x;
+    y = -y;
+  }
+
+  int32_t z = 0;
+  for (int i = 0; i < CORDIC_ITERATIONS; i++)
+  {
+    int64_t dx = y >> i;
+    int64_t dy = x >> i;
+    if (y > 0)
+    {
+      x += dx;
+      y -= dy;
+      z += CORDIC_ANGLES[i];
+    }
+    else
+    {
+      x -= dx;
+      y += dy;
+      z -= CORDIC_ANGLES[i];
+    }
+  }
+  return z + offset;
+}
+
+int32_t SolarCalculator::asinDeg(int32_t value)
+{
+  int64_t v = value;
+  return atan2Deg(v, isqrt((uint64_t)((int64_t)ONE * ONE - v * v)));
+}
+
+int32_t SolarCalculator::acosDeg(int32_t value)
+{
+  int64_t v = value;
+  return atan2Deg(isqrt((uint64_t)((int64_t)ONE * ONE - v * v)), v);
+}
+
+int32_t SolarCalculator::normalize(int64_t angle)
+{
+  angle %= FULL_TURN;
+  if (angle < 0)
+    angle += FULL_TURN;
+  return (int32_t)angle;
+}
+
+int64_t SolarCalculator::mulQ30(int64_t a, int64_t b)
+{
+  return (a * b) >> 30;
+}
+
+int64_t SolarCalculator::isqrt(uint64_t value)
+{
+  uint64_t result = 0;
+  uint64_t bit = (uint64_t)1 << 62;
+
+  while (bit > value)
+    bit >>= 2;
+
+  while (bit != 0)
+  {
+    if (value >= result + bit)
+    {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    }
+    else
+    {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (int64_t)result;
+}
@@ -1,48 +1,753 @@
 #include "Storage.h"
 #include "config.h"
+#include "Trace.h"
+#include "DeltaPatch.h"
+#include "LogShipper.h"
 #include <EEPROM.h>
 
+// Static member initialization
+SemaphoreHandle_t Storage::mutex = NULL;
+
+// On-EEPROM layout of the persistent metrics block
+struct StoredMetrics
+{
+  uint16_t magic;
+  uint16_t reserved;
+  uint32_t watchdogResets;
+  uint32_t motionAborts;
+};
+
+// On-EEPROM layout of the lifetime counter block
+struct StoredLifetime
+{
+  uint16_t magic;
+  uint16_t reserved;
+  uint32_t reserved2; // Keeps the counters 8-byte aligned
+  LifetimeCounters totals;
+};
+
+// On-EEPROM layout of the task override block
+struct StoredTaskOverrides
+{
+  uint16_t magic;
+  uint16_t count;
+  TaskOverride entries[TASK_COUNT];
+};
+
+// On-EEPROM layout of the OTA trial boot record
+struct StoredOtaTrial
+{
+  uint16_t magic;
+  uint8_t attempts;
+  uint8_t reserved;
+  uint32_t previousAddress;
+  uint32_t trialAddress;
+};
+
+// On-EEPROM layout of the schedule block
+struct StoredSchedule
+{
+  uint16_t magic;
+  uint16_t reserved;
+  ScheduleSettings settings;
+};
+
+// On-EEPROM layout of the dual-motor skew block
+struct StoredSkew
+{
+  uint16_t magic;
+  uint16_t reserved[3];
+  int64_t skew;
+};
+
+// On-EEPROM layout of the remote group membership block
+struct StoredRemote
+{
+  uint16_t magic;
+  uint8_t groups;
+  uint8_t reserved;
+};
+
+// On-EEPROM layout of the command arbitration block
+struct StoredArbitration
+{
+  uint16_t magic;
+  uint8_t deferDuringHold;
+  uint8_t reserved;
+  uint32_t holdMs;
+};
+
+// On-EEPROM layout of the deployed limit trip block
+struct StoredLimitTrips
+{
+  uint16_t magic;
+  uint16_t reserved;
+  TripSamples samples;
+};
+
+// On-EEPROM layout of the log shipping block
+struct StoredLogShipping
+{
+  uint16_t magic;
+  uint16_t reserved;
+  LogShippingSettings settings;
+};
+
+// On-EEPROM layout of the tuned limit switch debounce block
+struct StoredDebounce
+{
+  uint16_t magic;
+  uint16_t count;
+  uint32_t debounceUs[SWITCH_COUNT];
+};
+
+// Each block has to end before the next one starts
+static_assert(EEPROM_ADDR_MAGIC + 16 <= EEPROM_ADDR_METRICS, "Calibration block overlaps the metrics block");
+static_assert(EEPROM_ADDR_METRICS + sizeof(StoredMetrics) <= EEPROM_ADDR_TASKS, "Metrics block overlaps the task table");
+static_assert(EEPROM_ADDR_TASKS + sizeof(StoredTaskOverrides) <= EEPROM_ADDR_OTA, "Task table overlaps the OTA trial record");
+static_assert(EEPROM_ADDR_OTA + sizeof(StoredOtaTrial) <= EEPROM_ADDR_SCHEDULE, "OTA trial record overlaps the schedule");
+static_assert(EEPROM_ADDR_SCHEDULE + sizeof(StoredSchedule) <= EEPROM_ADDR_REMOTE, "Schedule overlaps the remote block");
+static_assert(EEPROM_ADDR_REMOTE + sizeof(StoredRemote) <= EEPROM_ADDR_SKEW, "Remote block overlaps the skew block");
+static_assert(EEPROM_ADDR_SKEW + sizeof(StoredSkew) <= EEPROM_ADDR_ARBITRATION, "Skew block overlaps the arbitration block");
+static_assert(EEPROM_ADDR_ARBITRATION + sizeof(StoredArbitration) <= EEPROM_ADDR_LIMIT_TRIPS,
+              "Arbitration block overlaps the limit trips");
+static_assert(EEPROM_ADDR_LIMIT_TRIPS + sizeof(StoredLimitTrips) <= EEPROM_ADDR_DEBOUNCE, "Limit trips overlap the debounce block");
+static_assert(EEPROM_ADDR_DEBOUNCE + sizeof(StoredDebounce) <= EEPROM_ADDR_LIFETIME, "Debounce block overlaps the lifetime counters");
+static_assert(EEPROM_ADDR_LIFETIME + sizeof(StoredLifetime) <= EEPROM_ADDR_LOG, "Lifetime counters overlap the log block");
+static_assert(EEPROM_ADDR_LOG + sizeof(StoredLogShipping) <= EEPROM_SIZE, "Log block runs past the end of EEPROM");
+
+static bool validSchedule(const StoredSchedule &stored)
+{
+  return stored.settings.ruleCount <= SCHEDULE_MAX_RULES;
+}
+
+static bool validLimitTrips(const StoredLimitTrips &stored)
+{
+  return stored.samples.count <= SAFETY_BUFFER_SAMPLES && stored.samples.next < SAFETY_BUFFER_SAMPLES;
+}
+
+static bool validLogShipping(const StoredLogShipping &stored)
+{
+  const LogShippingSettings &settings = stored.settings;
+  return memchr(settings.host, '\0', sizeof(settings.host)) != NULL && settings.maxSeverity <= 7 &&
+         (settings.host[0] == '\0' || settings.port != 0);
+}
+
+static bool validDebounce(const StoredDebounce &stored)
+{
+  if (stored.count != SWITCH_COUNT)
+    return false;
+  for (int i = 0; i < SWITCH_COUNT; i++)
+  {
+    if (stored.debounceUs[i] < SWITCH_DEBOUNCE_MIN_US || stored.debounceUs[i] > SWITCH_DEBOUNCE_MAX_US)
+      return false;
+  }
+  return true;
+}
+
 void Storage::begin()
 {
+  mutex = xSemaphoreCreateMutex();
   EEPROM.begin(EEPROM_SIZE);
 }
 
-bool Storage::loadCalibration(long &deployedPosition, long &safetyBuffer)
+bool Storage::loadCalibration(int64_t &deployedPosition, int64_t &safetyBuffer)
 {
-  Serial.println("Checking for stored calibration...");
+  Console.println("Checking for stored calibration...");
 
+  xSemaphoreTake(mutex, portMAX_DELAY);
   unsigned short magic = EEPROM.readUShort(EEPROM_ADDR_MAGIC);
-  if (magic != EEPROM_MAGIC_NUMBER)
+  if (magic == EEPROM_MAGIC_NUMBER_V1)
   {
-    Serial.println("No valid calibration found in EEPROM");
-    return false;
+    // Older firmware stored 32-bit values; read them before the new layout
+    deployedPosition = EEPROM.readLong(EEPROM_ADDR_DEPLOYED_POS);
+    safetyBuffer = EEPROM.readLong(EEPROM_ADDR_SAFETY_BUFFER_V1);
+  }
+  else
+  {
+    deployedPosition = EEPROM.readLong64(EEPROM_ADDR_DEPLOYED_POS);
+    safetyBuffer = EEPROM.readLong(EEPROM_ADDR_SAFETY_BUFFER);
   }
+  xSemaphoreGive(mutex);
 
-  deployedPosition = EEPROM.readLong(EEPROM_ADDR_DEPLOYED_POS);
-  safetyBuffer = EEPROM.readLong(EEPROM_ADDR_SAFETY_BUFFER);
+  if (magic != EEPROM_MAGIC_NUMBER && magic != EEPROM_MAGIC_NUMBER_V1)
+  {
+    Console.println("No valid calibration found in EEPROM");
+    return false;
+  }
 
   // Validate loaded values
-  if (deployedPosition <= 0 || deployedPosition > 100000)
+  if (deployedPosition < CALIBRATION_MIN_STEPS || deployedPosition > CALIBRATION_MAX_STEPS)
   {
-    Serial.println("Invalid calibration data in EEPROM");
+    Console.println("Invalid calibration data in EEPROM");
     return false;
   }
 
-  Serial.println("Loaded calibration from EEPROM:");
-  Serial.print("  Deployed position: ");
-  Serial.println(deployedPosition);
-  Serial.print("  Safety buffer: ");
-  Serial.println(safetyBuffer);
+  if (magic == EEPROM_MAGIC_NUMBER_V1)
+  {
+    Console.println("Migrating calibration to the 64-bit layout");
+    saveCalibration(deployedPosition, safetyBuffer);
+  }
+
+  Console.println("Loaded calibration from EEPROM:");
+  Console.print("  Deployed position: ");
+  Console.println(deployedPosition);
+  Console.print("  Safety buffer: ");
+  Console.println(safetyBuffer);
 
   return true;
 }
 
-void Storage::saveCalibration(long deployedPosition, long safetyBuffer)
+// Write the RAM copy to flash; callers hold the mutex
+void Storage::commit()
+{
+  TRACE_BEGIN("eeprom commit");
+  EEPROM.commit();
+  TRACE_END("eeprom commit");
+}
+
+void Storage::saveCalibration(int64_t deployedPosition, int64_t safetyBuffer)
 {
-  Serial.println("Saving calibration to EEPROM...");
+  Console.println("Saving calibration to EEPROM...");
+  xSemaphoreTake(mutex, portMAX_DELAY);
   EEPROM.writeUShort(EEPROM_ADDR_MAGIC, EEPROM_MAGIC_NUMBER);
-  EEPROM.writeLong(EEPROM_ADDR_DEPLOYED_POS, deployedPosition);
+  EEPROM.writeLong64(EEPROM_ADDR_DEPLOYED_POS, deployedPosition);
   EEPROM.writeLong(EEPROM_ADDR_SAFETY_BUFFER, safetyBuffer);
-  EEPROM.commit();
-  Serial.println("Calibration saved");
+  commit();
+  xSemaphoreGive(mutex);
+  Console.println("Calibration saved");
+}
+
+bool Storage::loadMetrics(uint32_t &watchdogResets, uint32_t &motionAborts)
+{
+  StoredMetrics stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_METRICS, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_METRICS_MAGIC)
+  {
+    Console.println("No stored metrics found, starting from zero");
+    watchdogResets = 0;
+    motionAborts = 0;
+    return false;
+  }
+
+  watchdogResets = stored.watchdogResets;
+  motionAborts = stored.motionAborts;
+  return true;
+}
+
+void Storage::saveMetrics(uint32_t watchdogResets, uint32_t motionAborts)
+{
+  StoredMetrics stored = {};
+  stored.magic = EEPROM_METRICS_MAGIC;
+  stored.watchdogResets = watchdogResets;
+  stored.motionAborts = motionAborts;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_METRICS, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadLifetime(LifetimeCounters &totals)
+{
+  StoredLifetime stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_LIFETIME, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_LIFETIME_MAGIC)
+    return false;
+
+  totals = stored.totals;
+  return true;
+}
+
+void Storage::saveLifetime(const LifetimeCounters &totals)
+{
+  StoredLifetime stored = {};
+  stored.magic = EEPROM_LIFETIME_MAGIC;
+  stored.totals = totals;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_LIFETIME, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadTaskOverrides(TaskOverride *overrides, size_t count)
+{
+  StoredTaskOverrides stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_TASKS, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_TASKS_MAGIC || stored.count != count)
+    return false;
+
+  memcpy(overrides, stored.entries, sizeof(TaskOverride) * count);
+  return true;
+}
+
+void Storage::saveTaskOverrides(const TaskOverride *overrides, size_t count)
+{
+  StoredTaskOverrides stored = {};
+  stored.magic = EEPROM_TASKS_MAGIC;
+  stored.count = count;
+  memcpy(stored.entries, overrides, sizeof(TaskOverride) * count);
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_TASKS, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadOtaTrial(uint32_t &previousAddress, uint32_t &trialAddress, uint8_t &attempts)
+{
+  StoredOtaTrial stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_OTA, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_OTA_MAGIC)
+    return false;
+
+  previousAddress = stored.previousAddress;
+  trialAddress = stored.trialAddress;
+  attempts = stored.attempts;
+  return true;
+}
+
+void Storage::saveOtaTrial(uint32_t previousAddress, uint32_t trialAddress, uint8_t attempts)
+{
+  StoredOtaTrial stored = {};
+  stored.magic = EEPROM_OTA_MAGIC;
+  stored.attempts = attempts;
+  stored.previousAddress = previousAddress;
+  stored.trialAddress = trialAddress;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_OTA, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+void Storage::clearOtaTrial()
+{
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.writeUShort(EEPROM_ADDR_OTA, 0);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadSchedule(ScheduleSettings &settings)
+{
+  StoredSchedule stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_SCHEDULE, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_SCHEDULE_MAGIC || !validSchedule(stored))
+    return false;
+
+  settings = stored.settings;
+  settings.timezone[sizeof(settings.timezone) - 1] = '\0';
+  return true;
+}
+
+void Storage::saveSchedule(const ScheduleSettings &settings)
+{
+  StoredSchedule stored = {};
+  stored.magic = EEPROM_SCHEDULE_MAGIC;
+  stored.settings = settings;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_SCHEDULE, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadRemoteGroups(uint8_t &groups)
+{
+  StoredRemote stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_REMOTE, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_REMOTE_MAGIC)
+    return false;
+
+  groups = stored.groups;
+  return true;
+}
+
+void Storage::saveRemoteGroups(uint8_t groups)
+{
+  StoredRemote stored = {};
+  stored.magic = EEPROM_REMOTE_MAGIC;
+  stored.groups = groups;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_REMOTE, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadSkew(int64_t &skew)
+{
+  StoredSkew stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_SKEW, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_SKEW_MAGIC)
+    return false;
+
+  skew = stored.skew;
+  return true;
+}
+
+void Storage::saveSkew(int64_t skew)
+{
+  StoredSkew stored = {};
+  stored.magic = EEPROM_SKEW_MAGIC;
+  stored.skew = skew;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_SKEW, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadArbitration(uint32_t &holdMs, bool &deferDuringHold)
+{
+  StoredArbitration stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_ARBITRATION, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_ARBITRATION_MAGIC)
+    return false;
+
+  holdMs = stored.holdMs;
+  deferDuringHold = stored.deferDuringHold != 0;
+  return true;
+}
+
+void Storage::saveArbitration(uint32_t holdMs, bool deferDuringHold)
+{
+  StoredArbitration stored = {};
+  stored.magic = EEPROM_ARBITRATION_MAGIC;
+  stored.deferDuringHold = deferDuringHold ? 1 : 0;
+  stored.holdMs = holdMs;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_ARBITRATION, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadLimitTrips(TripSamples &samples)
+{
+  StoredLimitTrips stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_LIMIT_TRIPS, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_LIMIT_TRIPS_MAGIC || !validLimitTrips(stored))
+    return false;
+
+  samples = stored.samples;
+  return true;
+}
+
+void Storage::saveLimitTrips(const TripSamples &samples)
+{
+  StoredLimitTrips stored = {};
+  stored.magic = EEPROM_LIMIT_TRIPS_MAGIC;
+  stored.samples = samples;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_LIMIT_TRIPS, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadDebounce(uint32_t *debounceUs, size_t count)
+{
+  StoredDebounce stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_DEBOUNCE, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_DEBOUNCE_MAGIC || stored.count != count || !validDebounce(stored))
+    return false;
+
+  memcpy(debounceUs, stored.debounceUs, sizeof(uint32_t) * count);
+  return true;
+}
+
+void Storage::saveDebounce(const uint32_t *debounceUs, size_t count)
+{
+  StoredDebounce stored = {};
+  stored.magic = EEPROM_DEBOUNCE_MAGIC;
+  stored.count = count;
+  memcpy(stored.debounceUs, debounceUs, sizeof(uint32_t) * count);
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_DEBOUNCE, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+bool Storage::loadLogShipping(LogShippingSettings &settings)
+{
+  StoredLogShipping stored;
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.get(EEPROM_ADDR_LOG, stored);
+  xSemaphoreGive(mutex);
+
+  if (stored.magic != EEPROM_LOG_MAGIC || !validLogShipping(stored))
+    return false;
+
+  settings = stored.settings;
+  return true;
+}
+
+void Storage::saveLogShipping(const LogShippingSettings &settings)
+{
+  StoredLogShipping stored = {};
+  stored.magic = EEPROM_LOG_MAGIC;
+  stored.settings = settings;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  EEPROM.put(EEPROM_ADDR_LOG, stored);
+  commit();
+  xSemaphoreGive(mutex);
+}
+
+// ========================================
+// Configuration snapshot
+// ========================================
+
+enum SnapshotTag
+{
+  SNAPSHOT_SCHEDULE = 1,
+  SNAPSHOT_REMOTE = 2,
+  SNAPSHOT_ARBITRATION = 3,
+  SNAPSHOT_TASKS = 4,
+  SNAPSHOT_LOG_SHIPPING = 5,
+  SNAPSHOT_CALIBRATION = 16,
+  SNAPSHOT_SKEW = 17,
+  SNAPSHOT_DEBOUNCE = 18,
+  SNAPSHOT_LIMIT_TRIPS = 19
+};
+
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_HEADER_SIZE 16
+#define SNAPSHOT_BLOCK_HEADER_SIZE 4
+#define SNAPSHOT_FLAG_CALIBRATION 0x01
+#define CALIBRATION_BLOCK_SIZE 16 // Magic, deployed position and safety buffer (see loadCalibration)
+
+static const uint8_t SNAPSHOT_MAGIC[4] = {'B', 'B', 'C', 'S'};
+
+// Blocks are checked on a copy, as the payload need not be aligned
+template <typename T, bool (*check)(const T &)>
+static bool validBlock(const uint8_t *bytes)
+{
+  T block;
+  memcpy(&block, bytes, sizeof(T));
+  return check(block);
+}
+
+static bool validTaskOverrides(const StoredTaskOverrides &stored)
+{
+  return stored.count == TASK_COUNT;
+}
+
+static bool validCalibration(const uint8_t *bytes)
+{
+  int64_t deployedPosition;
+  memcpy(&deployedPosition, bytes + EEPROM_ADDR_DEPLOYED_POS, sizeof(deployedPosition));
+  return deployedPosition >= CALIBRATION_MIN_STEPS && deployedPosition <= CALIBRATION_MAX_STEPS;
+}
+
+struct SnapshotBlock
+{
+  uint8_t tag;
+  uint16_t address;
+  uint16_t size;
+  uint16_t magic;
+  bool calibration; // Unit-specific: only exported and applied on request
+  bool (*valid)(const uint8_t *bytes);
+};
+
+// Settings worth copying between units. Health counters, lifetime totals
+// and the OTA trial record stay with the unit.
+static const SnapshotBlock SNAPSHOT_BLOCKS[] = {
+    {SNAPSHOT_SCHEDULE, EEPROM_ADDR_SCHEDULE, sizeof(StoredSchedule), EEPROM_SCHEDULE_MAGIC, false,
+     validBlock<StoredSchedule, validSchedule>},
+    {SNAPSHOT_REMOTE, EEPROM_ADDR_REMOTE, sizeof(StoredRemote), EEPROM_REMOTE_MAGIC, false, NULL},
+    {SNAPSHOT_ARBITRATION, EEPROM_ADDR_ARBITRATION, sizeof(StoredArbitration), EEPROM_ARBITRATION_MAGIC, false, NULL},
+    {SNAPSHOT_TASKS, EEPROM_ADDR_TASKS, sizeof(StoredTaskOverrides), EEPROM_TASKS_MAGIC, false,
+     validBlock<StoredTaskOverrides, validTaskOverrides>},
+    {SNAPSHOT_LOG_SHIPPING, EEPROM_ADDR_LOG, sizeof(StoredLogShipping), EEPROM_LOG_MAGIC, false,
+     validBlock<StoredLogShipping, validLogShipping>},
+    {SNAPSHOT_CALIBRATION, EEPROM_ADDR_MAGIC, CALIBRATION_BLOCK_SIZE, EEPROM_MAGIC_NUMBER, true, validCalibration},
+    {SNAPSHOT_SKEW, EEPROM_ADDR_SKEW, sizeof(StoredSkew), EEPROM_SKEW_MAGIC, true, NULL},
+    {SNAPSHOT_DEBOUNCE, EEPROM_ADDR_DEBOUNCE, sizeof(StoredDebounce), EEPROM_DEBOUNCE_MAGIC, true,
+     validBlock<StoredDebounce, validDebounce>},
+    {SNAPSHOT_LIMIT_TRIPS, EEPROM_ADDR_LIMIT_TRIPS, sizeof(StoredLimitTrips), EEPROM_LIMIT_TRIPS_MAGIC, true,
+     validBlock<StoredLimitTrips, validLimitTrips>},
+};
+static const size_t SNAPSHOT_BLOCK_COUNT = sizeof(SNAPSHOT_BLOCKS) / sizeof(SNAPSHOT_BLOCKS[0]);
+
+static void writeU16(uint8_t *p, uint16_t value)
+{
+  p[0] = value;
+  p[1] = value >> 8;
+}
+
+static void writeU32(uint8_t *p, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    p[i] = value >> (8 * i);
+}
+
+static uint16_t readU16(const uint8_t *p)
+{
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static uint32_t readU32(const uint8_t *p)
+{
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+size_t Storage::exportSnapshot(uint8_t *buffer, size_t capacity, bool withCalibration)
+{
+  size_t length = SNAPSHOT_HEADER_SIZE;
+  uint16_t blockCount = 0;
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  for (size_t i = 0; i < SNAPSHOT_BLOCK_COUNT; i++)
+  {
+    const SnapshotBlock &block = SNAPSHOT_BLOCKS[i];
+    if (block.calibration && !withCalibration)
+      continue;
+    // Unset blocks are left out; importing clears them on the other unit
+    if (EEPROM.readUShort(block.address) != block.magic)
+      continue;
+    if (length + SNAPSHOT_BLOCK_HEADER_SIZE + block.size > capacity)
+    {
+      xSemaphoreGive(mutex);
+      return 0;
+    }
+    buffer[length] = block.tag;
+    buffer[length + 1] = 0;
+    writeU16(buffer + length + 2, block.size);
+    EEPROM.readBytes(block.address, buffer + length + SNAPSHOT_BLOCK_HEADER_SIZE, block.size);
+    length += SNAPSHOT_BLOCK_HEADER_SIZE + block.size;
+    blockCount++;
+  }
+  xSemaphoreGive(mutex);
+
+  memcpy(buffer, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  buffer[4] = SNAPSHOT_VERSION;
+  buffer[5] = withCalibration ? SNAPSHOT_FLAG_CALIBRATION : 0;
+  writeU16(buffer + 6, blockCount);
+  writeU32(buffer + 8, length);
+  writeU32(buffer + 12, DeltaPatch::crc32(0, buffer + SNAPSHOT_HEADER_SIZE, length - SNAPSHOT_HEADER_SIZE));
+  return length;
+}
+
+// Every block is checked before any is written, and all of them go out
+// in one commit, so a bad snapshot changes nothing
+bool Storage::importSnapshot(const uint8_t *data, size_t length, String &error)
+{
+  if (length < SNAPSHOT_HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+  {
+    error = "Not a configuration snapshot";
+    return false;
+  }
+  if (data[4] != SNAPSHOT_VERSION)
+  {
+    error = "Unsupported snapshot version " + String(data[4]);
+    return false;
+  }
+  if (readU32(data + 8) != length)
+  {
+    error = "Snapshot length mismatch";
+    return false;
+  }
+  if (readU32(data + 12) != DeltaPatch::crc32(0, data + SNAPSHOT_HEADER_SIZE, length - SNAPSHOT_HEADER_SIZE))
+  {
+    error = "Snapshot checksum mismatch";
+    return false;
+  }
+  bool withCalibration = (data[5] & SNAPSHOT_FLAG_CALIBRATION) != 0;
+  uint16_t blockCount = readU16(data + 6);
+
+  const uint8_t *found[SNAPSHOT_BLOCK_COUNT] = {};
+  size_t offset = SNAPSHOT_HEADER_SIZE;
+  for (uint16_t n = 0; n < blockCount; n++)
+  {
+    if (offset + SNAPSHOT_BLOCK_HEADER_SIZE > length)
+    {
+      error = "Snapshot truncated";
+      return false;
+    }
+    uint8_t tag = data[offset];
+    uint16_t size = readU16(data + offset + 2);
+    const uint8_t *bytes = data + offset + SNAPSHOT_BLOCK_HEADER_SIZE;
+    offset += SNAPSHOT_BLOCK_HEADER_SIZE + size;
+    if (offset > length)
+    {
+      error = "Snapshot truncated";
+      return false;
+    }
+
+    size_t i = 0;
+    while (i < SNAPSHOT_BLOCK_COUNT && SNAPSHOT_BLOCKS[i].tag != tag)
+      i++;
+    if (i == SNAPSHOT_BLOCK_COUNT || (SNAPSHOT_BLOCKS[i].calibration && !withCalibration))
+    {
+      error = "Unexpected block " + String(tag);
+      return false;
+    }
+    const SnapshotBlock &block = SNAPSHOT_BLOCKS[i];
+    if (found[i] != NULL || size != block.size || readU16(bytes) != block.magic ||
+        (block.valid != NULL && !block.valid(bytes)))
+    {
+      error = "Invalid block " + String(tag);
+      return false;
+    }
+    found[i] = bytes;
+  }
+  if (offset != length)
+  {
+    error = "Trailing data after the last block";
+    return false;
+  }
+
+  xSemaphoreTake(mutex, portMAX_DELAY);
+  for (size_t i = 0; i < SNAPSHOT_BLOCK_COUNT; i++)
+  {
+    const SnapshotBlock &block = SNAPSHOT_BLOCKS[i];
+    if (block.calibration && !withCalibration)
+      continue;
+    if (found[i] != NULL)
+      EEPROM.writeBytes(block.address, found[i], block.size);
+    else
+      EEPROM.writeUShort(block.address, 0); // Back to defaults
+  }
+  commit();
+  xSemaphoreGive(mutex);
+
+  Console.print("Configuration snapshot applied: ");
+  Console.print(blockCount);
+  Console.println(withCalibration ? " blocks, calibration included" : " blocks");
+  return true;
 }
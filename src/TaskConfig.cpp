@@ -0,0 +1,210 @@
+#include "TaskConfig.h"
+#include "config.h"
+#include "Storage.h"
+#include "LogShipper.h"
+
+// Static member initialization
+TaskSettings TaskConfig::table[TASK_COUNT] = {
+    {"MotorControl", "motor", MOTOR_TASK_STACK, MOTOR_TASK_PRIORITY, MOTOR_TASK_CORE, true},
+    {"WebServer", "web", WEB_TASK_STACK, WEB_TASK_PRIORITY, WEB_TASK_CORE, true},
+    {"Persistence", "persistence", PERSISTENCE_TASK_STACK, PERSISTENCE_TASK_PRIORITY, PERSISTENCE_TASK_CORE, true},
+    {"Scheduler", "scheduler", SCHEDULER_TASK_STACK, SCHEDULER_TASK_PRIORITY, SCHEDULER_TASK_CORE, true},
+    {"loopTask", "loop", CONFIG_ARDUINO_LOOP_STACK_SIZE, LOOP_TASK_PRIORITY, ARDUINO_RUNNING_CORE, false},
+    {"async_tcp", "async_tcp", CONFIG_ASYNC_TCP_STACK_SIZE, CONFIG_ASYNC_TCP_PRIORITY, CONFIG_ASYNC_TCP_RUNNING_CORE, false},
+};
+TaskOverride TaskConfig::overrides[TASK_COUNT] = {};
+
+void TaskConfig::begin()
+{
+  if (!Storage::loadTaskOverrides(overrides, TASK_COUNT))
+    return;
+
+  for (int i = 0; i < TASK_COUNT; i++)
+  {
+    if (!overrides[i].active)
+      continue;
+
+    table[i].priority = overrides[i].priority;
+    if (table[i].coreConfigurable)
+      table[i].core = overrides[i].core;
+
+    Console.print("Task override: ");
+    Console.print(table[i].key);
+    Console.print(" core ");
+    Console.print(table[i].core);
+    Console.print(", priority ");
+    Console.println(table[i].priority);
+  }
+}
+
+const TaskSettings &TaskConfig::get(TaskId id)
+{
+  return table[id];
+}
+
+int TaskConfig::findByKey(const String &key)
+{
+  for (int i = 0; i < TASK_COUNT; i++)
+  {
+    if (key == table[i].key)
+      return i;
+  }
+  return -1;
+}
+
+bool TaskConfig::create(TaskId id, TaskFunction_t function, TaskHandle_t *handle)
+{
+  const TaskSettings &task = table[id];
+  BaseType_t core = task.core < 0 ? tskNO_AFFINITY : task.core;
+
+  if (xTaskCreatePinnedToCore(function, task.name, task.stackSize, NULL, task.priority, handle, core) != pdPASS)
+  {
+    Console.print("ERROR: Failed to create task ");
+    Console.println(task.name);
+    return false;
+  }
+  return true;
+}
+
+void TaskConfig::applyExternal()
+{
+  for (int i = 0; i < TASK_COUNT; i++)
+  {
+    if (table[i].coreConfigurable)
+      continue;
+
+    TaskHandle_t handle = findHandle((TaskId)i);
+    if (handle != NULL)
+      vTaskPrioritySet(handle, table[i].priority);
+  }
+}
+
+bool TaskConfig::ownTasksRunning()
+{
+  for (int i = 0; i < TASK_COUNT; i++)
+  {
+    if (table[i].coreConfigurable && findHandle((TaskId)i) == NULL)
+      return false;
+  }
+  return true;
+}
+
+bool TaskConfig::setOverride(TaskId id, int core, int priority, String &error)
+{
+  TaskSettings &task = table[id];
+
+  if (priority < 1 || priority >= configMAX_PRIORITIES)
+  {
+    error = "Priority must be between 1 and " + String(configMAX_PRIORITIES - 1);
+    return false;
+  }
+  if (core != task.core && !task.coreConfigurable)
+  {
+    error = String("Core of ") + task.key + " is fixed at build time";
+    return false;
+  }
+  if (core < -1 || core >= portNUM_PROCESSORS)
+  {
+    error = "Core must be -1, 0 or 1";
+    return false;
+  }
+
+  overrides[id].active = 1;
+  overrides[id].core = core;
+  overrides[id].priority = priority;
+  Storage::saveTaskOverrides(overrides, TASK_COUNT);
+
+  // Priority takes effect now; a new core only when the task is recreated
+  task.priority = priority;
+  TaskHandle_t handle = findHandle(id);
+  if (handle != NULL)
+    vTaskPrioritySet(handle, priority);
+
+  if (core != task.core)
+  {
+    task.core = core;
+    Console.print("Task ");
+    Console.print(task.key);
+    Console.println(" core change takes effect after restart");
+  }
+  return true;
+}
+
+void TaskConfig::clearOverrides()
+{
+  for (int i = 0; i < TASK_COUNT; i++)
+    overrides[i].active = 0;
+  Storage::saveTaskOverrides(overrides, TASK_COUNT);
+  Console.println("Task overrides cleared; defaults apply after restart");
+}
+
+void TaskConfig::writeJSON(Print &out)
+{
+  out.print("[");
+  for (int i = 0; i < TASK_COUNT; i++)
+  {
+    const TaskSettings &task = table[i];
+    TaskHandle_t handle = findHandle((TaskId)i);
+
+    if (i > 0)
+      out.print(",");
+    out.print("{\"key\":\"");
+    out.print(task.key);
+    out.print("\",\"name\":\"");
+    out.print(task.name);
+    out.print("\",\"core\":");
+    out.print(task.core);
+    out.print(",\"priority\":");
+    out.print((unsigned int)task.priority);
+    out.print(",\"stackSize\":");
+    out.print(task.stackSize);
+    out.print(",\"coreConfigurable\":");
+    out.print(task.coreConfigurable ? "true" : "false");
+    out.print(",\"overridden\":");
+    out.print(overrides[i].active ? "true" : "false");
+    out.print(",\"running\":");
+    out.print(handle != NULL ? "true" : "false");
+    if (handle != NULL)
+    {
+      out.print(",\"livePriority\":");
+      out.print((unsigned int)uxTaskPriorityGet(handle));
+      out.print(",\"stackFree\":");
+      out.print((unsigned int)uxTaskGetStackHighWaterMark(handle));
+    }
+    out.print("}");
+  }
+  out.print("]");
+}
+
+void TaskConfig::print()
+{
+  Console.println("\n=== Task Configuration ===");
+  for (int i = 0; i < TASK_COUNT; i++)
+  {
+    const TaskSettings &task = table[i];
+    TaskHandle_t handle = findHandle((TaskId)i);
+
+    Console.print("  ");
+    Console.print(task.name);
+    Console.print(": core ");
+    if (task.core < 0)
+      Console.print("any");
+    else
+      Console.print(task.core);
+    Console.print(", priority ");
+    Console.print((unsigned int)task.priority);
+    Console.print(", stack ");
+    Console.print(task.stackSize);
+    if (overrides[i].active)
+      Console.print(" (override)");
+    if (handle == NULL)
+      Console.print(" [not running]");
+    Console.println();
+  }
+  Console.println("==========================\n");
+}
+
+TaskHandle_t TaskConfig::findHandle(TaskId id)
+{
+  return xTaskGetHandle(table[id].name);
+}
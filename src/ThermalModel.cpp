@@ -0,0 +1,176 @@
+#include "ThermalModel.h"
+#include "LogShipper.h"
+#include <math.h>
+
+// Static member initialization
+float ThermalModel::temperatureC = THERMAL_AMBIENT_C;
+float ThermalModel::peakC = THERMAL_AMBIENT_C;
+float ThermalModel::loadW = 0;
+unsigned long ThermalModel::lastUpdateMs = 0;
+SpeedProfile ThermalModel::lastProfile = PROFILE_CONSERVATIVE;
+uint32_t ThermalModel::burstMoves = 0;
+uint32_t ThermalModel::conservativeMoves = 0;
+uint32_t ThermalModel::fallbacks = 0;
+portMUX_TYPE ThermalModel::lock = portMUX_INITIALIZER_UNLOCKED;
+
+void ThermalModel::begin()
+{
+  // The driver is enabled from boot, so idle is holding, not cold
+  loadW = powerW(MOTOR_HOLD_CURRENT_MA, 0);
+  temperatureC = THERMAL_AMBIENT_C + loadW * THERMAL_RESISTANCE_C_PER_W;
+  peakC = temperatureC;
+  lastUpdateMs = millis();
+
+  Console.print("Thermal model: idle ");
+  Console.print(temperatureC, 1);
+  Console.print(" C, limit ");
+  Console.print(THERMAL_LIMIT_C);
+  Console.print(" C, burst ");
+  Console.print(MotionPlanner::stepRate(PROFILE_BURST));
+  Console.print(" steps/s at ");
+  Console.print(runCurrentMa(PROFILE_BURST));
+  Console.println(" mA");
+}
+
+// Without VREF control the pot sets one current for both profiles
+uint32_t ThermalModel::runCurrentMa(SpeedProfile profile)
+{
+  if (profile == PROFILE_BURST && VREF_PWM_PIN >= 0)
+    return MOTOR_BURST_CURRENT_MA;
+  return MOTOR_RUN_CURRENT_MA;
+}
+
+float ThermalModel::powerW(uint32_t currentMa, uint32_t stepRate)
+{
+  float amps = currentMa / 1000.0f;
+  float copperW = 2 * amps * amps * (MOTOR_PHASE_RESISTANCE_MOHM / 1000.0f);
+  return copperW + stepRate / 1000.0f * (THERMAL_SPEED_LOSS_MW_PER_KSPS / 1000.0f);
+}
+
+// Temperature after running this long at a constant power
+float ThermalModel::settle(float fromC, float watts, float seconds)
+{
+  float steadyC = THERMAL_AMBIENT_C + watts * THERMAL_RESISTANCE_C_PER_W;
+  return steadyC + (fromC - steadyC) * expf(-seconds / THERMAL_TIME_CONSTANT_S);
+}
+
+// Callers hold the lock
+void ThermalModel::advance(unsigned long now)
+{
+  temperatureC = settle(temperatureC, loadW, (now - lastUpdateMs) / 1000.0f);
+  lastUpdateMs = now;
+  if (temperatureC > peakC)
+    peakC = temperatureC;
+}
+
+void ThermalModel::startMoving(SpeedProfile profile)
+{
+  float watts = powerW(runCurrentMa(profile), MotionPlanner::stepRate(profile));
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  advance(now);
+  loadW = watts;
+  lastProfile = profile;
+  if (profile == PROFILE_BURST)
+    burstMoves++;
+  else
+    conservativeMoves++;
+  portEXIT_CRITICAL(&lock);
+}
+
+void ThermalModel::stopMoving()
+{
+  float watts = powerW(MOTOR_HOLD_CURRENT_MA, 0);
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  advance(now);
+  loadW = watts;
+  portEXIT_CRITICAL(&lock);
+}
+
+SpeedProfile ThermalModel::predictProfile(int64_t steps, float &endC)
+{
+  float watts = powerW(runCurrentMa(PROFILE_BURST), MotionPlanner::stepRate(PROFILE_BURST));
+  float seconds = MotionPlanner::stepsDurationUs(steps, PROFILE_BURST) / 1000000.0f;
+  endC = settle(getTemperatureC(), watts, seconds);
+  return endC <= THERMAL_LIMIT_C - THERMAL_BURST_MARGIN_C ? PROFILE_BURST : PROFILE_CONSERVATIVE;
+}
+
+SpeedProfile ThermalModel::predictProfile(int64_t steps)
+{
+  float endC;
+  return predictProfile(steps, endC);
+}
+
+SpeedProfile ThermalModel::chooseProfile(int64_t steps)
+{
+  float endC;
+  SpeedProfile profile = predictProfile(steps, endC);
+  if (profile == PROFILE_CONSERVATIVE)
+  {
+    portENTER_CRITICAL(&lock);
+    fallbacks++;
+    portEXIT_CRITICAL(&lock);
+    Console.print("[Thermal] A burst would end at ");
+    Console.print(endC, 1);
+    Console.println(" C, moving conservatively");
+  }
+  return profile;
+}
+
+float ThermalModel::getTemperatureC()
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  advance(now);
+  float value = temperatureC;
+  portEXIT_CRITICAL(&lock);
+  return value;
+}
+
+float ThermalModel::getPeakTemperatureC()
+{
+  unsigned long now = millis();
+  portENTER_CRITICAL(&lock);
+  advance(now);
+  float value = peakC;
+  portEXIT_CRITICAL(&lock);
+  return value;
+}
+
+SpeedProfile ThermalModel::getLastProfile()
+{
+  return lastProfile;
+}
+
+// Prometheus samples
+void ThermalModel::writeMetrics(Print &out)
+{
+  float nowC = getTemperatureC();
+  portENTER_CRITICAL(&lock);
+  float maxC = peakC;
+  uint32_t bursts = burstMoves;
+  uint32_t conservative = conservativeMoves;
+  uint32_t refused = fallbacks;
+  portEXIT_CRITICAL(&lock);
+
+  out.print("# HELP birdblinds_motor_temperature_celsius Estimated motor temperature (thermal model).\n");
+  out.print("# TYPE birdblinds_motor_temperature_celsius gauge\n");
+  out.print("birdblinds_motor_temperature_celsius ");
+  out.print(nowC, 2);
+  out.print("\n# HELP birdblinds_motor_temperature_peak_celsius Highest estimated motor temperature since boot.\n");
+  out.print("# TYPE birdblinds_motor_temperature_peak_celsius gauge\n");
+  out.print("birdblinds_motor_temperature_peak_celsius ");
+  out.print(maxC, 2);
+  out.print("\n# HELP birdblinds_moves_total Moves by speed profile.\n");
+  out.print("# TYPE birdblinds_moves_total counter\n");
+  out.print("birdblinds_moves_total{profile=\"burst\"} ");
+  out.print(bursts);
+  out.print("\nbirdblinds_moves_total{profile=\"conservative\"} ");
+  out.print(conservative);
+  out.print("\n# HELP birdblinds_burst_fallbacks_total Moves run conservatively because a burst would have run too hot.\n");
+  out.print("# TYPE birdblinds_burst_fallbacks_total counter\n");
+  out.print("birdblinds_burst_fallbacks_total ");
+  out.print(refused);
+  out.print("\n");
+}
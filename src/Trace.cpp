@@ -0,0 +1,211 @@
+#include "Trace.h"
+
+#if TRACE_ENABLED
+
+#include <esp_timer.h>
+
+enum ExportStage
+{
+  STAGE_HEADER,
+  STAGE_PROCESSES,
+  STAGE_THREADS,
+  STAGE_EVENTS,
+  STAGE_FOOTER,
+  STAGE_DONE
+};
+
+// Static member initialization
+Trace::Ring Trace::rings[portNUM_PROCESSORS];
+
+Trace::Ring::Ring() : next(0)
+{
+  portMUX_TYPE unlocked = portMUX_INITIALIZER_UNLOCKED;
+  lock = unlocked;
+}
+
+void Trace::record(char phase, const char *name, int32_t value)
+{
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  Ring &ring = rings[xPortGetCoreID()];
+
+  // The timestamp is taken under the lock, so each ring stays in time order
+  portENTER_CRITICAL(&ring.lock);
+  TraceEvent &event = ring.events[ring.next++ % TRACE_RING_EVENTS];
+  event.us = esp_timer_get_time();
+  event.name = name;
+  event.task = task;
+  event.value = value;
+  event.phase = phase;
+  portEXIT_CRITICAL(&ring.lock);
+}
+
+// The rings are copied out first, so the response streams at whatever
+// pace the client reads while tracing carries on
+Trace::Cursor::Cursor()
+    : taskCount(0), overwritten(0), stage(STAGE_HEADER), index(0), pendingLength(0), pendingOffset(0)
+{
+  size_t bytes = sizeof(TraceEvent) * TRACE_RING_EVENTS * portNUM_PROCESSORS;
+  events = (TraceEvent *)(psramFound() ? ps_malloc(bytes) : malloc(bytes));
+
+  size_t count = 0;
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+  {
+    eventCounts[core] = 0;
+    if (events == NULL)
+      continue;
+
+    // Oldest first
+    Ring &ring = rings[core];
+    portENTER_CRITICAL(&ring.lock);
+    uint32_t kept = ring.next < TRACE_RING_EVENTS ? ring.next : TRACE_RING_EVENTS;
+    for (uint32_t n = ring.next - kept; n != ring.next; n++)
+      events[count + eventCounts[core]++] = ring.events[n % TRACE_RING_EVENTS];
+    overwritten += ring.next - kept;
+    portEXIT_CRITICAL(&ring.lock);
+
+    for (size_t i = count; i < count + eventCounts[core]; i++)
+    {
+      int tid = threadId(events[i].task);
+      if (tid > 0)
+        taskCores[tid - 1] |= 1 << core;
+    }
+    count += eventCounts[core];
+  }
+}
+
+Trace::Cursor::~Cursor()
+{
+  free(events);
+}
+
+// Small thread ids in order of first appearance; 0 for tasks past the table
+int Trace::Cursor::threadId(TaskHandle_t task)
+{
+  for (size_t i = 0; i < taskCount; i++)
+  {
+    if (tasks[i] == task)
+      return i + 1;
+  }
+  if (taskCount == TRACE_MAX_THREADS)
+    return 0;
+  tasks[taskCount] = task;
+  taskCores[taskCount] = 0;
+  return ++taskCount;
+}
+
+int Trace::Cursor::coreOf(size_t event)
+{
+  int core = 0;
+  while (core < portNUM_PROCESSORS - 1 && event >= eventCounts[core])
+    event -= eventCounts[core++];
+  return core;
+}
+
+// Format the next JSON piece into pending; false when there is none
+bool Trace::Cursor::nextPiece()
+{
+  size_t count = 0;
+  for (int core = 0; core < portNUM_PROCESSORS; core++)
+    count += eventCounts[core];
+
+  pendingOffset = 0;
+  pendingLength = 0;
+  while (true)
+  {
+    switch (stage)
+    {
+    case STAGE_HEADER:
+      pendingLength = snprintf(pending, sizeof(pending), "{\"traceEvents\":[");
+      stage = STAGE_PROCESSES;
+      index = 0;
+      return true;
+
+    case STAGE_PROCESSES:
+      if (index < portNUM_PROCESSORS)
+      {
+        pendingLength = snprintf(pending, sizeof(pending),
+                                 "%s{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%u,\"args\":{\"name\":\"core %u\"}}",
+                                 index > 0 ? "," : "", (unsigned int)index, (unsigned int)index);
+        index++;
+        return true;
+      }
+      stage = STAGE_THREADS;
+      index = 0;
+      break;
+
+    case STAGE_THREADS:
+      // One track per task and core it ran on
+      while (index < taskCount * portNUM_PROCESSORS)
+      {
+        size_t task = index / portNUM_PROCESSORS;
+        unsigned int core = index % portNUM_PROCESSORS;
+        index++;
+        if ((taskCores[task] & (1 << core)) == 0)
+          continue;
+        const char *name = tasks[task] != NULL ? pcTaskGetName(tasks[task]) : "unknown";
+        pendingLength = snprintf(pending, sizeof(pending),
+                                 ",{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                                 core, (unsigned int)(task + 1), name);
+        return true;
+      }
+      stage = STAGE_EVENTS;
+      index = 0;
+      break;
+
+    case STAGE_EVENTS:
+      if (index < count)
+      {
+        const TraceEvent &event = events[index];
+        int core = coreOf(index);
+        index++;
+        pendingLength = snprintf(pending, sizeof(pending), ",{\"ph\":\"%c\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%lld",
+                                 event.phase, event.name, core, threadId(event.task), (long long)event.us);
+        if (event.phase == 'i')
+          pendingLength += snprintf(pending + pendingLength, sizeof(pending) - pendingLength, ",\"s\":\"t\"");
+        if (event.phase == 'i' || event.phase == 'C')
+          pendingLength += snprintf(pending + pendingLength, sizeof(pending) - pendingLength,
+                                    ",\"args\":{\"value\":%ld}", (long)event.value);
+        pendingLength += snprintf(pending + pendingLength, sizeof(pending) - pendingLength, "}");
+        return true;
+      }
+      stage = STAGE_FOOTER;
+      break;
+
+    case STAGE_FOOTER:
+      pendingLength = snprintf(pending, sizeof(pending),
+                               "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"version\":\"%s\",\"overwritten\":%lu}}",
+                               FIRMWARE_VERSION, (unsigned long)overwritten);
+      stage = STAGE_DONE;
+      return true;
+
+    default:
+      return false;
+    }
+  }
+}
+
+size_t Trace::Cursor::read(uint8_t *buffer, size_t maxLength)
+{
+  size_t written = 0;
+
+  while (written < maxLength)
+  {
+    if (pendingOffset < pendingLength)
+    {
+      size_t take = pendingLength - pendingOffset;
+      if (take > maxLength - written)
+        take = maxLength - written;
+      memcpy(buffer + written, pending + pendingOffset, take);
+      pendingOffset += take;
+      written += take;
+      continue;
+    }
+
+    if (!nextPiece())
+      break;
+  }
+
+  return written;
+}
+
+#endif // TRACE_ENABLED
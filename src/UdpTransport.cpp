@@ -0,0 +1,68 @@
+#include "UdpTransport.h"
+#include "CommandBus.h"
+#include "LogShipper.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+bool UdpTransport::begin()
+{
+  sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0)
+  {
+    Console.println("ERROR: UDP command socket failed");
+    return false;
+  }
+
+  // Several nodes may share one host when testing over loopback
+  int enable = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  setsockopt(sock, SOL_SOCKET, SO_BROADCAST, &enable, sizeof(enable));
+
+  struct sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(sock, (struct sockaddr *)&local, sizeof(local)) < 0)
+  {
+    Console.print("ERROR: UDP command port ");
+    Console.print(port);
+    Console.println(" unavailable");
+    close(sock);
+    sock = -1;
+    return false;
+  }
+
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+  return true;
+}
+
+bool UdpTransport::send(const CommandPacket &packet)
+{
+  if (sock < 0)
+    return false;
+
+  struct sockaddr_in destination = {};
+  destination.sin_family = AF_INET;
+  destination.sin_port = htons(port);
+  destination.sin_addr.s_addr = inet_addr(address);
+
+  return sendto(sock, &packet, sizeof(packet), 0, (struct sockaddr *)&destination, sizeof(destination)) == sizeof(packet);
+}
+
+void UdpTransport::poll()
+{
+  if (sock < 0)
+    return;
+
+  uint8_t buffer[64];
+  for (int i = 0; i < 8; i++)
+  {
+    ssize_t length = recv(sock, buffer, sizeof(buffer), 0);
+    if (length <= 0)
+      break;
+    CommandBus::receive(buffer, length, this);
+  }
+}
@@ -0,0 +1,56 @@
+#include "Watchdog.h"
+#include "config.h"
+#include "LogShipper.h"
+#include <esp_idf_version.h>
+#include <esp_system.h>
+#include <esp_task_wdt.h>
+
+void Watchdog::begin()
+{
+  // The TWDT is already running from startup; reconfigure it so that
+  // a starved task resets the chip instead of only printing a warning
+#if ESP_IDF_VERSION_MAJOR >= 5
+  esp_task_wdt_config_t config = {};
+  config.timeout_ms = TASK_WDT_TIMEOUT_S * 1000;
+  config.idle_core_mask = 0;
+  config.trigger_panic = true;
+  if (esp_task_wdt_reconfigure(&config) == ESP_ERR_INVALID_STATE)
+  {
+    esp_task_wdt_init(&config);
+  }
+#else
+  esp_task_wdt_init(TASK_WDT_TIMEOUT_S, true);
+#endif
+
+  Console.print("Task watchdog armed (");
+  Console.print(TASK_WDT_TIMEOUT_S);
+  Console.println(" s timeout)");
+}
+
+bool Watchdog::subscribe(const char *taskName)
+{
+  esp_err_t err = esp_task_wdt_add(NULL);
+  if (err != ESP_OK)
+  {
+    Console.print("Warning: Failed to subscribe ");
+    Console.print(taskName);
+    Console.print(" to task watchdog: ");
+    Console.println(esp_err_to_name(err));
+    return false;
+  }
+
+  Console.print("[Watchdog] Supervising ");
+  Console.println(taskName);
+  return true;
+}
+
+void Watchdog::feed()
+{
+  esp_task_wdt_reset();
+}
+
+bool Watchdog::wasWatchdogReset()
+{
+  esp_reset_reason_t reason = esp_reset_reason();
+  return reason == ESP_RST_TASK_WDT || reason == ESP_RST_INT_WDT || reason == ESP_RST_WDT;
+}
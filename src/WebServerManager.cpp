@@ -1,37 +1,371 @@
 #include "WebServerManager.h"
+#include "config.h"
 #include "MotorControl.h"
+#include "Storage.h"
 #include "WiFiManager.h"
+#include "Metrics.h"
+#include "TaskConfig.h"
+#include "OtaUpdater.h"
+#include "Scheduler.h"
+#include "History.h"
+#include "CommandBus.h"
+#include "MoveReports.h"
+#include "MotionSupervisor.h"
+#include "RequestArena.h"
+#include "CommandArbiter.h"
+#include "ThermalModel.h"
+#include "SafetyBuffer.h"
+#include "LimitSwitches.h"
+#include "Trace.h"
+#include "LogShipper.h"
 #include <ESPAsyncWebServer.h>
+#include <StreamString.h>
+#include <esp_timer.h>
 
 static AsyncWebServer server(80);
 
+typedef std::function<void(Print &)> ResponseWriter;
+
+// Build a response body in a request arena and send it from there; the
+// arena goes back to the pool when the connection closes. With an etag,
+// clients are told to revalidate rather than reuse the body unasked.
+static void sendBuilt(AsyncWebServerRequest *request, int code, const char *contentType, ResponseWriter writer,
+                      const String &etag = String())
+{
+  AsyncWebServerResponse *response;
+  RequestArena *arena = RequestArena::acquire();
+  if (arena == NULL)
+  {
+    // Pool exhausted: build on the heap instead
+    StreamString body;
+    writer(body);
+    response = request->beginResponse(code, contentType, (const String &)body);
+  }
+  else
+  {
+    writer(*arena);
+    if (arena->overflowed())
+    {
+      RequestArena::release(arena);
+      request->send(500, "application/json", "{\"success\":false,\"message\":\"Response too large\"}");
+      return;
+    }
+    request->onDisconnect([arena]()
+                          { RequestArena::release(arena); });
+    response = request->beginResponse(code, contentType, arena->data(), arena->length());
+  }
+  if (etag.length() > 0)
+  {
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+  }
+  request->send(response);
+}
+
+// What the cached /api/status body was built from. While the motor is
+// idle, everything it reports is covered by a generation counter or read
+// here (the limit switches poll their pins when read). Moves and manual
+// holds count down by the millisecond, so those responses are not cached.
+struct StatusKey
+{
+  uint32_t motorGeneration;
+  uint32_t actionGeneration;
+  int32_t temperatureDeciC;
+  bool retractedLimit;
+  bool deployedLimit;
+
+  bool operator==(const StatusKey &other) const
+  {
+    return motorGeneration == other.motorGeneration && actionGeneration == other.actionGeneration &&
+           temperatureDeciC == other.temperatureDeciC && retractedLimit == other.retractedLimit &&
+           deployedLimit == other.deployedLimit;
+  }
+};
+
+// AsyncTCP task only
+static char statusBody[STATUS_CACHE_BYTES];
+static size_t statusLength = 0; // 0 while nothing is cached
+static StatusKey statusKey;
+static uint32_t statusGeneration = 0; // Bumped per rebuild; the ETag
+static uint32_t statusEpoch = 0;      // Per boot, so an ETag never matches across restarts
+static uint32_t statusBuilds = 0;
+static uint32_t statusCacheHits = 0;
+static uint32_t statusNotModified = 0;
+
+// GET /api/status: 304 when the client's ETag is still current, the
+// cached body when only the client is behind, and a rebuild otherwise
+static void sendStatus(AsyncWebServerRequest *request)
+{
+  if (MotionSupervisor::isMoveActive() || CommandArbiter::getHoldRemainingMs() > 0)
+  {
+    statusBuilds++;
+    sendBuilt(request, 200, "application/json", WebServerManager::writeStatusJSON);
+    return;
+  }
+
+  StatusKey key = {MotorControl::getStateGeneration(), WiFiManager::getLastActionGeneration(),
+                   (int32_t)lroundf(ThermalModel::getTemperatureC() * 10), MotorControl::isRetractedLimitHit(),
+                   MotorControl::isDeployedLimitHit()};
+  bool rebuilt = statusLength == 0 || !(key == statusKey);
+  if (rebuilt)
+  {
+    // Built straight into the cache; a body too large for it is rebuilt
+    // into a pooled arena and sent uncached
+    RequestArena cache((uint8_t *)statusBody, sizeof(statusBody));
+    WebServerManager::writeStatusJSON(cache);
+    statusBuilds++;
+    if (cache.overflowed())
+    {
+      statusLength = 0;
+      sendBuilt(request, 200, "application/json", WebServerManager::writeStatusJSON);
+      return;
+    }
+    statusLength = cache.length();
+    statusKey = key;
+    statusGeneration++;
+  }
+
+  String etag = "\"" + String(statusEpoch, HEX) + "-" + String(statusGeneration) + "\"";
+  if (request->header("If-None-Match") == etag)
+  {
+    statusNotModified++;
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+    request->send(response);
+    return;
+  }
+  if (!rebuilt)
+    statusCacheHits++;
+  sendBuilt(request, 200, "application/json", [](Print &out)
+            { out.write((const uint8_t *)statusBody, statusLength); }, etag);
+}
+
+// Feed one chunk of a firmware upload (multipart or raw body) to the updater
+static void handleOtaChunk(size_t index, uint8_t *data, size_t len, size_t total)
+{
+  if (index == 0)
+  {
+    String error;
+    if (!OtaUpdater::start(total, error))
+      return;
+  }
+  TRACE_BEGIN("ota write");
+  OtaUpdater::write(data, len);
+  TRACE_END("ota write");
+}
+
+// A configuration snapshot being received
+struct SnapshotUpload
+{
+  size_t length;
+  size_t received;
+  uint8_t data[CONFIG_SNAPSHOT_MAX_BYTES];
+};
+
+static void handleSnapshotChunk(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+{
+  if (index == 0)
+  {
+    if (total > CONFIG_SNAPSHOT_MAX_BYTES)
+      return;
+    SnapshotUpload *upload = (SnapshotUpload *)malloc(sizeof(SnapshotUpload));
+    if (upload == NULL)
+      return;
+    upload->length = total;
+    upload->received = 0;
+    request->_tempObject = upload; // Freed with the request
+  }
+  SnapshotUpload *upload = (SnapshotUpload *)request->_tempObject;
+  if (upload == NULL || index + len > upload->length)
+    return;
+  memcpy(upload->data + index, data, len);
+  upload->received += len;
+}
+
+// Offer a command from a web request to the motor task. Requests count as
+// automation unless they say source=manual, as the web page does.
+static void queueFromRequest(AsyncWebServerRequest *request, MotorCommand cmd, const char *action, const char *queued)
+{
+  CommandSource source = request->hasParam("source") ? CommandArbiter::parseSource(request->getParam("source")->value()) : SOURCE_API;
+  CommandDecision decision = MotorControl::queueCommand(cmd, source);
+  if (decision != COMMAND_ACCEPTED)
+  {
+    uint32_t seconds = (CommandArbiter::getHoldRemainingMs() + 999) / 1000;
+    if (decision == COMMAND_REFUSED)
+      request->send(503, "application/json", "{\"success\":false,\"message\":\"Firmware update in progress, retry when it finishes\"}");
+    else if (decision == COMMAND_DEFERRED)
+      sendBuilt(request, 202, "application/json", [seconds](Print &out)
+                {
+        out.print("{\"success\":true,\"deferred\":true,\"message\":\"Manual override active, command runs in ");
+        out.print(seconds);
+        out.print(" s\"}"); });
+    else
+      sendBuilt(request, 409, "application/json", [seconds](Print &out)
+                {
+        out.print("{\"success\":false,\"message\":\"Manual override active for ");
+        out.print(seconds);
+        out.print(" s, command dropped\"}"); });
+    return;
+  }
+  WiFiManager::updateLastAction(action);
+  sendBuilt(request, 200, "application/json", [queued](Print &out)
+            {
+    out.print("{\"success\":true,\"message\":\"");
+    out.print(queued);
+    out.print("\"}"); });
+}
+
+// Requests handled and the time spent in their handlers; AsyncTCP task only
+static uint32_t webRequests = 0;
+static uint64_t webHandlerUs = 0;
+
+// Register a route. Every run of its request handler is timed for
+// /metrics and, with tracing on, shows up on the timeline under the
+// route's path.
+static void route(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+                  ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr)
+{
+  ArRequestHandlerFunction handler = onRequest;
+  onRequest = [uri, handler](AsyncWebServerRequest *request)
+  {
+    TRACE_BEGIN(uri);
+    int64_t start = esp_timer_get_time();
+    handler(request);
+    webHandlerUs += esp_timer_get_time() - start;
+    webRequests++;
+    TRACE_END(uri);
+  };
+  server.on(uri, method, onRequest, onUpload, onBody);
+}
+
+// Stream a snapshot of the trace rings
+static void sendTrace(AsyncWebServerRequest *request)
+{
+#if TRACE_ENABLED
+  Trace::Cursor *cursor = new Trace::Cursor();
+  request->onDisconnect([cursor]()
+                        { delete cursor; });
+  request->send(request->beginChunkedResponse("application/json", [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                              { return cursor->read(buffer, maxLen); }));
+#else
+  request->send(404, "application/json", "{\"success\":false,\"message\":\"Tracing not enabled in this build\"}");
+#endif
+}
+
 void WebServerManager::begin()
 {
+  RequestArena::begin();
+  statusEpoch = esp_random();
   setupRoutes();
   server.begin();
-  Serial.println("Web server started");
+  Console.println("Web server started");
+}
+
+void WebServerManager::writeStatusJSON(Print &out)
+{
+  out.print("{\"calibrated\":");
+  out.print(MotorControl::isCalibrated() ? "true" : "false");
+  out.print(",\"calibrationSuspect\":");
+  out.print(MotorControl::isCalibrationSuspect() ? "true" : "false");
+  out.print(",\"currentPosition\":");
+  out.print(MotorControl::getPosition());
+  out.print(",\"deployedPosition\":");
+  out.print(MotorControl::getDeployedPosition());
+  if (DUAL_MOTOR_ENABLED)
+  {
+    out.print(",\"secondPosition\":");
+    out.print(MotorControl::getSecondPosition());
+    out.print(",\"skew\":");
+    out.print(MotorControl::getSkew());
+  }
+  out.print(",\"retractedLimit\":");
+  out.print(MotorControl::isRetractedLimitHit() ? "true" : "false");
+  out.print(",\"deployedLimit\":");
+  out.print(MotorControl::isDeployedLimitHit() ? "true" : "false");
+  bool moving = MotionSupervisor::isMoveActive();
+  out.print(",\"moving\":");
+  out.print(moving ? "true" : "false");
+  if (moving)
+  {
+    out.print(",\"progress\":");
+    out.print(MotionSupervisor::getProgress(), 3);
+    out.print(",\"eta_ms\":");
+    out.print(MotionSupervisor::getEtaMs());
+    out.print(",\"profile\":\"");
+    out.print(MotionPlanner::profileName(ThermalModel::getLastProfile()));
+    out.print("\"");
+  }
+  out.print(",\"manualHoldMs\":");
+  out.print(CommandArbiter::getHoldRemainingMs());
+  out.print(",\"motorTempC\":");
+  out.print(ThermalModel::getTemperatureC(), 1);
+  out.print(",\"lastAction\":\"");
+  out.print(WiFiManager::getLastAction());
+  out.print("\",\"firmwareVersion\":\"" FIRMWARE_VERSION "\"}");
+}
+
+// One Prometheus sample with its HELP and TYPE lines
+static void writeMetric(Print &out, const char *name, const char *type, const char *help, uint32_t value)
+{
+  out.print("# HELP ");
+  out.print(name);
+  out.print(" ");
+  out.print(help);
+  out.print("\n# TYPE ");
+  out.print(name);
+  out.print(" ");
+  out.print(type);
+  out.print("\n");
+  out.print(name);
+  out.print(" ");
+  out.print(value);
+  out.print("\n");
 }
 
-String WebServerManager::getStatusJSON()
+// Prometheus text exposition format
+void WebServerManager::writeMetricsText(Print &out)
 {
-  long pos = MotorControl::getPosition();
-  String json = "{";
-  json += "\"calibrated\":" + String(MotorControl::isCalibrated() ? "true" : "false") + ",";
-  json += "\"currentPosition\":" + String(pos) + ",";
-  json += "\"deployedPosition\":" + String(MotorControl::getDeployedPosition()) + ",";
-  json += "\"retractedLimit\":" + String(MotorControl::isRetractedLimitHit() ? "true" : "false") + ",";
-  json += "\"deployedLimit\":" + String(MotorControl::isDeployedLimitHit() ? "true" : "false") + ",";
-  json += "\"lastAction\":\"" + WiFiManager::getLastAction() + "\"";
-  json += "}";
-  return json;
+  writeMetric(out, "birdblinds_watchdog_resets_total", "counter", "Resets caused by a task or interrupt watchdog.", Metrics::getWatchdogResets());
+  writeMetric(out, "birdblinds_motion_aborts_total", "counter", "Moves aborted by the motion supervisor.", Metrics::getMotionAborts());
+  Metrics::writeMetrics(out);
+  writeMetric(out, "birdblinds_history_records_dropped_total", "counter", "History records lost to a full queue.", History::getDroppedRecords());
+  writeMetric(out, "birdblinds_request_arena_high_water_bytes", "gauge", "Largest response body built in a request arena.", RequestArena::getHighWaterBytes());
+  writeMetric(out, "birdblinds_request_arena_high_water_in_use", "gauge", "Most request arenas in use at once.", RequestArena::getHighWaterInUse());
+  writeMetric(out, "birdblinds_request_arena_fallbacks_total", "counter", "Responses built on the heap because every arena was busy.", RequestArena::getFallbacks());
+  writeMetric(out, "birdblinds_request_arena_overflows_total", "counter", "Responses that did not fit in an arena.", RequestArena::getOverflows());
+  writeMetric(out, "birdblinds_heap_free_bytes", "gauge", "Free internal heap.", ESP.getFreeHeap());
+  writeMetric(out, "birdblinds_heap_min_free_bytes", "gauge", "Lowest free internal heap since boot.", ESP.getMinFreeHeap());
+  writeMetric(out, "birdblinds_heap_size_bytes", "gauge", "Internal heap size.", ESP.getHeapSize());
+  writeMetric(out, "birdblinds_web_requests_total", "counter", "Requests handled by the web routes.", webRequests);
+  out.print("# HELP birdblinds_web_handler_seconds_total Time spent in web route handlers, all on the AsyncTCP task.\n");
+  out.print("# TYPE birdblinds_web_handler_seconds_total counter\n");
+  out.print("birdblinds_web_handler_seconds_total ");
+  out.print(webHandlerUs / 1e6, 6);
+  out.print("\n");
+  out.print("# HELP birdblinds_status_responses_total /api/status responses by how the body was produced.\n");
+  out.print("# TYPE birdblinds_status_responses_total counter\n");
+  out.print("birdblinds_status_responses_total{result=\"built\"} ");
+  out.print(statusBuilds);
+  out.print("\nbirdblinds_status_responses_total{result=\"cached\"} ");
+  out.print(statusCacheHits);
+  out.print("\nbirdblinds_status_responses_total{result=\"not_modified\"} ");
+  out.print(statusNotModified);
+  out.print("\n");
+  writeMetric(out, "birdblinds_manual_hold_remaining_ms", "gauge", "Time left before automation commands run again.", CommandArbiter::getHoldRemainingMs());
+  CommandArbiter::writeMetrics(out);
+  ThermalModel::writeMetrics(out);
+  SafetyBuffer::writeMetrics(out);
+  LimitSwitches::writeMetrics(out);
+  LogShipper::writeMetrics(out);
 }
 
 void WebServerManager::setupRoutes()
 {
   // Serve main HTML page
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request)
-            {
-    String html = R"rawliteral(
+  route("/", HTTP_GET, [](AsyncWebServerRequest *request)
+        {
+    static const char html[] = R"rawliteral(
 <!DOCTYPE html>
 <html>
 <head>
@@ -163,7 +497,7 @@ void WebServerManager::setupRoutes()
         function sendCommand(cmd) {
             showMessage('Sending command...', 'success');
             
-            fetch('/api/' + cmd, {method: 'POST'})
+            fetch('/api/' + cmd + '?source=manual', {method: 'POST'})
                 .then(response => response.json())
                 .then(data => {
                     if (data.success) {
@@ -209,38 +543,393 @@ void WebServerManager::setupRoutes()
 </body>
 </html>
 )rawliteral";
-    request->send(200, "text/html", html); });
+    request->send(200, "text/html", (const uint8_t *)html, strlen(html)); });
 
   // API: Deploy
-  server.on("/api/deploy", HTTP_POST, [](AsyncWebServerRequest *request)
-            {
+  route("/api/deploy", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
     if (!MotorControl::isCalibrated()) {
       request->send(200, "application/json", "{\"success\":false,\"message\":\"Not calibrated\"}");
       return;
     }
-    WiFiManager::updateLastAction("Deploy command received");
-    MotorControl::queueCommand(CMD_DEPLOY);
-    request->send(200, "application/json", "{\"success\":true,\"message\":\"Deploy command queued\"}"); });
+    queueFromRequest(request, CMD_DEPLOY, "Deploy command received", "Deploy command queued"); });
 
   // API: Retract
-  server.on("/api/retract", HTTP_POST, [](AsyncWebServerRequest *request)
-            {
+  route("/api/retract", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
     if (!MotorControl::isCalibrated()) {
       request->send(200, "application/json", "{\"success\":false,\"message\":\"Not calibrated\"}");
       return;
     }
-    WiFiManager::updateLastAction("Retract command received");
-    MotorControl::queueCommand(CMD_RETRACT);
-    request->send(200, "application/json", "{\"success\":true,\"message\":\"Retract command queued\"}"); });
+    queueFromRequest(request, CMD_RETRACT, "Retract command received", "Retract command queued"); });
 
   // API: Calibrate
-  server.on("/api/calibrate", HTTP_POST, [](AsyncWebServerRequest *request)
-            {
-    WiFiManager::updateLastAction("Calibration started");
-    MotorControl::queueCommand(CMD_CALIBRATE);
-    request->send(200, "application/json", "{\"success\":true,\"message\":\"Calibration command queued\"}"); });
+  route("/api/calibrate", HTTP_POST, [](AsyncWebServerRequest *request)
+        { queueFromRequest(request, CMD_CALIBRATE, "Calibration started", "Calibration command queued"); });
+
+  // API: Status (sends an ETag; If-None-Match gets a 304 while nothing changed)
+  route("/api/status", HTTP_GET, sendStatus);
+
+  // API: Plan a move without making it (?target=<steps>, deploy or retract)
+  route("/api/plan", HTTP_GET, [](AsyncWebServerRequest *request)
+        {
+    if (!MotorControl::isCalibrated()) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"Not calibrated\"}");
+      return;
+    }
+    String value = request->hasParam("target") ? request->getParam("target")->value() : String("");
+    int64_t safeDeployed = MotorControl::getSafeDeployedPosition();
+    char *end = NULL;
+    int64_t target = value == "deploy" ? safeDeployed : value == "retract" ? 0 : strtoll(value.c_str(), &end, 10);
+    if ((end != NULL && (end == value.c_str() || *end != '\0')) || target < 0 || target > safeDeployed) {
+      sendBuilt(request, 400, "application/json", [safeDeployed](Print &out)
+                {
+        out.print("{\"success\":false,\"message\":\"target must be deploy, retract or 0-");
+        out.print(safeDeployed);
+        out.print("\"}"); });
+      return;
+    }
+
+    MotionPlan plan = MotorControl::planMove(target);
+    uint32_t startAfterMs = MotionSupervisor::getEtaMs();
+    sendBuilt(request, 200, "application/json", [plan, startAfterMs](Print &out)
+              {
+      uint32_t durationMs = (plan.durationUs + 999) / 1000;
+      out.print("{\"from\":");
+      out.print(plan.from);
+      out.print(",\"target\":");
+      out.print(plan.to);
+      out.print(",\"steps\":");
+      out.print(plan.steps);
+      out.print(",\"segments\":");
+      out.print(plan.segments);
+      out.print(",\"peakSpeed\":");
+      out.print(plan.peakSpeed);
+      out.print(",\"profile\":\"");
+      out.print(MotionPlanner::profileName(plan.profile));
+      out.print("\",\"durationMs\":");
+      out.print(durationMs);
+      out.print(",\"startAfterMs\":");
+      out.print(startAfterMs);
+      out.print(",\"finishInMs\":");
+      out.print(startAfterMs + durationMs);
+      out.print("}"); }); });
+
+  // API: Task table
+  route("/api/tasks", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", TaskConfig::writeJSON); });
+
+  // API: Override a task's core/priority (?key=motor&priority=3&core=1, or ?reset=1)
+  route("/api/tasks", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    if (request->hasParam("reset")) {
+      TaskConfig::clearOverrides();
+      request->send(200, "application/json", "{\"success\":true,\"message\":\"Overrides cleared, restart to apply\"}");
+      return;
+    }
+    int id = request->hasParam("key") ? TaskConfig::findByKey(request->getParam("key")->value()) : -1;
+    if (id < 0) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"Unknown task key\"}");
+      return;
+    }
+    const TaskSettings &task = TaskConfig::get((TaskId)id);
+    int core = request->hasParam("core") ? request->getParam("core")->value().toInt() : task.core;
+    int priority = request->hasParam("priority") ? request->getParam("priority")->value().toInt() : task.priority;
+    String error;
+    if (!TaskConfig::setOverride((TaskId)id, core, priority, error)) {
+      sendBuilt(request, 400, "application/json", [&error](Print &out)
+                {
+        out.print("{\"success\":false,\"message\":\"");
+        out.print(error);
+        out.print("\"}"); });
+      return;
+    }
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Task override saved\"}"); });
+
+  // API: Schedule
+  route("/api/schedule", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", Scheduler::writeJSON); });
+
+  // API: Add a rule (?kind=time&at=07:30 or ?kind=sunrise&offset=-15, &action=deploy, &days=1-5)
+  route("/api/schedule", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    if (!request->hasParam("kind") || !request->hasParam("action")) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"kind and action are required\"}");
+      return;
+    }
+    String kind = request->getParam("kind")->value();
+    String action = request->getParam("action")->value();
+
+    ScheduleRule rule = {};
+    rule.enabled = 1;
+    rule.kind = kind == "sunrise" ? RULE_SUNRISE : kind == "sunset" ? RULE_SUNSET : kind == "time" ? RULE_TIME : 0xFF;
+    rule.action = action == "deploy" ? CMD_DEPLOY : action == "retract" ? CMD_RETRACT : CMD_NONE;
+    rule.weekdays = request->hasParam("days") ? Scheduler::parseWeekdays(request->getParam("days")->value()) : 0x7F;
+    if (rule.kind == RULE_TIME) {
+      String at = request->hasParam("at") ? request->getParam("at")->value() : String("");
+      int colon = at.indexOf(':');
+      rule.minutes = colon > 0 ? at.substring(0, colon).toInt() * 60 + at.substring(colon + 1).toInt() : -1;
+    } else {
+      rule.minutes = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+    }
+
+    String error;
+    if (!Scheduler::addRule(rule, error)) {
+      sendBuilt(request, 400, "application/json", [&error](Print &out)
+                {
+        out.print("{\"success\":false,\"message\":\"");
+        out.print(error);
+        out.print("\"}"); });
+      return;
+    }
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Rule added\"}"); });
+
+  // API: Remove a rule (?index=N)
+  route("/api/schedule", HTTP_DELETE, [](AsyncWebServerRequest *request)
+        {
+    int index = request->hasParam("index") ? request->getParam("index")->value().toInt() : -1;
+    if (!Scheduler::removeRule(index)) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"No such rule\"}");
+      return;
+    }
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Rule removed\"}"); });
+
+  // API: Location and timezone for sun-relative rules (?lat=51.5&lon=-0.12&tz=GMT0BST,M3.5.0/1,M10.5.0)
+  route("/api/location", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    if (!request->hasParam("lat") || !request->hasParam("lon")) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"lat and lon are required\"}");
+      return;
+    }
+    double lat = request->getParam("lat")->value().toDouble();
+    double lon = request->getParam("lon")->value().toDouble();
+    if (lat < -90 || lat > 90 || lon < -180 || lon > 180) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"Coordinates out of range\"}");
+      return;
+    }
+    String tz = request->hasParam("tz") ? request->getParam("tz")->value() : String("");
+    Scheduler::setLocation((int32_t)(lat * 1e6), (int32_t)(lon * 1e6), tz);
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Location saved\"}"); });
+
+  // API: Peer-to-peer remote status and group membership (?groups=1,3 or all)
+  route("/api/remote", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", CommandBus::writeJSON); });
+
+  route("/api/remote", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    uint8_t groups = request->hasParam("groups") ? CommandBus::parseGroups(request->getParam("groups")->value()) : 0;
+    if (groups == 0) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"groups must list 1-8 or all\"}");
+      return;
+    }
+    CommandBus::setGroups(groups);
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Groups saved\"}"); });
+
+  // API: Command a group of nodes, including this one if it is a member (?action=deploy&groups=2)
+  route("/api/broadcast", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    String action = request->hasParam("action") ? request->getParam("action")->value() : String("");
+    MotorCommand command = action == "deploy" ? CMD_DEPLOY : action == "retract" ? CMD_RETRACT : action == "calibrate" ? CMD_CALIBRATE : CMD_NONE;
+    uint8_t groups = request->hasParam("groups") ? CommandBus::parseGroups(request->getParam("groups")->value()) : 0xFF;
+    if (command == CMD_NONE || groups == 0) {
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"action must be deploy, retract or calibrate\"}");
+      return;
+    }
+    if (!CommandBus::broadcast(command, groups)) {
+      request->send(503, "application/json", "{\"success\":false,\"message\":\"No transport could send\"}");
+      return;
+    }
+    WiFiManager::updateLastAction("Group " + action + " sent");
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Command sent\"}"); });
+
+  // API: Adaptive safety buffer and the deployed limit trips behind it
+  route("/api/safety-buffer", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", SafetyBuffer::writeJSON); });
+
+  // API: Limit switch debounce and captured bounce statistics
+  route("/api/switches", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", LimitSwitches::writeJSON); });
+
+  // API: Edge capture (?capture=1|0, ?reset=1 clears the statistics)
+  route("/api/switches", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    if (request->hasParam("capture"))
+      LimitSwitches::setCapture(request->getParam("capture")->value().toInt() != 0);
+    if (request->hasParam("reset") && request->getParam("reset")->value().toInt() != 0)
+      LimitSwitches::resetStats();
+    sendBuilt(request, 200, "application/json", LimitSwitches::writeJSON); });
+
+  // API: Command arbitration settings and per-source counters
+  route("/api/commands", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", CommandArbiter::writeJSON); });
+
+  // API: Manual override hold (?hold=<seconds>&policy=defer|drop, both optional)
+  route("/api/commands", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    uint32_t holdMs = CommandArbiter::getHoldMs();
+    bool defer = CommandArbiter::getDeferDuringHold();
+    if (request->hasParam("hold")) {
+      long seconds = request->getParam("hold")->value().toInt();
+      if (seconds < 0 || seconds > 86400) {
+        request->send(400, "application/json", "{\"success\":false,\"message\":\"hold must be 0-86400 seconds\"}");
+        return;
+      }
+      holdMs = seconds * 1000;
+    }
+    if (request->hasParam("policy")) {
+      String policy = request->getParam("policy")->value();
+      if (policy != "defer" && policy != "drop") {
+        request->send(400, "application/json", "{\"success\":false,\"message\":\"policy must be defer or drop\"}");
+        return;
+      }
+      defer = policy == "defer";
+    }
+    CommandArbiter::setHold(holdMs, defer);
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Arbitration saved\"}"); });
+
+  // API: Remote log collector and shipping counters
+  route("/api/logging", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", LogShipper::writeJSON); });
+
+  // API: Set the collector (?host=<IPv4, empty for off>&port=514&level=info, all optional)
+  route("/api/logging", HTTP_POST, [](AsyncWebServerRequest *request)
+        {
+    LogShippingSettings settings = LogShipper::getSettings();
+    if (request->hasParam("host")) {
+      String host = request->getParam("host")->value();
+      if (host.length() > 0 && !LogShipper::isValidHost(host)) {
+        request->send(400, "application/json", "{\"success\":false,\"message\":\"host must be an IPv4 address\"}");
+        return;
+      }
+      memset(settings.host, 0, sizeof(settings.host));
+      strncpy(settings.host, host.c_str(), sizeof(settings.host) - 1);
+    }
+    if (request->hasParam("port")) {
+      long port = request->getParam("port")->value().toInt();
+      if (port < 1 || port > 65535) {
+        request->send(400, "application/json", "{\"success\":false,\"message\":\"port must be 1-65535\"}");
+        return;
+      }
+      settings.port = port;
+    }
+    if (request->hasParam("level")) {
+      int severity = LogShipper::parseSeverity(request->getParam("level")->value());
+      if (severity < 0) {
+        request->send(400, "application/json", "{\"success\":false,\"message\":\"level must be error, warning, info, debug or 0-7\"}");
+        return;
+      }
+      settings.maxSeverity = severity;
+    }
+    LogShipper::setSettings(settings);
+    Storage::saveLogShipping(settings);
+    request->send(200, "application/json", "{\"success\":true,\"message\":\"Log shipping saved\"}"); });
+
+  // API: Per-move reports newer than ?since=<id> (poll with the returned "latest")
+  route("/api/moves", HTTP_GET, [](AsyncWebServerRequest *request)
+        {
+    uint32_t since = request->hasParam("since") ? strtoul(request->getParam("since")->value().c_str(), NULL, 10) : 0;
+    sendBuilt(request, 200, "application/json", [since](Print &out)
+              { MoveReports::writeJSON(out, since); }); });
+
+  // API: Motion history (?from=&to= in epoch seconds, both optional), streamed from flash
+  route("/api/history", HTTP_GET, [](AsyncWebServerRequest *request)
+        {
+    if (!History::isAvailable()) {
+      request->send(503, "application/json", "{\"success\":false,\"message\":\"History not available\"}");
+      return;
+    }
+    int64_t from = request->hasParam("from") ? strtoll(request->getParam("from")->value().c_str(), NULL, 10) * 1000 : 0;
+    int64_t to = request->hasParam("to") ? strtoll(request->getParam("to")->value().c_str(), NULL, 10) * 1000 : INT64_MAX;
+
+    History::Cursor *cursor = new History::Cursor(from, to);
+    request->onDisconnect([cursor]() { delete cursor; });
+    request->send(request->beginChunkedResponse("application/json", [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t
+                                                { return cursor->read(buffer, maxLen); })); });
+
+  // API: Settings snapshot for provisioning other units (?calibration=1
+  // adds this unit's calibration, skew, debounce and limit trips)
+  route("/api/config/snapshot", HTTP_GET, [](AsyncWebServerRequest *request)
+        {
+    bool withCalibration = request->hasParam("calibration") && request->getParam("calibration")->value().toInt() != 0;
+    uint8_t *buffer = (uint8_t *)malloc(CONFIG_SNAPSHOT_MAX_BYTES);
+    size_t length = buffer != NULL ? Storage::exportSnapshot(buffer, CONFIG_SNAPSHOT_MAX_BYTES, withCalibration) : 0;
+    if (length == 0) {
+      free(buffer);
+      request->send(500, "application/json", "{\"success\":false,\"message\":\"Snapshot could not be built\"}");
+      return;
+    }
+    request->onDisconnect([buffer]() { free(buffer); });
+    request->send(request->beginResponse(200, "application/octet-stream", buffer, length)); });
+
+  // API: Apply a snapshot in one EEPROM commit, then restart to load it
+  route(
+      "/api/config/snapshot", HTTP_PUT,
+      [](AsyncWebServerRequest *request)
+      {
+        SnapshotUpload *upload = (SnapshotUpload *)request->_tempObject;
+        if (upload == NULL || upload->received != upload->length)
+        {
+          sendBuilt(request, 400, "application/json", [](Print &out)
+                    {
+            out.print("{\"success\":false,\"message\":\"Snapshot missing, incomplete or larger than ");
+            out.print(CONFIG_SNAPSHOT_MAX_BYTES);
+            out.print(" bytes\"}"); });
+          return;
+        }
+        if (MotionSupervisor::isMoveActive())
+        {
+          request->send(409, "application/json", "{\"success\":false,\"message\":\"Motor is moving, try again when it stops\"}");
+          return;
+        }
+        String error;
+        if (!Storage::importSnapshot(upload->data, upload->length, error))
+        {
+          sendBuilt(request, 400, "application/json", [&error](Print &out)
+                    {
+            out.print("{\"success\":false,\"message\":\"");
+            out.print(error);
+            out.print("\"}"); });
+          return;
+        }
+        WiFiManager::updateLastAction("Configuration imported, restarting");
+        OtaUpdater::scheduleRestart("Restarting with the imported configuration...");
+        request->send(200, "application/json", "{\"success\":true,\"message\":\"Snapshot applied, restarting\"}");
+      },
+      nullptr, handleSnapshotChunk);
+
+  // API: Firmware update status
+  route("/api/ota", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "application/json", OtaUpdater::writeStatusJSON); });
+
+  // API: Firmware update (raw, zlib-compressed or delta image; see tools/ota_delta.py)
+  route(
+      "/api/ota", HTTP_POST,
+      [](AsyncWebServerRequest *request)
+      {
+        String error;
+        if (!OtaUpdater::finish(error))
+        {
+          sendBuilt(request, 400, "application/json", [&error](Print &out)
+                    {
+            out.print("{\"success\":false,\"message\":\"");
+            out.print(error);
+            out.print("\"}"); });
+          return;
+        }
+        WiFiManager::updateLastAction("Firmware updated, restarting");
+        request->send(200, "application/json", "{\"success\":true,\"message\":\"Update installed, restarting\"}");
+      },
+      [](AsyncWebServerRequest *request, const String &filename, size_t index, uint8_t *data, size_t len, bool final)
+      { handleOtaChunk(index, data, len, 0); },
+      [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total)
+      { handleOtaChunk(index, data, len, total); });
+
+  // API: Recent task, command and motion events in Chrome trace-event
+  // format, for ui.perfetto.dev or chrome://tracing
+  route("/api/trace.json", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendTrace(request); });
 
-  // API: Status
-  server.on("/api/status", HTTP_GET, [](AsyncWebServerRequest *request)
-            { request->send(200, "application/json", getStatusJSON()); });
+  // Metrics (Prometheus format)
+  route("/metrics", HTTP_GET, [](AsyncWebServerRequest *request)
+        { sendBuilt(request, 200, "text/plain; version=0.0.4", writeMetricsText); });
 }
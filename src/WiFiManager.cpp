@@ -1,18 +1,20 @@
 #include "WiFiManager.h"
 #include "wifi_config.h"
+#include "LogShipper.h"
 #include <WiFi.h>
 
 // Static member initialization
 String WiFiManager::lastAction = "System started";
 unsigned long WiFiManager::lastActionTime = 0;
+volatile uint32_t WiFiManager::lastActionGeneration = 0;
 
 void WiFiManager::begin()
 {
-  Serial.println("\n=== WiFi Setup ===");
+  Console.println("\n=== WiFi Setup ===");
 
 // ESP32-S3 specific: Add delay for USB CDC stability
 #ifdef ARDUINO_USB_CDC_ON_BOOT
-  Serial.println("USB CDC detected - adding initialization delay");
+  Console.println("USB CDC detected - adding initialization delay");
   delay(5000);
 #endif
 
@@ -35,10 +37,10 @@ void WiFiManager::begin()
   // Set WiFi power saving to none for reliable connection
   WiFi.setSleep(false);
 
-  Serial.print("Connecting to ");
-  Serial.println(WIFI_SSID);
-  Serial.print("MAC Address: ");
-  Serial.println(WiFi.macAddress());
+  Console.print("Connecting to ");
+  Console.println(WIFI_SSID);
+  Console.print("MAC Address: ");
+  Console.println(WiFi.macAddress());
 
   // Begin connection
   WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
@@ -49,37 +51,37 @@ void WiFiManager::begin()
   while (WiFi.status() != WL_CONNECTED && attempts < 40)
   {
     delay(500);
-    Serial.print(".");
+    Console.print(".");
 
     // Print status every 5 attempts
     if ((attempts + 1) % 5 == 0)
     {
-      Serial.println();
-      Serial.print("Status: ");
+      Console.println();
+      Console.print("Status: ");
       switch (WiFi.status())
       {
       case WL_IDLE_STATUS:
-        Serial.println("IDLE");
+        Console.println("IDLE");
         break;
       case WL_NO_SSID_AVAIL:
-        Serial.println("NO SSID AVAILABLE");
+        Console.println("NO SSID AVAILABLE");
         break;
       case WL_SCAN_COMPLETED:
-        Serial.println("SCAN COMPLETED");
+        Console.println("SCAN COMPLETED");
         break;
       case WL_CONNECT_FAILED:
-        Serial.println("CONNECT FAILED");
+        Console.println("CONNECT FAILED");
         break;
       case WL_CONNECTION_LOST:
-        Serial.println("CONNECTION LOST");
+        Console.println("CONNECTION LOST");
         break;
       case WL_DISCONNECTED:
-        Serial.println("DISCONNECTED");
+        Console.println("DISCONNECTED");
         break;
       default:
-        Serial.print("UNKNOWN (");
-        Serial.print(WiFi.status());
-        Serial.println(")");
+        Console.print("UNKNOWN (");
+        Console.print(WiFi.status());
+        Console.println(")");
       }
     }
     attempts++;
@@ -87,20 +89,20 @@ void WiFiManager::begin()
 
   if (WiFi.status() == WL_CONNECTED)
   {
-    Serial.println("\n\nWiFi connected!");
-    Serial.print("IP Address: ");
-    Serial.println(WiFi.localIP());
-    Serial.print("Gateway: ");
-    Serial.println(WiFi.gatewayIP());
-    Serial.print("Subnet: ");
-    Serial.println(WiFi.subnetMask());
-    Serial.print("DNS: ");
-    Serial.println(WiFi.dnsIP());
-    Serial.print("Signal Strength: ");
-    Serial.print(WiFi.RSSI());
-    Serial.println(" dBm");
-    Serial.print("Channel: ");
-    Serial.println(WiFi.channel());
+    Console.println("\n\nWiFi connected!");
+    Console.print("IP Address: ");
+    Console.println(WiFi.localIP());
+    Console.print("Gateway: ");
+    Console.println(WiFi.gatewayIP());
+    Console.print("Subnet: ");
+    Console.println(WiFi.subnetMask());
+    Console.print("DNS: ");
+    Console.println(WiFi.dnsIP());
+    Console.print("Signal Strength: ");
+    Console.print(WiFi.RSSI());
+    Console.println(" dBm");
+    Console.print("Channel: ");
+    Console.println(WiFi.channel());
 
     // Now enable auto-reconnect for stability
     WiFi.setAutoReconnect(true);
@@ -110,19 +112,19 @@ void WiFiManager::begin()
   }
   else
   {
-    Serial.println("\n\nWiFi connection failed!");
-    Serial.print("Final status: ");
-    Serial.println(WiFi.status());
-    Serial.println("\nTroubleshooting:");
-    Serial.println("1. Verify SSID and password in wifi_config.h");
-    Serial.println("2. Check if router is on 2.4GHz (ESP32 doesn't support 5GHz)");
-    Serial.println("3. Try moving ESP32 closer to router");
-    Serial.println("4. Check if router has MAC filtering enabled");
-    Serial.println("\nController will still work via serial commands");
+    Console.println("\n\nWiFi connection failed!");
+    Console.print("Final status: ");
+    Console.println(WiFi.status());
+    Console.println("\nTroubleshooting:");
+    Console.println("1. Verify SSID and password in wifi_config.h");
+    Console.println("2. Check if router is on 2.4GHz (ESP32 doesn't support 5GHz)");
+    Console.println("3. Try moving ESP32 closer to router");
+    Console.println("4. Check if router has MAC filtering enabled");
+    Console.println("\nController will still work via serial commands");
     lastAction = "WiFi connection failed";
     lastActionTime = millis();
   }
-  Serial.println("==================\n");
+  Console.println("==================\n");
 }
 
 void WiFiManager::checkConnection()
@@ -144,14 +146,14 @@ void WiFiManager::checkConnection()
 
       if (isConnected)
       {
-        Serial.println("\n[WiFi] Connected!");
-        Serial.print("[WiFi] IP: ");
-        Serial.println(WiFi.localIP());
+        Console.println("\n[WiFi] Connected!");
+        Console.print("[WiFi] IP: ");
+        Console.println(WiFi.localIP());
         lastAction = "WiFi reconnected";
       }
       else
       {
-        Serial.println("\n[WiFi] Disconnected - attempting reconnect...");
+        Console.println("\n[WiFi] Disconnected - attempting reconnect...");
         lastAction = "WiFi disconnected";
         // Auto-reconnect should handle this, but we can force it
         WiFi.reconnect();
@@ -174,6 +176,7 @@ void WiFiManager::updateLastAction(const String &action)
 {
   lastAction = action;
   lastActionTime = millis();
+  lastActionGeneration++;
 }
 
 String WiFiManager::getLastAction()
@@ -185,3 +188,8 @@ unsigned long WiFiManager::getLastActionTime()
 {
   return lastActionTime;
 }
+
+uint32_t WiFiManager::getLastActionGeneration()
+{
+  return lastActionGeneration;
+}
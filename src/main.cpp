@@ -2,77 +2,95 @@
 #include "config.h"
 #include "MotorControl.h"
 #include "Storage.h"
+#include "Metrics.h"
+#include "Watchdog.h"
+#include "TaskConfig.h"
+#include "OtaUpdater.h"
+#include "Scheduler.h"
+#include "CommandArbiter.h"
+#include "ThermalModel.h"
+#include "SafetyBuffer.h"
+#include "LimitSwitches.h"
+#include "History.h"
+#include "CommandBus.h"
+#include "Discovery.h"
+#include "MoveReports.h"
+#include "MotionSupervisor.h"
 #include "WiFiManager.h"
 #include "WebServerManager.h"
+#include "LogShipper.h"
 
-// Multi-threading Configuration
-// Core 0: Web server and WiFi (less time-critical)
+// Multi-threading Configuration (defaults, see TaskConfig)
+// Core 0: Web server, WiFi, AsyncTCP and persistence (less time-critical)
 // Core 1: Motor control and serial commands (time-critical for smooth stepping)
 TaskHandle_t webServerTaskHandle = NULL;
 TaskHandle_t motorControlTaskHandle = NULL;
+TaskHandle_t persistenceTaskHandle = NULL;
+TaskHandle_t schedulerTaskHandle = NULL;
 
 // Task function declarations
 void webServerTask(void *parameter);
 void motorControlTask(void *parameter);
+void persistenceTask(void *parameter);
+void schedulerTask(void *parameter);
 
 void setup()
 {
   Serial.begin(115200);
 
-  Serial.println("Bird Blinds Controller Started");
-  Serial.println("TMC2209 in standalone mode (STEP/DIR control)");
-  Serial.println("Multi-threaded: Core 0 = Web, Core 1 = Motor");
+  Console.println("Bird Blinds Controller Started");
+  Console.println("TMC2209 in standalone mode (STEP/DIR control)");
 
-  // Initialize storage
+  // Initialize storage and the task table (may carry runtime overrides)
   Storage::begin();
+  TaskConfig::begin();
+
+  // Pool log lines for the remote collector, if one is set
+  LogShipper::begin();
+
+  // Arm the task watchdog and load persistent metrics
+  Watchdog::begin();
+  Metrics::begin();
+
+  // Count this boot if it is a trial of freshly updated firmware
+  OtaUpdater::begin();
 
   // Initialize motor control (creates mutexes and sets up pins)
   MotorControl::begin();
 
-  // Try to load stored calibration
-  if (MotorControl::loadStoredCalibration())
-  {
-    Serial.println("Using stored calibration");
+  // Motor temperature estimate that decides when moves may burst
+  ThermalModel::begin();
 
-    // Home to retracted position
-    MotorControl::homeToRetractedPosition();
+  // Deployed limit trips behind the adaptive safety buffer
+  SafetyBuffer::begin();
 
-    Serial.println("Ready! System is calibrated and homed.");
-  }
-  else
-  {
-    Serial.println("No stored calibration found. Performing full calibration...");
-    MotorControl::calibrate();
-    Serial.println("Calibration complete!");
-  }
+  // Debounced limit switches and their edge capture
+  LimitSwitches::begin();
+
+  // Open the motion history ring before the first move
+  History::begin();
+  History::record(HIST_BOOT, 0);
+
+  // Load schedule rules and location
+  Scheduler::begin();
 
-  Serial.println("Commands: 'd' = deploy, 'r' = retract, 'c' = calibrate");
-
-  // Create motor control task on Core 1 (time-critical)
-  xTaskCreatePinnedToCore(
-      motorControlTask,        // Task function
-      "MotorControl",          // Task name
-      8192,                    // Stack size (bytes)
-      NULL,                    // Parameters
-      2,                       // Priority (2 = high)
-      &motorControlTaskHandle, // Task handle
-      1                        // Core 1
-  );
-
-  // Create web server task on Core 0 (less critical)
-  xTaskCreatePinnedToCore(
-      webServerTask,        // Task function
-      "WebServer",          // Task name
-      8192,                 // Stack size (bytes)
-      NULL,                 // Parameters
-      1,                    // Priority (1 = normal)
-      &webServerTaskHandle, // Task handle
-      0                     // Core 0
-  );
-
-  Serial.println("\nTasks created:");
-  Serial.println("  - Motor Control Task (Core 1, Priority 2)");
-  Serial.println("  - Web Server Task (Core 0, Priority 1)");
+  // Manual override hold window for automation commands
+  CommandArbiter::begin();
+
+  // Home with the stored calibration, or calibrate from scratch
+  MotorControl::startup();
+
+  Console.println("Commands: 'd' = deploy, 'r' = retract, 'c' = calibrate");
+
+  // Create tasks from the task configuration table
+  TaskConfig::create(TASK_MOTOR, motorControlTask, &motorControlTaskHandle);
+  TaskConfig::create(TASK_WEB, webServerTask, &webServerTaskHandle);
+  TaskConfig::create(TASK_PERSISTENCE, persistenceTask, &persistenceTaskHandle);
+  TaskConfig::create(TASK_SCHEDULER, schedulerTask, &schedulerTaskHandle);
+
+  // loopTask priority applies now; AsyncTCP once the web server starts it
+  TaskConfig::applyExternal();
+  TaskConfig::print();
 }
 
 void loop()
@@ -83,14 +101,29 @@ void loop()
 }
 
 // ========================================
-// MOTOR CONTROL TASK (Core 1)
+// MOTOR CONTROL TASK (Core 1 by default)
 // ========================================
+
+// Serial commands are manual input: they go through the arbiter like the
+// web page's buttons and run from the queue below
+static void queueSerialCommand(MotorCommand cmd, const char *action, const char *queued)
+{
+  if (MotorControl::queueCommand(cmd, SOURCE_MANUAL) != COMMAND_ACCEPTED)
+    return;
+  WiFiManager::updateLastAction(action);
+  Console.println(queued);
+}
+
 void motorControlTask(void *parameter)
 {
-  Serial.println("[Motor Task] Started on core 1");
+  Console.print("[Motor Task] Started on core ");
+  Console.println(xPortGetCoreID());
+  Watchdog::subscribe("Motor Task");
 
   while (true)
   {
+    Watchdog::feed();
+
     // Check for serial commands
     if (Serial.available() > 0)
     {
@@ -100,51 +133,71 @@ void motorControlTask(void *parameter)
       {
       case 'd':
       case 'D':
-        Serial.println("Deploying blinds...");
-        MotorControl::deploy();
-        Serial.println("Blinds deployed");
+        queueSerialCommand(CMD_DEPLOY, "Deploy command received", "Deploy command queued");
         break;
 
       case 'r':
       case 'R':
-        Serial.println("Retracting blinds...");
-        MotorControl::retract();
-        Serial.println("Blinds retracted");
+        queueSerialCommand(CMD_RETRACT, "Retract command received", "Retract command queued");
         break;
 
       case 'c':
       case 'C':
-        Serial.println("Starting calibration...");
-        MotorControl::calibrate();
-        Serial.println("Calibration complete");
+        queueSerialCommand(CMD_CALIBRATE, "Calibration started", "Calibration command queued");
         break;
 
       case 's':
       case 'S':
         // Status command
-        Serial.println("\n=== Current Status ===");
-        Serial.print("LIMIT_RETRACTED: ");
-        Serial.println(MotorControl::isRetractedLimitHit() ? "TRIGGERED" : "NOT TRIGGERED");
-        Serial.print("LIMIT_DEPLOYED: ");
-        Serial.println(MotorControl::isDeployedLimitHit() ? "TRIGGERED" : "NOT TRIGGERED");
-        Serial.print("Current position: ");
-        Serial.println(MotorControl::getPosition());
-        Serial.print("Calibrated: ");
-        Serial.println(MotorControl::isCalibrated() ? "YES" : "NO");
+        Console.println("\n=== Current Status ===");
+        Console.print("LIMIT_RETRACTED: ");
+        Console.println(MotorControl::isRetractedLimitHit() ? "TRIGGERED" : "NOT TRIGGERED");
+        Console.print("LIMIT_DEPLOYED: ");
+        Console.println(MotorControl::isDeployedLimitHit() ? "TRIGGERED" : "NOT TRIGGERED");
+        Console.print("Current position: ");
+        Console.println(MotorControl::getPosition());
+        if (DUAL_MOTOR_ENABLED)
+        {
+          Console.print("Second side position: ");
+          Console.print(MotorControl::getSecondPosition());
+          Console.print(" (skew ");
+          Console.print(MotorControl::getSkew());
+          Console.println(")");
+        }
+        Console.print("Calibrated: ");
+        Console.println(MotorControl::isCalibrated() ? "YES" : "NO");
         if (MotorControl::isCalibrated())
         {
-          Serial.print("Deployed position: ");
-          Serial.println(MotorControl::getDeployedPosition());
+          Console.print("Deployed position: ");
+          Console.println(MotorControl::getDeployedPosition());
         }
-        Serial.print("Running on core: ");
-        Serial.println(xPortGetCoreID());
-        Serial.println("====================\n");
+        Console.print("Running on core: ");
+        Console.println(xPortGetCoreID());
+        Console.println("====================\n");
+        break;
+
+      case 'k':
+      case 'K':
+        // Task table
+        TaskConfig::print();
+        break;
+
+      case 'n':
+      case 'N':
+        // Schedule and next events
+        Scheduler::print();
+        break;
+
+      case 'm':
+      case 'M':
+        // Recent move reports
+        MoveReports::print(10);
         break;
 
       case 't':
       case 'T':
         // Test motor movement - 100 steps forward
-        Serial.println("Test: Moving 100 steps forward...");
+        Console.println("Test: Moving 100 steps forward...");
         digitalWrite(DIR_PIN, HIGH);
         for (int i = 0; i < 100; i++)
         {
@@ -153,42 +206,13 @@ void motorControlTask(void *parameter)
           digitalWrite(STEP_PIN, LOW);
           delayMicroseconds(SPEED_DELAY);
         }
-        Serial.println("Test complete. Did motor move?");
+        Console.println("Test complete. Did motor move?");
         break;
       }
     }
 
-    // Check for queued commands from web interface
-    MotorCommand cmd = MotorControl::getQueuedCommand();
-    if (cmd != CMD_NONE)
-    {
-      MotorControl::clearQueuedCommand();
-
-      switch (cmd)
-      {
-      case CMD_DEPLOY:
-        Serial.println("[Web] Deploying blinds...");
-        MotorControl::deploy();
-        Serial.println("[Web] Blinds deployed");
-        break;
-
-      case CMD_RETRACT:
-        Serial.println("[Web] Retracting blinds...");
-        MotorControl::retract();
-        Serial.println("[Web] Blinds retracted");
-        break;
-
-      case CMD_CALIBRATE:
-        Serial.println("[Web] Starting calibration...");
-        MotorControl::calibrate();
-        Serial.println("[Web] Calibration complete");
-        break;
-
-      case CMD_NONE:
-        // No command pending
-        break;
-      }
-    }
+    // Run a command queued by the web interface, scheduler or peers
+    MotorControl::processQueuedCommand();
 
     // Small delay to prevent task from hogging CPU
     vTaskDelay(pdMS_TO_TICKS(10));
@@ -196,22 +220,89 @@ void motorControlTask(void *parameter)
 }
 
 // ========================================
-// WEB SERVER TASK (Core 0)
+// WEB SERVER TASK (Core 0 by default)
 // ========================================
 void webServerTask(void *parameter)
 {
-  Serial.println("[Web Task] Started on core 0");
+  Console.print("[Web Task] Started on core ");
+  Console.println(xPortGetCoreID());
 
   // Setup WiFi and Web Server on Core 0
   WiFiManager::begin();
   WebServerManager::begin();
+  LogShipper::setHostname(Discovery::getHostname());
+
+  // Peer-to-peer group commands (ESP-NOW works without the AP)
+  CommandBus::begin();
+
+  // The AsyncTCP task now exists; apply its runtime priority
+  TaskConfig::applyExternal();
+
+  // Keep the scheduler's clock in sync while the network is available
+  Scheduler::startTimeSync();
+
+  // Subscribe only after the (slow) initial WiFi connection attempt
+  Watchdog::subscribe("Web Task");
 
   while (true)
   {
+    Watchdog::feed();
+
     // Monitor WiFi connection status
     WiFiManager::checkConnection();
 
+    // Receive group commands from other nodes
+    CommandBus::service();
+
+    // Advertise over mDNS and keep the TXT status current
+    Discovery::service();
+
+    // Restart after a completed firmware upload, or give up on a stalled one
+    OtaUpdater::pollRestart();
+    OtaUpdater::checkStall();
+
+    // Send pooled log lines to the collector
+    LogShipper::service();
+
     // Delay to prevent task from hogging CPU
     vTaskDelay(pdMS_TO_TICKS(100));
   }
 }
+
+// ========================================
+// PERSISTENCE TASK (Core 0 by default)
+// ========================================
+void persistenceTask(void *parameter)
+{
+  Console.print("[Persistence Task] Started on core ");
+  Console.println(xPortGetCoreID());
+  Watchdog::subscribe("Persistence Task");
+
+  while (true)
+  {
+    Watchdog::feed();
+
+    // Commit changed counters in the background
+    Metrics::flush();
+
+    // Confirm or roll back freshly updated firmware
+    OtaUpdater::checkHealth();
+
+    // Sample motion and append history records to flash
+    History::service();
+
+    vTaskDelay(pdMS_TO_TICKS(MotionSupervisor::isMoveActive() ? HISTORY_SAMPLE_INTERVAL_MS : 1000));
+  }
+}
+
+// ========================================
+// SCHEDULER TASK (Core 0 by default)
+// ========================================
+void schedulerTask(void *parameter)
+{
+  Console.print("[Scheduler Task] Started on core ");
+  Console.println(xPortGetCoreID());
+
+  // Sleeps until the next scheduled event, so it is not watchdog-supervised
+  Scheduler::run();
+}
@@ -0,0 +1,293 @@
+#include <unity.h>
+#include <string.h>
+#include <vector>
+#include "DeltaPatch.h"
+
+// Host tests for the OTA delta applier (pio test -e native). Patches are
+// built here in the format tools/ota_delta.py writes.
+
+typedef std::vector<uint8_t> Bytes;
+
+static Bytes source;
+static Bytes output;
+static bool failWrites;
+
+static bool readSource(uint32_t offset, uint8_t *buffer, size_t length, void *context)
+{
+  if (offset + length > source.size())
+    return false;
+  memcpy(buffer, source.data() + offset, length);
+  return true;
+}
+
+static bool writeTarget(const uint8_t *data, size_t length, void *context)
+{
+  if (failWrites)
+    return false;
+  output.insert(output.end(), data, data + length);
+  return true;
+}
+
+static void putU32(Bytes &out, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+    out.push_back(value >> (8 * i));
+}
+
+static void putVarint(Bytes &out, uint32_t value)
+{
+  do
+  {
+    uint8_t byte = value & 0x7F;
+    value >>= 7;
+    out.push_back(value ? byte | 0x80 : byte);
+  } while (value);
+}
+
+static Bytes header(uint32_t targetSize, uint32_t targetCrc)
+{
+  Bytes out = {'B', 'B', 'D', 'P', DeltaPatch::VERSION, 0, 0, 0};
+  putU32(out, source.size());
+  putU32(out, DeltaPatch::crc32(0, source.data(), source.size()));
+  putU32(out, targetSize);
+  putU32(out, targetCrc);
+  return out;
+}
+
+static void copyOp(Bytes &patch, uint32_t offset, uint32_t length)
+{
+  patch.push_back(0x01);
+  putVarint(patch, offset);
+  putVarint(patch, length);
+}
+
+static void insertOp(Bytes &patch, const char *text)
+{
+  patch.push_back(0x02);
+  putVarint(patch, strlen(text));
+  patch.insert(patch.end(), text, text + strlen(text));
+}
+
+// Source bytes 100..399, "hello", then source bytes 0..49
+static Bytes expectedTarget()
+{
+  Bytes target(source.begin() + 100, source.begin() + 400);
+  const char *text = "hello";
+  target.insert(target.end(), text, text + 5);
+  target.insert(target.end(), source.begin(), source.begin() + 50);
+  return target;
+}
+
+static Bytes samplePatch()
+{
+  Bytes target = expectedTarget();
+  Bytes patch = header(target.size(), DeltaPatch::crc32(0, target.data(), target.size()));
+  copyOp(patch, 100, 300);
+  insertOp(patch, "hello");
+  copyOp(patch, 0, 50);
+  patch.push_back(0x00);
+  return patch;
+}
+
+// Feed the patch in pieces of chunk bytes; returns the last feed() status
+static DeltaPatch::Status apply(DeltaPatch &patcher, const Bytes &patch, size_t chunk)
+{
+  patcher.begin(readSource, writeTarget, NULL);
+  DeltaPatch::Status status = DeltaPatch::PATCH_OK;
+  for (size_t pos = 0; pos < patch.size() && status == DeltaPatch::PATCH_OK; pos += chunk)
+  {
+    size_t take = patch.size() - pos < chunk ? patch.size() - pos : chunk;
+    status = patcher.feed(patch.data() + pos, take);
+  }
+  return status;
+}
+
+void setUp(void)
+{
+  source.resize(1000);
+  for (size_t i = 0; i < source.size(); i++)
+    source[i] = (uint8_t)(i * 7 + i / 13);
+  output.clear();
+  failWrites = false;
+}
+
+void tearDown(void)
+{
+}
+
+static void test_copy_and_insert(void)
+{
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_DONE, apply(patcher, samplePatch(), 4096));
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_DONE, patcher.finish());
+
+  Bytes target = expectedTarget();
+  TEST_ASSERT_EQUAL(target.size(), output.size());
+  TEST_ASSERT_EQUAL_MEMORY(target.data(), output.data(), target.size());
+  TEST_ASSERT_EQUAL(target.size(), patcher.getBytesWritten());
+}
+
+static void test_any_chunk_size(void)
+{
+  Bytes patch = samplePatch();
+  Bytes target = expectedTarget();
+  for (size_t chunk = 1; chunk <= patch.size(); chunk++)
+  {
+    output.clear();
+    DeltaPatch patcher;
+    TEST_ASSERT_EQUAL_MESSAGE(DeltaPatch::PATCH_DONE, apply(patcher, patch, chunk), "feed");
+    TEST_ASSERT_EQUAL_MESSAGE(DeltaPatch::PATCH_DONE, patcher.finish(), "finish");
+    TEST_ASSERT_EQUAL(target.size(), output.size());
+    TEST_ASSERT_EQUAL_MEMORY(target.data(), output.data(), target.size());
+  }
+}
+
+static void test_target_crc_mismatch(void)
+{
+  Bytes target = expectedTarget();
+  Bytes patch = samplePatch();
+  Bytes bad = header(target.size(), DeltaPatch::crc32(0, target.data(), target.size()) ^ 1);
+  patch.erase(patch.begin(), patch.begin() + DeltaPatch::HEADER_SIZE);
+  bad.insert(bad.end(), patch.begin(), patch.end());
+
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_CRC_MISMATCH, apply(patcher, bad, 16));
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_CRC_MISMATCH, patcher.finish());
+}
+
+static void test_target_size_mismatch(void)
+{
+  Bytes target = expectedTarget();
+  uint32_t crc = DeltaPatch::crc32(0, target.data(), target.size());
+  Bytes ops = samplePatch();
+  ops.erase(ops.begin(), ops.begin() + DeltaPatch::HEADER_SIZE);
+
+  // Ends short of the promised size
+  Bytes longer = header(target.size() + 1, crc);
+  longer.insert(longer.end(), ops.begin(), ops.end());
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_SIZE_MISMATCH, apply(patcher, longer, 4096));
+
+  // Writes past it
+  Bytes shorter = header(target.size() - 1, crc);
+  shorter.insert(shorter.end(), ops.begin(), ops.end());
+  output.clear();
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_SIZE_MISMATCH, apply(patcher, shorter, 4096));
+  TEST_ASSERT_TRUE(output.size() < target.size());
+}
+
+static void test_source_mismatch(void)
+{
+  Bytes patch = samplePatch();
+  source[500] ^= 0xFF;
+
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_SOURCE_MISMATCH, apply(patcher, patch, 4096));
+  TEST_ASSERT_EQUAL(0, output.size());
+}
+
+static void test_copy_outside_source(void)
+{
+  Bytes patch = header(20, 0);
+  copyOp(patch, source.size() - 10, 20);
+  patch.push_back(0x00);
+
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_SOURCE_RANGE, apply(patcher, patch, 4096));
+}
+
+static void test_truncated_patch(void)
+{
+  Bytes patch = samplePatch();
+  DeltaPatch patcher;
+
+  // Cut inside the header, inside the literal and just before END
+  const size_t cuts[] = {10, DeltaPatch::HEADER_SIZE + 6, patch.size() - 1};
+  for (size_t cut : cuts)
+  {
+    output.clear();
+    Bytes truncated(patch.begin(), patch.begin() + cut);
+    TEST_ASSERT_EQUAL(DeltaPatch::PATCH_OK, apply(patcher, truncated, 7));
+    TEST_ASSERT_EQUAL(DeltaPatch::PATCH_INCOMPLETE, patcher.finish());
+  }
+}
+
+static void test_trailing_data(void)
+{
+  Bytes patch = samplePatch();
+  patch.push_back(0x01);
+
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_TRAILING_DATA, apply(patcher, patch, 4096));
+}
+
+static void test_bad_opcode(void)
+{
+  Bytes patch = header(0, 0);
+  patch.push_back(0x07);
+
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_BAD_OPCODE, apply(patcher, patch, 4096));
+}
+
+static void test_write_failure(void)
+{
+  failWrites = true;
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_WRITE_FAILED, apply(patcher, samplePatch(), 4096));
+}
+
+static void test_five_byte_varint(void)
+{
+  // Offset 0 and length 50 padded to five bytes each: still valid
+  Bytes target(source.begin(), source.begin() + 50);
+  Bytes patch = header(50, DeltaPatch::crc32(0, target.data(), target.size()));
+  const uint8_t op[] = {0x01, 0x80, 0x80, 0x80, 0x80, 0x00, 0xB2, 0x80, 0x80, 0x80, 0x00, 0x00};
+  patch.insert(patch.end(), op, op + sizeof(op));
+
+  DeltaPatch patcher;
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_DONE, apply(patcher, patch, 1));
+  TEST_ASSERT_EQUAL_MEMORY(target.data(), output.data(), target.size());
+}
+
+static void test_overlong_varint(void)
+{
+  DeltaPatch patcher;
+
+  // Fifth byte with bits above 32
+  Bytes high = header(0, 0);
+  const uint8_t highOp[] = {0x01, 0x80, 0x80, 0x80, 0x80, 0x10, 0x01, 0x00};
+  high.insert(high.end(), highOp, highOp + sizeof(highOp));
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_BAD_OPCODE, apply(patcher, high, 4096));
+
+  // Sixth byte, in the second argument
+  Bytes longer = header(0, 0);
+  const uint8_t longOp[] = {0x01, 0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00};
+  longer.insert(longer.end(), longOp, longOp + sizeof(longOp));
+  TEST_ASSERT_EQUAL(DeltaPatch::PATCH_BAD_OPCODE, apply(patcher, longer, 4096));
+}
+
+static void test_crc32_matches_zlib(void)
+{
+  const char *text = "123456789";
+  TEST_ASSERT_EQUAL_UINT32(0xCBF43926, DeltaPatch::crc32(0, (const uint8_t *)text, 9));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_copy_and_insert);
+  RUN_TEST(test_any_chunk_size);
+  RUN_TEST(test_target_crc_mismatch);
+  RUN_TEST(test_target_size_mismatch);
+  RUN_TEST(test_source_mismatch);
+  RUN_TEST(test_copy_outside_source);
+  RUN_TEST(test_truncated_patch);
+  RUN_TEST(test_trailing_data);
+  RUN_TEST(test_bad_opcode);
+  RUN_TEST(test_write_failure);
+  RUN_TEST(test_five_byte_varint);
+  RUN_TEST(test_overlong_varint);
+  RUN_TEST(test_crc32_matches_zlib);
+  return UNITY_END();
+}
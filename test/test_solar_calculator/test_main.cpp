@@ -0,0 +1,100 @@
+#include <unity.h>
+#include "SolarCalculator.h"
+
+// Host tests for the sunrise/sunset calculation (pio test -e native).
+// Reference times come from a double-precision implementation of Meeus,
+// Astronomical Algorithms ch. 25 (with nutation and aberration), iterated
+// at each event for the same -0.833 degree altitude. The fixed-point code
+// must stay within a minute of them.
+
+static const int32_t TOLERANCE_S = 60;
+
+struct Reference
+{
+  const char *place;
+  int year, month, day;
+  int32_t latitudeE6, longitudeE6;
+  int32_t sunriseUtc, sunsetUtc; // Seconds after 00:00 UTC
+};
+
+static const Reference REFERENCES[] = {
+    {"New York equinox", 2024, 3, 20, 40712800, -74006000, 39510, 83324},   // 10:58:30, 23:08:44
+    {"London solstice", 2024, 6, 21, 51507400, -127800, 13391, 73300},      // 03:43:11, 20:21:40
+    {"Quito", 2024, 12, 21, -180000, -78470000, 40094, 83782},              // 11:08:14, 23:16:22
+    {"Sydney", 2024, 12, 21, -33868800, 151209300, -19148, 32740},          // 18:40:52 the day before, 09:05:40
+    {"Tromso equinox", 2024, 3, 20, 69649200, 18955300, 16902, 61410},      // 04:41:42, 17:03:30
+    {"Reykjavik", 2026, 8, 15, 64146600, -21942600, 19126, 78211},          // 05:18:46, 21:43:31
+};
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+static void test_reference_times(void)
+{
+  for (const Reference &ref : REFERENCES)
+  {
+    SolarTimes times = SolarCalculator::compute(ref.year, ref.month, ref.day, ref.latitudeE6, ref.longitudeE6);
+    TEST_ASSERT_EQUAL_MESSAGE(SolarTimes::SOLAR_NORMAL, times.state, ref.place);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(TOLERANCE_S, ref.sunriseUtc, times.sunriseUtc, ref.place);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(TOLERANCE_S, ref.sunsetUtc, times.sunsetUtc, ref.place);
+    TEST_ASSERT_TRUE(times.sunriseUtc < times.noonUtc && times.noonUtc < times.sunsetUtc);
+  }
+}
+
+static void test_polar_day(void)
+{
+  // Tromso in June and McMurdo in December
+  SolarTimes north = SolarCalculator::compute(2024, 6, 21, 69649200, 18955300);
+  TEST_ASSERT_EQUAL(SolarTimes::SOLAR_POLAR_DAY, north.state);
+  SolarTimes south = SolarCalculator::compute(2024, 12, 21, -77850000, 166670000);
+  TEST_ASSERT_EQUAL(SolarTimes::SOLAR_POLAR_DAY, south.state);
+  TEST_ASSERT_EQUAL(south.noonUtc, south.sunriseUtc);
+  TEST_ASSERT_EQUAL(south.noonUtc, south.sunsetUtc);
+}
+
+static void test_polar_night(void)
+{
+  SolarTimes north = SolarCalculator::compute(2024, 12, 21, 69649200, 18955300);
+  TEST_ASSERT_EQUAL(SolarTimes::SOLAR_POLAR_NIGHT, north.state);
+  SolarTimes south = SolarCalculator::compute(2024, 6, 21, -77850000, 166670000);
+  TEST_ASSERT_EQUAL(SolarTimes::SOLAR_POLAR_NIGHT, south.state);
+}
+
+static void test_days_from_civil(void)
+{
+  TEST_ASSERT_EQUAL_INT32(0, SolarCalculator::daysFromCivil(1970, 1, 1));
+  TEST_ASSERT_EQUAL_INT32(10957, SolarCalculator::daysFromCivil(2000, 1, 1));
+  TEST_ASSERT_EQUAL_INT32(11016, SolarCalculator::daysFromCivil(2000, 2, 29));
+  TEST_ASSERT_EQUAL_INT32(-1, SolarCalculator::daysFromCivil(1969, 12, 31));
+}
+
+static void test_trig(void)
+{
+  // Q30 values to about 1e-6
+  const int32_t tolerance = 2000;
+  TEST_ASSERT_INT_WITHIN(tolerance, 0, SolarCalculator::sinQ30(0));
+  TEST_ASSERT_INT_WITHIN(tolerance, SolarCalculator::ONE / 2, SolarCalculator::sinQ30(30 * SolarCalculator::DEGREE));
+  TEST_ASSERT_INT_WITHIN(tolerance, -SolarCalculator::ONE, SolarCalculator::sinQ30(270 * SolarCalculator::DEGREE));
+  TEST_ASSERT_INT_WITHIN(tolerance, -SolarCalculator::ONE / 2, SolarCalculator::cosQ30(120 * SolarCalculator::DEGREE));
+
+  // Angles to about 1/1000 degree (inputs in Q30)
+  TEST_ASSERT_INT_WITHIN(64, 30 * SolarCalculator::DEGREE, SolarCalculator::asinDeg(SolarCalculator::ONE / 2));
+  TEST_ASSERT_INT_WITHIN(64, 120 * SolarCalculator::DEGREE, SolarCalculator::acosDeg(-SolarCalculator::ONE / 2));
+  TEST_ASSERT_INT_WITHIN(64, -135 * SolarCalculator::DEGREE, SolarCalculator::atan2Deg(-SolarCalculator::ONE / 2, -SolarCalculator::ONE / 2));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_reference_times);
+  RUN_TEST(test_polar_day);
+  RUN_TEST(test_polar_night);
+  RUN_TEST(test_days_from_civil);
+  RUN_TEST(test_trig);
+  return UNITY_END();
+}
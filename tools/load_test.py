@@ -0,0 +1,369 @@
+#!/usr/bin/env python3
+"""Load-test the Bird Blinds web API and record how the controller copes.
+
+Runs a scenario against a controller or the emulator (pio run -e emu) and
+measures what the clients see: requests per second, latency percentiles
+and errors per endpoint. The device's /metrics are read before and after
+each load level for its side of the story: free heap, the lowest it got,
+and the share of time the AsyncTCP task spent in web handlers. Results are
+written as JSON so runs can be compared.
+
+A scenario steps through load levels, each run for --duration seconds:
+
+  dashboards  N pages polling /api/status every --interval seconds,
+              revalidating with the ETag as a browser does
+  commands    bursts of deploy/retract posts (--burst posts every
+              --burst-interval seconds) under N dashboards; the command
+              latency is the number to watch
+  followers   N live views following /api/moves?since=, with command
+              bursts so there are moves to follow
+
+The firmware has no push endpoint, so followers poll /api/moves; each one
+costs the device what a subscriber to a push stream would.
+
+Command bursts move the blind. Do not run them against a blind someone is
+using.
+
+Examples:
+  # Against the emulator
+  .pio/build/emu/program --port 8080 &
+  tools/load_test.py run --target http://localhost:8080 --scenario commands -o before.json
+
+  # Against a controller, with different load levels
+  tools/load_test.py run --target http://birdblinds.local --scenario dashboards --levels 1,2,4 -o after.json
+
+  # What changed
+  tools/load_test.py compare before.json after.json
+"""
+
+import argparse
+import http.client
+import json
+import math
+import random
+import sys
+import threading
+import time
+import urllib.parse
+
+SCENARIOS = {
+    # Level counts vary the named client kind; the rest stay fixed
+    "dashboards": {"vary": "pollers", "levels": [1, 2, 4, 8, 16, 32], "commands": False},
+    "commands": {"vary": "pollers", "levels": [0, 4, 8, 16, 32], "commands": True},
+    "followers": {"vary": "followers", "levels": [1, 4, 8, 16], "commands": True},
+}
+
+COMMAND_PATHS = ["/api/deploy", "/api/retract"]
+
+
+class Recorder:
+    """Latencies and outcomes per endpoint, shared by every client thread."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.endpoints = {}
+
+    def add(self, endpoint, seconds, status):
+        with self.lock:
+            entry = self.endpoints.setdefault(endpoint, {"latencies": [], "errors": 0, "notModified": 0, "codes": {}})
+            entry["latencies"].append(seconds)
+            entry["codes"][str(status)] = entry["codes"].get(str(status), 0) + 1
+            if status == 304:
+                entry["notModified"] += 1
+            elif status is None or status >= 400:
+                entry["errors"] += 1
+
+
+def percentile(sorted_values, fraction):
+    """Nearest-rank percentile of an already sorted list."""
+    if not sorted_values:
+        return None
+    rank = max(1, math.ceil(fraction * len(sorted_values)))
+    return sorted_values[rank - 1]
+
+
+def summarize(entry, elapsed):
+    latencies = sorted(entry["latencies"])
+    ms = lambda value: None if value is None else round(value * 1000, 2)
+    return {
+        "requests": len(latencies),
+        "rps": round(len(latencies) / elapsed, 2),
+        "errors": entry["errors"],
+        "notModified": entry["notModified"],
+        "codes": entry["codes"],
+        "meanMs": ms(sum(latencies) / len(latencies)) if latencies else None,
+        "p50Ms": ms(percentile(latencies, 0.50)),
+        "p90Ms": ms(percentile(latencies, 0.90)),
+        "p99Ms": ms(percentile(latencies, 0.99)),
+        "maxMs": ms(latencies[-1]) if latencies else None,
+    }
+
+
+class Client:
+    """One HTTP request per connection, as the controller closes them anyway."""
+
+    def __init__(self, target, timeout):
+        url = urllib.parse.urlsplit(target)
+        self.host = url.hostname
+        self.port = url.port or 80
+        self.timeout = timeout
+
+    def request(self, method, path, headers=None):
+        """Return (status, headers, body); status is None when the request failed."""
+        connection = http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+        try:
+            connection.request(method, path, headers=headers or {})
+            response = connection.getresponse()
+            body = response.read()
+            return response.status, response, body
+        except (OSError, http.client.HTTPException):
+            return None, None, b""
+        finally:
+            connection.close()
+
+
+def timed(client, recorder, endpoint, method, path, headers=None):
+    start = time.perf_counter()
+    status, response, body = client.request(method, path, headers)
+    recorder.add(endpoint, time.perf_counter() - start, status)
+    return status, response, body
+
+
+def pause(stop, deadline):
+    remaining = deadline - time.perf_counter()
+    if remaining > 0:
+        stop.wait(remaining)
+
+
+def poller(client, recorder, stop, interval, use_etag):
+    """A dashboard: poll the status, sending back the last ETag."""
+    etag = None
+    stop.wait(random.uniform(0, interval))  # Pages are not opened in lockstep
+    while not stop.is_set():
+        deadline = time.perf_counter() + interval
+        headers = {"If-None-Match": etag} if use_etag and etag else None
+        status, response, _ = timed(client, recorder, "GET /api/status", "GET", "/api/status", headers)
+        if status == 200:
+            etag = response.getheader("ETag")
+        pause(stop, deadline)
+
+
+def follower(client, recorder, stop, interval):
+    """A live view: fetch the move reports newer than the last one seen."""
+    since = 0
+    stop.wait(random.uniform(0, interval))
+    while not stop.is_set():
+        deadline = time.perf_counter() + interval
+        status, _, body = timed(client, recorder, "GET /api/moves", "GET", "/api/moves?since=%d" % since)
+        if status == 200:
+            try:
+                since = json.loads(body).get("latest", since)
+            except ValueError:
+                pass
+        pause(stop, deadline)
+
+
+def commander(client, recorder, stop, burst, burst_interval):
+    """Automation: bursts of deploy/retract posts back to back."""
+    turn = 0
+    while not stop.is_set():
+        deadline = time.perf_counter() + burst_interval
+        for _ in range(burst):
+            path = COMMAND_PATHS[turn % len(COMMAND_PATHS)]
+            turn += 1
+            timed(client, recorder, "POST /api/command", "POST", path + "?source=api")
+        pause(stop, deadline)
+
+
+def parse_metrics(text):
+    """Prometheus text into {name or name{labels}: value}."""
+    samples = {}
+    for line in text.splitlines():
+        if not line or line.startswith("#"):
+            continue
+        name, _, value = line.rpartition(" ")
+        try:
+            samples[name] = float(value)
+        except ValueError:
+            pass
+    return samples
+
+
+def read_metrics(client):
+    status, _, body = client.request("GET", "/metrics")
+    if status != 200:
+        return None
+    return parse_metrics(body.decode("utf-8", "replace"))
+
+
+def device_summary(before, after, elapsed):
+    """The controller's view of one level, from two /metrics readings."""
+    if before is None or after is None:
+        return None
+
+    def delta(name):
+        if name not in before or name not in after:
+            return None
+        return after[name] - before[name]
+
+    def gauge(name):
+        return int(after[name]) if name in after else None
+
+    handler_seconds = delta("birdblinds_web_handler_seconds_total")
+    requests = delta("birdblinds_web_requests_total")
+    status = {result: int(delta('birdblinds_status_responses_total{result="%s"}' % result) or 0)
+              for result in ("built", "cached", "not_modified")}
+    return {
+        "heapFreeBytes": gauge("birdblinds_heap_free_bytes"),
+        "heapMinFreeBytes": gauge("birdblinds_heap_min_free_bytes"),
+        "handlerCpuPercent": None if handler_seconds is None else round(100 * handler_seconds / elapsed, 2),
+        "requests": None if requests is None else int(requests),
+        "handlerMsPerRequest": None if not requests or handler_seconds is None else
+        round(1000 * handler_seconds / requests, 3),
+        "statusResponses": status,
+        "arenaFallbacks": int(delta("birdblinds_request_arena_fallbacks_total") or 0),
+        "arenaOverflows": int(delta("birdblinds_request_arena_overflows_total") or 0),
+    }
+
+
+def run_level(args, level):
+    client = Client(args.target, args.timeout)
+    recorder = Recorder()
+    stop = threading.Event()
+    threads = []
+    for _ in range(level["pollers"]):
+        threads.append(threading.Thread(target=poller, args=(client, recorder, stop, args.interval, not args.no_etag)))
+    for _ in range(level["followers"]):
+        threads.append(threading.Thread(target=follower, args=(client, recorder, stop, args.interval)))
+    if level["commands"]:
+        threads.append(threading.Thread(target=commander, args=(client, recorder, stop, args.burst, args.burst_interval)))
+
+    before = read_metrics(client)
+    start = time.perf_counter()
+    for thread in threads:
+        thread.daemon = True
+        thread.start()
+    stop.wait(args.duration)
+    stop.set()
+    for thread in threads:
+        thread.join(args.timeout + args.interval)
+    elapsed = time.perf_counter() - start
+    after = read_metrics(client)
+
+    result = dict(level)
+    result["elapsedSeconds"] = round(elapsed, 2)
+    result["endpoints"] = {name: summarize(entry, elapsed) for name, entry in sorted(recorder.endpoints.items())}
+    result["device"] = device_summary(before, after, elapsed)
+    return result
+
+
+def print_level(result):
+    print("pollers=%d followers=%d commands=%s" % (result["pollers"], result["followers"], result["commands"]))
+    for name, s in result["endpoints"].items():
+        print("  %-18s %7.1f req/s  p50 %7s ms  p90 %7s ms  p99 %7s ms  errors %d  304s %d" %
+              (name, s["rps"], s["p50Ms"], s["p90Ms"], s["p99Ms"], s["errors"], s["notModified"]))
+    device = result["device"]
+    if device:
+        print("  device: heap free %s (min %s), handlers %s%% of the AsyncTCP task, %s ms per request" %
+              (device["heapFreeBytes"], device["heapMinFreeBytes"], device["handlerCpuPercent"],
+               device["handlerMsPerRequest"]))
+    else:
+        print("  device: /metrics unavailable")
+
+
+def run(args):
+    scenario = SCENARIOS[args.scenario]
+    counts = [int(n) for n in args.levels.split(",")] if args.levels else scenario["levels"]
+    results = {
+        "target": args.target,
+        "scenario": args.scenario,
+        "started": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "settings": {
+            "duration": args.duration,
+            "interval": args.interval,
+            "burst": args.burst,
+            "burstInterval": args.burst_interval,
+            "etag": not args.no_etag,
+        },
+        "levels": [],
+    }
+
+    for count in counts:
+        level = {"pollers": args.pollers, "followers": 0, "commands": scenario["commands"]}
+        level[scenario["vary"]] = count
+        result = run_level(args, level)
+        results["levels"].append(result)
+        print_level(result)
+        if args.settle > 0 and count != counts[-1]:
+            time.sleep(args.settle)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(results, f, indent=2)
+            f.write("\n")
+        print("results written to %s" % args.output)
+
+
+def level_key(level):
+    return (level["pollers"], level["followers"], level["commands"])
+
+
+def compare(args):
+    with open(args.base) as f:
+        base = json.load(f)
+    with open(args.new) as f:
+        new = json.load(f)
+
+    base_levels = {level_key(level): level for level in base["levels"]}
+    print("%s -> %s (%s)" % (args.base, args.new, new["scenario"]))
+    for level in new["levels"]:
+        old = base_levels.get(level_key(level))
+        print("pollers=%d followers=%d commands=%s" % level_key(level))
+        if old is None:
+            print("  not in %s" % args.base)
+            continue
+        for name, s in level["endpoints"].items():
+            o = old["endpoints"].get(name)
+            if o is None:
+                print("  %-18s new endpoint" % name)
+                continue
+            print("  %-18s req/s %7.1f -> %7.1f  p50 %7s -> %7s ms  p99 %7s -> %7s ms  errors %d -> %d" %
+                  (name, o["rps"], s["rps"], o["p50Ms"], s["p50Ms"], o["p99Ms"], s["p99Ms"], o["errors"], s["errors"]))
+        if old.get("device") and level.get("device"):
+            o, d = old["device"], level["device"]
+            print("  device: heap min %s -> %s, handlers %s%% -> %s%%, %s -> %s ms per request" %
+                  (o["heapMinFreeBytes"], d["heapMinFreeBytes"], o["handlerCpuPercent"], d["handlerCpuPercent"],
+                   o["handlerMsPerRequest"], d["handlerMsPerRequest"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    runner = sub.add_parser("run", help="run a scenario against a controller")
+    runner.add_argument("--target", required=True, help="base URL, e.g. http://birdblinds.local")
+    runner.add_argument("--scenario", choices=sorted(SCENARIOS), default="dashboards")
+    runner.add_argument("--levels", help="comma-separated client counts instead of the scenario's")
+    runner.add_argument("--pollers", type=int, default=4, help="dashboards when the scenario varies something else")
+    runner.add_argument("--duration", type=float, default=20, help="seconds per level")
+    runner.add_argument("--interval", type=float, default=2, help="seconds between polls per client (the page uses 2)")
+    runner.add_argument("--burst", type=int, default=4, help="command posts per burst")
+    runner.add_argument("--burst-interval", type=float, default=5, help="seconds between command bursts")
+    runner.add_argument("--settle", type=float, default=2, help="seconds between levels")
+    runner.add_argument("--timeout", type=float, default=5, help="per-request timeout in seconds")
+    runner.add_argument("--no-etag", action="store_true", help="poll without If-None-Match")
+    runner.add_argument("-o", "--output", help="write the results as JSON")
+
+    comparer = sub.add_parser("compare", help="compare two result files")
+    comparer.add_argument("base")
+    comparer.add_argument("new")
+
+    args = parser.parse_args()
+    if args.command == "run":
+        run(args)
+    else:
+        compare(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""Build compressed or delta OTA images for the Bird Blinds controller.
+
+Delta images describe the new firmware as COPY ranges from the firmware
+currently running on the device plus INSERTed literal bytes (format in
+include/DeltaPatch.h). By default the result is zlib-compressed; the
+device detects raw, compressed and delta images automatically.
+
+Examples:
+  # Delta from the firmware the devices run now to the new build
+  tools/ota_delta.py delta old/firmware.bin .pio/build/esp32s3box/firmware.bin -o update.bbdp
+
+  # Full image, compressed only (for devices on an unknown version)
+  tools/ota_delta.py compress .pio/build/esp32s3box/firmware.bin -o update.bin.z
+
+  # Upload
+  curl -F firmware=@update.bbdp http://birdblinds.local/api/ota
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = b"BBDP"
+VERSION = 1
+
+OP_END = 0x00
+OP_COPY = 0x01
+OP_INSERT = 0x02
+
+BLOCK = 32        # Match length indexed in the source image
+INDEX_STRIDE = 4  # Index every 4th source offset (code is word aligned)
+MIN_MATCH = 24    # Shorter matches cost more than they save
+
+
+def varint(value):
+    out = bytearray()
+    while True:
+        byte = value & 0x7F
+        value >>= 7
+        if value:
+            out.append(byte | 0x80)
+        else:
+            out.append(byte)
+            return bytes(out)
+
+
+def build_index(source):
+    index = {}
+    for offset in range(0, len(source) - BLOCK + 1, INDEX_STRIDE):
+        index.setdefault(source[offset:offset + BLOCK], offset)
+    return index
+
+
+def diff(source, target):
+    """Greedy block matcher producing COPY/INSERT operations."""
+    index = build_index(source)
+    ops = []
+    literal = bytearray()
+    pos = 0
+
+    while pos < len(target):
+        offset = index.get(target[pos:pos + BLOCK]) if pos + BLOCK <= len(target) else None
+        if offset is None:
+            literal.append(target[pos])
+            pos += 1
+            continue
+
+        # Extend the match backwards into pending literals, then forwards
+        back = 0
+        while back < len(literal) and offset - back > 0 and source[offset - back - 1] == literal[-back - 1]:
+            back += 1
+        length = BLOCK
+        while pos + length < len(target) and offset + length < len(source) and \
+                source[offset + length] == target[pos + length]:
+            length += 1
+
+        if length + back < MIN_MATCH:
+            literal.append(target[pos])
+            pos += 1
+            continue
+
+        if back:
+            del literal[-back:]
+        if literal:
+            ops.append((OP_INSERT, bytes(literal)))
+            literal = bytearray()
+        ops.append((OP_COPY, offset - back, length + back))
+        pos += length
+
+    if literal:
+        ops.append((OP_INSERT, bytes(literal)))
+    return ops
+
+
+def encode(source, target, ops):
+    out = bytearray()
+    out += MAGIC
+    out += struct.pack("<BBH", VERSION, 0, 0)
+    out += struct.pack("<IIII", len(source), zlib.crc32(source) & 0xFFFFFFFF,
+                       len(target), zlib.crc32(target) & 0xFFFFFFFF)
+    for op in ops:
+        if op[0] == OP_COPY:
+            out.append(OP_COPY)
+            out += varint(op[1])
+            out += varint(op[2])
+        else:
+            out.append(OP_INSERT)
+            out += varint(len(op[1]))
+            out += op[1]
+    out.append(OP_END)
+    return bytes(out)
+
+
+def apply(source, patch):
+    """Reference applier, used to verify every patch before it is written."""
+    if patch[:4] != MAGIC or patch[4] != VERSION:
+        raise ValueError("bad header")
+    src_size, src_crc, tgt_size, tgt_crc = struct.unpack_from("<IIII", patch, 8)
+    if len(source) < src_size or zlib.crc32(source[:src_size]) & 0xFFFFFFFF != src_crc:
+        raise ValueError("source mismatch")
+
+    def read_varint(pos):
+        value = shift = 0
+        while True:
+            byte = patch[pos]
+            pos += 1
+            value |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                return value, pos
+
+    out = bytearray()
+    pos = 24
+    while True:
+        op = patch[pos]
+        pos += 1
+        if op == OP_END:
+            break
+        if op == OP_COPY:
+            offset, pos = read_varint(pos)
+            length, pos = read_varint(pos)
+            out += source[offset:offset + length]
+        elif op == OP_INSERT:
+            length, pos = read_varint(pos)
+            out += patch[pos:pos + length]
+            pos += length
+        else:
+            raise ValueError("bad opcode %d" % op)
+    if len(out) != tgt_size or zlib.crc32(out) & 0xFFFFFFFF != tgt_crc:
+        raise ValueError("target mismatch")
+    return bytes(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    delta = sub.add_parser("delta", help="build a delta from OLD to NEW")
+    delta.add_argument("old", help="firmware image currently on the devices")
+    delta.add_argument("new", help="new firmware image")
+    delta.add_argument("-o", "--output", required=True)
+    delta.add_argument("--no-compress", action="store_true", help="write the delta without zlib")
+
+    compress = sub.add_parser("compress", help="zlib-compress a full image")
+    compress.add_argument("image")
+    compress.add_argument("-o", "--output", required=True)
+
+    args = parser.parse_args()
+
+    if args.command == "delta":
+        with open(args.old, "rb") as f:
+            source = f.read()
+        with open(args.new, "rb") as f:
+            target = f.read()
+
+        ops = diff(source, target)
+        patch = encode(source, target, ops)
+        if apply(source, patch) != target:
+            sys.exit("internal error: patch does not reproduce the new image")
+
+        copied = sum(op[2] for op in ops if op[0] == OP_COPY)
+        payload = patch if args.no_compress else zlib.compress(patch, 9)
+        print("delta: %d ops, %d of %d bytes copied from old image" % (len(ops), copied, len(target)))
+    else:
+        with open(args.image, "rb") as f:
+            target = f.read()
+        payload = zlib.compress(target, 9)
+
+    with open(args.output, "wb") as f:
+        f.write(payload)
+    print("%s: %d bytes (%.1f%% of %d byte image)" %
+          (args.output, len(payload), 100.0 * len(payload) / len(target), len(target)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Check host simulation results against the committed golden numbers.
+
+The simulator (sim/) runs the motion code through fixed scenarios and
+prints one JSON object per scenario. Every metric listed under
+"tolerances" in the golden file is a lower-is-better number; a result
+fails when it exceeds the golden value by more than
+golden * percent / 100 + absolute. Results that beat the golden value by
+the same margin are reported so the golden file can be refreshed.
+
+Examples:
+  # Build and run the scenarios, then compare
+  pio run -e sim && .pio/build/sim/program > sim-results.json
+  tools/sim_compare.py sim-results.json
+
+  # Accept the current numbers after an intended change
+  tools/sim_compare.py sim-results.json --update
+"""
+
+import argparse
+import json
+import sys
+
+DEFAULT_GOLDEN = "sim/golden.json"
+
+
+def allowance(golden, tolerance):
+    return abs(golden) * tolerance.get("percent", 0) / 100 + tolerance.get("absolute", 0)
+
+
+def compare(results, golden):
+    """Return (failures, improvements) as lists of message strings."""
+    failures = []
+    improvements = []
+    tolerances = golden["tolerances"]
+
+    for name, expected in golden["scenarios"].items():
+        actual = results["scenarios"].get(name)
+        if actual is None:
+            failures.append(f"{name}: missing from results")
+            continue
+
+        for metric, tolerance in tolerances.items():
+            if metric not in expected or metric not in actual:
+                continue
+            margin = allowance(expected[metric], tolerance)
+            delta = actual[metric] - expected[metric]
+            line = f"{name}.{metric}: {actual[metric]} (golden {expected[metric]}, allowed +{margin:g})"
+            if delta > margin:
+                failures.append(line)
+            elif -delta > margin:
+                improvements.append(line)
+
+    for name in results["scenarios"]:
+        if name not in golden["scenarios"]:
+            improvements.append(f"{name}: new scenario, not in golden file")
+
+    return failures, improvements
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("results", help="JSON printed by the simulator")
+    parser.add_argument("--golden", default=DEFAULT_GOLDEN, help=f"golden file (default {DEFAULT_GOLDEN})")
+    parser.add_argument("--update", action="store_true", help="replace the golden numbers with these results")
+    args = parser.parse_args()
+
+    with open(args.results) as f:
+        results = json.load(f)
+    with open(args.golden) as f:
+        golden = json.load(f)
+
+    if args.update:
+        golden["travelSteps"] = results["travelSteps"]
+        golden["speedDelayUs"] = results["speedDelayUs"]
+        golden["burstSpeedDelayUs"] = results["burstSpeedDelayUs"]
+        golden["scenarios"] = results["scenarios"]
+        with open(args.golden, "w") as f:
+            json.dump(golden, f, indent=2)
+            f.write("\n")
+        print(f"Updated {args.golden} ({len(results['scenarios'])} scenarios)")
+        return
+
+    for key in ("travelSteps", "speedDelayUs", "burstSpeedDelayUs"):
+        if results.get(key) != golden.get(key):
+            print(f"warning: {key} is {results.get(key)}, golden was recorded with {golden.get(key)}")
+
+    failures, improvements = compare(results, golden)
+    for line in improvements:
+        print(f"better  {line}")
+    for line in failures:
+        print(f"WORSE   {line}")
+
+    checked = len(golden["scenarios"])
+    if failures:
+        print(f"{len(failures)} regression(s) across {checked} scenarios")
+        sys.exit(1)
+    print(f"All {checked} scenarios within tolerance")
+
+
+if __name__ == "__main__":
+    main()